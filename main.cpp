@@ -2,12 +2,17 @@
 #include <cstring>
 #include <cstdio>
 #include <cstddef>
+#include <cmath>
+#include <chrono>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "lib/jg_baselayer.h"
 
 
 // TODO: export to the baselayer 
-// TODO: have a StrIntern type-thing which is better && works with HasMap (the Str struct itself is pushed)
 Str FindDirCategory(Str path) {
     Str category_name = {};
     Str dirpath = StrDirPath(path);
@@ -24,38 +29,46 @@ Str FindDirCategory(Str path) {
 }
 
 
+// TODO: export to the baselayer
+bool FileSizeAndTime(Str path, u64 *size, s64 *mtime) {
+    struct stat st;
+    if (stat(StrZ(path), &st) != 0) {
+        return false;
+    }
+    *size = (u64) st.st_size;
+    *mtime = (s64) st.st_mtime;
+    return true;
+}
+
+
 #include "src/parsecore.h"
 #include "src/parsehelpers.h"
 #include "src/parse_comp.h"
 #include "src/parse_instr.h"
+#include "src/check_instr.h"
+#include "src/emitter.h"
 #include "src/cogen_comp.h"
+#include "src/cogen_monnd.h"
+#include "src/cogen_fold.h"
 #include "src/cogen_instr.h"
+#include "src/bench.h"
 
 
-struct ParseStats {
-    s32 total_cnt = 0;
-    s32 parsed_cnt = 0;
-    s32 registered_cnt = 0;
-    s32 duplicate_cnt = 0;
-    s32 parse_error_cnt = 0;
-    s32 type_error_cnt = 0;
-};
-
 bool RegisterComponentType(ComponentParse *comp, HashMap *map) {
-    u64 val = MapGet(map, comp->type);
+    u64 val = MapGet(map, (u64) comp->type_sym);
     bool type_was_unique = (val == 0);
     if (type_was_unique) {
-        MapPut(map, comp->type, comp);
+        MapPut(map, (u64) comp->type_sym, comp);
     }
 
     return type_was_unique;
 }
 
 bool RegisterInstrument(InstrumentParse *instr, HashMap *map) {
-    u64 val = MapGet(map, instr->name);
+    u64 val = MapGet(map, (u64) instr->name_sym);
     bool name_is_unique = (val == 0);
     if (name_is_unique) {
-        MapPut(map, instr->name, instr);
+        MapPut(map, (u64) instr->name_sym, instr);
     }
 
     return name_is_unique;
@@ -100,36 +113,174 @@ ParseStats ParseInstruments(MArena *a_dest, HashMap *map_instrs, StrLst *fpaths)
 }
 
 
-ParseStats ParseComponents(MArena *a_dest, HashMap *map_comps, StrLst *fpaths) {
+//
+//  Streaming mode: component calls are checked and code generated as they are parsed, and the per-call
+//  allocations are released right after, so memory use is bounded by the largest component call rather than
+//  by the instrument. Only names, jump references and COPY sources are retained.
+
+
+struct CogenStats {
+    u64 bytes;
+    f64 secs;
+};
+
+struct MemStats {
+    u64 file_hwm;
+    u64 check_hwm;
+};
+
+static f64 CogenNow() {
+    using namespace std::chrono;
+    return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+static u64 FileBytes(Str path) {
+    struct stat st;
+    if (stat(StrZ(path), &st) != 0) {
+        return 0;
+    }
+    return (u64) st.st_size;
+}
+
+static u64 ShareLibBytes(Str share_dir, ShareLib lib) {
+    // "read_table-lib" is read_table-lib.h + read_table-lib.c, names with an extension are a single file
+    if (StrExtension(lib.name).len) {
+        return FileBytes(StrPathBuild(share_dir, StrBasename(lib.name), StrExtension(lib.name)));
+    }
+    return FileBytes(StrPathBuild(share_dir, lib.name, StrL("h"))) + FileBytes(StrPathBuild(share_dir, lib.name, StrL("c")));
+}
+
+
+#define STREAM_FLUSH_SIZE (1024 * 1024)
+
+struct StreamInstr {
+    MArena *a_check;
+    HashMap *comps;
+    HashMap *copy_sources;
+    ParseStats *stats;
+    EmitBuff *buff;
+    CogenStats *cogen_stats;
+    Str path;
+    Str out_dir;
+    Str out_path;
+    FILE *out;
+    CheckState check;
+    CogenInstrState cogen;
+    s32 comps_cnt;
+    s32 check_idx;
+    bool begun;
+    bool do_cogen;
+};
+
+void _StreamBegin(InstrumentParse *instr, StreamInstr *si) {
+    si->begun = true;
+    instr->path = si->path;
+    instr->check_idx = si->check_idx;
+    si->check = CheckBegin(si->a_check, instr, si->comps, si->stats, si->comps_cnt, si->copy_sources);
+
+    if (si->do_cogen) {
+        Str basename = StrCat(instr->name, "_config");
+        si->out_path = StrPathBuild(si->out_dir, basename, StrL("h"));
+        si->out = fopen(StrZ(si->out_path), "w");
+
+        EmitBuffClear(si->buff);
+        f64 t0 = CogenNow();
+        si->cogen = CogenInstrumentConfigBegin(si->buff, instr);
+        si->cogen_stats->secs += CogenNow() - t0;
+    }
+}
+
+void _StreamFlush(StreamInstr *si, u32 min_len) {
+    if (si->out && si->buff->len >= min_len) {
+        fwrite(si->buff->str, 1, si->buff->len, si->out);
+        si->cogen_stats->bytes += si->buff->len;
+        EmitBuffClear(si->buff);
+    }
+}
+
+void StreamComponentCall(InstrumentParse *instr, ComponentCall *c, void *data) {
+    StreamInstr *si = (StreamInstr*) data;
+    if (si->begun == false) {
+        _StreamBegin(instr, si);
+    }
+
+    CheckComponent(&si->check, c);
+    if (si->out && si->check.nameref_error == false) {
+        f64 t0 = CogenNow();
+        CogenComponentConfig(si->buff, &si->cogen, *c);
+        si->cogen_stats->secs += CogenNow() - t0;
+        _StreamFlush(si, STREAM_FLUSH_SIZE);
+    }
+}
+
+ParseStats StreamInstruments(HashMap *map_comps, StrLst *fpaths, Str out_dir, EmitBuff *buff, CogenStats *cogen_stats, MemStats *mem_stats, bool do_cogen) {
     ParseStats ps = {};
 
+    // nothing outlives its file: text and parse go to a_file, check state to a_check, both cleared per file
+    MArena a_file = ArenaCreate();
+    MArena a_check = ArenaCreate();
     while (fpaths) {
+        ArenaClear(&a_file);
+        ArenaClear(&a_check);
+
         Str filename = StrLstNext(&fpaths);
-        Str text = LoadTextFileFSeek(a_dest, filename);
+        Str text = LoadTextFileFSeek(&a_file, filename);
         if (text.len == 0) {
             continue;
         }
 
-        printf("parsing  #%.3d: %.*s", ps.total_cnt, filename.len, filename.str);
-        ComponentParse *comp = ParseComponent(a_dest, text);
-        comp->file_path = filename;
-        comp->category = FindDirCategory(filename);
+        printf("streaming #%.3d: %.*s\n", ps.total_cnt, filename.len, filename.str);
+
+        HashMap copy_sources = InitMap(&a_check, 64);
+        PreScanCopySources(text, &copy_sources);
+
+        StreamInstr si = {};
+        si.a_check = &a_check;
+        si.comps = map_comps;
+        si.copy_sources = &copy_sources;
+        si.stats = &ps;
+        si.buff = buff;
+        si.cogen_stats = cogen_stats;
+        si.path = filename;
+        si.out_dir = out_dir;
+        si.comps_cnt = PreScanInstrument(text).comps_cnt;
+        si.check_idx = ps.total_cnt;
+        si.do_cogen = do_cogen;
+
+        InstrumentParse *instr = ParseInstrument(&a_file, text, StreamComponentCall, &si);
+        instr->path = filename;
 
-        if (comp->parse_error == true) {
+        if (instr->parse_error) {
             ps.parse_error_cnt++;
         }
         else {
+            // instruments are not registered when streaming, every parsed instrument counts
             ps.parsed_cnt++;
+            ps.registered_cnt++;
+            if (si.begun == false) {
+                _StreamBegin(instr, &si);
+            }
+            CheckEnd(&si.check);
+        }
 
-            if (RegisterComponentType(comp, map_comps)) {
-                ps.registered_cnt++;
+        if (si.out) {
+            if (instr->parse_error == false && instr->namerefs_checked) {
+                f64 t0 = CogenNow();
+                CogenInstrumentConfigEnd(buff, instr, &si.cogen);
+                cogen_stats->secs += CogenNow() - t0;
+                _StreamFlush(&si, 0);
+                fclose(si.out);
+                StrPrint("Saved instument config file to: ", si.out_path, "\n");
             }
             else {
-                ps.duplicate_cnt++;
+                fclose(si.out);
+                remove(StrZ(si.out_path));
             }
         }
         printf("\n");
 
+        if (a_file.used > mem_stats->file_hwm) { mem_stats->file_hwm = a_file.used; }
+        if (a_check.used > mem_stats->check_hwm) { mem_stats->check_hwm = a_check.used; }
         ps.total_cnt++;
     }
 
@@ -137,103 +288,186 @@ ParseStats ParseComponents(MArena *a_dest, HashMap *map_comps, StrLst *fpaths) {
 }
 
 
-ComponentCall *_FindByName(Array<ComponentCall> comps, Str name) {
-    for (s32 i = 0; i < comps.len; ++i) {
-        if (StrEqual(name, comps.arr[i].name)) {
-            return comps.arr + i;
+ParseStats StreamComponents(MArena *a_sigs, HashMap *map_comps, StrLst *fpaths, EmitBuff *buff, CogenStats *cogen_stats, MemStats *mem_stats, bool do_cogen) {
+    // each component is parsed into a_file, generated and released, only its signature is kept in a_sigs
+    ParseStats ps = {};
+
+    MArena a_file = ArenaCreate();
+    while (fpaths) {
+        ArenaClear(&a_file);
+
+        Str filename = StrLstNext(&fpaths);
+        Str text = LoadTextFileFSeek(&a_file, filename);
+        if (text.len == 0) {
+            continue;
         }
-    }
-    return NULL;
-}
 
+        printf("streaming #%.3d: %.*s", ps.total_cnt, filename.len, filename.str);
+        ComponentParse *comp = ParseComponent(&a_file, text, (do_cogen == false));
+        comp->file_path = filename;
+        comp->category = FindDirCategory(filename);
 
-bool CheckInstrument(MArena *a_tmp, InstrumentParse *instr, HashMap *comps, ParseStats *stats, bool dbg_print_missing_types = false) {
-    TimeFunction;
+        if (comp->parse_error == true) {
+            ps.parse_error_cnt++;
+        }
+        else if (MapGet(map_comps, (u64) comp->type_sym)) {
+            ps.parsed_cnt++;
+            ps.duplicate_cnt++;
+        }
+        else {
+            ps.parsed_cnt++;
 
-    s32 max_copy_comps = 1000;
-    HashMap map_cpys = InitMap(a_tmp, max_copy_comps);
+            if (do_cogen) {
+                EmitBuffClear(buff);
+                f64 t0 = CogenNow();
+                CogenComponent(buff, comp);
+                cogen_stats->secs += CogenNow() - t0;
+                cogen_stats->bytes += buff->len;
+
+                Str f_safe = StrPathBuild(StrDirPath(comp->file_path), StrBasename(comp->file_path), StrL("h"));
+                printf(" -> %.*s", f_safe.len, f_safe.str);
+                SaveFile(StrZ(f_safe), buff->str, buff->len);
+            }
 
-    bool type_error = false;
-    bool nameref_error = false;
+            RegisterComponentType(ComponentSignature(a_sigs, comp), map_comps);
+            ps.registered_cnt++;
+        }
+        printf("\n");
 
-    printf("checking  #%d: ", instr->check_idx);
-    StrPrint(instr->name);
+        if (a_file.used > mem_stats->file_hwm) { mem_stats->file_hwm = a_file.used; }
+        ps.total_cnt++;
+    }
 
-    for (s32 i = 0; i < instr->comps.len; ++i) {
-        ComponentCall *c = instr->comps.arr + i;
+    return ps;
+}
 
-        // Handle "... = COPY (copy_type)":
-        //      Meaning, we eliminate any COPY notes and reference the .type and .args.
-        if (c->copy_type.len) {
-            if (StrEqual(c->copy_type, "PREVIOUS")) {
 
-                // TODO: on error, set error flag and skip
-                if (i == 0) {
-                    nameref_error = true;
-                    printf("\nERROR: COPY(PREVIOUS) can not be the first component call\n\n");
-                }
-                else {
-                    Str prev_type = instr->comps.arr[i-1].type;
-                    c->type = prev_type;
-                }
-            }
-            else {
-                ComponentCall *org_comp = _FindByName(instr->comps, c->copy_type);
-                if (org_comp == NULL) {
-                    StrPrint("\nERROR: Referenced component name not found: ", c->copy_type, "\n\n");
+ParseStats ParseComponents(MArena *a_dest, HashMap *map_comps, StrLst *fpaths, bool header_only = false) {
+    ParseStats ps = {};
 
-                    nameref_error = true;
-                }
+    while (fpaths) {
+        Str filename = StrLstNext(&fpaths);
+        Str text = LoadTextFileFSeek(a_dest, filename);
+        if (text.len == 0) {
+            continue;
+        }
+
+        printf("parsing  #%.3d: %.*s", ps.total_cnt, filename.len, filename.str);
+        ComponentParse *comp = ParseComponent(a_dest, text, header_only);
+        comp->file_path = filename;
+        comp->category = FindDirCategory(filename);
+        FileSizeAndTime(filename, &comp->file_size, &comp->file_mtime);
+
+        if (comp->parse_error == true) {
+            ps.parse_error_cnt++;
+        }
+        else {
+            ps.parsed_cnt++;
 
-                // reference the type and args of the copied component
-                c->type = org_comp->type;
-                c->args = org_comp->args;
+            if (RegisterComponentType(comp, map_comps)) {
+                ps.registered_cnt++;
+            }
+            else {
+                ps.duplicate_cnt++;
             }
         }
+        printf("\n");
 
-        // Handle "COPY (copy_name) = ...":
-        //      Meaning, we eliminate any COPY notes and coyp the .name.
-        if (c->copy_name.len) {
-            // We don't need to check that a component by name exists unless we are dealing with PREVIOUS.
-            // We just need the index to put in the component name.
-            u64 copy_name_index = MapGet(&map_cpys, c->copy_name);
-            copy_name_index++;
-            MapPut(&map_cpys, c->copy_name, (void*) copy_name_index);
+        ps.total_cnt++;
+    }
+
+    return ps;
+}
 
-            c->name = StrAlloc(c->copy_name.len + 4);
-            StrCopy(c->copy_name, c->name);
 
-            char subscript[4];
-            sprintf(subscript, "_%lu", copy_name_index);
-            strcat(c->name.str, subscript);
-        }
+ParseStats ParseComponentIndex(MArena *a_dest, HashMap *map_comps, Str index_path) {
+    // header-only components from a library index, code blocks are read from the .comp files on demand
+    ParseStats ps = {};
 
-        u64 comp_exists = MapGet(comps, c->type);
-        if (comp_exists == 0) {
-            type_error = true;
-            stats->type_error_cnt++;
+    Str lib_path = StrDirPath(index_path);
+    Str text = LoadTextFileFSeek(a_dest, index_path);
+    if (text.len && strncmp(text.str, COMPONENT_INDEX_HEADER "\n", strlen(COMPONENT_INDEX_HEADER) + 1) != 0) {
+        printf("ERROR: %.*s is not a current component index, write it again with --index\n", index_path.len, index_path.str);
+        ps.parse_error_cnt++;
+        return ps;
+    }
+    char *at = text.len ? strstr(text.str, "\n@ ") : NULL;
+    while (at) {
+        char *entry = at + 3;
+        char *header = strchr(entry, '\n');
+        if (header == NULL) {
+            break;
+        }
+        *header++ = '\0';
+        at = strstr(header, "\n@ ");
+        if (at) {
+            *at = '\0';
+        }
 
-            if (dbg_print_missing_types) {
-                printf("\n");
-                printf("    Missing component type (idx %d): ", i);
-                StrPrint(c->type);
+        char *end;
+        u64 file_size = (u64) strtoull(entry, &end, 10);
+        s64 file_mtime = (s64) strtoll(end, &end, 10);
+        u32 blocks_offset = (u32) strtoul(end, &end, 10);
+        s32 blocks_line = (s32) strtol(end, &end, 10);
+        while (*end == ' ') {
+            ++end;
+        }
+        char *path = strchr(end, ' ');
+        if (path == NULL) {
+            printf("ERROR: malformed component index entry: %s\n", entry);
+            ps.parse_error_cnt++;
+            ps.total_cnt++;
+            continue;
+        }
+        Str category = { end, (u32) (path - end) };
+        Str file_path = lib_path.len ? StrCat(StrCat(lib_path, "/"), path + 1) : StrL(path + 1);
+
+        // an entry is only used while its file is unchanged, otherwise the file is parsed
+        ComponentParse *comp;
+        u64 size = 0;
+        s64 mtime = 0;
+        if (FileSizeAndTime(file_path, &size, &mtime) && size == file_size && mtime == file_mtime) {
+            comp = ParseComponent(a_dest, StrL(header), true);
+            comp->category = StrEqual(category, StrL("-")) ? Str {} : category;
+            comp->text = {};
+            comp->blocks_offset = blocks_offset;
+            comp->blocks_line = blocks_line;
+        }
+        else {
+            Str comp_text = LoadTextFileFSeek(a_dest, file_path);
+            if (comp_text.len == 0) {
+                printf("ERROR: component in the index not found: %.*s\n", file_path.len, file_path.str);
+                ps.parse_error_cnt++;
+                ps.total_cnt++;
+                continue;
             }
+            printf("component index: %.*s changed, parsing the file\n", file_path.len, file_path.str);
+            comp = ParseComponent(a_dest, comp_text, true);
+            comp->category = FindDirCategory(file_path);
         }
-    }
+        comp->file_path = file_path;
+        comp->file_size = size;
+        comp->file_mtime = mtime;
 
-    instr->type_checked = ! type_error;
-    instr->namerefs_checked = ! nameref_error;
+        if (comp->parse_error == true) {
+            ps.parse_error_cnt++;
+        }
+        else {
+            ps.parsed_cnt++;
 
-    if ((instr->type_checked == true) && (instr->namerefs_checked == true)) { printf(" - OK"); }
-    if ((instr->type_checked == false && dbg_print_missing_types == false)) { printf("\n    ERROR: Missing component types"); }
-    if ((instr->namerefs_checked == false)) { printf("\n    ERROR: Component instance name reference"); }
-    if ((type_error || nameref_error) && dbg_print_missing_types) { printf("\n"); } 
-    printf("\n");
+            if (RegisterComponentType(comp, map_comps)) {
+                ps.registered_cnt++;
+            }
+            else {
+                ps.duplicate_cnt++;
+            }
+        }
+        ps.total_cnt++;
+    }
 
-    return (! type_error) && (! nameref_error);
+    return ps;
 }
 
-
 int main (int argc, char **argv) {
     TimeProgram;
 
@@ -253,6 +487,16 @@ int main (int argc, char **argv) {
         printf("--comps                 component file or library path\n");
         printf("--instrs                instrument file or library path\n");
         printf("--cogen                 generate code\n");
+        printf("--spec                  specialise component instances with literal options at cogen time (Monitor_nD)\n");
+        printf("--nofold                disable cogen-time folding of constant AT/ROTATED placements\n");
+        printf("--scan <p1,p2,...>      instrument parameters that vary at runtime, all others are folded at their defaults\n");
+        printf("--index                 write <comp-lib-path>/comps.idx, which --comps accepts in place of the library\n");
+        printf("--noshare               keep %%include libraries and identical SHARE blocks inline in each component header\n");
+        printf("--pch                   write comps_pch.h and a script that precompiles it\n");
+        printf("--unity                 write a single translation unit including all generated instrument configs\n");
+        printf("--stream                generate components one file at a time and instruments one component call at a time (bounded memory)\n");
+        printf("--bench <lib-path>      time every stage over a library, with --reps <n> (10), --json <file>, --baseline <file>\n");
+        printf("                        and --threshold <pct> (5): exits with 1 if a stage median regressed by more than pct\n");
         printf("--version               display mcparse version\n");
         printf("--test                  run enabled tests\n");
         printf("\n");
@@ -264,6 +508,33 @@ int main (int argc, char **argv) {
         printf("0.1.0\n");
     }
 
+    else if (CLAContainsArg("--bench", argc, argv)) {
+        char *lib_path = CLAGetArgValue("--bench", argc, argv);
+        char *reps_arg = CLAGetArgValue("--reps", argc, argv);
+        char *threshold_arg = CLAGetArgValue("--threshold", argc, argv);
+        s32 reps = reps_arg ? atoi(reps_arg) : 10;
+        f64 threshold = threshold_arg ? atof(threshold_arg) : 5;
+        if (lib_path == NULL || reps < 1) {
+            printf("Usage: mcparse --bench <lib-path> [--reps <n>] [--json <file>] [--baseline <file>] [--threshold <pct>]\n");
+            exit(1);
+        }
+
+        BenchResult res = RunBench(lib_path, reps);
+        BenchPrint(&res);
+
+        if (char *json_path = CLAGetArgValue("--json", argc, argv)) {
+            if (BenchSaveJson(&res, json_path)) {
+                printf("Saved benchmark results to: %s\n\n", json_path);
+            }
+        }
+        if (char *baseline_path = CLAGetArgValue("--baseline", argc, argv)) {
+            s32 regressions = BenchCompare(&res, baseline_path, threshold);
+            if (regressions != 0) {
+                exit(1);
+            }
+        }
+    }
+
     else if (CLAContainsArg("--test", argc, argv)) {
         // any test code here
         printf("Running enabled tests ...\n");
@@ -271,7 +542,16 @@ int main (int argc, char **argv) {
 
     else {
         bool do_cogen = false;
+        bool do_share = true;
         if (CLAContainsArg("--cogen", argc, argv)) { do_cogen = true; }
+        if (CLAContainsArg("--noshare", argc, argv)) { do_share = false; }
+        if (CLAContainsArg("--spec", argc, argv)) { g_cogen_specialise = true; }
+        if (CLAContainsArg("--nofold", argc, argv)) { g_cogen_fold = false; }
+        if (CLAContainsArg("--scan", argc, argv)) {
+            g_cogen_fold_params = true;
+            char *scan = CLAGetArgValue("--scan", argc, argv);
+            g_cogen_scan_params = scan ? StrL(scan) : Str {};
+        }
 
 
         // get input
@@ -294,46 +574,169 @@ int main (int argc, char **argv) {
 
         // init
         MContext *ctx = InitBaselayer();
-        StrBuff buff = StrBuffInit();
+        EmitBuff buff = EmitBuffInit();
+        CogenStats cogen_stats = {};
+        MemStats mem_stats = {};
         MapIter iter = {};
+        bool do_stream = CLAContainsArg("--stream", argc, argv);
 
 
         // components
         HashMap comp_map = {};
         ParseStats comp_stats = {};
+        ShareIndex share = {};
+        ShareIndex *si = NULL;
+        u64 bytes_inline = 0;
+        u64 bytes_shared = 0;
+        bool comps_streamed = false;
         if (comp_lib_path) {
-            StrLst *comp_paths = GetFiles(comp_lib_path, "comp", true);
-            comp_map = InitMap(ctx->a_life, StrListLen(comp_paths) * 3);
-            comp_stats = ParseComponents(ctx->a_life, &comp_map, comp_paths);
+            // type checking only needs component headers, code blocks are parsed if cogen needs them
+            Str comp_lib = StrL(comp_lib_path);
+            f64 t0 = CogenNow();
+            if (StrEqual(StrExtension(comp_lib), StrL("idx"))) {
+                comp_map = InitMap(ctx->a_life, 4096);
+                comp_stats = ParseComponentIndex(ctx->a_life, &comp_map, comp_lib);
+                comp_lib = StrDirPath(comp_lib);
+            }
+            else if (do_stream) {
+                StrLst *comp_paths = GetFiles(comp_lib_path, "comp", true);
+                comp_map = InitMap(ctx->a_life, StrListLen(comp_paths) * 3);
+                comp_stats = StreamComponents(ctx->a_life, &comp_map, comp_paths, &buff, &cogen_stats, &mem_stats, do_cogen);
+                comps_streamed = true;
+            }
+            else {
+                StrLst *comp_paths = GetFiles(comp_lib_path, "comp", true);
+                comp_map = InitMap(ctx->a_life, StrListLen(comp_paths) * 3);
+                comp_stats = ParseComponents(ctx->a_life, &comp_map, comp_paths, (do_cogen == false));
+            }
+            if (do_cogen && comps_streamed == false) {
+                s32 deferred_errors = 0;
+                iter = {};
+                while (ComponentParse *comp = (ComponentParse*) MapNextVal(&comp_map, &iter)) {
+                    if (ParseComponentDeferred(ctx->a_life, comp) == false) {
+                        printf("ERROR: code blocks of %.*s do not parse: %.*s\n", comp->type.len, comp->type.str, comp->file_path.len, comp->file_path.str);
+                        deferred_errors++;
+                    }
+                }
+
+                // as with a full parse, components that do not parse are not registered
+                if (deferred_errors) {
+                    HashMap parsed_map = InitMap(ctx->a_life, comp_map.nslots);
+                    iter = {};
+                    while (ComponentParse *comp = (ComponentParse*) MapNextVal(&comp_map, &iter)) {
+                        if (comp->parse_error == false) {
+                            RegisterComponentType(comp, &parsed_map);
+                        }
+                    }
+                    comp_map = parsed_map;
+                    comp_stats.parse_error_cnt += deferred_errors;
+                    comp_stats.parsed_cnt -= deferred_errors;
+                    comp_stats.registered_cnt -= deferred_errors;
+                }
+            }
+            printf("Components: %d loaded in %.2f ms\n\n", comp_stats.registered_cnt, (CogenNow() - t0) * 1000);
+
+            // library index, used in place of the library path for fast startup: --comps <lib>/comps.idx
+            if (CLAContainsArg("--index", argc, argv) && comps_streamed) {
+                printf("Component index is not written when streaming, the header text is released\n\n");
+            }
+            else if (CLAContainsArg("--index", argc, argv)) {
+                EmitBuffClear(&buff);
+                CogenComponentIndex(&buff, &comp_map, comp_lib);
+
+                Str savefile = StrPathBuild(comp_lib, StrL("comps"), StrL("idx"));
+                StrPrint("Saving component index to: ", savefile, "\n\n");
+
+                SaveFile(StrZ(savefile), buff.str, buff.len);
+            }
+
+            Str share_dir = StrCat(comp_lib, "/share");
+            // shared code needs every share block before the first header is generated
+            if (do_cogen && do_share && comps_streamed == false) {
+                share = ShareIndexBuild(ctx->a_life, &comp_map);
+                si = &share;
+
+                // preprocessed size: every component pulls in its own copy of each library
+                for (u32 i = 0; i < share.libs.len; ++i) {
+                    u64 lib_bytes = ShareLibBytes(share_dir, share.libs.arr[i]);
+                    bytes_inline += lib_bytes * share.libs.arr[i].users;
+                    bytes_shared += lib_bytes;
+                }
+            }
 
             iter = {};
             while (ComponentParse *comp = (ComponentParse*) MapNextVal(&comp_map, &iter)) {
 
                 // cogen components
-                if (do_cogen) {
+                if (do_cogen && comps_streamed == false && comp->parse_error == false) {
                     // print component names
                     StrPrint("Cogen: ", comp->type, " -> ");
-                    StrBuffClear(&buff);
-                    CogenComponent(&buff, comp);
+                    EmitBuffClear(&buff);
+                    t0 = CogenNow();
+                    CogenComponent(&buff, comp, si);
+                    cogen_stats.secs += CogenNow() - t0;
+                    cogen_stats.bytes += buff.len;
+                    bytes_shared += buff.len;
 
                     Str f_safe = StrPathBuild(StrDirPath(comp->file_path), StrBasename(comp->file_path), StrL("h"));
                     StrPrint(f_safe);
                     printf("\n");
 
                     SaveFile(StrZ(f_safe), buff.str, buff.len);
+
+                    // for the report, the same header with its share block inline
+                    if (si) {
+                        EmitBuffClear(&buff);
+                        CogenComponent(&buff, comp);
+                        bytes_inline += buff.len;
+                    }
                 }
             }
             if (do_cogen) {
                 printf("\n");
-                StrBuffClear(&buff);
-                CogenComponentMeta(&buff, &comp_map);
+                EmitBuffClear(&buff);
+                t0 = CogenNow();
+                CogenComponentMeta(&buff, &comp_map, si);
+                cogen_stats.secs += CogenNow() - t0;
+                cogen_stats.bytes += buff.len;
 
                 // save component aggregate file
-                Str dirpath = StrDirPath( StrL(comp_lib_path) );
+                Str dirpath = StrDirPath(comp_lib);
                 Str savefile = StrPathBuild(dirpath, StrL("comps_meta"), StrL("h"));
-                StrPrint("Saving component meta file to: ", savefile, "\n\n");
+                StrPrint("Saving component meta file to: ", savefile, "\n");
 
                 SaveFile(StrZ(savefile), buff.str, buff.len);
+
+                // save shared code
+                if (si) {
+                    EmitBuffClear(&buff);
+                    t0 = CogenNow();
+                    CogenComponentShared(&buff, si);
+                    cogen_stats.secs += CogenNow() - t0;
+                    cogen_stats.bytes += buff.len;
+                    bytes_shared += buff.len;
+
+                    savefile = StrPathBuild(dirpath, StrL("comps_shared"), StrL("h"));
+                    StrPrint("Saving shared code file to: ", savefile, "\n");
+
+                    SaveFile(StrZ(savefile), buff.str, buff.len);
+                }
+
+                // precompiled header over everything the instrument configs include
+                if (CLAContainsArg("--pch", argc, argv)) {
+                    EmitBuffClear(&buff);
+                    CogenComponentPCH(&buff);
+                    savefile = StrPathBuild(dirpath, StrL("comps_pch"), StrL("h"));
+                    StrPrint("Saving precompiled header to: ", savefile, "\n");
+                    SaveFile(StrZ(savefile), buff.str, buff.len);
+
+                    EmitBuffClear(&buff);
+                    CogenComponentPCHScript(&buff, share_dir);
+                    savefile = StrPathBuild(dirpath, StrL("comps_pch"), StrL("sh"));
+                    StrPrint("Saving precompiled header build script to: ", savefile, "\n");
+                    SaveFile(StrZ(savefile), buff.str, buff.len);
+                }
+                printf("\n");
             }
         }
 
@@ -341,7 +744,13 @@ int main (int argc, char **argv) {
         // instruments
         HashMap instr_map = {};
         ParseStats instr_stats = {};
-        if (instr_lib_path) {
+        // instrument config files and the unity file go to the same directory in both modes
+        Str instr_out_dir = instr_lib_path ? StrDirPath( StrL(instr_lib_path) ) : Str {};
+        if (instr_lib_path && do_stream) {
+            StrLst *instr_paths = GetFiles(instr_lib_path, "instr", true);
+            instr_stats = StreamInstruments(&comp_map, instr_paths, instr_out_dir, &buff, &cogen_stats, &mem_stats, do_cogen);
+        }
+        else if (instr_lib_path) {
             StrLst *instr_paths = GetFiles(instr_lib_path, "instr", true);
             instr_map = InitMap(ctx->a_life, StrListLen(instr_paths) * 3);
             instr_stats = ParseInstruments(ctx->a_life, &instr_map, instr_paths);
@@ -359,19 +768,31 @@ int main (int argc, char **argv) {
                     InstrumentPrint(instr, true, true, true);
                 }
 
-                if (do_cogen) {
-                    StrBuffClear(&buff);
+                if (do_cogen && instr->namerefs_checked) {
+                    EmitBuffClear(&buff);
+                    f64 t0 = CogenNow();
                     CogenInstrumentConfig(&buff, instr);
+                    cogen_stats.secs += CogenNow() - t0;
+                    cogen_stats.bytes += buff.len;
 
                     // save instrument config file
-                    Str dirpath = StrDirPath( StrL(instr_lib_path) );
                     Str basename = StrCat(instr->name, "_config");
-                    Str savefile = StrPathBuild(dirpath, basename, StrL("h"));
+                    Str savefile = StrPathBuild(instr_out_dir, basename, StrL("h"));
                     StrPrint("Saving instument config file to: ", savefile, "\n");
 
                     SaveFile(StrZ(savefile), buff.str, buff.len);
                 }
             }
+
+            if (do_cogen && CLAContainsArg("--unity", argc, argv)) {
+                EmitBuffClear(&buff);
+                CogenInstrumentUnity(&buff, &instr_map, CLAContainsArg("--pch", argc, argv));
+
+                Str savefile = StrPathBuild(instr_out_dir, StrL("instrs_unity"), StrL("cpp"));
+                StrPrint("Saving unity build file to: ", savefile, "\n");
+
+                SaveFile(StrZ(savefile), buff.str, buff.len);
+            }
         }
         printf("\n");
 
@@ -382,9 +803,31 @@ int main (int argc, char **argv) {
         }
 
         if (instr_lib_path) {
-            printf("Instrument parse: %d total, %d parsed, %d errors, type-errs: %d [dupes: %d]\n",
-                instr_stats.total_cnt, instr_stats.registered_cnt, instr_stats.parse_error_cnt, instr_stats.type_error_cnt, instr_stats.duplicate_cnt);
+            printf("Instrument parse: %d total, %d parsed, %d errors, type-errs: %d, name-errs: %d [dupes: %d]\n",
+                instr_stats.total_cnt, instr_stats.registered_cnt, instr_stats.parse_error_cnt, instr_stats.type_error_cnt, instr_stats.nameref_error_cnt, instr_stats.duplicate_cnt);
         }
+
+        if (do_cogen && cogen_stats.secs > 0) {
+            printf("Cogen: %lu bytes generated in %.2f ms, %.1f MB/s\n",
+                cogen_stats.bytes, cogen_stats.secs * 1000, cogen_stats.bytes / cogen_stats.secs / (1024 * 1024));
+        }
+
+        if (si) {
+            s32 blocks_shared = 0;
+            for (u32 i = 0; i < share.blocks.len; ++i) {
+                blocks_shared += (share.blocks.arr[i].users > 1);
+            }
+            printf("Shared code: %d libraries, %d of %d share blocks hoisted; component headers preprocess to %lu bytes, %lu inline\n",
+                share.libs.len, blocks_shared, share.blocks.len, bytes_shared, bytes_inline);
+        }
+
+        struct rusage usage = {};
+        getrusage(RUSAGE_SELF, &usage);
+        printf("Memory: peak RSS %ld KB, life arena %lu KB", usage.ru_maxrss, ctx->a_life->used / 1024);
+        if (do_stream) {
+            printf(", high-water file arena %lu KB, check arena %lu KB", mem_stats.file_hwm / 1024, mem_stats.check_hwm / 1024);
+        }
+        printf("\n");
         printf("\n");
     }
 }
@@ -0,0 +1,66 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/cdf_guide-lib.c
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Guide tables for tabulated cumulative distributions, see cdf_guide-lib.h.
+*
+* Usage: within SHARE
+* %include "cdf_guide-lib"
+*
+*******************************************************************************/
+
+#ifndef CDF_GUIDE_LIB_H
+#error McStas : please import this library with %include "cdf_guide-lib"
+#endif
+
+/* element i of a strided array of doubles, stride in bytes */
+#define CDF_GUIDE_AT(p, i, stride) (*(double*)((char*)(p) + (size_t)(i)*(stride)))
+
+/* cdf_guide_build
+  fill guide[0..length-1] for the non decreasing cumul[0..n-1], normalized to 0:1
+ */
+void cdf_guide_build(long *guide, long length, double *cumul, long n, int stride)
+{
+  long i, j = 0;
+  for (i = 0; i < length; i++) {
+    double u = (double)i/(double)length; /* a random number tabulated value */
+    while (j < n && u > CDF_GUIDE_AT(cumul, j, stride)) j++;
+    guide[i] = j < n ? j : n - 1;
+  }
+}
+
+/* cdf_guide_search
+  the first bin with randnum <= cumul, or the last one; guide may be NULL
+ */
+#pragma acc routine seq
+long cdf_guide_search(long *guide, long length, double *cumul, long n, int stride, double randnum)
+{
+  long j = 0;
+
+  if (randnum < 0) randnum = 0;
+  if (randnum > 1) randnum = 1;
+
+  if (guide && length > 0) {
+    long i = (long)floor(randnum*length);
+    if (i > length - 1) i = length - 1;
+    /* one bin back for the rounding of randnum*length */
+    j = guide[i] - 1;
+    if (j < 0) j = 0;
+  }
+  while (j < n && randnum > CDF_GUIDE_AT(cumul, j, stride)) j++;
+  if (j >= n) j = n - 1;
+  return j;
+}
+
+/* end of cdf_guide-lib.c */
@@ -0,0 +1,38 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/cdf_guide-lib.h
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Guide tables for sampling a tabulated cumulative distribution. The guide
+* entry i holds the first bin whose cumulated probability reaches i/length,
+* so a search starts next to its answer and, with about one entry per bin,
+* takes a constant expected number of steps. The bin found for a random
+* number is the one of a plain linear search, so callers may still
+* interpolate inside the bin with the same random number.
+*
+* Usage: within SHARE
+* %include "cdf_guide-lib"
+*
+*******************************************************************************/
+
+#ifndef CDF_GUIDE_LIB_H
+
+#define CDF_GUIDE_LIB_H "$Revision$"
+
+  void cdf_guide_build(long *guide, long length, double *cumul, long n, int stride);
+#pragma acc routine seq
+  long cdf_guide_search(long *guide, long length, double *cumul, long n, int stride, double randnum);
+
+#endif
+
+/* end of cdf_guide-lib.h */
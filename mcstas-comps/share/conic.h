@@ -3,7 +3,7 @@
 Simple Meta-Conic Neutron Raytracer is a framework for raytracing geometries of the form: @f$ r^2=k_1 + k_2 z + k_3 z^2 @f$. 
 
 <h3>General Notes</h3>
-To use the software you must make a Scene element using the function makeScene(). You must then add items to this scene element using the various add function (addDisk(), addParaboloid(), etc...). Next you must call the function traceSingleNeutron() for every neutron you would like to trace through the geometry. The maximum number of each geometry you can place in a scene is defined by the MAX_CONICSURF, MAX_DISK and MAX_DETECTOR definitions in the conic.h file.
+To use the software you must make a Scene element using the function makeScene(). You must then add items to this scene element using the various add function (addDisk(), addParaboloid(), etc...). Next you should call initSimulation() once, which bins the surfaces along z so that only candidate surfaces are tested, and then the function traceSingleNeutron() for every neutron you would like to trace through the geometry. The maximum number of each geometry you can place in a scene is defined by the MAX_CONICSURF, MAX_DISK and MAX_DETECTOR definitions in the conic.h file.
 
 <h3>TODO</h3>
 
@@ -113,7 +113,7 @@ int main() {
     double i;
     for (i = 0; i < NUM_NEUTRON; i++) {
         _class_particle p = generate_class_particleFromSource(0.005, 0.02422, 4, NUM_NEUTRON);
-        traceSingleNeutron(&p,s);
+        traceSingleNeutron(&p,&s);
     }
 
     //Finish Simulation of the Scene
@@ -166,6 +166,7 @@ int main() {
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /** @defgroup simgroup Simulator Internals
     Contains items general to the simulation
@@ -183,6 +184,9 @@ int main() {
 //! Max number of Detectors allowed in a Scene
 #define MAX_DETECTOR 10
 
+//! Number of z bins initSimulation() makes between consecutive surface ends
+#define ZBIN_SPLIT 2
+
 //! If "1" simulator will record z location where neutron with greatest grazing angle reflected for each ConicSurf
 /*! The information is stored in the max_ga and max_ga_z0 members of each ConicSurf, which are only present if
     this flag is 1. See source code for clarification.
@@ -586,6 +590,18 @@ typedef struct {
     #endif
 
 } FlatSurf;
+/*! @ingroup simgroup
+\brief Entry of a ConicSurf or FlatSurf in a z bin of the Scene
+
+The radial envelope is r for a ConicSurf and |x| for a FlatSurf, over the part
+of the surface inside the bin. */
+typedef struct {
+    double rmin; //!< Smallest radius of the surface within the bin
+    double rmax; //!< Largest radius of the surface within the bin
+    int type;    //!< CONIC or FLAT
+    int index;   //!< Index in Scene c or f
+} BinItem;
+
 /*! @ingroup simgroup
 \brief Structure to hold all scene geometry
 
@@ -605,6 +621,11 @@ typedef struct {
     Detector d[MAX_DETECTOR];  //!< Array of all Detector in Scene
     int num_d;                 //!< Number of Detector in Scene
 
+    int num_zb;                //!< Number of z bins, 0 until initSimulation() is called
+    double* zb;                //!< Bin edges along z, num_zb+1 of them
+    int* zb_first;             //!< Offset of the first BinItem of each bin, num_zb+1 of them
+    double* zb_span;           //!< Largest rmax-rmin among the items of each bin
+    BinItem* zb_items;         //!< Surfaces overlapping each bin, sorted by rmin
 
 } Scene;
 
@@ -703,12 +724,13 @@ Detector* addDetector(double z0, double xmin, double xmax, double ymin, double y
 
 @return Time until the propogation or -1 if particle will not hit detector
 */
-double getTimeOfFirstCollisionDetector(_class_particle p, Detector d) {
-    double t = (d.z0-p.z)/p.vz;
+double getTimeOfFirstCollisionDetector(_class_particle* p, Detector* d) {
+    double t = (d->z0-p->z)/p->vz;
     if (t <= 0)
         return -1;
-    _class_particle p2 = copyMove_class_particleT(t,p);
-    if (p2.x > d.xmax || p2.x < d.xmin || p2.y > d.ymax || p2.y < d.ymin)
+    double x = p->x+p->vx*t;
+    double y = p->y+p->vy*t;
+    if (x > d->xmax || x < d->xmin || y > d->ymax || y < d->ymin)
         return -1;
     return t;
 }
@@ -718,13 +740,13 @@ double getTimeOfFirstCollisionDetector(_class_particle p, Detector d) {
 @param p Pointer to particle to be traced
 @param d Detector to be traced
 */
-void traceNeutronDetector(_class_particle* p, Detector d) {
-    double t = getTimeOfFirstCollisionDetector(*p, d);
+void traceNeutronDetector(_class_particle* p, Detector* d) {
+    double t = getTimeOfFirstCollisionDetector(p, d);
     if (t < 0)
         return;
     move_class_particleT(t,p);
-    d.data[(int)floor((p->x-d.xmin)/d.xstep)][(int)floor((p->y-d.ymin)/d.ystep)] += p->p;
-    (*d.num_count) += p->p;
+    d->data[(int)floor((p->x-d->xmin)/d->xstep)][(int)floor((p->y-d->ymin)/d->ystep)] += p->p;
+    (*d->num_count) += p->p;
 }
 
 /*! \brief Function to finalize detector
@@ -835,14 +857,16 @@ Disk* addEndDisk(double z0, double r0, double r1, Scene* s) {
 @param d Disk to consider
 @return Time until the propogation or -1 if particle will not hit disk
 */
-double getTimeOfFirstCollisionDisk(_class_particle p, Disk d) {
-    double tz = (d.z0-p.z)/p.vz;
+double getTimeOfFirstCollisionDisk(_class_particle* p, Disk* d) {
+    double tz = (d->z0-p->z)/p->vz;
     if (tz <= 0)
         return -1;
-    _class_particle p2 = copyMove_class_particleT(tz, p);
-    double rp = sqrt(p2.x*p2.x+p2.y*p2.y);
-    if (rp > d.r0 && rp < d.r1 && fabs(p2.z-d.z0) < 1e-11)
-        return (d.z0-p.z)/p.vz; 
+    double x = p->x+p->vx*tz;
+    double y = p->y+p->vy*tz;
+    double z = p->z+p->vz*tz;
+    double rp = sqrt(x*x+y*y);
+    if (rp > d->r0 && rp < d->r1 && fabs(z-d->z0) < 1e-11)
+        return tz;
     return -1;
 }
 
@@ -851,14 +875,14 @@ double getTimeOfFirstCollisionDisk(_class_particle p, Disk d) {
 @param p Pointer to particle to be traced
 @param d Disk to be traced
 */
-void traceNeutronDisk(_class_particle* p, Disk d) {
-    double t = getTimeOfFirstCollisionDisk(*p, d);
+void traceNeutronDisk(_class_particle* p, Disk* d) {
+    double t = getTimeOfFirstCollisionDisk(p, d);
 
     if (t <= 0)
         return;
 
     move_class_particleT(t, p);
-    if (d.absorb)
+    if (d->absorb)
       absorb_class_particle(p);
 }
 
@@ -1274,8 +1298,8 @@ MAKE SURE p IS ON SURFACE
 @param p Point to compute normal vector
 @param s ConicSurf to compute normal vector of
 */
-Vec getNormConic(Point p, ConicSurf s) {
-    double det = s.k2*s.k2+4*s.k3*(p.x*p.x+p.y*p.y-s.k1);
+Vec getNormConic(Point p, ConicSurf* s) {
+    double det = s->k2*s->k2+4*s->k3*(p.x*p.x+p.y*p.y-s->k1);
     if (det <= 0.){
 
         return makeVec(-p.x/sqrt(p.x*p.x + p.y*p.y),-p.y/(p.x*p.x + p.y*p.y),0);
@@ -1283,7 +1307,7 @@ Vec getNormConic(Point p, ConicSurf s) {
     double den = sqrt(det);
     double nx = -2*p.x/den;
     double ny = -2*p.y/den;
-    double nz = sign(2*s.k3*p.z+s.k2);
+    double nz = sign(2*s->k3*p.z+s->k2);
     double n = sqrt(nx*nx+ny*ny+nz*nz);
     return makeVec(nx/n,ny/n,nz/n);
 }
@@ -1296,7 +1320,7 @@ MAKE SURE p IS ON SURFACE
 @param p Point to compute normal vector
 @param s FlatSurf to compute normal vector of; for s.b > 0 surface posseses translation symmetry along y direction
 */
-Vec getNormFlat(Point p, FlatSurf s) {
+Vec getNormFlat(Point p, FlatSurf* s) {
     double r;
     //if(s.b > 0){
     r = p.x;
@@ -1304,7 +1328,7 @@ Vec getNormFlat(Point p, FlatSurf s) {
     //    r = p.y;
     //};
     double den;
-    double det = s.k2*s.k2+4*s.k3*(r*r-s.k1);
+    double det = s->k2*s->k2+4*s->k3*(r*r-s->k1);
     if (det > 0){
         den = sqrt(det);
     }
@@ -1313,7 +1337,7 @@ Vec getNormFlat(Point p, FlatSurf s) {
     }
     double nx = -2*p.x/den;
     double ny = 0;
-    double nz = sign(2*s.k3*p.z+s.k2);
+    double nz = sign(2*s->k3*p.z+s->k2);
     double n = sqrt(nx*nx+ny*ny+nz*nz);
     return makeVec(nx/n,ny/n,nz/n);
 }
@@ -1324,23 +1348,26 @@ Vec getNormFlat(Point p, FlatSurf s) {
 @param s ConicSurf to consider
 @return Time until the propogation or -1 if particle will not hit disk
 */ 
-double getTimeOfFirstCollisionConic(_class_particle p, ConicSurf s) {
-    double tz = (s.zs-p.z)/p.vz;
+double getTimeOfFirstCollisionConic(_class_particle* p, ConicSurf* s) {
+    double tz = (s->zs-p->z)/p->vz;
     if (tz < 0) {
        tz = 0;
-       if (p.z > s.ze)
+       if (p->z > s->ze)
             return -1;
     }
 
-    _class_particle p2 = copyMove_class_particleT(tz,p);
+    //Position at tz, the particle itself is not copied
+    double x = p->x+p->vx*tz;
+    double y = p->y+p->vy*tz;
+    double z = p->z+p->vz*tz;
 
-    double A = p2.vx*p2.vx+p2.vy*p2.vy-s.k3*p2.vz*p2.vz;
-    double B = 2*(p2.vx*p2.x+p2.vy*p2.y-s.k3*p2.vz*p2.z)-s.k2*p2.vz;
-    double C = p2.x*p2.x+p2.y*p2.y-s.k3*p2.z*p2.z-s.k2*p2.z-s.k1;
+    double A = p->vx*p->vx+p->vy*p->vy-s->k3*p->vz*p->vz;
+    double B = 2*(p->vx*x+p->vy*y-s->k3*p->vz*z)-s->k2*p->vz;
+    double C = x*x+y*y-s->k3*z*z-s->k2*z-s->k1;
     
     double t = solveQuad(A,B,C);
 
-    if (t <= 0 || p2.vz*t+p2.z > s.ze || p2.vz*t+p2.z < s.zs)  
+    if (t <= 0 || p->vz*t+z > s->ze || p->vz*t+z < s->zs)  
         return -1;
     return t+tz;
 }
@@ -1352,24 +1379,27 @@ double getTimeOfFirstCollisionConic(_class_particle p, ConicSurf s) {
 @return Time until the propogation or -1 if particle will not hit surface
 */
 //TODO
-double getTimeOfFirstCollisionFlat(_class_particle p, FlatSurf s) {
-    double tz = (s.zs-p.z)/p.vz;
+double getTimeOfFirstCollisionFlat(_class_particle* p, FlatSurf* s) {
+    double tz = (s->zs-p->z)/p->vz;
     if (tz < 0) {
        tz = 0;
-       if (p.z > s.ze)
+       if (p->z > s->ze)
             return -1;
     }
 
-    _class_particle p2 = copyMove_class_particleT(tz,p);
+    //Position at tz, the particle itself is not copied
+    double x = p->x+p->vx*tz;
+    double y = p->y+p->vy*tz;
+    double z = p->z+p->vz*tz;
     double vs = 0;//the vector important for calculating the intersection with the ellipse
     double s0 = 0;
     double vt = 0;//the other component only important for testing whether the mirror is hit
     double t0 = 0;
     //if(s.b > 0){//obsolete iteration allowing to rotate by 90 deg with out rotation in McStas, not really needed
-    vs = p2.vx;
-    s0 = p2.x;
-    vt = p2.vy;
-    t0 = p2.y;
+    vs = p->vx;
+    s0 = x;
+    vt = p->vy;
+    t0 = y;
 
     //}
     /*else{
@@ -1379,13 +1409,13 @@ double getTimeOfFirstCollisionFlat(_class_particle p, FlatSurf s) {
     t0 = p2.x;
     };
     */
-    double A = vs*vs-s.k3*p2.vz*p2.vz;
-    double B = 2*(vs*s0-s.k3*p2.vz*p2.z)-s.k2*p2.vz;
-    double C = s0*s0-s.k3*p2.z*p2.z-s.k2*p2.z-s.k1;
+    double A = vs*vs-s->k3*p->vz*p->vz;
+    double B = 2*(vs*s0-s->k3*p->vz*z)-s->k2*p->vz;
+    double C = s0*s0-s->k3*z*z-s->k2*z-s->k1;
 
     double t = solveQuad(A,B,C);
 
-    if (t <= 0 || p2.vz*t+p2.z > s.ze || p2.vz*t+p2.z < s.zs||vt*t+t0 < s.ll||vt*t +t0 > s.rl)
+    if (t <= 0 || p->vz*t+z > s->ze || p->vz*t+z < s->zs||vt*t+t0 < s->ll||vt*t +t0 > s->rl)
         return -1;
     return t+tz;
 }
@@ -1470,7 +1500,7 @@ before computing reflection
 
 @see traceNeutronConic()
 */
-double reflectNeutronConic(_class_particle* _particle, ConicSurf s) {
+double reflectNeutronConic(_class_particle* _particle, ConicSurf* s) {
     Vec n = getNormConic(get_class_particlePos(*_particle),s);
     Vec pv = get_class_particleVel(*_particle);
 	
@@ -1522,7 +1552,7 @@ double reflectNeutronConic(_class_particle* _particle, ConicSurf s) {
     }
 
     double ga = fabs(acos(vn/v)) - M_PI/2;
-    double gc = 6.84459399932*s.m/v;
+    double gc = 6.84459399932*s->m/v;
     double ref=1.0;
     if (ga > gc) {
         absorb_class_particle(_particle);
@@ -1533,7 +1563,7 @@ double reflectNeutronConic(_class_particle* _particle, ConicSurf s) {
         _particle->vy = _particle->vy-2*vn*n.y; 
         _particle->vz = _particle->vz-2*vn*n.z; 
         double q = V2Q*(-2)*vn/sqrt(pv.x*pv.x + pv.y*pv.y + pv.z*pv.z);
-        double par[5] = {s.R0, s.Qc, s.alpha, s.m, s.W};
+        double par[5] = {s->R0, s->Qc, s->alpha, s->m, s->W};
         StdReflecFunc(q, par, &ref);
 	_particle->p = _particle->p * ref;
     if (disp>0) {
@@ -1600,7 +1630,7 @@ before computing reflection
 
 @see traceNeutronConic()
 */
-double reflectNeutronFlat(_class_particle* _particle, FlatSurf s) {
+double reflectNeutronFlat(_class_particle* _particle, FlatSurf* s) {
     Vec n = getNormFlat(get_class_particlePos(*_particle),s);
     Vec pv = get_class_particleVel(*_particle);
     //printf("nothing");
@@ -1610,11 +1640,11 @@ double reflectNeutronFlat(_class_particle* _particle, FlatSurf s) {
     //Hitting shell from outside For FlatSurface this has to be checked
     // make it able to reflect from the outside
     double ga = fabs(acos(vn/v)) - M_PI/2;
-    double gc = 6.84459399932*s.m/v;
+    double gc = 6.84459399932*s->m/v;
     double ref=1.0;
 
     double q = V2Q*(-2)*vn/sqrt(pv.x*pv.x + pv.y*pv.y + pv.z*pv.z);
-    double par[5] = {s.R0, s.Qc, s.alpha, s.m, s.W};
+    double par[5] = {s->R0, s->Qc, s->alpha, s->m, s->W};
     StdReflecFunc(q, par, &ref);
 
     _particle->p = _particle->p * ref;
@@ -1663,17 +1693,17 @@ double reflectNeutronFlat(_class_particle* _particle, FlatSurf s) {
 @param c ConicSurf to use
 
 */
-void traceNeutronConic(_class_particle* _particle, ConicSurf c) {
-    double t = getTimeOfFirstCollisionConic(*_particle, c);
+void traceNeutronConic(_class_particle* _particle, ConicSurf* c) {
+    double t = getTimeOfFirstCollisionConic(_particle, c);
     if (t < 0)
         return;
     else {
         move_class_particleT(t, _particle);
         double ga = reflectNeutronConic(_particle, c);
 #if REC_MAX_GA
-        if (ga > c.max_ga) {
-            c.max_ga = ga;
-            c.max_ga_z0 = _particle->z;
+        if (ga > c->max_ga) {
+            c->max_ga = ga;
+            c->max_ga_z0 = _particle->z;
         }
 #endif
     }
@@ -1685,8 +1715,8 @@ void traceNeutronConic(_class_particle* _particle, ConicSurf c) {
 @param f FlatSurf to use
 
 */
-void traceNeutronFlat(_class_particle* _particle, FlatSurf f) {
-    double t = getTimeOfFirstCollisionFlat(*_particle, f);
+void traceNeutronFlat(_class_particle* _particle, FlatSurf* f) {
+    double t = getTimeOfFirstCollisionFlat(_particle, f);
     if (t < 0)
         return;
     else {
@@ -1696,9 +1726,9 @@ void traceNeutronFlat(_class_particle* _particle, FlatSurf f) {
         double ga = reflectNeutronFlat(_particle, f);
 
 #if REC_MAX_GA
-        if (ga > f.max_ga) {
-            f.max_ga = ga;
-            f.max_ga_z0 = p->_z;
+        if (ga > f->max_ga) {
+            f->max_ga = ga;
+            f->max_ga_z0 = _particle->z;
         }
 #endif
     }
@@ -1725,26 +1755,263 @@ Scene makeScene() {
     s.num_c = 0;
     s.num_di = 0;
     s.num_d = 0;
+    s.num_zb = 0;
+    s.zb = NULL;
+    s.zb_first = NULL;
+    s.zb_span = NULL;
+    s.zb_items = NULL;
     return s;
 }
 
+/*! \brief Function to compute the range of r^2 = k1+k2 z+k3 z^2 for z in [za, zb]
+
+@param k1, k2, k3 Coefficients of the surface
+@param za, zb z range
+@param rmin Set to the smallest radius
+@param rmax Set to the largest radius
+*/
+void rangeConicRadius(double k1, double k2, double k3, double za, double zb,
+    double* rmin, double* rmax) {
+    double ra = k1+k2*za+k3*za*za;
+    double rb = k1+k2*zb+k3*zb*zb;
+    double lo = ra < rb ? ra : rb;
+    double hi = ra < rb ? rb : ra;
+    if (k3 != 0) {
+        double zv = -k2/(2*k3);
+        if (zv > za && zv < zb) {
+            double rv = k1+k2*zv+k3*zv*zv;
+            if (rv < lo) lo = rv;
+            if (rv > hi) hi = rv;
+        }
+    }
+    *rmin = lo > 0 ? sqrt(lo) : 0;
+    *rmax = hi > 0 ? sqrt(hi) : 0;
+}
+
+int compareBinItem(const void* a, const void* b) {
+    double ra = ((const BinItem*)a)->rmin;
+    double rb = ((const BinItem*)b)->rmin;
+    return (ra > rb) - (ra < rb);
+}
+
+int compareDouble(const void* a, const void* b) {
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
 //! Function to init simulation items
 /*! Should be called after all items
 have been added to scene but before
 neutrons are traced.
 
+Bins the ConicSurf and FlatSurf items along z, with bin edges at every surface
+end split ZBIN_SPLIT times, and records the radial envelope of each surface in
+each bin it overlaps. traceSingleNeutron() then only tests the surfaces whose
+envelope the neutron path crosses.
+
 @param s Pointer of Scene to init
 */
 void initSimulation(Scene* s) {
-    //
+    int n = s->num_c+s->num_f;
+    int i, j, b, k;
+
+    free(s->zb);
+    free(s->zb_first);
+    free(s->zb_span);
+    free(s->zb_items);
+    s->num_zb = 0;
+    s->zb = NULL;
+    s->zb_first = NULL;
+    s->zb_span = NULL;
+    s->zb_items = NULL;
+    if (n == 0)
+        return;
+
+    //Unique surface ends
+    double* ends = (double*)malloc(2*n*sizeof(double));
+    for (i = 0; i < s->num_c; i++) {
+        ends[2*i] = s->c[i].zs;
+        ends[2*i+1] = s->c[i].ze;
+    }
+    for (i = 0; i < s->num_f; i++) {
+        ends[2*(s->num_c+i)] = s->f[i].zs;
+        ends[2*(s->num_c+i)+1] = s->f[i].ze;
+    }
+    qsort(ends, 2*n, sizeof(double), compareDouble);
+    int num_ends = 1;
+    for (i = 1; i < 2*n; i++)
+        if (ends[i] > ends[num_ends-1])
+            ends[num_ends++] = ends[i];
+    if (num_ends < 2) {
+        free(ends);
+        return;
+    }
+
+    s->num_zb = (num_ends-1)*ZBIN_SPLIT;
+    s->zb = (double*)malloc((s->num_zb+1)*sizeof(double));
+    for (i = 0; i < num_ends-1; i++)
+        for (j = 0; j < ZBIN_SPLIT; j++)
+            s->zb[i*ZBIN_SPLIT+j] = ends[i]+(ends[i+1]-ends[i])*j/ZBIN_SPLIT;
+    s->zb[s->num_zb] = ends[num_ends-1];
+    free(ends);
+
+    //Surfaces overlapping each bin, two passes to size the item list
+    s->zb_first = (int*)malloc((s->num_zb+1)*sizeof(int));
+    for (k = 0; k < 2; k++) {
+        int count = 0;
+        for (b = 0; b < s->num_zb; b++) {
+            if (k == 1)
+                s->zb_first[b] = count;
+            for (i = 0; i < n; i++) {
+                int is_c = i < s->num_c;
+                double zs = is_c ? s->c[i].zs : s->f[i-s->num_c].zs;
+                double ze = is_c ? s->c[i].ze : s->f[i-s->num_c].ze;
+                double za = zs > s->zb[b] ? zs : s->zb[b];
+                double zb = ze < s->zb[b+1] ? ze : s->zb[b+1];
+                if (za > zb)
+                    continue;
+                if (k == 1) {
+                    BinItem* it = &s->zb_items[count];
+                    if (is_c) {
+                        rangeConicRadius(s->c[i].k1, s->c[i].k2, s->c[i].k3, za, zb, &it->rmin, &it->rmax);
+                        it->type = CONIC;
+                        it->index = i;
+                    } else {
+                        rangeConicRadius(s->f[i-s->num_c].k1, s->f[i-s->num_c].k2, s->f[i-s->num_c].k3, za, zb, &it->rmin, &it->rmax);
+                        it->type = FLAT;
+                        it->index = i-s->num_c;
+                    }
+                    //Padded so rounding in the collision kernels never loses a hit
+                    it->rmin = it->rmin*(1-1e-9)-1e-12;
+                    it->rmax = it->rmax*(1+1e-9)+1e-12;
+                }
+                count++;
+            }
+        }
+        if (k == 0)
+            s->zb_items = (BinItem*)malloc((count > 0 ? count : 1)*sizeof(BinItem));
+        else
+            s->zb_first[s->num_zb] = count;
+    }
+    s->zb_span = (double*)malloc(s->num_zb*sizeof(double));
+    for (b = 0; b < s->num_zb; b++) {
+        qsort(s->zb_items+s->zb_first[b], s->zb_first[b+1]-s->zb_first[b], sizeof(BinItem), compareBinItem);
+        s->zb_span[b] = 0;
+        for (k = s->zb_first[b]; k < s->zb_first[b+1]; k++)
+            if (s->zb_items[k].rmax-s->zb_items[k].rmin > s->zb_span[b])
+                s->zb_span[b] = s->zb_items[k].rmax-s->zb_items[k].rmin;
+    }
+}
+
+/*! \brief Function to find the ConicSurf or FlatSurf a neutron hits first using the z bins of the Scene
+
+Walks the bins in the direction of flight, and tests only surfaces whose radial
+envelope in the bin overlaps that of the neutron path through the bin. Stops
+after the first bin that contains the earliest hit found so far.
+
+@param p Pointer of particle to consider
+@param s Pointer of Scene with bins built by initSimulation()
+@param t Set to the time of the hit
+@param type Set to CONIC or FLAT, left unchanged if nothing is hit
+@return Index of surface hit or -1
+*/
+int findFirstCollisionBinned(_class_particle* p, Scene* s, double* t, enum GEO* type) {
+    char tested[MAX_CONICSURF+MAX_FLATSURF];
+    int index = -1;
+    int step = p->vz > 0 ? 1 : -1;
+    int b, k;
+
+    memset(tested, 0, s->num_c+s->num_f);
+
+    //Bin holding the particle, or the first one ahead of it
+    if (step > 0) {
+        if (p->z >= s->zb[s->num_zb])
+            return -1;
+        for (b = 0; b < s->num_zb-1 && s->zb[b+1] < p->z; b++);
+    } else {
+        if (p->z <= s->zb[0])
+            return -1;
+        for (b = s->num_zb-1; b > 0 && s->zb[b] > p->z; b--);
+    }
+
+    double vr2 = p->vx*p->vx+p->vy*p->vy;
+    for (; b >= 0 && b < s->num_zb; b += step) {
+        //Part of the path inside the bin
+        double ta = (s->zb[b]-p->z)/p->vz;
+        double tb = (s->zb[b+1]-p->z)/p->vz;
+        double t0 = ta < tb ? ta : tb;
+        double t1 = ta < tb ? tb : ta;
+        if (t0 < 0) t0 = 0;
+        if (t1 < t0)
+            continue;
+
+        //Radial envelope of the path, r^2 is convex in time
+        double x0 = p->x+p->vx*t0, y0 = p->y+p->vy*t0;
+        double x1 = p->x+p->vx*t1, y1 = p->y+p->vy*t1;
+        double r0 = x0*x0+y0*y0, r1 = x1*x1+y1*y1;
+        double rhi = r0 > r1 ? r0 : r1;
+        double rlo = r0 < r1 ? r0 : r1;
+        if (vr2 > 0) {
+            double tv = -(p->x*p->vx+p->y*p->vy)/vr2;
+            if (tv > t0 && tv < t1) {
+                double xv = p->x+p->vx*tv, yv = p->y+p->vy*tv;
+                rlo = xv*xv+yv*yv;
+            }
+        }
+        rhi = sqrt(rhi);
+        rlo = sqrt(rlo);
+        //|x| envelope for FlatSurf
+        double xhi = fabs(x0) > fabs(x1) ? fabs(x0) : fabs(x1);
+        double xlo = (x0 < 0) != (x1 < 0) ? 0 : (fabs(x0) < fabs(x1) ? fabs(x0) : fabs(x1));
+        double env_hi = rhi > xhi ? rhi : xhi;
+        double env_lo = (rlo < xlo ? rlo : xlo)-s->zb_span[b];
+
+        //First item that can reach env_lo, items are sorted by rmin and no wider than zb_span
+        int lo = s->zb_first[b], hi = s->zb_first[b+1];
+        while (lo < hi) {
+            int mid = (lo+hi)/2;
+            if (s->zb_items[mid].rmin < env_lo)
+                lo = mid+1;
+            else
+                hi = mid;
+        }
+
+        for (k = lo; k < s->zb_first[b+1]; k++) {
+            BinItem* it = &s->zb_items[k];
+            if (it->rmin > env_hi)
+                break;
+            int id = it->type == CONIC ? it->index : s->num_c+it->index;
+            if (tested[id])
+                continue;
+            if (it->type == CONIC ? (it->rmax < rlo || it->rmin > rhi) : (it->rmax < xlo || it->rmin > xhi))
+                continue;
+            tested[id] = 1;
+
+            double t2 = it->type == CONIC ? getTimeOfFirstCollisionConic(p, &s->c[it->index])
+                                          : getTimeOfFirstCollisionFlat(p, &s->f[it->index]);
+            if (t2 <= 0)
+                continue;
+            //Ties go to the surface the linear scan would have found first
+            if (index == -1 || t2 < *t || (t2 == *t && (it->type < *type || (it->type == *type && it->index < index)))) {
+                *type = (enum GEO)it->type;
+                index = it->index;
+                *t = t2;
+            }
+        }
+        //Later bins only hold hits further along the path
+        if (index != -1 && (step > 0 ? p->z+p->vz*(*t) <= s->zb[b+1] : p->z+p->vz*(*t) >= s->zb[b]))
+            break;
+    }
+    return index;
 }
 
 /*! \brief Function to raytrace single neutron through geometries specified by d, di and c.
 
 @param p Pointer of particle to trace
-@param s Scene to trace
+@param s Pointer of Scene to trace
 */
-void traceSingleNeutron(_class_particle* _particle, Scene s) {
+void traceSingleNeutron(_class_particle* _particle, Scene* s) {
    
     int contact = 1;
     do {
@@ -1753,32 +2020,36 @@ void traceSingleNeutron(_class_particle* _particle, Scene s) {
         int index = -1;
         int i;
 
-        for (i = 0; i < s.num_c; i++) {
-            double t2 = getTimeOfFirstCollisionConic(*_particle,s.c[i]);
-
-            if (t2 <= 0)
-                continue;
-            if (index == -1 || t2 < t) {
-                type = CONIC;
-                index = i;
-                t = t2;
+        if (s->num_zb > 0 && _particle->vz != 0) {
+            index = findFirstCollisionBinned(_particle, s, &t, &type);
+        } else {
+            for (i = 0; i < s->num_c; i++) {
+                double t2 = getTimeOfFirstCollisionConic(_particle,&s->c[i]);
+
+                if (t2 <= 0)
+                    continue;
+                if (index == -1 || t2 < t) {
+                    type = CONIC;
+                    index = i;
+                    t = t2;
+                }
             }
-        }
 
-        for (i = 0; i < s.num_f; i++) {
-            double t2 = getTimeOfFirstCollisionFlat(*_particle,s.f[i]);
+            for (i = 0; i < s->num_f; i++) {
+                double t2 = getTimeOfFirstCollisionFlat(_particle,&s->f[i]);
 
-            if (t2 <= 0)
-                continue;
-            if (index == -1 || t2 < t) {
-                type = FLAT;
-                index = i;
-                t = t2;
+                if (t2 <= 0)
+                    continue;
+                if (index == -1 || t2 < t) {
+                    type = FLAT;
+                    index = i;
+                    t = t2;
+                }
             }
         }
 
-        for (i = 0; i < s.num_di; i++)  {
-            double t2 = getTimeOfFirstCollisionDisk(*_particle,s.di[i]);
+        for (i = 0; i < s->num_di; i++)  {
+            double t2 = getTimeOfFirstCollisionDisk(_particle,&s->di[i]);
 
             if (t2 <= 0)
                 continue;
@@ -1789,8 +2060,8 @@ void traceSingleNeutron(_class_particle* _particle, Scene s) {
             }
         }
 
-        for (i = 0; i < s.num_d; i++) {
-            double t2 = getTimeOfFirstCollisionDetector(*_particle,s.d[i]);
+        for (i = 0; i < s->num_d; i++) {
+            double t2 = getTimeOfFirstCollisionDetector(_particle,&s->d[i]);
 
             if (t2 <= 0)
                 continue;
@@ -1803,16 +2074,16 @@ void traceSingleNeutron(_class_particle* _particle, Scene s) {
 
         switch (type) {
             case DETECTOR:
-                traceNeutronDetector(_particle, s.d[index]);
+                traceNeutronDetector(_particle, &s->d[index]);
                 break;
             case FLAT:
-	        traceNeutronFlat(_particle, s.f[index]);
+	        traceNeutronFlat(_particle, &s->f[index]);
                 break;
             case DISK:
-                traceNeutronDisk(_particle, s.di[index]);
+                traceNeutronDisk(_particle, &s->di[index]);
                 break;
             case CONIC:
-                traceNeutronConic(_particle, s.c[index]);
+                traceNeutronConic(_particle, &s->c[index]);
                 break;
             default:
                 contact = 0;
@@ -1834,6 +2105,16 @@ void finishSimulation(Scene* s) {
     //Finish Detectors
     for (i=0; i < s->num_d; i++)
         finishDetector(s->d[i]);
+
+    free(s->zb);
+    free(s->zb_first);
+    free(s->zb_span);
+    free(s->zb_items);
+    s->num_zb = 0;
+    s->zb = NULL;
+    s->zb_first = NULL;
+    s->zb_span = NULL;
+    s->zb_items = NULL;
 }
 
 /** @} */ //end of ingroup simgroup
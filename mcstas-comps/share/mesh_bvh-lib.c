@@ -0,0 +1,292 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/mesh_bvh-lib.c
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Bounding volume hierarchy over the facets of a Union mesh geometry, see
+* mesh_bvh-lib.h. The facet test is the Moller-Trumbore test of
+* sample_mesh_intersect / r_within_mesh with the same arithmetic, so the
+* hierarchy only changes which facets are visited, not the hit times.
+*
+* Usage: within SHARE, before union-lib.c
+* %include "mesh_bvh-lib"
+*
+*******************************************************************************/
+
+#ifndef MESH_BVH_LIB_H
+#error McStas : please import this library with %include "mesh_bvh-lib"
+#endif
+
+struct mesh_bvh_build_state {
+  mesh_bvh *bvh;
+  int    *idx;        /* facet indices, partitioned in place */
+  double *lo, *hi;    /* facet bounds, 3 per facet */
+  double *c;          /* facet centroids, 3 per facet */
+};
+
+double mesh_bvh_area(double *lo, double *hi) {
+  double dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+  if (dx < 0 || dy < 0 || dz < 0) return 0;
+  return 2*(dx*dy + dy*dz + dz*dx);
+}
+
+void mesh_bvh_grow(double *lo, double *hi, double *f_lo, double *f_hi) {
+  int k;
+  for (k = 0; k < 3; k++) {
+    if (f_lo[k] < lo[k]) lo[k] = f_lo[k];
+    if (f_hi[k] > hi[k]) hi[k] = f_hi[k];
+  }
+}
+
+int mesh_bvh_build_node(struct mesh_bvh_build_state *st, int begin, int end, int depth) {
+  mesh_bvh *bvh = st->bvh;
+  int node = bvh->n_nodes++;
+  int n = end - begin;
+  int i, k, b, axis;
+
+  // node bounds and centroid bounds
+  double lo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL }, hi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+  double c_lo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL }, c_hi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+  for (i = begin; i < end; i++) {
+    int f = st->idx[i];
+    mesh_bvh_grow(lo, hi, st->lo + 3*f, st->hi + 3*f);
+    mesh_bvh_grow(c_lo, c_hi, st->c + 3*f, st->c + 3*f);
+  }
+
+  // pad, so rounding in the facet test can not put a hit outside its box
+  double pad = 1e-9*(fabs(hi[0] - lo[0]) + fabs(hi[1] - lo[1]) + fabs(hi[2] - lo[2])) + 1e-12;
+  bvh->min_x[node] = lo[0] - pad; bvh->max_x[node] = hi[0] + pad;
+  bvh->min_y[node] = lo[1] - pad; bvh->max_y[node] = hi[1] + pad;
+  bvh->min_z[node] = lo[2] - pad; bvh->max_z[node] = hi[2] + pad;
+
+  bvh->first[node] = begin;
+  bvh->count[node] = n;
+  if (n <= MESH_BVH_LEAF_SIZE || depth >= MESH_BVH_STACK - 2) return node;
+
+  // binned SAH, cost of a leaf is one facet test per facet, traversal counts as one
+  double parent_area = mesh_bvh_area(lo, hi);
+  double best_cost = HUGE_VAL;
+  int best_axis = -1, best_bin = 0;
+  for (axis = 0; axis < 3; axis++) {
+    double extent = c_hi[axis] - c_lo[axis];
+    if (extent <= 0) continue;
+    double scale = MESH_BVH_BINS/extent;
+
+    int    cnt[MESH_BVH_BINS] = { 0 };
+    double b_lo[MESH_BVH_BINS][3], b_hi[MESH_BVH_BINS][3];
+    for (b = 0; b < MESH_BVH_BINS; b++)
+      for (k = 0; k < 3; k++) { b_lo[b][k] = HUGE_VAL; b_hi[b][k] = -HUGE_VAL; }
+    for (i = begin; i < end; i++) {
+      int f = st->idx[i];
+      b = (int) ((st->c[3*f + axis] - c_lo[axis])*scale);
+      if (b >= MESH_BVH_BINS) b = MESH_BVH_BINS - 1;
+      cnt[b]++;
+      mesh_bvh_grow(b_lo[b], b_hi[b], st->lo + 3*f, st->hi + 3*f);
+    }
+
+    // sweep from the right, then from the left
+    double r_area[MESH_BVH_BINS];
+    int    r_cnt[MESH_BVH_BINS];
+    double a_lo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL }, a_hi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+    int acc = 0;
+    for (b = MESH_BVH_BINS - 1; b > 0; b--) {
+      acc += cnt[b];
+      mesh_bvh_grow(a_lo, a_hi, b_lo[b], b_hi[b]);
+      r_cnt[b] = acc;
+      r_area[b] = mesh_bvh_area(a_lo, a_hi);
+    }
+    for (k = 0; k < 3; k++) { a_lo[k] = HUGE_VAL; a_hi[k] = -HUGE_VAL; }
+    acc = 0;
+    for (b = 0; b < MESH_BVH_BINS - 1; b++) {
+      acc += cnt[b];
+      mesh_bvh_grow(a_lo, a_hi, b_lo[b], b_hi[b]);
+      if (acc == 0 || r_cnt[b + 1] == 0) continue;
+      double cost = 1 + (mesh_bvh_area(a_lo, a_hi)*acc + r_area[b + 1]*r_cnt[b + 1])/parent_area;
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_bin = b;
+      }
+    }
+  }
+
+  // all centroids coincide, or splitting costs more than a small leaf
+  if (best_axis < 0) return node;
+  if (best_cost >= n && n <= 4*MESH_BVH_LEAF_SIZE) return node;
+
+  // partition on the split bin
+  double scale = MESH_BVH_BINS/(c_hi[best_axis] - c_lo[best_axis]);
+  int mid = begin;
+  for (i = begin; i < end; i++) {
+    int f = st->idx[i];
+    b = (int) ((st->c[3*f + best_axis] - c_lo[best_axis])*scale);
+    if (b >= MESH_BVH_BINS) b = MESH_BVH_BINS - 1;
+    if (b <= best_bin) {
+      st->idx[i] = st->idx[mid];
+      st->idx[mid] = f;
+      mid++;
+    }
+  }
+  if (mid == begin || mid == end) return node;
+
+  bvh->count[node] = 0;
+  mesh_bvh_build_node(st, begin, mid, depth + 1);
+  bvh->first[node] = mesh_bvh_build_node(st, mid, end, depth + 1);
+  return node;
+}
+
+int mesh_bvh_build(mesh_bvh *bvh, int n_facets,
+       double *v1_x, double *v1_y, double *v1_z,
+       double *v2_x, double *v2_y, double *v2_z,
+       double *v3_x, double *v3_y, double *v3_z) {
+  int i, k;
+  memset(bvh, 0, sizeof(mesh_bvh));
+  if (n_facets <= 0) return 0;
+
+  int max_nodes = 2*n_facets;
+  bvh->n_facets = n_facets;
+  bvh->min_x = (double*) malloc(6*max_nodes*sizeof(double));
+  bvh->min_y = bvh->min_x + max_nodes;
+  bvh->min_z = bvh->min_y + max_nodes;
+  bvh->max_x = bvh->min_z + max_nodes;
+  bvh->max_y = bvh->max_x + max_nodes;
+  bvh->max_z = bvh->max_y + max_nodes;
+  bvh->first = (int*) malloc(2*max_nodes*sizeof(int));
+  bvh->count = bvh->first + max_nodes;
+  bvh->v1_x = (double*) malloc(10*n_facets*sizeof(double));
+  bvh->v1_y = bvh->v1_x + n_facets;
+  bvh->v1_z = bvh->v1_y + n_facets;
+  bvh->e1_x = bvh->v1_z + n_facets;
+  bvh->e1_y = bvh->e1_x + n_facets;
+  bvh->e1_z = bvh->e1_y + n_facets;
+  bvh->e2_x = bvh->e1_z + n_facets;
+  bvh->e2_y = bvh->e2_x + n_facets;
+  bvh->e2_z = bvh->e2_y + n_facets;
+  bvh->scratch = bvh->e2_z + n_facets;
+
+  struct mesh_bvh_build_state st;
+  st.bvh = bvh;
+  st.idx = (int*) malloc(n_facets*sizeof(int));
+  st.lo = (double*) malloc(9*n_facets*sizeof(double));
+  st.hi = st.lo + 3*n_facets;
+  st.c = st.hi + 3*n_facets;
+  for (i = 0; i < n_facets; i++) {
+    double v[3][3] = { { v1_x[i], v1_y[i], v1_z[i] }, { v2_x[i], v2_y[i], v2_z[i] }, { v3_x[i], v3_y[i], v3_z[i] } };
+    st.idx[i] = i;
+    for (k = 0; k < 3; k++) {
+      st.lo[3*i + k] = fmin(v[0][k], fmin(v[1][k], v[2][k]));
+      st.hi[3*i + k] = fmax(v[0][k], fmax(v[1][k], v[2][k]));
+      st.c[3*i + k] = (v[0][k] + v[1][k] + v[2][k])/3;
+    }
+  }
+
+  mesh_bvh_build_node(&st, 0, n_facets, 0);
+
+  // facets in leaf order, edges as sample_mesh_intersect computes them
+  for (i = 0; i < n_facets; i++) {
+    int f = st.idx[i];
+    bvh->v1_x[i] = v1_x[f];
+    bvh->v1_y[i] = v1_y[f];
+    bvh->v1_z[i] = v1_z[f];
+    bvh->e1_x[i] = v2_x[f] - v1_x[f];
+    bvh->e1_y[i] = v2_y[f] - v1_y[f];
+    bvh->e1_z[i] = v2_z[f] - v1_z[f];
+    bvh->e2_x[i] = v3_x[f] - v1_x[f];
+    bvh->e2_y[i] = v3_y[f] - v1_y[f];
+    bvh->e2_z[i] = v3_z[f] - v1_z[f];
+  }
+
+  free(st.idx);
+  free(st.lo);
+  return bvh->n_nodes;
+}
+
+void mesh_bvh_free(mesh_bvh *bvh) {
+  free(bvh->min_x);
+  free(bvh->first);
+  free(bvh->v1_x);
+  memset(bvh, 0, sizeof(mesh_bvh));
+}
+
+// slab test, the line is o + t*d for t >= t_min
+int mesh_bvh_box_hit(mesh_bvh *bvh, int node, double *o, double *d, double *inv, double t_min) {
+  double t_near = t_min, t_far = HUGE_VAL;
+  double lo[3] = { bvh->min_x[node], bvh->min_y[node], bvh->min_z[node] };
+  double hi[3] = { bvh->max_x[node], bvh->max_y[node], bvh->max_z[node] };
+  int k;
+  for (k = 0; k < 3; k++) {
+    if (d[k] == 0) {
+      if (o[k] < lo[k] || o[k] > hi[k]) return 0;
+      continue;
+    }
+    double t0 = (lo[k] - o[k])*inv[k];
+    double t1 = (hi[k] - o[k])*inv[k];
+    if (t0 > t1) { double tmp = t0; t0 = t1; t1 = tmp; }
+    if (t0 > t_near) t_near = t0;
+    if (t1 < t_far) t_far = t1;
+    if (t_near > t_far) return 0;
+  }
+  return 1;
+}
+
+/* Hit times of the facets crossed by the line o + t*d, in bvh->scratch. With whole_line every crossing is
+   returned, otherwise only t > 0. Facets with |a| < epsilon, nearly parallel to d, are skipped. */
+int mesh_bvh_hits(mesh_bvh *bvh, double ox, double oy, double oz, double dx, double dy, double dz,
+       int whole_line, double epsilon) {
+  if (bvh->n_nodes == 0) return 0;
+
+  double o[3] = { ox, oy, oz };
+  double d[3] = { dx, dy, dz };
+  double inv[3] = { 1.0/dx, 1.0/dy, 1.0/dz };
+  double t_min = whole_line ? -HUGE_VAL : 0;
+  int stack[MESH_BVH_STACK];
+  int sp = 0, n_hits = 0, i;
+
+  stack[sp++] = 0;
+  while (sp > 0) {
+    int node = stack[--sp];
+    if (!mesh_bvh_box_hit(bvh, node, o, d, inv, t_min)) continue;
+
+    int cnt = bvh->count[node];
+    if (cnt == 0) {
+      stack[sp++] = bvh->first[node];
+      stack[sp++] = node + 1;
+      continue;
+    }
+    int first = bvh->first[node];
+    for (i = first; i < first + cnt; i++) {
+      // Moller-Trumbore, h = d x e2, q = s x e1
+      double e1x = bvh->e1_x[i], e1y = bvh->e1_y[i], e1z = bvh->e1_z[i];
+      double e2x = bvh->e2_x[i], e2y = bvh->e2_y[i], e2z = bvh->e2_z[i];
+      double hx = dy*e2z - e2y*dz;
+      double hy = dz*e2x - e2z*dx;
+      double hz = dx*e2y - e2x*dy;
+      double a = e1x*hx + e1y*hy + e1z*hz;
+      if (a > -epsilon && a < epsilon) continue;
+      double f = 1.0/a;
+      double sx = ox - bvh->v1_x[i], sy = oy - bvh->v1_y[i], sz = oz - bvh->v1_z[i];
+      double u = f*(sx*hx + sy*hy + sz*hz);
+      if (u < 0.0 || u > 1.0) continue;
+      double qx = sy*e1z - e1y*sz;
+      double qy = sz*e1x - e1z*sx;
+      double qz = sx*e1y - e1x*sy;
+      double V = f*(dx*qx + dy*qy + dz*qz);
+      if (V < 0.0 || u + V > 1.0) continue;
+      double t = f*(qx*e2x + qy*e2y + qz*e2z);
+      if (whole_line || t > 0) bvh->scratch[n_hits++] = t;
+    }
+  }
+  return n_hits;
+}
+
+/* end of mesh_bvh-lib.c */
@@ -0,0 +1,61 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/mesh_bvh-lib.h
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Bounding volume hierarchy over the facets of a Union mesh geometry. Built
+* once at initialize with a binned surface area heuristic, and flattened
+* depth first into structure-of-arrays nodes: the first child of an interior
+* node is the next node, the second child is stored. Leaf facets are copied
+* in leaf order as one vertex and two edges, the form Moller-Trumbore uses.
+*
+* Usage: within SHARE, before union-lib.c
+* %include "mesh_bvh-lib"
+*
+*******************************************************************************/
+
+#ifndef MESH_BVH_LIB_H
+
+#define MESH_BVH_LIB_H "$Revision$"
+#define MESH_BVH_LEAF_SIZE 4   /* max facets in a leaf */
+#define MESH_BVH_BINS      16  /* SAH bins per axis */
+#define MESH_BVH_STACK     64  /* traversal stack depth */
+
+  typedef struct mesh_bvh
+  {
+    int    n_nodes;
+    int    n_facets;
+    /* nodes, padded bounding boxes */
+    double *min_x, *min_y, *min_z;
+    double *max_x, *max_y, *max_z;
+    int    *first;         /* leaf: first facet, interior: second child */
+    int    *count;         /* leaf: facets, interior: 0 */
+    /* facets in leaf order */
+    double *v1_x, *v1_y, *v1_z;
+    double *e1_x, *e1_y, *e1_z;   /* v2 - v1 */
+    double *e2_x, *e2_y, *e2_z;   /* v3 - v1 */
+    /* hit times of the last traversal, room for every facet; not safe for concurrent traversals of one mesh */
+    double *scratch;
+  } mesh_bvh;
+
+  int  mesh_bvh_build(mesh_bvh *bvh, int n_facets,
+         double *v1_x, double *v1_y, double *v1_z,
+         double *v2_x, double *v2_y, double *v2_z,
+         double *v3_x, double *v3_y, double *v3_z);
+  void mesh_bvh_free(mesh_bvh *bvh);
+  int  mesh_bvh_hits(mesh_bvh *bvh, double ox, double oy, double oz, double dx, double dy, double dz,
+         int whole_line, double epsilon);
+
+#endif
+
+/* end of mesh_bvh-lib.h */
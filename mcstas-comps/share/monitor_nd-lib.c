@@ -159,6 +159,8 @@ void Monitor_nD_Init(MonitornD_Defines_type *DEFS,
     Vars->Flag_log          = 0;   /* log10 of the flux */
     Vars->Flag_parallel     = 0;   /* set neutron state back after detection (parallel components) */
     Vars->Flag_Binary_List  = 0;   /* save list as a binary file (smaller) */
+    Vars->Flag_Stream       = 0;   /* stream list to a binary file during TRACE */
+    Vars->Stream            = NULL;
     Vars->Coord_Number      = 0;   /* total number of variables to monitor, plus intensity (0) */
     Vars->Coord_NumberNoPixel=0;   /* same but without counting PixelID */
 
@@ -312,6 +314,8 @@ void Monitor_nD_Init(MonitornD_Defines_type *DEFS,
         if (!strcmp(token, "multiple")) {Vars->Flag_Multiple     = 1; iskeyword=1; }
         if (!strcmp(token, "list") || !strcmp(token, "events")) {
           Vars->Flag_List = 1; Set_Coord_Mode = DEFS->COORD_EVNT;  }
+        if (!strcmp(token, "stream")) {
+          Vars->Flag_Stream = 1; Vars->Flag_List = 2; iskeyword=1; }
         if (!strcmp(token, "limits") || !strcmp(token, "min"))
           Set_Coord_Mode = DEFS->COORD_MIN;
         if (!strcmp(token, "slit") || !strcmp(token, "absorb")) {
@@ -700,7 +704,20 @@ void Monitor_nD_Init(MonitornD_Defines_type *DEFS,
     /* list and auto limits case : Vars->Flag_List or Vars->Flag_Auto_Limits
      * -> Buffer to flush and suppress after Vars->Flag_Auto_Limits
      */
-    if ((Vars->Flag_Auto_Limits || Vars->Flag_List) && Vars->Coord_Number)
+    #ifdef MONnD_STREAM
+    if (Vars->Flag_Stream && (!Vars->Flag_List || Vars->Flag_Auto_Limits || !Vars->Coord_Number))
+    { printf("Monitor_nD: %s 'stream' cannot be used with auto limits or without variables. Using in-memory list.\n", Vars->compcurname); Vars->Flag_Stream = 0; }
+    if (Vars->Flag_Stream)
+    { /* events go to per-thread buffers written by a background thread, no Mon2D_Buffer */
+      Vars->Stream = Monitor_nD_StreamOpen(Vars);
+      if (Vars->Stream == NULL) Vars->Flag_Stream = 0;
+    }
+    #else
+    if (Vars->Flag_Stream)
+    { printf("Monitor_nD: %s 'stream' is not available in this build. Using in-memory list.\n", Vars->compcurname); Vars->Flag_Stream = 0; }
+    #endif
+
+    if ((Vars->Flag_Auto_Limits || Vars->Flag_List) && Vars->Coord_Number && !Vars->Flag_Stream)
     { /* Dim : (Vars->Coord_Number+1)*Vars->Buffer_Block matrix (for p, dp) */
       Vars->Mon2D_Buffer = (double *)malloc((Vars->Coord_Number+1)*Vars->Buffer_Block*sizeof(double));
       if (Vars->Mon2D_Buffer == NULL)
@@ -1455,6 +1472,11 @@ int Monitor_nD_Trace(MonitornD_Defines_type *DEFS, MonitornD_Variables_type *Var
     
     if (Vars->Flag_Auto_Limits != 2 && !outsidebounds) /* not when reading auto limits Buffer */
     { /* now store Coord into Buffer (no index needed) if necessary (list or auto limits) */
+      #ifdef MONnD_STREAM
+      if (Vars->Flag_Stream)
+        Monitor_nD_StreamPush((MonitornD_Stream_type *)Vars->Stream, Coord);
+      else
+      #endif
       if ((Vars->Buffer_Counter < Vars->Buffer_Block) && ((Vars->Flag_List) || (Vars->Flag_Auto_Limits == 1)))
       {
         for (i = 0; i <= Vars->Coord_Number; i++)
@@ -1900,6 +1922,15 @@ void Monitor_nD_Finally(MonitornD_Defines_type *DEFS,
   {
     int i;
 
+    #ifdef MONnD_STREAM
+    /* flush remaining events and wait for the writer */
+    if (Vars->Stream)
+    {
+      Monitor_nD_StreamClose((MonitornD_Stream_type *)Vars->Stream);
+      Vars->Stream = NULL;
+    }
+    #endif
+
     /* Now Free memory Mon2D.. */
     if ((Vars->Flag_Auto_Limits || Vars->Flag_List) && Vars->Coord_Number)
     { /* Dim : (Vars->Coord_Number+1)*Vars->Buffer_Block matrix (for p, dp) */
@@ -2136,4 +2167,246 @@ void Monitor_nD_McDisplay(MonitornD_Defines_type *DEFS,
     }
   } /* end Monitor_nD_McDisplay */
 
+#ifdef MONnD_STREAM
+/* ========================================================================= */
+/* Monitor_nD_Stream: list events streamed to a columnar binary file         */
+/* ========================================================================= */
+/*
+ * File layout (little endian as written by the host):
+ *   char   magic[8]        "MONNDEVT"
+ *   int    version         1
+ *   int    ncol            number of columns, p first
+ *   int    elem_size       8 (double)
+ *   int    block_rows      MONnD_STREAM_ROWS
+ *   long long nevents      total events, patched when the stream is closed
+ *   char   component[128]
+ *   char   column[ncol][30] Coord_Var of each column
+ * followed by blocks of
+ *   long long rows
+ *   double col0[rows], col1[rows], ... col{ncol-1}[rows]
+ */
+
+static __thread int Monitor_nD_StreamThread = -1;
+static int Monitor_nD_StreamThreads = 0;
+
+static void *Monitor_nD_StreamWriter(void *arg)
+{
+  MonitornD_Stream_type *s = (MonitornD_Stream_type *)arg;
+  MonitornD_StreamBuffer_type *buf;
+  long long rows;
+  long c;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&s->lock);
+    while (!s->full_head && !s->closing)
+      pthread_cond_wait(&s->cond_full, &s->lock);
+    buf = s->full_head;
+    if (!buf) { pthread_mutex_unlock(&s->lock); break; }
+    s->full_head = buf->next;
+    if (!s->full_head) s->full_tail = NULL;
+    pthread_mutex_unlock(&s->lock);
+
+    rows = buf->count;
+    if (s->file)
+    {
+      fwrite(&rows, sizeof(rows), 1, s->file);
+      for (c = 0; c < s->ncol; c++)
+        fwrite(buf->data + c*MONnD_STREAM_ROWS, sizeof(double), buf->count, s->file);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->nevents += rows;
+    buf->count = 0;
+    buf->next  = s->free_list;
+    s->free_list = buf;
+    pthread_cond_signal(&s->cond_free);
+    pthread_mutex_unlock(&s->lock);
+  }
+  return NULL;
+}
+
+/* open the file and start the writer, called with s->lock held */
+static int Monitor_nD_StreamStart(MonitornD_Stream_type *s)
+{
+  char  fname[CHAR_BUF_LENGTH];
+  char  header[128];
+  char *path;
+  int   v;
+  long long n = 0;
+  long  c;
+
+  s->writer_started = 1;
+  if (s->mon_file && strlen(s->mon_file)) strncpy(fname, s->mon_file, CHAR_BUF_LENGTH-16);
+  else strncpy(fname, s->compname, CHAR_BUF_LENGTH-16);
+  fname[CHAR_BUF_LENGTH-16] = '\0';
+  #ifdef USE_MPI
+  sprintf(fname+strlen(fname), "_%i", mpi_node_rank);
+  #endif
+  path = mcfull_file(fname, "evt");
+  s->file = fopen(path ? path : fname, "wb");
+  if (!s->file)
+    fprintf(stderr, "Monitor_nD: %s cannot open event stream file %s. Events are discarded.\n", s->compname, path ? path : fname);
+  else
+  {
+    fwrite("MONNDEVT", 1, 8, s->file);
+    v = 1;                      fwrite(&v, sizeof(v), 1, s->file);
+    v = (int)s->ncol;           fwrite(&v, sizeof(v), 1, s->file);
+    v = sizeof(double);         fwrite(&v, sizeof(v), 1, s->file);
+    v = MONnD_STREAM_ROWS;      fwrite(&v, sizeof(v), 1, s->file);
+    fwrite(&n, sizeof(n), 1, s->file);
+    memset(header, 0, sizeof(header));
+    strncpy(header, s->compname, sizeof(header)-1);
+    fwrite(header, 1, sizeof(header), s->file);
+    for (c = 0; c < s->ncol; c++)
+      fwrite(s->colname[c], 1, sizeof(s->colname[c]), s->file);
+  }
+  if (path) free(path);
+
+  if (pthread_create(&s->writer, NULL, Monitor_nD_StreamWriter, s))
+  {
+    fprintf(stderr, "Monitor_nD: %s cannot start event stream writer. Fatal.\n", s->compname);
+    exit(-1);
+  }
+  return 1;
+}
+
+MonitornD_Stream_type *Monitor_nD_StreamOpen(MonitornD_Variables_type *Vars)
+{
+  MonitornD_Stream_type *s = (MonitornD_Stream_type *)calloc(1, sizeof(MonitornD_Stream_type));
+  long c;
+
+  if (!s)
+  {
+    printf("Monitor_nD: %s cannot allocate event stream. Using in-memory list.\n", Vars->compcurname);
+    return NULL;
+  }
+  s->ncol     = Vars->Coord_Number+1;
+  s->mon_file = Vars->Mon_File;
+  strncpy(s->compname, Vars->compcurname, sizeof(s->compname)-1);
+  for (c = 0; c < s->ncol; c++)
+    strncpy(s->colname[c], Vars->Coord_Var[c], sizeof(s->colname[c])-1);
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_mutex_init(&s->shared_lock, NULL);
+  pthread_cond_init(&s->cond_full, NULL);
+  pthread_cond_init(&s->cond_free, NULL);
+  if (Vars->Flag_Verbose)
+    printf("Monitor_nD: %s streams %li variables per event in blocks of %i.\n", Vars->compcurname, s->ncol, MONnD_STREAM_ROWS);
+  return s;
+}
+
+/* hand a full buffer to the writer and return an empty one, called with s->lock held */
+static MonitornD_StreamBuffer_type *Monitor_nD_StreamSwap(MonitornD_Stream_type *s, MonitornD_StreamBuffer_type *full)
+{
+  MonitornD_StreamBuffer_type *buf;
+
+  if (full)
+  {
+    if (!s->writer_started) Monitor_nD_StreamStart(s);
+    full->next = NULL;
+    if (s->full_tail) s->full_tail->next = full;
+    else s->full_head = full;
+    s->full_tail = full;
+    pthread_cond_signal(&s->cond_full);
+  }
+  while (!s->free_list)
+  {
+    if (s->nalloc < MONnD_STREAM_NBUF + Monitor_nD_StreamThreads + 1)
+    {
+      buf = (MonitornD_StreamBuffer_type *)calloc(1, sizeof(MonitornD_StreamBuffer_type));
+      if (buf) buf->data = (double *)malloc(s->ncol*MONnD_STREAM_ROWS*sizeof(double));
+      if (!buf || !buf->data)
+      {
+        fprintf(stderr, "Monitor_nD: %s cannot allocate event stream buffer. Fatal.\n", s->compname);
+        exit(-1);
+      }
+      s->nalloc++;
+      return buf;
+    }
+    pthread_cond_wait(&s->cond_free, &s->lock);
+  }
+  buf = s->free_list;
+  s->free_list = buf->next;
+  buf->next = NULL;
+  return buf;
+}
+
+void Monitor_nD_StreamPush(MonitornD_Stream_type *s, double *Coord)
+{
+  MonitornD_StreamBuffer_type *buf;
+  int  tid = Monitor_nD_StreamThread;
+  int  shared;
+  long c;
+
+  if (tid < 0)
+    tid = Monitor_nD_StreamThread = __sync_fetch_and_add(&Monitor_nD_StreamThreads, 1);
+  shared = (tid >= MONnD_STREAM_NTHREAD);
+  if (shared)
+  {
+    tid = MONnD_STREAM_NTHREAD;
+    pthread_mutex_lock(&s->shared_lock);
+  }
+
+  buf = s->current[tid];
+  if (!buf || buf->count >= MONnD_STREAM_ROWS)
+  {
+    pthread_mutex_lock(&s->lock);
+    buf = s->current[tid] = Monitor_nD_StreamSwap(s, buf);
+    pthread_mutex_unlock(&s->lock);
+  }
+  for (c = 0; c < s->ncol; c++)
+    buf->data[c*MONnD_STREAM_ROWS + buf->count] = Coord[c];
+  buf->count++;
+
+  if (shared) pthread_mutex_unlock(&s->shared_lock);
+}
+
+void Monitor_nD_StreamClose(MonitornD_Stream_type *s)
+{
+  MonitornD_StreamBuffer_type *buf;
+  long i;
+
+  pthread_mutex_lock(&s->lock);
+  for (i = 0; i <= MONnD_STREAM_NTHREAD; i++)
+  {
+    buf = s->current[i];
+    s->current[i] = NULL;
+    if (!buf) continue;
+    if (buf->count)
+    {
+      if (!s->writer_started) Monitor_nD_StreamStart(s);
+      buf->next = NULL;
+      if (s->full_tail) s->full_tail->next = buf;
+      else s->full_head = buf;
+      s->full_tail = buf;
+    }
+    else { buf->next = s->free_list; s->free_list = buf; }
+  }
+  s->closing = 1;
+  pthread_cond_signal(&s->cond_full);
+  pthread_mutex_unlock(&s->lock);
+
+  if (s->writer_started) pthread_join(s->writer, NULL);
+  if (s->file)
+  {
+    fseek(s->file, 8 + 4*sizeof(int), SEEK_SET);
+    fwrite(&s->nevents, sizeof(s->nevents), 1, s->file);
+    fclose(s->file);
+  }
+
+  while (s->free_list)
+  {
+    buf = s->free_list;
+    s->free_list = buf->next;
+    free(buf->data);
+    free(buf);
+  }
+  pthread_mutex_destroy(&s->lock);
+  pthread_mutex_destroy(&s->shared_lock);
+  pthread_cond_destroy(&s->cond_full);
+  pthread_cond_destroy(&s->cond_free);
+  free(s);
+}
+#endif
+
 /* end of monitor_nd-lib.c */
@@ -28,6 +28,18 @@
 #define MONITOR_ND_LIB_H "$Revision$"
 #define MONnD_COORD_NMAX  30  /* max number of variables to record */
 
+/* 'stream' option: list events to a binary file while tracing. Needs POSIX threads, and is left out on
+   other platforms, under OPENACC, or when built with -DMONnD_NOSTREAM */
+#if !defined(OPENACC) && !defined(MONnD_NOSTREAM) && (defined(__unix__) || defined(__APPLE__))
+#define MONnD_STREAM
+#endif
+#ifdef MONnD_STREAM
+#include <pthread.h>
+#endif
+#define MONnD_STREAM_ROWS    65536 /* events per stream buffer */
+#define MONnD_STREAM_NBUF    16    /* spare buffers per stream, on top of one per tracing thread */
+#define MONnD_STREAM_NTHREAD 256   /* threads with a private buffer, others share a locked one */
+
   typedef struct MonitornD_Defines
   {
     int COORD_NONE  ;
@@ -112,6 +124,37 @@
 
   } MonitornD_Defines_type;
 
+#ifdef MONnD_STREAM
+  typedef struct MonitornD_StreamBuffer
+  {
+    long   count;                            /* events stored */
+    double *data;                            /* column major: data[col*MONnD_STREAM_ROWS + row] */
+    struct MonitornD_StreamBuffer *next;
+  } MonitornD_StreamBuffer_type;
+
+  typedef struct MonitornD_Stream
+  {
+    FILE   *file;                            /* opened by the first flush, Mon_File may change after Init */
+    char   *mon_file;                        /* Vars->Mon_File */
+    char   compname[128];
+    char   colname[MONnD_COORD_NMAX][30];    /* Coord_Var of each column */
+    long   ncol;                             /* Coord_Number+1, p first */
+    long   nalloc;                           /* buffers allocated, bounds memory use */
+    long long nevents;
+    int    closing;
+    int    writer_started;
+    pthread_t       writer;
+    pthread_mutex_t lock;                    /* buffer lists */
+    pthread_mutex_t shared_lock;             /* threads beyond MONnD_STREAM_NTHREAD */
+    pthread_cond_t  cond_full;               /* writer waits for full buffers */
+    pthread_cond_t  cond_free;               /* tracers wait for a free buffer when the writer lags */
+    MonitornD_StreamBuffer_type *free_list;
+    MonitornD_StreamBuffer_type *full_head;
+    MonitornD_StreamBuffer_type *full_tail;
+    MonitornD_StreamBuffer_type *current[MONnD_STREAM_NTHREAD+1]; /* last slot is shared */
+  } MonitornD_Stream_type;
+#endif
+
   typedef struct MonitornD_Variables
   {
     double area;
@@ -128,6 +171,7 @@
     char   Flag_log          ;   /* log10 of the flux */
     char   Flag_parallel     ;   /* set neutron state back after detection (parallel components) */
     char   Flag_Binary_List  ;
+    char   Flag_Stream       ;   /* list events are streamed to a binary file during TRACE */
     char   Flag_capture      ;   /* lambda monitor with lambda/lambda(2200m/s = 1.7985 Angs) weightening */
     int    Flag_signal       ;   /* 0:monitor p, else monitor a mean value */
     int    Flag_mantid       ;   /* 0:normal monitor, else do mantid-event specifics */
@@ -175,6 +219,7 @@
     double **Mon2D_p;
     double **Mon2D_p2;
     double *Mon2D_Buffer;
+    void   *Stream;              /* MonitornD_Stream_type when Flag_Stream */
     unsigned long PixelID;
 
     double mxmin,mxmax,mymin,mymax,mzmin,mzmax;
@@ -195,6 +240,11 @@ int Monitor_nD_Trace(MonitornD_Defines_type *, MonitornD_Variables_type *, _clas
 MCDETECTOR Monitor_nD_Save(MonitornD_Defines_type *, MonitornD_Variables_type *);
 void Monitor_nD_Finally(MonitornD_Defines_type *, MonitornD_Variables_type *);
 void Monitor_nD_McDisplay(MonitornD_Defines_type *, MonitornD_Variables_type *);
+#ifdef MONnD_STREAM
+MonitornD_Stream_type *Monitor_nD_StreamOpen(MonitornD_Variables_type *);
+void Monitor_nD_StreamPush(MonitornD_Stream_type *, double *);
+void Monitor_nD_StreamClose(MonitornD_Stream_type *);
+#endif
 
 #endif
 
@@ -74,6 +74,7 @@ int line_plane_intersect(Coords line_p, Coords line_v, Coords plane_normal, Coor
 		(*d_intersect_point).z = line_v.z * (-n_dot_dp) / n_dot_v; 
 		*dt = -n_dot_dp / n_dot_v; 
 	}
+	return 1;
 }
 
 //rotate a plane around a rotation axis by an angle, right hand rule applies
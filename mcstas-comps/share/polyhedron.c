@@ -17,6 +17,9 @@
 * Initial formation much have point (0,0,0) on or inside the polyhedron.
 * Calculates the intersects of neutron flight path through the polyhedron
 * Such a geometry has up to two intersects.
+* The faces are also kept as a structure of arrays for a branch free slab test,
+* see polyhedron_slab-lib; line_polyhedron_intersect uses it to skip lines that
+* miss the polyhedron and planes that are crossed outside of it.
 * 
 * The number of faces are limited to 50, otherwise the program crashes
 *
@@ -591,6 +594,9 @@ int form_polyhedron(int nf_in, Coords *fn_in, Coords *fp_in, Polyhedron *polyhed
 	a->lpi.a_lp_pn=calloc(a->nf,sizeof(int));  //intersect plane number
 	a->lpi.a_lp_ty=calloc(a->nf,sizeof(int));  //intersect type
 	a->lpi.idp = calloc(a->nf, sizeof(PolyhedronIndexValuePair)); //for sorting intersect according to point-plane distance
+	
+	polyhedron_slab_alloc(&(a->slab), a->nf); //faces for the slab test
+	update_polyhedron_slab(a);
 
 	return a->nf;
 
@@ -658,6 +664,17 @@ int line_polyhedron_intersect(double line_t, Coords line_p, Coords line_v,
 	double lp_t; //intersect time absolute
 	Coords lp_p; //intersect position absolute
 
+	//slab test with the faces moved outwards by max_d: a line missing it has no intersect on the polyhedron,
+	//and an intersect on the polyhedron lies between its entry and exit, other planes need not be checked.
+	//planes in the skip list are faces of the slab, so only use it without skip list.
+	double t_slab_in = -DBL_MAX, t_slab_out = DBL_MAX; 
+	if (!(skip_plane_number && num_skip_plane > 0) && a->slab.nf == a->nf) {
+		if (line_polyhedron_slab_intersect(line_p, line_v, a, max_d + POLYHEDRON_SLAB_MARGIN, &t_slab_in, &t_slab_out, 0, 0) == 0 
+			|| t_slab_out < 0) {
+			*num_intersect = 0;
+			return 1;
+		}
+	}
 
 	double *dtime = (double*)malloc(a->nf * sizeof(double));
 	Coords *dpoint = (Coords*)malloc(a->nf * sizeof(Coords));
@@ -679,7 +696,7 @@ int line_polyhedron_intersect(double line_t, Coords line_p, Coords line_v,
 	}
 
 	//first find all the potential intersects that happens immediately or in the future.
-	LinePolyhedronIntersect *lpi = &(a->lpi);
+	//intersects are kept in the arrays above, not in the polyhedron, so that threads can share it.
 	for (i = 0; i < a->nf; i++) { 
 		
 		//if num_intersect > number of polyhedron faces, something's wrong.
@@ -710,6 +727,10 @@ int line_polyhedron_intersect(double line_t, Coords line_p, Coords line_v,
 		if (lp_dt < 0) {
 			continue;
 		}
+		//if intersect is outside the slab, it is not on polyhedron, skip to next plane.
+		if (lp_dt < t_slab_in || lp_dt > t_slab_out) {
+			continue;
+		}
 		lp_t = line_t + lp_dt;
 		lp_p = coords_add(line_p, lp_dp); 
 		
@@ -736,15 +757,15 @@ int line_polyhedron_intersect(double line_t, Coords line_p, Coords line_v,
 		if (n_intersect_found > 1) {
 			skip = 0;
 			for (j = 0; j < n_intersect_found; j++) {
-				if (fabs((lpi->a_lp_t)[j] - lp_t) < DBL_EPSILON && 
-					fabs((lpi->a_lp_p)[j].x - lp_p.x) < DBL_EPSILON && 
-					fabs((lpi->a_lp_p)[j].y - lp_p.y) < DBL_EPSILON && 
-					fabs((lpi->a_lp_p)[j].z - lp_p.z) < DBL_EPSILON &&
-					((lpi->a_lp_pn)[j] == i || is_crossing_plane == 0) &&
-					fabs((lpi->a_lp_dt)[j] - lp_dt) < DBL_EPSILON && 
-					fabs((lpi->a_lp_dp)[j].x - lp_dp.x) < DBL_EPSILON && 
-					fabs((lpi->a_lp_dp)[j].y - lp_dp.y) < DBL_EPSILON && 
-					fabs((lpi->a_lp_dp)[j].z - lp_dp.z) < DBL_EPSILON) {
+				if (fabs(time[j] - lp_t) < DBL_EPSILON && 
+					fabs(point[j].x - lp_p.x) < DBL_EPSILON && 
+					fabs(point[j].y - lp_p.y) < DBL_EPSILON && 
+					fabs(point[j].z - lp_p.z) < DBL_EPSILON &&
+					(plane_number[j] == i || is_crossing_plane == 0) &&
+					fabs(dtime[j] - lp_dt) < DBL_EPSILON && 
+					fabs(dpoint[j].x - lp_dp.x) < DBL_EPSILON && 
+					fabs(dpoint[j].y - lp_dp.y) < DBL_EPSILON && 
+					fabs(dpoint[j].z - lp_dp.z) < DBL_EPSILON) {
 					skip = 1;
 					break;
 				}
@@ -756,17 +777,17 @@ int line_polyhedron_intersect(double line_t, Coords line_p, Coords line_v,
 		
 		//intersect point is on polyhedron, at present or in the future, and not a repeat of last intersect or a duplicated intersect.
 		//store the result of point-plane intersect in the list
-		(lpi->a_lp_dt)[n_intersect_found] = lp_dt;
-		(lpi->a_lp_dp)[n_intersect_found] = lp_dp;
-		(lpi->a_lp_t)[n_intersect_found] = lp_t;
-		(lpi->a_lp_p)[n_intersect_found] = lp_p;
-		(lpi->a_lp_pn)[n_intersect_found] = i;
-		(lpi->a_lp_ty)[n_intersect_found] = 0; //should not be 0
-		if (is_crossing_plane == 1) (lpi->a_lp_ty)[n_intersect_found] = 1;
-		if (is_crossing_edge == 1) (lpi->a_lp_ty)[n_intersect_found] = 2;
-		if (is_crossing_vertex == 1) (lpi->a_lp_ty)[n_intersect_found] = 3;
-		if (is_flying_on_plane == 1) (lpi->a_lp_ty)[n_intersect_found] = 4;
-		if (is_flying_on_edge == 1) (lpi->a_lp_ty)[n_intersect_found] = 5;
+		dtime[n_intersect_found] = lp_dt;
+		dpoint[n_intersect_found] = lp_dp;
+		time[n_intersect_found] = lp_t;
+		point[n_intersect_found] = lp_p;
+		plane_number[n_intersect_found] = i;
+		type[n_intersect_found] = 0; //should not be 0
+		if (is_crossing_plane == 1) type[n_intersect_found] = 1;
+		if (is_crossing_edge == 1) type[n_intersect_found] = 2;
+		if (is_crossing_vertex == 1) type[n_intersect_found] = 3;
+		if (is_flying_on_plane == 1) type[n_intersect_found] = 4;
+		if (is_flying_on_edge == 1) type[n_intersect_found] = 5;
 		++(n_intersect_found);
 	}
 	
@@ -796,31 +817,35 @@ int line_polyhedron_intersect(double line_t, Coords line_p, Coords line_v,
 	int n_output = MIN(n_intersect_found, *num_intersect);
 	
 	if (n_intersect_found == 1) {
-			if (intersect_dtime != 0) intersect_dtime[0] = (lpi->a_lp_dt)[0];
-			if (intersect_dpoint != 0) intersect_dpoint[0] = (lpi->a_lp_dp)[0];
-			if (intersect_time != 0) intersect_time[0] = (lpi->a_lp_t)[0];
-			if (intersect_point != 0) intersect_point[0] = (lpi->a_lp_p)[0];
-			if (intersect_plane != 0) intersect_plane[0] = (lpi->a_lp_pn)[0];
-			if (intersect_type != 0) intersect_type[0] = (lpi->a_lp_ty)[0]; 
+			if (intersect_dtime != 0) intersect_dtime[0] = dtime[0];
+			if (intersect_dpoint != 0) intersect_dpoint[0] = dpoint[0];
+			if (intersect_time != 0) intersect_time[0] = time[0];
+			if (intersect_point != 0) intersect_point[0] = point[0];
+			if (intersect_plane != 0) intersect_plane[0] = plane_number[0];
+			if (intersect_type != 0) intersect_type[0] = type[0]; 
 	}
 	else { //n_intersect_found > 1, sort the sequence
-		PolyhedronIndexValuePair *idp = lpi->idp;
-		Coords *a_lp_dp=lpi->a_lp_dp;
-		for (i = 0; i < n_intersect_found; i++) {
-			idp[i].index = i;
-			idp[i].value = coords_len(a_lp_dp[i]);
-		}
 		//sort the intersect list according to the distance between point and intersect |dp|
-		//sort using qsort, the order of list idp is rearranged as a result
-		qsort(idp, n_intersect_found, sizeof(idp[0]), polyhedron_qsort_compare_func);
+		//insertion sort in place, there are only a few intersects
+		int lp_pn, lp_ty;
+		double lp_len;
+		for (i = 1; i < n_intersect_found; i++) {
+			lp_dt = dtime[i]; lp_dp = dpoint[i]; lp_t = time[i]; lp_p = point[i]; lp_pn = plane_number[i]; lp_ty = type[i];
+			lp_len = coords_len(lp_dp);
+			for (j = i; j > 0 && coords_len(dpoint[j-1]) > lp_len; j--) {
+				dtime[j] = dtime[j-1]; dpoint[j] = dpoint[j-1]; time[j] = time[j-1]; point[j] = point[j-1]; 
+				plane_number[j] = plane_number[j-1]; type[j] = type[j-1];
+			}
+			dtime[j] = lp_dt; dpoint[j] = lp_dp; time[j] = lp_t; point[j] = lp_p; plane_number[j] = lp_pn; type[j] = lp_ty;
+		}
 		
 		for (i = 0; i < n_output; i++) {
-			if (intersect_dtime != 0) intersect_dtime[i] = (lpi->a_lp_dt)[idp[i].index];
-			if (intersect_dpoint != 0) intersect_dpoint[i] = (lpi->a_lp_dp)[idp[i].index];
-			if (intersect_time != 0) intersect_time[i] = (lpi->a_lp_t)[idp[i].index];
-			if (intersect_point != 0) intersect_point[i] = (lpi->a_lp_p)[idp[i].index];
-			if (intersect_plane != 0) intersect_plane[i] = (lpi->a_lp_pn)[idp[i].index];
-			if (intersect_type != 0) intersect_type[i] = (lpi->a_lp_ty)[idp[i].index];
+			if (intersect_dtime != 0) intersect_dtime[i] = dtime[i];
+			if (intersect_dpoint != 0) intersect_dpoint[i] = dpoint[i];
+			if (intersect_time != 0) intersect_time[i] = time[i];
+			if (intersect_point != 0) intersect_point[i] = point[i];
+			if (intersect_plane != 0) intersect_plane[i] = plane_number[i];
+			if (intersect_type != 0) intersect_type[i] = type[i];
 		} 
 	}
 	
@@ -837,6 +862,37 @@ int line_polyhedron_intersect(double line_t, Coords line_p, Coords line_v,
   return 1;
 }
 
+/**********************************************************************************************************/
+/* entry and exit time of a line through a polyhedron, faces moved outwards by margin [m]                 */
+/* branch free slab test over the faces, no sorting, safe to call from several threads                    */
+/* returns 1 if the line passes through the polyhedron, 0 if not                                          */
+/* t_in, t_out [s] may be negative, t_in < 0 <= t_out for a point inside                                  */
+/* plane_in, plane_out: faces of entry and exit, pass 0 if not needed                                     */
+/**********************************************************************************************************/
+int line_polyhedron_slab_intersect(Coords line_p, Coords line_v, Polyhedron *polyhedron, double margin, 
+		double *t_in, double *t_out, int *plane_in, int *plane_out) 
+{
+	return polyhedron_slab_intersect(&(polyhedron->slab), line_p.x, line_p.y, line_p.z, line_v.x, line_v.y, line_v.z, 
+										margin, t_in, t_out, plane_in, plane_out);
+}
+
+/**********************************************************************************/
+/* Rebuild the slab test faces from fn, fp after they have been changed directly. */
+/* form, rotate and translate functions below call it.                            */
+/* returns 1 = no error, 0 = error                                                */
+/**********************************************************************************/
+int update_polyhedron_slab(Polyhedron*polyGeo) {
+	Polyhedron*a = polyGeo;
+	int i;
+	if (a->nf <= 0 || a->slab.nf != a->nf) {
+		return 0;
+	}
+	for (i = 0; i < a->nf; i++) {
+		polyhedron_slab_set_face(&(a->slab), i, a->fn[i].x, a->fn[i].y, a->fn[i].z, a->fp[i].x, a->fp[i].y, a->fp[i].z);
+	}
+	return 1;
+}
+
 /*****************************************************/
 /* Rotate a polyhedron by applying a rotation matrix */
 /* returns 1 = no error, 0 = error                   */
@@ -861,6 +917,7 @@ int rotate_polyhedron (Polyhedron*polyGeo, Rotation rot) {
 	}
 
 	*(polyGeo) = geo; //copy back from geo to polyGeo
+	update_polyhedron_slab(polyGeo);
 	
 	return 1;
 }
@@ -907,6 +964,7 @@ int rotate_polyhedron_about_axis (Polyhedron*polyGeo, Coords axis, double angle,
 		}
 	
 	*(polyGeo) = geo; //copy back from geo to polyGeo
+	update_polyhedron_slab(polyGeo);
 	
 	return 1;
 }
@@ -931,6 +989,7 @@ int translate_polyhedron (Polyhedron*polyGeo, Coords displace) {
 		}
 	
 	*(polyGeo) = geo; //copy back from geo to polyGeo
+	update_polyhedron_slab(polyGeo);
 	
 	return 1;
 } 
@@ -962,6 +1021,7 @@ void empty_polyhedron(Polyhedron*polyGeo){
 			free(a->lpi.a_lp_pn);
 			free(a->lpi.a_lp_ty);
 			free(a->lpi.idp);
+			polyhedron_slab_free(&(a->slab));
 			a->nf = 0;
 		}
 		if (a->nv > 0) {
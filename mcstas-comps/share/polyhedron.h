@@ -17,6 +17,9 @@
 * Initial formation much have point (0,0,0) on or inside the polyhedron.
 * Calculates the intersects of neutron flight path through the polyhedron
 * Such a geometry has up to two intersects.
+* The faces are also kept as a structure of arrays for a branch free slab test,
+* see polyhedron_slab-lib; line_polyhedron_intersect uses it to skip lines that
+* miss the polyhedron and planes that are crossed outside of it.
 * 
 * The number of faces are limited to 50, otherwise the program crashes
 *
@@ -50,6 +53,10 @@
 #ifndef POLYHEDRON_H
 #define POLYHEDRON_H
 
+#ifndef POLYHEDRON_SLAB_LIB_H
+%include "polyhedron_slab-lib"
+#endif
+
 typedef struct PolyhedronIndexValuePair {
 	int index;
 	double value;
@@ -82,6 +89,8 @@ typedef struct Polyhedron{
 	
 	LinePolyhedronIntersect lpi; //LinePolyhedronIntersect
 
+	PolyhedronSlab slab; //faces as structure of arrays for the slab test, kept up to date with fn, fp
+
 } Polyhedron; 
 
 //plane normal designation, before rotation of polyhedron
@@ -174,6 +183,23 @@ int line_polyhedron_intersect(double line_t, Coords line_p, Coords line_v,
 		double last_intersect_time, Coords last_intersect_point, int last_intersect_plane, 
 		int*num_intersect, double*intersect_dtime, Coords*intersect_dpoint, double*intersect_time, Coords*intersect_point, int*intersect_plane, int*intersect_type);
 
+/**********************************************************************************************************/
+/* entry and exit time of a line through a polyhedron, faces moved outwards by margin [m]                 */
+/* branch free slab test over the faces, no sorting, safe to call from several threads                    */
+/* returns 1 if the line passes through the polyhedron, 0 if not                                          */
+/* t_in, t_out [s] may be negative, t_in < 0 <= t_out for a point inside                                  */
+/* plane_in, plane_out: faces of entry and exit, pass 0 if not needed                                     */
+/**********************************************************************************************************/
+int line_polyhedron_slab_intersect(Coords line_p, Coords line_v, Polyhedron *polyhedron, double margin, 
+		double *t_in, double *t_out, int *plane_in, int *plane_out);
+
+/**********************************************************************************/
+/* Rebuild the slab test faces from fn, fp after they have been changed directly. */
+/* form, rotate and translate functions below call it.                            */
+/* returns 1 = no error, 0 = error                                                */
+/**********************************************************************************/
+int update_polyhedron_slab(Polyhedron*polyhedron);
+
 /****************************************************************************/
 /* Rotate a polyhedron about a rotate axis by an angle, right hand rule     */
 /* pass a Rotation pointer to receive the rotation matrix, 0 if not needed. */
@@ -0,0 +1,137 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/polyhedron_slab-lib.c
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Slab test for a closed convex polyhedron, see polyhedron_slab-lib.h.
+*
+* Usage: within SHARE
+* %include "polyhedron_slab-lib"
+*
+*******************************************************************************/
+
+#ifndef POLYHEDRON_SLAB_LIB_H
+#error McStas : please import this library with %include "polyhedron_slab-lib"
+#endif
+
+int polyhedron_slab_alloc(PolyhedronSlab *slab, int nf)
+{
+	//one block for all arrays, nx is its start
+	double *block;
+	memset(slab, 0, sizeof(PolyhedronSlab));
+	if (nf <= 0) return 0;
+	block = (double*)calloc(4*nf, sizeof(double));
+	if (!block) {
+		printf("polyhedron_slab_alloc: Cannot allocate %i faces.\n", nf);
+		return 0;
+	}
+	slab->nf = nf;
+	slab->nx = block;
+	slab->ny = block + nf;
+	slab->nz = block + 2*nf;
+	slab->d  = block + 3*nf;
+	return 1;
+}
+
+void polyhedron_slab_free(PolyhedronSlab *slab)
+{
+	if (slab->nx) free(slab->nx);
+	memset(slab, 0, sizeof(PolyhedronSlab));
+}
+
+void polyhedron_slab_set_face(PolyhedronSlab *slab, int i, double nx, double ny, double nz, double px, double py, double pz)
+{
+	slab->nx[i] = nx;
+	slab->ny[i] = ny;
+	slab->nz[i] = nz;
+	slab->d[i] = nx*px + ny*py + nz*pz;
+}
+
+int polyhedron_slab_intersect(const PolyhedronSlab *slab, double px, double py, double pz, double vx, double vy, double vz,
+	double margin, double *t_in, double *t_out, int *plane_in, int *plane_out)
+/******************************************************************************************************************************
+Entry and exit time of the line p + v t through the polyhedron with every face moved outwards by margin [m].
+Returns 1 if t_in <= t_out, i.e. the line passes through the polyhedron, 0 if it misses. Either time may be negative:
+t_in < 0 <= t_out for a point inside. A line parallel to a face and outside of it gets t_in = DBL_MAX, t_out = -DBL_MAX.
+plane_in and plane_out receive the faces of t_in and t_out, pass 0 if not used, they cost a second, scalar, loop.
+********************************************************************************************************************************/
+{
+	int i, nf = slab->nf;
+	const double *nx = slab->nx, *ny = slab->ny, *nz = slab->nz, *d = slab->d;
+	double t0 = -DBL_MAX, t1 = DBL_MAX;
+
+	if (plane_in || plane_out) {
+		int i0 = -1, i1 = -1;
+		for (i = 0; i < nf; i++) {
+			double dist = d[i] + margin - (nx[i]*px + ny[i]*py + nz[i]*pz);
+			double den = nx[i]*vx + ny[i]*vy + nz[i]*vz;
+			if (den < 0) {
+				if (dist/den > t0) { t0 = dist/den; i0 = i; }
+			}
+			else if (den > 0) {
+				if (dist/den < t1) { t1 = dist/den; i1 = i; }
+			}
+			else if (dist < 0) {
+				t0 = DBL_MAX; i0 = i;
+				t1 = -DBL_MAX; i1 = i;
+				break;
+			}
+		}
+		if (plane_in) *plane_in = i0;
+		if (plane_out) *plane_out = i1;
+	}
+	else {
+		#pragma omp simd reduction(max:t0) reduction(min:t1)
+		for (i = 0; i < nf; i++) {
+			double dist = d[i] + margin - (nx[i]*px + ny[i]*py + nz[i]*pz); //>= 0 on the inner side of the face
+			double den = nx[i]*vx + ny[i]*vy + nz[i]*vz;
+			double t = dist/(den != 0 ? den : 1);
+			int outside = den == 0 && dist < 0; //parallel to the face and outside of it
+			double ti = den < 0 ? t : (outside ? DBL_MAX : -DBL_MAX);
+			double to = den > 0 ? t : (outside ? -DBL_MAX : DBL_MAX);
+			t0 = ti > t0 ? ti : t0;
+			t1 = to < t1 ? to : t1;
+		}
+	}
+	if (t_in) *t_in = t0;
+	if (t_out) *t_out = t1;
+	return t0 <= t1;
+}
+
+double polyhedron_slab_distance(const PolyhedronSlab *slab, double px, double py, double pz, int *plane)
+/******************************************************************************************************************************
+Largest signed distance n.p - d of a point to the faces: <= 0 inside or on the polyhedron, > 0 outside.
+plane receives the face of the largest distance, pass 0 if not used.
+********************************************************************************************************************************/
+{
+	int i, nf = slab->nf;
+	const double *nx = slab->nx, *ny = slab->ny, *nz = slab->nz, *d = slab->d;
+	double dd = -DBL_MAX;
+
+	if (plane) {
+		*plane = -1;
+		for (i = 0; i < nf; i++) {
+			double di = nx[i]*px + ny[i]*py + nz[i]*pz - d[i];
+			if (di > dd) { dd = di; *plane = i; }
+		}
+		return dd;
+	}
+	#pragma omp simd reduction(max:dd)
+	for (i = 0; i < nf; i++) {
+		double di = nx[i]*px + ny[i]*py + nz[i]*pz - d[i];
+		dd = di > dd ? di : dd;
+	}
+	return dd;
+}
+
+/* end of polyhedron_slab-lib.c */
@@ -0,0 +1,54 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/polyhedron_slab-lib.h
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Slab test for a closed convex polyhedron. The faces are kept as a structure
+* of arrays of outward unit normals and plane offsets d = n.face_point, so a
+* point x is inside when n.x <= d for every face. Each face bounds the time
+* a line spends inside from below (n.v < 0) or from above (n.v > 0), and
+* the entry and exit times are the largest lower and smallest upper bound.
+* The face loops are branch free and vectorised with -fopenmp-simd, no
+* sorting or scratch memory is needed, and a PolyhedronSlab is only read
+* after it has been filled, so it can be shared by threads.
+*
+* Usage: within SHARE
+* %include "polyhedron_slab-lib"
+*
+*******************************************************************************/
+
+#ifndef POLYHEDRON_SLAB_LIB_H
+#define POLYHEDRON_SLAB_LIB_H "$Revision$"
+
+//distance in [m] added to the polyhedron faces by users of the slab test that
+//must not drop an intersect found by the per-face calculation of polyhedron.c
+#define POLYHEDRON_SLAB_MARGIN 1e-9
+
+typedef struct PolyhedronSlab {
+	int nf; //number of faces
+	double *nx; //outward unit face normal
+	double *ny;
+	double *nz;
+	double *d; //n . face point
+} PolyhedronSlab;
+
+	int  polyhedron_slab_alloc(PolyhedronSlab *slab, int nf);
+	void polyhedron_slab_free(PolyhedronSlab *slab);
+	void polyhedron_slab_set_face(PolyhedronSlab *slab, int i, double nx, double ny, double nz, double px, double py, double pz);
+	int  polyhedron_slab_intersect(const PolyhedronSlab *slab, double px, double py, double pz, double vx, double vy, double vz,
+		double margin, double *t_in, double *t_out, int *plane_in, int *plane_out);
+	double polyhedron_slab_distance(const PolyhedronSlab *slab, double px, double py, double pz, int *plane);
+
+#endif
+
+/* end of polyhedron_slab-lib.h */
@@ -0,0 +1,284 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/refl_grid-lib.c
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Uniform grid over reciprocal lattice points, see refl_grid-lib.h. The
+* reflection test is the one of Single_crystal hkl_search, with the same
+* arithmetic, so the grid only changes which reflections are visited.
+*
+* Usage: within SHARE
+* %include "refl_grid-lib"
+*
+*******************************************************************************/
+
+#ifndef REFL_GRID_LIB_H
+#error McStas : please import this library with %include "refl_grid-lib"
+#endif
+
+/* element i of a strided array of doubles, stride in bytes */
+#define REFL_GRID_AT(p, i, stride) (*(double*)((char*)(p) + (size_t)(i)*(stride)))
+
+int refl_grid_cell(double c, double lo, double h, int n) {
+  double f = floor((c - lo)/h);
+  if (f < 0) return 0;
+  if (f > n - 1) return n - 1;
+  return (int)f;
+}
+
+/* distance from c to the slab [x0, x0+h], nearest and farthest */
+void refl_grid_slab_dist(double c, double x0, double h, double *d_min, double *d_max) {
+  double x1 = x0 + h;
+  double d0 = fabs(c - x0), d1 = fabs(c - x1);
+  *d_min = c < x0 ? d0 : (c > x1 ? d1 : 0);
+  *d_max = d0 > d1 ? d0 : d1;
+}
+
+int refl_grid_build(refl_grid *grid, int n, double *tau_x, double *tau_y, double *tau_z,
+    double *tau, double *cutoff, int stride)
+{
+  double lo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL }, hi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+  double *p[3] = { tau_x, tau_y, tau_z };
+  double ext[3], ext_max = 0, vol = 1;
+  int *cell, *fill;
+  int i, k, ncells;
+
+  memset(grid, 0, sizeof(refl_grid));
+  if (n <= 0) return 0;
+
+  for (i = 0; i < n; i++) {
+    for (k = 0; k < 3; k++) {
+      double c = REFL_GRID_AT(p[k], i, stride);
+      if (c < lo[k]) lo[k] = c;
+      if (c > hi[k]) hi[k] = c;
+    }
+    if (REFL_GRID_AT(cutoff, i, stride) > grid->max_cutoff)
+      grid->max_cutoff = REFL_GRID_AT(cutoff, i, stride);
+  }
+
+  // cell size for REFL_GRID_PER_CELL reflections per cell, flat lattices are given some depth
+  for (k = 0; k < 3; k++) {
+    ext[k] = hi[k] - lo[k];
+    if (ext[k] > ext_max) ext_max = ext[k];
+  }
+  if (ext_max <= 0) ext_max = 1;
+  for (k = 0; k < 3; k++)
+    vol *= ext[k] > ext_max/REFL_GRID_MAX_DIM ? ext[k] : ext_max/REFL_GRID_MAX_DIM;
+  grid->h = cbrt(vol*REFL_GRID_PER_CELL/n);
+  if (ext_max/grid->h > REFL_GRID_MAX_DIM - 1)
+    grid->h = ext_max/(REFL_GRID_MAX_DIM - 1);
+
+  grid->n  = n;
+  grid->nx = (int)(ext[0]/grid->h) + 1;
+  grid->ny = (int)(ext[1]/grid->h) + 1;
+  grid->nz = (int)(ext[2]/grid->h) + 1;
+  grid->lo_x = lo[0]; grid->lo_y = lo[1]; grid->lo_z = lo[2];
+  ncells = grid->nx*grid->ny*grid->nz;
+
+  grid->cell_start = (int*) calloc(ncells + 1, sizeof(int));
+  grid->items = (refl_grid_item*) malloc(n*sizeof(refl_grid_item));
+  cell = (int*) malloc(n*sizeof(int));
+  fill = (int*) malloc(ncells*sizeof(int));
+  if (!grid->cell_start || !grid->items || !cell || !fill) {
+    free(cell); free(fill);
+    refl_grid_free(grid);
+    return 0;
+  }
+
+  // counting sort of the reflections into cells, keeping list order within a cell
+  for (i = 0; i < n; i++) {
+    int ix = refl_grid_cell(REFL_GRID_AT(tau_x, i, stride), grid->lo_x, grid->h, grid->nx);
+    int iy = refl_grid_cell(REFL_GRID_AT(tau_y, i, stride), grid->lo_y, grid->h, grid->ny);
+    int iz = refl_grid_cell(REFL_GRID_AT(tau_z, i, stride), grid->lo_z, grid->h, grid->nz);
+    cell[i] = (ix*grid->ny + iy)*grid->nz + iz;
+    grid->cell_start[cell[i] + 1]++;
+  }
+  for (k = 0; k < ncells; k++) {
+    grid->cell_start[k + 1] += grid->cell_start[k];
+    fill[k] = grid->cell_start[k];
+  }
+  for (i = 0; i < n; i++) {
+    refl_grid_item *it = &grid->items[fill[cell[i]]++];
+    it->tau_x  = REFL_GRID_AT(tau_x, i, stride);
+    it->tau_y  = REFL_GRID_AT(tau_y, i, stride);
+    it->tau_z  = REFL_GRID_AT(tau_z, i, stride);
+    it->tau    = REFL_GRID_AT(tau, i, stride);
+    it->cutoff = REFL_GRID_AT(cutoff, i, stride);
+    it->index  = i;
+  }
+  free(cell);
+  free(fill);
+  return 1;
+}
+
+void refl_grid_free(refl_grid *grid) {
+  free(grid->cell_start);
+  free(grid->items);
+  memset(grid, 0, sizeof(refl_grid));
+}
+
+void refl_grid_sift(int *heap, int n, int m) {
+  int top = heap[m];
+  while (2*m + 1 < n) {
+    int c = 2*m + 1;
+    if (c + 1 < n && heap[c + 1] > heap[c]) c++;
+    if (heap[c] <= top) break;
+    heap[m] = heap[c];
+    m = c;
+  }
+  heap[m] = top;
+}
+
+/* keep the max_index smallest list indices, as a max-heap once full */
+int refl_grid_keep(int *index, int count, int max_index, int i) {
+  int m;
+  if (count < max_index) {
+    index[count++] = i;
+    if (count == max_index)
+      for (m = count/2 - 1; m >= 0; m--) refl_grid_sift(index, count, m);
+  } else if (i < index[0]) {
+    index[0] = i;
+    refl_grid_sift(index, count, 0);
+  }
+  return count;
+}
+
+int refl_grid_compare_index(const void *a, const void *b) {
+  return *(const int*)a - *(const int*)b;
+}
+
+/* visit the cells iz0..iz1 of column (ix, iy), keep the max_index smallest list indices that pass
+   with t_lo < tau <= t_hi. Cells within t_lo of the origin were searched by an earlier band. */
+int refl_grid_visit(refl_grid *grid, int ix, int iy, int iz0, int iz1, double d2_xy,
+    double kix, double kiy, double kiz, double ki, double t_lo, double t_hi,
+    int *index, int count, int max_index)
+{
+  int c = (ix*grid->ny + iy)*grid->nz;
+  int iz, k;
+  for (iz = iz0; iz <= iz1; iz++) {
+    double dz_min, dz_max;
+    refl_grid_slab_dist(0, grid->lo_z + iz*grid->h, grid->h, &dz_min, &dz_max);
+    if (t_lo > 0 && d2_xy + dz_max*dz_max < t_lo*t_lo)
+      continue;
+    for (k = grid->cell_start[c + iz]; k < grid->cell_start[c + iz + 1]; k++) {
+      refl_grid_item *it = &grid->items[k];
+      double rho_x, rho_y, rho_z, rho;
+      int i = it->index;
+      /* cells keep list order, the rest of this one can not make the short list */
+      if (count == max_index && i > index[0])
+        break;
+      if (it->tau > t_hi || it->tau <= t_lo)
+        continue;
+      /* Same test as hkl_search */
+      rho_x = kix - it->tau_x;
+      rho_y = kiy - it->tau_y;
+      rho_z = kiz - it->tau_z;
+      rho = sqrt(rho_x*rho_x + rho_y*rho_y + rho_z*rho_z);
+      if (fabs(rho - ki) > it->cutoff)
+        continue;
+      count = refl_grid_keep(index, count, max_index, i);
+    }
+  }
+  return count;
+}
+
+/* the reflections with t_lo < tau <= t_hi in the Ewald shell of ki, see refl_grid_search */
+int refl_grid_band(refl_grid *grid, double kix, double kiy, double kiz, double ki, double t_lo, double t_hi,
+    int *index, int max_index)
+{
+  double pad = grid->h*1e-6;
+  double r_hi = ki + grid->max_cutoff + pad;
+  double r_lo = ki - grid->max_cutoff - pad;
+  double r_hi2 = r_hi*r_hi;
+  double r_lo2 = r_lo > 0 ? r_lo*r_lo : 0;
+  double bound = t_hi + pad;
+  double h = grid->h;
+  int count = 0;
+  int ix, iy, ix0, ix1;
+
+  // columns within the outer sphere of the shell, and within t_hi of the origin
+  ix0 = refl_grid_cell(kix - r_hi > -bound ? kix - r_hi : -bound, grid->lo_x, h, grid->nx);
+  ix1 = refl_grid_cell(kix + r_hi <  bound ? kix + r_hi :  bound, grid->lo_x, h, grid->nx);
+  for (ix = ix0; ix <= ix1; ix++) {
+    double dx_min, dx_max, ox_min, ox_max, ry;
+    int iy0, iy1;
+    refl_grid_slab_dist(kix, grid->lo_x + ix*h, h, &dx_min, &dx_max);
+    if (dx_min*dx_min > r_hi2)
+      continue;
+    refl_grid_slab_dist(0, grid->lo_x + ix*h, h, &ox_min, &ox_max);
+    ry = sqrt(r_hi2 - dx_min*dx_min);
+    iy0 = refl_grid_cell(kiy - ry > -bound ? kiy - ry : -bound, grid->lo_y, h, grid->ny);
+    iy1 = refl_grid_cell(kiy + ry <  bound ? kiy + ry :  bound, grid->lo_y, h, grid->ny);
+    for (iy = iy0; iy <= iy1; iy++) {
+      double dy_min, dy_max, oy_min, oy_max, d2_min, d2_max, a, b;
+      int za0, za1, zb0, zb1;
+      refl_grid_slab_dist(kiy, grid->lo_y + iy*h, h, &dy_min, &dy_max);
+      d2_min = dx_min*dx_min + dy_min*dy_min;
+      if (d2_min > r_hi2)
+        continue;
+      refl_grid_slab_dist(0, grid->lo_y + iy*h, h, &oy_min, &oy_max);
+      if (ox_min*ox_min + oy_min*oy_min > bound*bound)
+        continue;
+      d2_max = dx_max*dx_max + dy_max*dy_max;
+      // the shell cuts the column in [kiz-a, kiz-b] and [kiz+b, kiz+a], one interval when b = 0
+      a = sqrt(r_hi2 - d2_min);
+      b = r_lo2 > d2_max ? sqrt(r_lo2 - d2_max) : 0;
+      za0 = refl_grid_cell(kiz - a > -bound ? kiz - a : -bound, grid->lo_z, h, grid->nz);
+      za1 = refl_grid_cell(kiz - b, grid->lo_z, h, grid->nz);
+      zb0 = refl_grid_cell(kiz + b, grid->lo_z, h, grid->nz);
+      zb1 = refl_grid_cell(kiz + a <  bound ? kiz + a :  bound, grid->lo_z, h, grid->nz);
+      if (kiz - b < -bound) za1 = za0 - 1;
+      if (kiz + b >  bound) zb0 = zb1 + 1;
+      if (za1 >= zb0 - 1) {
+        za1 = zb1;
+        zb0 = zb1 + 1;
+      }
+      if (za0 <= za1)
+        count = refl_grid_visit(grid, ix, iy, za0, za1, ox_max*ox_max + oy_max*oy_max,
+          kix, kiy, kiz, ki, t_lo, t_hi, index, count, max_index);
+      if (zb0 <= zb1)
+        count = refl_grid_visit(grid, ix, iy, zb0, zb1, ox_max*ox_max + oy_max*oy_max,
+          kix, kiy, kiz, ki, t_lo, t_hi, index, count, max_index);
+    }
+  }
+  qsort(index, count, sizeof(int), refl_grid_compare_index);
+  return count;
+}
+
+/* refl_grid_search
+  the reflections with tau <= tau_max whose Gaussian reaches the Ewald sphere of ki,
+  written to index[] by increasing list position, at most max_index of them (the first ones)
+  returns the number written
+  The list is sorted by tau, so the search runs in growing tau bands and stops
+  once the short list is full, as the list scan does.
+ */
+int refl_grid_search(refl_grid *grid, double kix, double kiy, double kiz, double tau_max,
+    int *index, int max_index)
+{
+  double ki = sqrt(kix*kix+kiy*kiy+kiz*kiz);
+  double t_lo = -1, t_hi = tau_max/REFL_GRID_BANDS;
+  int count = 0;
+
+  if (!grid->n || max_index <= 0) return 0;
+
+  while (count < max_index) {
+    if (t_hi > tau_max) t_hi = tau_max;
+    count += refl_grid_band(grid, kix, kiy, kiz, ki, t_lo, t_hi, index + count, max_index - count);
+    if (t_hi >= tau_max) break;
+    t_lo = t_hi;
+    t_hi *= 2;
+  }
+  return count;
+}
+
+/* end of refl_grid-lib.c */
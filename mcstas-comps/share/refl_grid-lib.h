@@ -0,0 +1,63 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/refl_grid-lib.h
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Uniform grid over the reciprocal lattice points of a reflection list, built
+* once at initialize. A search visits only the grid columns and cells that
+* cut the Ewald shell of the incoming ki, and returns the same reflections,
+* in the same order, as a scan of the list sorted by increasing tau.
+* The grid is read only after refl_grid_build; search scratch is on the
+* caller's stack, so concurrent searches of one grid are safe.
+*
+* Usage: within SHARE
+* %include "refl_grid-lib"
+*
+*******************************************************************************/
+
+#ifndef REFL_GRID_LIB_H
+
+#define REFL_GRID_LIB_H "$Revision$"
+#define REFL_GRID_PER_CELL 16    /* target reflections per cell */
+#define REFL_GRID_MAX_DIM  256   /* max cells along an axis */
+#define REFL_GRID_BANDS    4     /* first tau band of a search is tau_max/REFL_GRID_BANDS */
+
+  /* one reflection, the fields the search reads together */
+  typedef struct refl_grid_item
+  {
+    double tau_x, tau_y, tau_z;
+    double tau;
+    double cutoff;
+    int    index;                /* position in the sorted reflection list */
+  } refl_grid_item;
+
+  typedef struct refl_grid
+  {
+    int    n;                    /* reflections, 0 when no grid is built */
+    int    nx, ny, nz;
+    double lo_x, lo_y, lo_z;     /* grid origin (1/AA) */
+    double h;                    /* cell size (1/AA) */
+    double max_cutoff;           /* largest Gaussian cutoff in the list */
+    int    *cell_start;          /* nx*ny*nz+1 offsets into the arrays below */
+    refl_grid_item *items;       /* reflections in cell order */
+  } refl_grid;
+
+  int  refl_grid_build(refl_grid *grid, int n, double *tau_x, double *tau_y, double *tau_z,
+         double *tau, double *cutoff, int stride);
+  void refl_grid_free(refl_grid *grid);
+  int  refl_grid_search(refl_grid *grid, double kix, double kiy, double kiz, double tau_max,
+         int *index, int max_index);
+
+#endif
+
+/* end of refl_grid-lib.h */
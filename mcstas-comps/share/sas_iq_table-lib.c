@@ -0,0 +1,179 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/sas_iq_table-lib.c
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Tabulated I(q) for the isotropic SasView models, see sas_iq_table-lib.h.
+*
+* Usage: within SHARE
+* %include "sas_iq_table-lib"
+*
+*******************************************************************************/
+
+#ifndef SAS_IQ_TABLE_LIB_H
+#error McStas : please import this library with %include "sas_iq_table-lib"
+#endif
+
+/* set the pending batch to the n values q = exp(lq + i*dlq) */
+void sas_iq_table_batch(sas_iq_table *table, double lq, double dlq, long n) {
+  long i;
+  for (i = 0; i < n; i++)
+    table->pending_q[i] = exp(lq + i*dlq);
+  table->pending_n = n;
+}
+
+int sas_iq_table_init(sas_iq_table *table, double q_min, double q_max, double tol)
+{
+  memset(table, 0, sizeof(sas_iq_table));
+  if (q_min <= 0 || q_max <= q_min) return 0;
+
+  table->q_min   = q_min;
+  table->q_max   = q_max;
+  table->tol     = tol > 0 ? tol : 1e-3;
+  table->lq_min  = log(q_min);
+  table->lq_step = (log(q_max) - table->lq_min)/(SAS_IQ_TABLE_N0 - 1);
+  table->pending_q  = (double*)malloc(SAS_IQ_TABLE_N0*sizeof(double));
+  table->pending_iq = (double*)malloc(SAS_IQ_TABLE_N0*sizeof(double));
+  if (!table->pending_q || !table->pending_iq) {
+    printf("sas_iq_table: Cannot allocate I(q) table (%li bytes).\n",
+      (long)(2*SAS_IQ_TABLE_N0*sizeof(double)));
+    sas_iq_table_free(table);
+    return 0;
+  }
+  /* the first batch is the whole first grid */
+  sas_iq_table_batch(table, table->lq_min, table->lq_step, SAS_IQ_TABLE_N0);
+  table->pending_q[SAS_IQ_TABLE_N0 - 1] = q_max;
+  return 1;
+}
+
+long sas_iq_table_pending(sas_iq_table *table, double **q, double **iq)
+{
+  *q  = table->pending_q;
+  *iq = table->pending_iq;
+  return table->pending_n;
+}
+
+void sas_iq_table_update(sas_iq_table *table)
+{
+  double *iq, iq_max = 0, err = 0;
+  long i, n;
+
+  if (!table->pending_n) return;
+
+  if (!table->iq) {
+    /* first grid: keep it and ask for its midpoints */
+    table->iq = table->pending_iq;
+    table->n  = table->pending_n;
+    table->pending_iq = (double*)malloc((table->n - 1)*sizeof(double));
+    if (!table->pending_iq) { sas_iq_table_free(table); return; }
+    sas_iq_table_batch(table, table->lq_min + table->lq_step/2, table->lq_step, table->n - 1);
+    return;
+  }
+
+  /* error of the linear interpolation at the new midpoints */
+  for (i = 0; i < table->n; i++)
+    if (fabs(table->iq[i]) > iq_max) iq_max = fabs(table->iq[i]);
+  for (i = 0; i < table->pending_n; i++) {
+    double mid = table->pending_iq[i];
+    double d   = fabs(mid - 0.5*(table->iq[i] + table->iq[i+1]));
+    if (d > 0) {
+      d /= fabs(mid) + SAS_IQ_TABLE_FLOOR*iq_max;
+      if (d > err) err = d;
+    }
+  }
+  table->err = err;
+
+  /* merge the midpoints, which halves the grid step */
+  n  = 2*table->n - 1;
+  iq = (double*)malloc(n*sizeof(double));
+  if (!iq) {
+    /* keep the current grid */
+    table->pending_n = 0;
+    return;
+  }
+  for (i = 0; i < table->n; i++) {
+    iq[2*i] = table->iq[i];
+    if (i < table->pending_n) iq[2*i+1] = table->pending_iq[i];
+  }
+  free(table->iq);
+  table->iq = iq;
+  table->n  = n;
+  table->lq_step /= 2;
+
+  free(table->pending_q);
+  free(table->pending_iq);
+  table->pending_q = table->pending_iq = NULL;
+  table->pending_n = 0;
+  if (err <= table->tol || 2*n - 1 > SAS_IQ_TABLE_NMAX) return;
+
+  /* next batch: the midpoints of the merged grid */
+  table->pending_q  = (double*)malloc((n - 1)*sizeof(double));
+  table->pending_iq = (double*)malloc((n - 1)*sizeof(double));
+  if (!table->pending_q || !table->pending_iq) {
+    free(table->pending_q);
+    free(table->pending_iq);
+    table->pending_q = table->pending_iq = NULL;
+    return;
+  }
+  sas_iq_table_batch(table, table->lq_min + table->lq_step/2, table->lq_step, n - 1);
+}
+
+void sas_iq_table_free(sas_iq_table *table) {
+  if (table->iq)         free(table->iq);
+  if (table->pending_q)  free(table->pending_q);
+  if (table->pending_iq) free(table->pending_iq);
+  memset(table, 0, sizeof(sas_iq_table));
+}
+
+/* sas_iq_table_lookup
+  interpolated I(q), returns 0 when q is out of the table or the table is not built
+ */
+#pragma acc routine seq
+int sas_iq_table_lookup(sas_iq_table *table, double q, double *iq)
+{
+  double x;
+  long   i;
+  if (!table->n || table->pending_n || q < table->q_min || q > table->q_max) return 0;
+  x = (log(q) - table->lq_min)/table->lq_step;
+  i = (long)x;
+  if (i < 0) i = 0;
+  if (i > table->n - 2) i = table->n - 2;
+  x -= i;
+  *iq = table->iq[i] + x*(table->iq[i+1] - table->iq[i]);
+  return 1;
+}
+
+/* sas_iq_table_pd_nodes
+  size scale factors and weights of a Gaussian distribution of relative width pd,
+  over +/- 3 sigma. n_pd is the number of polydisperse parameters averaged
+  together, which lowers the nodes per parameter. Returns the number of nodes,
+  at most SAS_IQ_TABLE_PD_N, and 1 for a monodisperse parameter.
+ */
+int sas_iq_table_pd_nodes(double pd, int n_pd, double *scale, double *weight)
+{
+  int i, n;
+  double sum = 0;
+
+  if (!pd) { scale[0] = weight[0] = 1; return 1; }
+  n = n_pd <= 1 ? SAS_IQ_TABLE_PD_N : (n_pd == 2 ? 15 : (n_pd == 3 ? 7 : 5));
+  for (i = 0; i < n; i++) {
+    double x = -3 + 6.0*i/(n - 1);
+    scale[i]  = 1 + x*pd;
+    weight[i] = exp(-0.5*x*x);
+    sum += weight[i];
+  }
+  for (i = 0; i < n; i++) weight[i] /= sum;
+  return n;
+}
+
+/* end of sas_iq_table-lib.c */
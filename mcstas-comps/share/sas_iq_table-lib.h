@@ -0,0 +1,73 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/sas_iq_table-lib.h
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Tabulated I(q) for the isotropic SasView models, built at initialize and
+* linearly interpolated in trace. The table is uniform in log(q) over
+* [q_min, q_max]. Its grid is doubled until linear interpolation at every new
+* midpoint is within the relative tolerance tol, with an absolute floor of
+* tol*SAS_IQ_TABLE_FLOOR of the largest value, or SAS_IQ_TABLE_NMAX points.
+*
+* The caller evaluates the model: sas_iq_table_pending gives the q values of
+* the next batch and where to store their I(q), sas_iq_table_update checks
+* the batch and prepares the next one. The q values of a batch are
+* independent, so they may be computed in parallel:
+*
+*   sas_iq_table_init(&t, q_min, q_max, tol);
+*   while ((n = sas_iq_table_pending(&t, &q, &iq))) {
+*     #pragma omp parallel for schedule(dynamic)
+*     for (i=0; i < n; i++) iq[i] = model(q[i]);
+*     sas_iq_table_update(&t);
+*   }
+*
+* Polydisperse models are tabulated as their average over Gaussian size
+* distributions, on the nodes given by sas_iq_table_pd_nodes.
+*
+* Usage: within SHARE
+* %include "sas_iq_table-lib"
+*
+*******************************************************************************/
+
+#ifndef SAS_IQ_TABLE_LIB_H
+
+#define SAS_IQ_TABLE_LIB_H "$Revision$"
+#define SAS_IQ_TABLE_N0    129      /* points of the first grid */
+#define SAS_IQ_TABLE_NMAX  65537    /* points of the finest grid */
+#define SAS_IQ_TABLE_FLOOR 1e-6     /* absolute tolerance, relative to the largest I(q) */
+#define SAS_IQ_TABLE_PD_N  35       /* Gaussian nodes for a single polydisperse parameter */
+
+  typedef struct sas_iq_table
+  {
+    long   n;                    /* grid points, 0 when no table is available */
+    double q_min, q_max;         /* table range (1/AA) */
+    double lq_min, lq_step;      /* log(q) grid */
+    double tol;                  /* relative interpolation tolerance */
+    double err;                  /* largest relative error at the last midpoints */
+    double *iq;                  /* I(q) on the grid */
+    long   pending_n;            /* batch for the caller to evaluate */
+    double *pending_q;
+    double *pending_iq;
+  } sas_iq_table;
+
+  int    sas_iq_table_init(sas_iq_table *table, double q_min, double q_max, double tol);
+  long   sas_iq_table_pending(sas_iq_table *table, double **q, double **iq);
+  void   sas_iq_table_update(sas_iq_table *table);
+  void   sas_iq_table_free(sas_iq_table *table);
+#pragma acc routine seq
+  int    sas_iq_table_lookup(sas_iq_table *table, double q, double *iq);
+  int    sas_iq_table_pd_nodes(double pd, int n_pd, double *scale, double *weight);
+
+#endif
+
+/* end of sas_iq_table-lib.h */
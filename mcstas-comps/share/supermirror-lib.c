@@ -41,8 +41,8 @@
 typedef struct SimState {
 	//neutron state parameters
 	int ray_count;
-	char location[CHAR_BUF_LENGTH];
-	char event[CHAR_BUF_LENGTH];
+	int location_code[3]; //side, plane, layer of the last event, as codes: the text is only built when printing the state
+	int event_code; //last event
 	double w; 
 	double t; 
 	Coords p; 
@@ -179,6 +179,7 @@ void set_process_parameters(int is_tracking, SupermirrorProcess *proc);
 void set_location_text(Supermirror*sm, char*name, int side, int plane, int layer, char*location);
 void set_location(SimState *state, Supermirror*sm);
 void set_event(SimState *state, Supermirror*sm, int event_code); 
+void set_event_text(Supermirror*sm, int event_code, char*event);
 
 /****************************/
 /* Neutron record functions */
@@ -459,12 +460,16 @@ void sm_print_state(char*subheader, SimState*state, Supermirror*sm, double ws_ta
 	
 	printf("%s neutron state parameters\n", supermirror_flat_s_prefix);
 	supermirror_flat_inc_prefix(&supermirror_flat_i_prefix, supermirror_flat_s_prefix);
-		if (state->plane==I_INDETERMINED) {
+		if (state->plane==I_INDETERMINED || state->location_code[1]==I_INDETERMINED || state->event_code==I_INDETERMINED) {
 			printf("%s location/event=indetermined\n", supermirror_flat_s_prefix);
 		}
 		else {
+			char location[CHAR_BUF_LENGTH];
+			char event[CHAR_BUF_LENGTH];
+			set_location_text(sm, sm->name, state->location_code[0], state->location_code[1], state->location_code[2], location);
+			set_event_text(sm, state->event_code, event);
 			printf("%s location/event=%s/%s\n", supermirror_flat_s_prefix, 
-					state->location, state->event);
+					location, event);
 		}
 		printf("%s w, ws+,ws-,ws,ws_target = %5e, (% 5f,% 5f),% 5f,% 5f\n", supermirror_flat_s_prefix,
 				state->w, state->ws[0], state->ws[1], state->ws[0]+state->ws[1], ws_target); 
@@ -1350,10 +1355,9 @@ void set_location_text(Supermirror*sm, char*name, int side, int plane, int layer
 }
 void set_location(SimState *state, Supermirror*sm) 
 {
-
-	sprintf(state->location,"%s/%s/%s/%s",
-		sm->name, ((sm->proc).side)[state->side], ((sm->proc).plane)[state->plane], ((sm->proc).layer)[state->layer]);
-
+	state->location_code[0] = state->side;
+	state->location_code[1] = state->plane;
+	state->location_code[2] = state->layer;
 }
 
 void set_event_text(Supermirror*sm, int event_code, char*event) 
@@ -1362,7 +1366,7 @@ void set_event_text(Supermirror*sm, int event_code, char*event)
 }
 void set_event(SimState *state, Supermirror*sm, int event_code) 
 {
-	strcpy(state->event, ((sm->proc).event)[event_code]);
+	state->event_code = event_code;
 }
 	
 
@@ -1442,8 +1446,8 @@ void sm_initialise_state(SimState*state) {
 
 	Coords null_vector = coords_set(F_INDETERMINED,F_INDETERMINED,F_INDETERMINED);
 	
-	state->location[0]='\0';
-	state->event[0] ='\0'; 
+	state->location_code[0] = I_INDETERMINED; state->location_code[1] = I_INDETERMINED; state->location_code[2] = I_INDETERMINED;
+	state->event_code = I_INDETERMINED; 
 	
 	state->w = F_INDETERMINED; 
 	state->t = F_INDETERMINED; 
@@ -1513,6 +1517,7 @@ calls:
 	// apply the formulation:
 	// arg = (q - m * Qc_Ni)/w, 
 	// reflectivity Rm_at_plane = R0*0.5*(1-tanh(arg))*(1-alpha*(q-Qc_m)+beta*(q-Qc_m)*(q-Qc_m));
+	// with 0.5*(1-tanh(arg)) = 1/(1+exp(2*arg)), which keeps its precision in the tail and is what sm_calc_Rm_batch evaluates
 	
 	double arg = W > 0 ? (q - Qc_m)/W : 11;
 	
@@ -1526,7 +1531,7 @@ calls:
 	}
 	else {
 		q -= Qc;
-		return R0*0.5*(1 - tanh(arg))*(1 - alpha*q + beta*q*q);
+		return R0/(1 + exp(2*arg))*(1 - alpha*q + beta*q*q);
 	}
 }
 void sm_get_Rm_at_plane (ReflectionParameters*mir, double vn_len, double *R_plus, double *R_minus) 
@@ -2577,6 +2582,59 @@ starting at given state, calculates the weight ws after internally reflecting n
 
 
 
+/*******************************************/
+/* Batched reflectivity and attenuation    */
+/*******************************************/
+void sm_batch_at_plane(Supermirror *sm, int plane, SupermirrorBatch *batch) 
+/******************************************************************************************************************************
+Purpose:	reflectivity, absorber and substrate attenuation at mirror plane for the neutrons of a batch
+uses: 		batch-> n, v_len, vn_len
+update: 	batch-> q
+output: 	batch-> Rm, L_attn_abs, t_prop_abs, T_prop_abs, L_attn_sub, 
+			same as sm_get_Rm_at_plane, sm_get_prop_abs_at_plane, sm_get_L_attn_sub per neutron
+calls: 		sm_calc_Rm_batch, sm_calc_L_attn_batch, sm_calc_prop_attn_batch
+********************************************************************************************************************************/
+{
+	long i, n = batch->n;
+	int spin;
+	ReflectionParameters *mir = ((sm->mat).mir)[plane];
+	AbsorberParameters *abs = &(((sm->mat).abs)[plane]);
+	SubstrateParameters *sub = &((sm->mat).sub);
+	double *q = batch->q;
+
+	//mirror reflectivity, 0 unless both spin states reflect
+	for (i = 0; i < n; i++) q[i] = 2 * batch->vn_len[i] * V2Q;
+	for (spin = 0; spin < SM_Num_Spin_States; spin++) {
+		double *Rm = batch->Rm[spin];
+		if ((mir[0].refl_type & sm_refl_type_refl) == sm_refl_type_refl && 
+			(mir[1].refl_type & sm_refl_type_refl) == sm_refl_type_refl) {
+			sm_calc_Rm_batch(n, q, mir[spin].Qc, mir[spin].R0, mir[spin].alpha, mir[spin].m, mir[spin].W, mir[spin].beta, Rm);
+			for (i = 0; i < n; i++) Rm[i] = fabs(q[i]) > DBL_EPSILON ? Rm[i] : 0;
+		}
+		else {
+			for (i = 0; i < n; i++) Rm[i] = 0;
+		}
+	}
+
+	//absorber layer
+	if ((abs->abs_type & sm_abs_type_attn) == 0) {
+		sm_calc_L_attn_batch(n, batch->v_len, -1, -1, batch->L_attn_abs);
+	}
+	else {
+		sm_calc_L_attn_batch(n, batch->v_len, abs->L_abs, abs->L_inc, batch->L_attn_abs);
+	}
+	sm_calc_prop_attn_batch(n, batch->v_len, batch->vn_len, abs->thickness_in_micron, 
+							batch->L_attn_abs, batch->t_prop_abs, batch->T_prop_abs);
+
+	//substrate
+	if ((sub->sub_type & sm_sub_type_attn) == 0) {
+		sm_calc_L_attn_batch(n, batch->v_len, -1, -1, batch->L_attn_sub);
+	}
+	else {
+		sm_calc_L_attn_batch(n, batch->v_len, sub->L_abs, sub->L_inc, batch->L_attn_sub);
+	}
+}
+
 /************************/
 /* Trajectory functions */
 /************************/
@@ -3251,7 +3309,7 @@ int sm_internal_reflections(SimState *state, Supermirror *sm, double ws_target)
 			for (ir_order = 0; ir_order < SM_Num_Mirror_Planes; ir_order++) {
 				set_location_text(sm, sm->name, state->side_at_ir_order[ir_order], state->plane_at_ir_order[ir_order], sm_MirrorLayer, location[ir_order]);
 			}
-			set_event_text(sm, sm_InternalReflection, save_state.event); 
+			set_event_text(sm, sm_InternalReflection, event); 
 			
 			//calculate vn at sm_ir_r=1(starting side), vn_ir_at_ir_order_1
 			
@@ -3706,13 +3764,18 @@ int InitialiseStdSupermirrorFlat_detail (
 					
 					m_plot_scale /= 100;
 					fprintf(fpp,"Q,Rm_at_plane[0][+],Rm_at_plane[0][-],Rm_at_plane[1][+],Rm_at_plane[1][-]\n");
-					double q; 
+					double q[100]; 
+					double Rm[SM_Num_Mirror_Planes][SM_Num_Spin_States][100];
+					for (k = 0; k < 100; k++) q[k] = qc * k * m_plot_scale; 
+					for (i = 0; i < SM_Num_Mirror_Planes; i++)
+					for (j = 0; j < SM_Num_Spin_States; j++) {
+						sm_calc_Rm_batch(100, q, mir[i][j]->Qc, mir[i][j]->R0, mir[i][j]->alpha, mir[i][j]->m, mir[i][j]->W, mir[i][j]->beta, Rm[i][j]);
+					}
 					for (k = 0; k < 100; k++) {
-						q = qc * k * m_plot_scale; 
-						fprintf(fpp, "%le",q);
+						fprintf(fpp, "%le",q[k]);
 						for (i = 0; i < SM_Num_Mirror_Planes; i++)
 						for (j = 0; j < SM_Num_Spin_States; j++) {
-							fprintf(fpp, ",%12.9e",sm_calc_Rm(q, mir[i][j]->Qc, mir[i][j]->R0, mir[i][j]->alpha, mir[i][j]->m, mir[i][j]->W, mir[i][j]->beta));
+							fprintf(fpp, ",%12.9e",Rm[i][j][k]);
 						}
 						fprintf(fpp, "\n");
 					}
@@ -312,6 +312,10 @@
 %include "polyhedron"
 #endif
 
+#ifndef SUPERMIRROR_BATCH_LIB_H
+%include "supermirror_batch-lib"
+#endif
+
 //record for SCATTER 
 typedef struct NeutronRecord {
 	int    nr_n; //neutron number in simulation
@@ -507,6 +511,10 @@ int StdSupermirrorFlat(
 		Supermirror *sm
 		);
 
+//Batched reflectivity and attenuation at mirror plane 0 or 1 of the batch->n neutrons with speeds batch->v_len, batch->vn_len
+//output: batch->Rm, L_attn_abs, t_prop_abs, T_prop_abs, L_attn_sub, as the per-neutron ray-tracing calculates them
+void sm_batch_at_plane(Supermirror *sm, int plane, SupermirrorBatch *batch);
+
 //Finishing - release allocated memories
 void EmptySupermirrorFlatData(Supermirror*sm);
 
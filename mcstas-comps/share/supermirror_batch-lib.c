@@ -0,0 +1,130 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/supermirror_batch-lib.c
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Batched supermirror reflectivity and attenuation, see supermirror_batch-lib.h.
+*
+* Usage: within SHARE
+* %include "supermirror_batch-lib"
+*
+*******************************************************************************/
+
+#ifndef SUPERMIRROR_BATCH_LIB_H
+#error McStas : please import this library with %include "supermirror_batch-lib"
+#endif
+
+#define SM_BATCH_NUM_ARRAYS 9
+
+int sm_batch_alloc(SupermirrorBatch *batch, long n)
+{
+	//one block for all arrays, v_len is its start
+	double *block;
+	memset(batch, 0, sizeof(SupermirrorBatch));
+	if (n <= 0) return 0;
+	block = (double*)calloc(SM_BATCH_NUM_ARRAYS*n, sizeof(double));
+	if (!block) {
+		printf("sm_batch_alloc: Cannot allocate batch of %li neutrons.\n", n);
+		return 0;
+	}
+	batch->n_allocated = n;
+	batch->v_len      = block;
+	batch->vn_len     = block + n;
+	batch->q          = block + 2*n;
+	batch->Rm[0]      = block + 3*n;
+	batch->Rm[1]      = block + 4*n;
+	batch->L_attn_abs = block + 5*n;
+	batch->t_prop_abs = block + 6*n;
+	batch->T_prop_abs = block + 7*n;
+	batch->L_attn_sub = block + 8*n;
+	return 1;
+}
+
+void sm_batch_free(SupermirrorBatch *batch)
+{
+	if (batch->v_len) free(batch->v_len);
+	memset(batch, 0, sizeof(SupermirrorBatch));
+}
+
+void sm_calc_Rm_batch(long n, const double *q, double Qc, double R0, double alpha, double m, double W, double beta, double *Rm)
+/******************************************************************************************************************************
+sm_calc_Rm for n values of q, the cut-offs become selects
+********************************************************************************************************************************/
+{
+	long i;
+	double Qc_m = m * 0.0217; //m * Qc for natural Ni (0.0217 [1/Å]
+
+	if (W <= 0 || m <= 0 || Qc_m <= 0 || R0 <= 0) {
+		for (i = 0; i < n; i++) Rm[i] = 0;
+		return;
+	}
+	#pragma omp simd
+	for (i = 0; i < n; i++) {
+		double arg = (q[i] - Qc_m)/W;
+		double dq = q[i] - Qc;
+		double x = arg < 10 ? arg : 10; //lanes beyond the cut-off are dropped, keep their exp cheap
+		double R = R0/(1 + exp(2*x))*(1 - alpha*dq + beta*dq*dq);
+		R = q[i] <= Qc ? R0 : R; //total reflection
+		Rm[i] = arg > 10 ? 0 : R;
+	}
+}
+
+void sm_calc_L_attn_batch(long n, const double *v_len, double L_abs, double L_inc, double *L_attn)
+/******************************************************************************************************************************
+sm_get_L_attn_abs_at_plane and sm_get_L_attn_sub for n speeds. Pass L_abs = L_inc = -1 for a layer without attenuation.
+********************************************************************************************************************************/
+{
+	long i;
+
+	if (L_abs < 0) {
+		//speed independent
+		for (i = 0; i < n; i++) L_attn[i] = L_inc >= 0 ? L_inc : -1;
+	}
+	else if (L_inc < 0) {
+		#pragma omp simd
+		for (i = 0; i < n; i++) L_attn[i] = (v_len[i] * L_abs) / AMS;
+	}
+	else {
+		#pragma omp simd
+		for (i = 0; i < n; i++) {
+			double L = (v_len[i] * L_abs) / AMS;
+			L_attn[i] = L != 0 ? L * (L_inc / (L + L_inc)) : L;
+		}
+	}
+}
+
+void sm_calc_prop_attn_batch(long n, const double *v_len, const double *vn_len, double thickness_in_micron,
+	double *L_attn, double *t_prop, double *T_prop)
+/******************************************************************************************************************************
+sm_get_prop_abs_at_plane for n neutrons, from the attenuation lengths of sm_calc_L_attn_batch.
+L_attn is set to -1 for neutrons flying parallel to the surface. Transmissions below 1e-304 are 0.
+********************************************************************************************************************************/
+{
+	long i;
+
+	#pragma omp simd
+	for (i = 0; i < n; i++) {
+		int parallel = vn_len[i] <= FLT_EPSILON;
+		double t = fabs(thickness_in_micron * 1E-6 / vn_len[i]);
+		double L = L_attn[i];
+		double a = -t * v_len[i] / L;
+		double T = exp(a > -700 ? (a < 0 ? a : 0) : -700); //keep lanes out of the slow paths of exp
+		T = a > -700 ? T : 0; //below 1e-304
+		T = L != -1 ? (L > DBL_EPSILON ? T : 0) : 1;
+		L_attn[i] = parallel ? -1 : L;
+		t_prop[i] = parallel ? F_INDETERMINED : t;
+		T_prop[i] = parallel ? 1 : T;
+	}
+}
+
+/* end of supermirror_batch-lib.c */
@@ -0,0 +1,69 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/supermirror_batch-lib.h
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Batched supermirror reflectivity and attenuation, the per-neutron formulas of
+* sm_calc_Rm, sm_get_prop_abs_at_plane and sm_get_L_attn_sub in supermirror-lib
+* evaluated for many neutrons at once. The neutrons of a batch are kept as a
+* structure of arrays and the material parameters are loop invariant, so every
+* loop is free of per-neutron branches and is vectorised by the compiler with
+* -fopenmp-simd (and a vector math library for exp, e.g. glibc libmvec with
+* -ffast-math). Results are the same as the per-neutron functions.
+*
+* The batch holds no tracking records: event records are only kept by the
+* per-neutron path of supermirror-lib, when tracking is requested.
+*
+* Usage: within SHARE
+* %include "supermirror_batch-lib"
+*
+*******************************************************************************/
+
+#ifndef SUPERMIRROR_BATCH_LIB_H
+#define SUPERMIRROR_BATCH_LIB_H "$Revision$"
+
+#ifndef INDETERMINED
+#define D_INDETERMINED -DBL_MAX
+#define F_INDETERMINED -FLT_MAX
+#define I_INDETERMINED -INT_MAX
+#define INDETERMINED
+#endif
+
+#ifndef AMS
+#define AMS 3956.034 //[Å m/s] neutron velocity -- wavelength coversion
+#endif
+
+//neutrons of a batch, structure of arrays, all arrays have n_allocated elements
+typedef struct SupermirrorBatch {
+	long n; //number of neutrons in the batch
+	long n_allocated;
+	double *v_len; //input: |v|
+	double *vn_len; //input: |v| normal to the plane
+	double *q; //2 * vn_len * V2Q
+	double *Rm[2]; //index=spin+,spin-, mirror reflectivity
+	double *L_attn_abs; //absorber layer attenuation length, -1 for no attenuation
+	double *t_prop_abs; //time through absorber layer
+	double *T_prop_abs; //transmission through absorber layer
+	double *L_attn_sub; //substrate attenuation length, -1 for no attenuation
+} SupermirrorBatch;
+
+	int  sm_batch_alloc(SupermirrorBatch *batch, long n);
+	void sm_batch_free(SupermirrorBatch *batch);
+	void sm_calc_Rm_batch(long n, const double *q, double Qc, double R0, double alpha, double m, double W, double beta, double *Rm);
+	void sm_calc_L_attn_batch(long n, const double *v_len, double L_abs, double L_inc, double *L_attn);
+	void sm_calc_prop_attn_batch(long n, const double *v_len, const double *vn_len, double thickness_in_micron,
+		double *L_attn, double *t_prop, double *T_prop);
+
+#endif
+
+/* end of supermirror_batch-lib.h */
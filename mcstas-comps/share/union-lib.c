@@ -41,6 +41,8 @@ int num_volumes;
 int *calculated;
 int *n_elements;
 double **intersection_times;
+int num_calculated;   // volumes calculated since the last reset, listed in calculated_list
+int *calculated_list;
 };
 
 struct line_segment{
@@ -728,119 +730,44 @@ void merge_lists(struct pointer_to_1d_int_list *result,struct pointer_to_1d_int_
     };
 
 void add_element_to_double_list(struct pointer_to_1d_double_list *list,double value) {
-    if (list->num_elements == 0) {
-      list->num_elements++;
-      list-> elements = malloc(list->num_elements*sizeof(double));
-      list-> elements[0] = value;
-    } else {
-      double *temp=malloc(list->num_elements*sizeof(double));
-      int iterate;
-      for (iterate=0;iterate<list->num_elements;iterate++) temp[iterate] = list->elements[iterate];
-      free(list->elements);
-      list->num_elements++;
-      list-> elements = malloc(list->num_elements*sizeof(double));
-      for (iterate=0;iterate<list->num_elements-1;iterate++) list->elements[iterate] = temp[iterate];
-      free(temp);
-      list->elements[list->num_elements-1] = value;
-    }
+    if (list->num_elements == 0) list->elements = NULL;
+    list->elements = realloc(list->elements, (list->num_elements+1)*sizeof(double));
+    list->elements[list->num_elements++] = value;
     };
 
 void add_element_to_int_list(struct pointer_to_1d_int_list *list,int value) {
-    if (list->num_elements == 0) {
-      list->num_elements++;
-      list-> elements = malloc(list->num_elements*sizeof(int));
-      list-> elements[0] = value;
-    } else {
-      double *temp=malloc(list->num_elements*sizeof(double));
-      int iterate;
-      for (iterate=0;iterate<list->num_elements;iterate++) temp[iterate] = list->elements[iterate];
-      free(list->elements);
-      list->num_elements++;
-      list-> elements = malloc(list->num_elements*sizeof(int));
-      for (iterate=0;iterate<list->num_elements-1;iterate++) list->elements[iterate] = temp[iterate];
-      free(temp);
-      list->elements[list->num_elements-1] = value;
-    }
+    // realloc can usually extend the block in place, where the old copy through a temporary list always moved it twice
+    if (list->num_elements == 0) list->elements = NULL;
+    list->elements = realloc(list->elements, (list->num_elements+1)*sizeof(int));
+    list->elements[list->num_elements++] = value;
     };
 
 // Need to check if absolute_rotation is preserved correctly.
 void add_element_to_focus_data_array(struct focus_data_array_struct *focus_data_array,struct focus_data_struct focus_data) {
-    if (focus_data_array->num_elements == 0) {
-      focus_data_array->num_elements++;
-      focus_data_array-> elements = malloc(focus_data_array->num_elements*sizeof(struct focus_data_struct));
-      focus_data_array-> elements[0] = focus_data;
-    } else {
-      struct focus_data_struct *temp=malloc(focus_data_array->num_elements*sizeof(struct focus_data_struct));
-      int iterate;
-      for (iterate=0;iterate<focus_data_array->num_elements;iterate++) temp[iterate] = focus_data_array->elements[iterate];
-      free(focus_data_array->elements);
-      focus_data_array->num_elements++;
-      focus_data_array-> elements = malloc(focus_data_array->num_elements*sizeof(struct focus_data_struct));
-      for (iterate=0;iterate<focus_data_array->num_elements-1;iterate++) focus_data_array->elements[iterate] = temp[iterate];
-      free(temp);
-      focus_data_array->elements[focus_data_array->num_elements-1] = focus_data;
-    }
+    if (focus_data_array->num_elements == 0) focus_data_array->elements = NULL;
+    focus_data_array->elements = realloc(focus_data_array->elements, (focus_data_array->num_elements+1)*sizeof(struct focus_data_struct));
+    focus_data_array->elements[focus_data_array->num_elements++] = focus_data;
     };
 
-
 void add_to_logger_with_data(struct logger_with_data_struct *logger_with_data, struct logger_struct *logger) {
-    // May reorder the order of the if conditions to avoid checking the == 0 for every single ray
-    if (logger_with_data->allocated_elements == 0) {
-        logger_with_data->allocated_elements = 5;
-        logger_with_data->logger_pointers = malloc(logger_with_data->allocated_elements*sizeof(struct logger_struct*));
-        logger_with_data->used_elements = 1;
-        logger_with_data->logger_pointers[0] = logger;
-    } else if (logger_with_data->used_elements > logger_with_data->allocated_elements-1) {
-        struct logger_with_data_struct temp_logger_with_data;
-        temp_logger_with_data.logger_pointers = malloc((logger_with_data->used_elements)*sizeof(struct logger_struct*));
-        int iterate;
-        for (iterate=0;iterate<logger_with_data->used_elements;iterate++) {
-            temp_logger_with_data.logger_pointers[iterate]  = logger_with_data->logger_pointers[iterate];
-        }
-        free(logger_with_data->logger_pointers);
-        logger_with_data->allocated_elements = logger_with_data->allocated_elements+5;
-        logger_with_data->logger_pointers = malloc(logger_with_data->allocated_elements*sizeof(struct logger_struct*));
-        for (iterate=0;iterate<logger_with_data->used_elements;iterate++) {
-            logger_with_data->logger_pointers[iterate]  = temp_logger_with_data.logger_pointers[iterate];
-        }
-
-        logger_with_data->logger_pointers[logger_with_data->used_elements++] = logger;
-        
-        
-    } else {
-        logger_with_data->logger_pointers[logger_with_data->used_elements++] = logger;
+    // Called for the first record of a ray in a logger. The list is emptied per ray but keeps its storage,
+    // and doubles when full, so it stops allocating once it fits the most loggers hit by one ray
+    if (logger_with_data->used_elements > logger_with_data->allocated_elements-1) {
+        if (logger_with_data->allocated_elements == 0) logger_with_data->logger_pointers = NULL;
+        logger_with_data->allocated_elements = logger_with_data->allocated_elements > 0 ? 2*logger_with_data->allocated_elements : 5;
+        logger_with_data->logger_pointers = realloc(logger_with_data->logger_pointers, logger_with_data->allocated_elements*sizeof(struct logger_struct*));
     }
-    
+    logger_with_data->logger_pointers[logger_with_data->used_elements++] = logger;
 };
 
 void add_to_abs_logger_with_data(struct abs_logger_with_data_struct *abs_logger_with_data, struct abs_logger_struct *abs_logger) {
-    // May reorder the order of the if conditions to avoid checking the == 0 for every single ray
-    if (abs_logger_with_data->allocated_elements == 0) {
-        abs_logger_with_data->allocated_elements = 5;
-        abs_logger_with_data->abs_logger_pointers = malloc(abs_logger_with_data->allocated_elements*sizeof(struct abs_logger_struct*));
-        abs_logger_with_data->used_elements = 1;
-        abs_logger_with_data->abs_logger_pointers[0] = abs_logger;
-    } else if (abs_logger_with_data->used_elements > abs_logger_with_data->allocated_elements-1) {
-        struct abs_logger_with_data_struct temp_abs_logger_with_data;
-        temp_abs_logger_with_data.abs_logger_pointers = malloc((abs_logger_with_data->used_elements)*sizeof(struct abs_logger_struct*));
-        int iterate;
-        for (iterate=0;iterate<abs_logger_with_data->used_elements;iterate++) {
-            temp_abs_logger_with_data.abs_logger_pointers[iterate]  = abs_logger_with_data->abs_logger_pointers[iterate];
-        }
-        free(abs_logger_with_data->abs_logger_pointers);
-        abs_logger_with_data->allocated_elements = abs_logger_with_data->allocated_elements+5;
-        abs_logger_with_data->abs_logger_pointers = malloc(abs_logger_with_data->allocated_elements*sizeof(struct abs_logger_struct*));
-        for (iterate=0;iterate<abs_logger_with_data->used_elements;iterate++) {
-            abs_logger_with_data->abs_logger_pointers[iterate] = temp_abs_logger_with_data.abs_logger_pointers[iterate];
-        }
-
-        abs_logger_with_data->abs_logger_pointers[abs_logger_with_data->used_elements++] = abs_logger;
-        
-        
-    } else {
-        abs_logger_with_data->abs_logger_pointers[abs_logger_with_data->used_elements++] = abs_logger;
+    // As add_to_logger_with_data
+    if (abs_logger_with_data->used_elements > abs_logger_with_data->allocated_elements-1) {
+        if (abs_logger_with_data->allocated_elements == 0) abs_logger_with_data->abs_logger_pointers = NULL;
+        abs_logger_with_data->allocated_elements = abs_logger_with_data->allocated_elements > 0 ? 2*abs_logger_with_data->allocated_elements : 5;
+        abs_logger_with_data->abs_logger_pointers = realloc(abs_logger_with_data->abs_logger_pointers, abs_logger_with_data->allocated_elements*sizeof(struct abs_logger_struct*));
     }
-    
+    abs_logger_with_data->abs_logger_pointers[abs_logger_with_data->used_elements++] = abs_logger;
 };
 
 
@@ -1283,6 +1210,7 @@ struct tagging_tree_node_struct {
   struct tagging_tree_node_struct *above;   // Pointer to node above
   struct tagging_tree_node_struct **volume_branches;
   struct tagging_tree_node_struct **process_branches;
+  struct union_arena *arena;                // Arena holding this node and its branches, NULL for malloc
 };
 
 struct list_of_tagging_tree_node_pointers {
@@ -1290,8 +1218,13 @@ struct list_of_tagging_tree_node_pointers {
   int num_elements;
 };
 
-struct tagging_tree_node_struct *make_tagging_tree_node(void) {
-    return (struct tagging_tree_node_struct *) malloc(sizeof(struct tagging_tree_node_struct));
+struct tagging_tree_node_struct *make_tagging_tree_node(struct union_arena *arena) {
+    // Nodes are created in trace until the history limit, the arena saves a malloc per node and branch list
+    struct tagging_tree_node_struct *new_node;
+    if (arena) new_node = (struct tagging_tree_node_struct *) union_arena_alloc(arena, sizeof(struct tagging_tree_node_struct));
+    else new_node = (struct tagging_tree_node_struct *) malloc(sizeof(struct tagging_tree_node_struct));
+    if (new_node) new_node->arena = arena;
+    return new_node;
 }
 
 
@@ -1302,7 +1235,7 @@ struct tagging_tree_node_struct  *simple_initialize_tagging_tree_node(struct tag
     
     //new_node->element = (struct tagging_tree_node_struct *) malloc(sizeof(struct tagging_tree_node_struct));
     //new_node = (struct tagging_tree_node_struct *) malloc(sizeof(struct tagging_tree_node_struct));
-    new_node = make_tagging_tree_node();
+    new_node = make_tagging_tree_node(NULL);
     
     if (new_node == NULL) printf("ERROR, Union tagging system could not allocate memory\n");
     new_node->intensity = 4.2; // (double) 4.2;
@@ -1313,15 +1246,16 @@ struct tagging_tree_node_struct  *simple_initialize_tagging_tree_node(struct tag
 };
 
 
-struct tagging_tree_node_struct *initialize_tagging_tree_node(struct tagging_tree_node_struct *new_node, struct tagging_tree_node_struct *above_node, struct Volume_struct *this_volume) {
-    new_node = make_tagging_tree_node();
+struct tagging_tree_node_struct *initialize_tagging_tree_node(struct tagging_tree_node_struct *new_node, struct tagging_tree_node_struct *above_node, struct Volume_struct *this_volume, struct union_arena *arena) {
+    new_node = make_tagging_tree_node(arena);
     
     new_node->intensity = (double) 0;
     new_node->number_of_rays = (int) 0;
     new_node->above = above_node;
     
     int next_volume_list_length = this_volume->geometry.next_volume_list.num_elements;
-    new_node->volume_branches = malloc(next_volume_list_length*sizeof(struct tagging_tree_node_struct*));
+    if (arena) new_node->volume_branches = (struct tagging_tree_node_struct **) union_arena_alloc(arena, next_volume_list_length*sizeof(struct tagging_tree_node_struct*));
+    else new_node->volume_branches = malloc(next_volume_list_length*sizeof(struct tagging_tree_node_struct*));
     int iterate;
     // Initializing pointers so that they can be checked for NULL later. Is this redundant? Does malloc return null pointers?
     for (iterate=0;iterate<next_volume_list_length;iterate++) new_node->volume_branches[iterate] = NULL;
@@ -1331,7 +1265,8 @@ struct tagging_tree_node_struct *initialize_tagging_tree_node(struct tagging_tre
     if (this_volume->p_physics == NULL) number_of_processes = 0;
     else number_of_processes = this_volume->p_physics->number_of_processes;
     
-    new_node->process_branches = malloc(number_of_processes*sizeof(struct tagging_tree_node_struct*));
+    if (arena) new_node->process_branches = (struct tagging_tree_node_struct **) union_arena_alloc(arena, number_of_processes*sizeof(struct tagging_tree_node_struct*));
+    else new_node->process_branches = malloc(number_of_processes*sizeof(struct tagging_tree_node_struct*));
     // Initializing pointers so that they can be checked for NULL later. Is this redundant? Does malloc return null pointers?
     for (iterate=0;iterate<number_of_processes;iterate++) new_node->process_branches[iterate] = NULL;
     //new_node->process_branches.num_elements=number_of_processes; // May be removed
@@ -1343,7 +1278,7 @@ struct tagging_tree_node_struct *goto_process_node(struct tagging_tree_node_stru
     // Either create a new node if it has not been created yet, or travel down the tree
     if (current_node->process_branches[process_index] == NULL) {
       if (stop_creating_nodes == 0) {
-        current_node->process_branches[process_index] = initialize_tagging_tree_node(current_node->process_branches[process_index],current_node,this_volume);
+        current_node->process_branches[process_index] = initialize_tagging_tree_node(current_node->process_branches[process_index],current_node,this_volume,current_node->arena);
         return current_node->process_branches[process_index];
       } else {
         // This stops the ray from using more goto node functions and being counted in the statistics.
@@ -1391,7 +1326,7 @@ struct tagging_tree_node_struct *goto_volume_node(struct tagging_tree_node_struc
     // Either create a new node if it has not been created yet, or travel down the tree
     if (current_node->volume_branches[next_volume_list_index] == NULL) {
       if (stop_creating_nodes == 0) {
-        current_node->volume_branches[next_volume_list_index] =  initialize_tagging_tree_node(current_node->volume_branches[next_volume_list_index],current_node,Volumes[next_volume]);
+        current_node->volume_branches[next_volume_list_index] =  initialize_tagging_tree_node(current_node->volume_branches[next_volume_list_index],current_node,Volumes[next_volume],current_node->arena);
         return current_node->volume_branches[next_volume_list_index];
       } else {
         // This stops the ray from using more goto node functions and being counted in the statistics.
@@ -1441,39 +1376,14 @@ struct total_history_struct {
 
 void add_to_history(struct dynamic_history_list *history, int volume_index, int process_index) {
     //printf("Adding to history[%d]: volume_index = %d, process_index = %d \n",history->used_elements,volume_index,process_index);
-    if (history->allocated_elements == 0) {
-        history->elements = malloc(5*sizeof(struct history_node_struct));
-        history->used_elements = 1;
-        history->allocated_elements = 5;
-        history->elements[0].volume_index = volume_index;
-        history->elements[0].process_index = process_index;
-    } else if (history->used_elements > history->allocated_elements-1) {
-        struct dynamic_history_list temp_history;
-        temp_history.elements = malloc((history->used_elements)*sizeof(struct history_node_struct));
-        int iterate;
-        for (iterate=0;iterate<history->used_elements;iterate++) {
-            temp_history.elements[iterate].volume_index  = history->elements[iterate].volume_index;
-            temp_history.elements[iterate].process_index = history->elements[iterate].process_index;
-        }
-        free(history->elements);
-        history->elements = malloc((history->allocated_elements+5)*sizeof(struct history_node_struct));
-        for (iterate=0;iterate<history->used_elements;iterate++) {
-            history->elements[iterate].volume_index  = temp_history.elements[iterate].volume_index;
-            history->elements[iterate].process_index = temp_history.elements[iterate].process_index;
-        }
-        
-        history->allocated_elements = history->allocated_elements+5;
-        
-        history->elements[history->used_elements].volume_index = volume_index;
-        history->elements[history->used_elements].process_index = process_index;
-        history->used_elements = history->used_elements+1;
-        
-    } else {
-        history->elements[history->used_elements].volume_index = volume_index;
-        history->elements[history->used_elements].process_index = process_index;
-        history->used_elements++;
+    if (history->used_elements > history->allocated_elements-1) {
+        if (history->allocated_elements == 0) history->elements = NULL;
+        history->allocated_elements = history->allocated_elements > 0 ? 2*history->allocated_elements : 5;
+        history->elements = realloc(history->elements, history->allocated_elements*sizeof(struct history_node_struct));
     }
-    
+    history->elements[history->used_elements].volume_index = volume_index;
+    history->elements[history->used_elements].process_index = process_index;
+    history->used_elements++;
 };
 
 void printf_history(struct dynamic_history_list *history) {
@@ -1636,7 +1546,7 @@ void write_tagging_tree(struct list_of_tagging_tree_node_pointers *master_list,
           } else {
             // reset to the root of the tree
             *kill_candidate = NULL;
-            free(search_node);
+            if (search_node->arena == NULL) free(search_node); // arena nodes are released with their arena
             search_node = master_list->elements[volume_index];
             
             if (volume_index != 0)
@@ -2166,6 +2076,7 @@ double normal_z[50000];
 Coords direction_vector;
 Coords Bounding_Box_Center;
 double Bounding_Box_Radius;
+mesh_bvh bvh; // built in Union_mesh initialize, shared by copies
 };
 
 // A number of functions below use Dot() as scalar product, replace by coords_sp define
@@ -2974,23 +2885,28 @@ This function was created by Martin Olsen at NBI on september 20, 2018.
     return 0;
 };
 
+// Crossings of the line through pos along dir with the mesh facets, counted by the sign of t
+void mesh_count_crossings(struct mesh_storage *storage, Coords pos, Coords dir, int *counter, int *neg_counter, int iteration) {
+    double UNION_EPSILON = 1e-27;
+    int n_hits = mesh_bvh_hits(&storage->bvh, pos.x, pos.y, pos.z, dir.x, dir.y, dir.z, 1, UNION_EPSILON);
+    int i;
+    for (i = 0 ; i < n_hits ; i++){
+        double t_hit = storage->bvh.scratch[i];
+        if (t_hit > 0){
+            (*counter)++;
+        } else {
+            (*neg_counter)++;
+        }
+        if (iteration > 1 && fabs(t_hit) <= UNION_EPSILON){
+            printf("\n [%f %f %f] Failed due to being close to surface (%i. iteration), E = %f",pos.x,pos.y,pos.z,iteration,t_hit);
+        }
+    }
+}
+
 int r_within_mesh(Coords pos,struct geometry_struct *geometry) {
 // Unpack parameters
 
-    Coords center = geometry->center;
-    int n_facets = geometry->geometry_parameters.p_mesh_storage->n_facets;
-    double *normal_x = geometry->geometry_parameters.p_mesh_storage->normal_x;
-    double *normal_y = geometry->geometry_parameters.p_mesh_storage->normal_y;
-    double *normal_z = geometry->geometry_parameters.p_mesh_storage->normal_z;
-    double *v1_x = geometry->geometry_parameters.p_mesh_storage->v1_x;
-    double *v1_y = geometry->geometry_parameters.p_mesh_storage->v1_y;
-    double *v1_z = geometry->geometry_parameters.p_mesh_storage->v1_z;
-    double *v2_x = geometry->geometry_parameters.p_mesh_storage->v2_x;
-    double *v2_y = geometry->geometry_parameters.p_mesh_storage->v2_y;
-    double *v2_z = geometry->geometry_parameters.p_mesh_storage->v2_z;
-    double *v3_x = geometry->geometry_parameters.p_mesh_storage->v3_x;
-    double *v3_y = geometry->geometry_parameters.p_mesh_storage->v3_y;
-    double *v3_z = geometry->geometry_parameters.p_mesh_storage->v3_z;
+    struct mesh_storage *storage = geometry->geometry_parameters.p_mesh_storage;
     
     double x_new,y_new,z_new;
     
@@ -3004,221 +2920,46 @@ int r_within_mesh(Coords pos,struct geometry_struct *geometry) {
    
     rotated_coordinates = rot_apply(geometry->transpose_rotation_matrix,coordinates);
 
-    
-    int verbal = 0;
-    // Generate unit direction vector along center axis of meshs
-    
-    // Start with vector that points along the mesh in the simple frame, and rotate to global
-    Coords simple_vector = coords_set(0,1,0);
-    Coords test_vector = coords_set(0,1,0);
-    // Check intersections with every single facet:
-    int iter =0;
+    // Count crossings along y, then z and x while the counts on the two sides of the point disagree
     int counter=0; int neg_counter=0;
-    Coords edge1,edge2,h,s,q,tmp,intersect_pos;
-    double UNION_EPSILON = 1e-27;
-    double this_facet_t;
-    double a,f,u,V;
-    //////printf("\n RWITHIN TEST 1ste");
-    for (iter = 0 ; iter < n_facets ; iter++){
-    /*//////printf("\n\n facet v1 = [%f,%f,%f]",v1_x[iter],v1_y[iter],v1_z[iter]);
-    //////printf("\n facet v2 = [%f,%f,%f]",v2_x[iter],v2_y[iter],v2_z[iter]);
-    //////printf("\n facet v3 = [%f,%f,%f]",v3_x[iter],v3_y[iter],v3_z[iter]);*/
-        // Intersection with face plane (Möller–Trumbore)
-        edge1 = coords_set(*(v2_x+iter)-*(v1_x+iter),*(v2_y+iter)-*(v1_y+iter),*(v2_z+iter)-*(v1_z+iter));
-            //////printf("\n edge 1 = [%f,%f,%f]",edge1.x,edge1.y,edge1.z);
-        edge2 = coords_set(*(v3_x+iter)-*(v1_x+iter),*(v3_y+iter)-*(v1_y+iter),*(v3_z+iter)-*(v1_z+iter));
-        
-        vec_prod(h.x,h.y,h.z,test_vector.x,test_vector.y,test_vector.z,edge2.x,edge2.y,edge2.z);
-        
-        a = Dot(edge1,h);
-        //////printf("\n a=%f",a);
-        if (a > -UNION_EPSILON && a < UNION_EPSILON){
-            //////printf("\n UNION_EPSILON fail");
-        } else{
-            f = 1.0/a;
-            s = coords_sub(rotated_coordinates, coords_set(*(v1_x+iter),*(v1_y+iter),*(v1_z+iter)));
-            u = f * (Dot(s,h));
-            if (u < 0.0 || u > 1.0){
-                //////printf("\n Nope 1");
-            }else{
-                //q = vec_prod(s,edge1);
-                vec_prod(q.x,q.y,q.z,s.x,s.y,s.z,edge1.x,edge1.y,edge1.z);
-                V = f * Dot(test_vector,q);
-                if (V < 0.0 || u + V > 1.0){
-                    //////printf("\n Nope 2");
-                } else {
-                    // At this stage we can compute t to find out where the intersection point is on the line.
-                    if (f* Dot(q,edge2) > 0){
-                        counter++;
-
-                    } else {
-                        neg_counter++;
-
-                    }
-                    if (fabs(f* Dot(q,edge2)) > UNION_EPSILON){
-                    } else { //printf("\n [%f %f %f] Failed due to being close to surface, E = %f",rotated_coordinates.x,rotated_coordinates.y,rotated_coordinates.z,f* Dot(q,edge2));
-                     }
-                    
-                    
-                    
-                }
-            }
-        }
-    }
-    int C1 = counter;
-    
     int maxC; int sameNr =0;
-    ////printf("\n first iter: (%i , %i)",counter,neg_counter);
+    mesh_count_crossings(storage, rotated_coordinates, coords_set(0,1,0), &counter, &neg_counter, 1);
     if (counter % 2 == neg_counter % 2){
         maxC = counter;
         sameNr = 1;
     } else {
-        //printf("\n not the same intersection numbers (%i , %i)",counter,neg_counter);
         maxC = counter;
         sameNr = 0;
     }
 
- if (sameNr == 0){
-     test_vector = coords_set(0,0,1);
-    iter =0;
-    counter=0;
-    //////printf("\n RWITHIN TEST 1ste");
-    for (iter = 0 ; iter < n_facets ; iter++){
-    ///////printf("\n\n facet v1 = [%f,%f,%f]",v1_x[iter],v1_y[iter],v1_z[iter]);
-    //////printf("\n facet v2 = [%f,%f,%f]",v2_x[iter],v2_y[iter],v2_z[iter]);
-    //////printf("\n facet v3 = [%f,%f,%f]",v3_x[iter],v3_y[iter],v3_z[iter]);
-        // Intersection with face plane (Möller–Trumbore)
-        edge1 = coords_set(*(v2_x+iter)-*(v1_x+iter),*(v2_y+iter)-*(v1_y+iter),*(v2_z+iter)-*(v1_z+iter));
-            //////printf("\n edge 1 = [%f,%f,%f]",edge1.x,edge1.y,edge1.z);
-        edge2 = coords_set(*(v3_x+iter)-*(v1_x+iter),*(v3_y+iter)-*(v1_y+iter),*(v3_z+iter)-*(v1_z+iter));
-        
-        vec_prod(h.x,h.y,h.z,test_vector.x,test_vector.y,test_vector.z,edge2.x,edge2.y,edge2.z);
-        
-        a = Dot(edge1,h);
-        //////printf("\n a=%f",a);
-        if (a > -UNION_EPSILON && a < UNION_EPSILON){
-            //////printf("\n UNION_EPSILON fail");
-        } else{
-            f = 1.0/a;
-            s = coords_sub(rotated_coordinates , coords_set(*(v1_x+iter),*(v1_y+iter),*(v1_z+iter)));
-            u = f * (Dot(s,h));
-            if (u < 0.0 || u > 1.0){
-                //////printf("\n Nope 1");
-            }else{
-                //q = vec_prod(s,edge1);
-                vec_prod(q.x,q.y,q.z,s.x,s.y,s.z,edge1.x,edge1.y,edge1.z);
-                V = f * Dot(test_vector,q);
-                if (V < 0.0 || u + V > 1.0){
-                    //////printf("\n Nope 2");
-                } else {
-                    // At this stage we can compute t to find out where the intersection point is on the line.
-
-                    if (f* Dot(q,edge2) > 0){
-                        counter++;
-
-                    } else {
-                        neg_counter++;
-
-                    }
-                    if (fabs(f* Dot(q,edge2)) > UNION_EPSILON){
-                    } else { printf("\n [%f %f %f] Failed due to being close to surface (2. iteration), E = %f",rotated_coordinates.x,rotated_coordinates.y,rotated_coordinates.z,f* Dot(q,edge2));
-                     }
-                    
-                    
-                    
-                }
-            }
+    if (sameNr == 0){
+        counter=0;
+        mesh_count_crossings(storage, rotated_coordinates, coords_set(0,0,1), &counter, &neg_counter, 2);
+        if (counter % 2 == neg_counter % 2){
+            maxC = counter;
+            sameNr = 1;
+        } else {
+            printf("\n not the same intersection numbers (%i , %i) second iteration",counter,neg_counter);
+            maxC = counter;
+            sameNr = 0;
         }
     }
-    }
-    
-    if (counter % 2 == neg_counter % 2){
-        maxC = counter;
-        sameNr = 1;
-    } else {
-        printf("\n not the same intersection numbers (%i , %i) second iteration",counter,neg_counter);
-        maxC = counter;
-        sameNr = 0;
-    }
 
     if (sameNr == 0){
-     test_vector = coords_set(1,0,0);
-    iter =0;
-    counter=0;
-    //////printf("\n RWITHIN TEST 1ste");
-    for (iter = 0 ; iter < n_facets ; iter++){
-    ///////printf("\n\n facet v1 = [%f,%f,%f]",v1_x[iter],v1_y[iter],v1_z[iter]);
-    //////printf("\n facet v2 = [%f,%f,%f]",v2_x[iter],v2_y[iter],v2_z[iter]);
-    //////printf("\n facet v3 = [%f,%f,%f]",v3_x[iter],v3_y[iter],v3_z[iter]);
-        // Intersection with face plane (Möller–Trumbore)
-        edge1 = coords_set(*(v2_x+iter)-*(v1_x+iter),*(v2_y+iter)-*(v1_y+iter),*(v2_z+iter)-*(v1_z+iter));
-            //////printf("\n edge 1 = [%f,%f,%f]",edge1.x,edge1.y,edge1.z);
-        edge2 = coords_set(*(v3_x+iter)-*(v1_x+iter),*(v3_y+iter)-*(v1_y+iter),*(v3_z+iter)-*(v1_z+iter));
-        
-        vec_prod(h.x,h.y,h.z,test_vector.x,test_vector.y,test_vector.z,edge2.x,edge2.y,edge2.z);
-        
-        a = Dot(edge1,h);
-        //////printf("\n a=%f",a);
-        if (a > -UNION_EPSILON && a < UNION_EPSILON){
-            //////printf("\n UNION_EPSILON fail");
-        } else{
-            f = 1.0/a;
-            s = coords_sub(rotated_coordinates , coords_set(*(v1_x+iter),*(v1_y+iter),*(v1_z+iter)));
-            u = f * (Dot(s,h));
-            if (u < 0.0 || u > 1.0){
-                //////printf("\n Nope 1");
-            }else{
-                //q = vec_prod(s,edge1);
-                vec_prod(q.x,q.y,q.z,s.x,s.y,s.z,edge1.x,edge1.y,edge1.z);
-                V = f * Dot(test_vector,q);
-                if (V < 0.0 || u + V > 1.0){
-                    //////printf("\n Nope 2");
-                } else {
-                    // At this stage we can compute t to find out where the intersection point is on the line.
-
-                    if (f* Dot(q,edge2) > 0){
-                        counter++;
-
-                    } else {
-                        neg_counter++;
-
-                    }
-                    if (fabs(f* Dot(q,edge2)) > UNION_EPSILON){
-                    } else { printf("\n [%f %f %f] Failed due to being close to surface (3. iteration), E = %f",rotated_coordinates.x,rotated_coordinates.y,rotated_coordinates.z,f* Dot(q,edge2));
-                    }
-                    
-                    
-                    
-                }
-            }
+        counter=0;
+        mesh_count_crossings(storage, rotated_coordinates, coords_set(1,0,0), &counter, &neg_counter, 3);
+        if (counter % 2 == neg_counter % 2){
+            maxC = counter;
+        } else {
+            return 0;
         }
     }
 
-    }
-   
-    
-    if (counter % 2 == neg_counter % 2){
-        maxC = counter;
-    } else {
-        //printf("\n not the same intersection numbers (3. iteration) (%i , %i)",counter,neg_counter);
-        //printf("\n this point is a bitch: [%f %f %f]",rotated_coordinates.x,rotated_coordinates.y,rotated_coordinates.z);
-        return 0;
-        
-    }
-    ////printf("\n test point: [%f %f %f]",rotated_coordinates.x,rotated_coordinates.y,rotated_coordinates.z);
-
-////printf("\n maxC: %i",maxC);
-
     if ( maxC % 2 == 0) {
-        ////printf("\n Even number of intersections,  %i",counter);
         return 0;
     }else{
-        ////printf("\n Odd number of intersections, INSIDE! %i",counter);
         return 1;
-        
     }
-    
-    return 0;
     };
 
 
@@ -3231,37 +2972,10 @@ int sample_mesh_intersect(double *t,int *num_solutions,double *r,double *v,struc
     */
 
 
-    int n_facets = geometry->geometry_parameters.p_mesh_storage->n_facets;
-    double *normal_x = geometry->geometry_parameters.p_mesh_storage->normal_x;
-    double *normal_y = geometry->geometry_parameters.p_mesh_storage->normal_y;
-    double *normal_z = geometry->geometry_parameters.p_mesh_storage->normal_z;
-    double *v1_x = geometry->geometry_parameters.p_mesh_storage->v1_x;
-    double *v1_y = geometry->geometry_parameters.p_mesh_storage->v1_y;
-    double *v1_z = geometry->geometry_parameters.p_mesh_storage->v1_z;
-    double *v2_x = geometry->geometry_parameters.p_mesh_storage->v2_x;
-    double *v2_y = geometry->geometry_parameters.p_mesh_storage->v2_y;
-    double *v2_z= geometry->geometry_parameters.p_mesh_storage->v2_z;
-    double *v3_x = geometry->geometry_parameters.p_mesh_storage->v3_x;
-    double *v3_y = geometry->geometry_parameters.p_mesh_storage->v3_y;
-    double *v3_z = geometry->geometry_parameters.p_mesh_storage->v3_z;
     Coords Bounding_Box_Center = geometry->geometry_parameters.p_mesh_storage->Bounding_Box_Center;
     double Bounding_Box_Radius = geometry->geometry_parameters.p_mesh_storage->Bounding_Box_Radius;
     
     
-    int i;
-    
-    
-    
-    
-    
-    
-    //////printf("\n\n  TEST facet v2 = [%f,%f,%f]",v2_x[1],v2_y[1],v2_z[1]);
-    for (i = 0 ; i< n_facets ; i++){
-    
-    ////printf("\n\n  TEST facet v2 = [%f,%f,%f]",*(v2_x+i),*(v2_y+i),*(v2_z+i));
-    }
-    
-    
     //Coords direction = geometry->geometry_parameters.p_mesh_storage->direction_vector;
     Coords center = geometry->center;
 
@@ -3334,156 +3048,25 @@ int sample_mesh_intersect(double *t,int *num_solutions,double *r,double *v,struc
     }
 
     
-    // Check intersections with every single facet:
-    int iter =0;
-    int counter=0;
-    Coords edge1,edge2,h,s,q,tmp,intersect_pos;
-    double UNION_EPSILON = 0.0000001;
-    double this_facet_t;
-    double a,f,u,V;
-    double *t_intersect=malloc(n_facets*sizeof(double));
-    *num_solutions = 0;
-    for (iter = 0 ; iter < n_facets ; iter++){
-    /*////printf("\n\n facet v1 = [%f,%f,%f]",v1_x[iter],v1_y[iter],v1_z[iter]);
-    ////printf("\n facet v2 = [%f,%f,%f]",v2_x[iter],v2_y[iter],v2_z[iter]);
-    ////printf("\n facet v3 = [%f,%f,%f]",v3_x[iter],v3_y[iter],v3_z[iter]);*/
-        // Intersection with face plane (Möller–Trumbore)
-        edge1 = coords_set(*(v2_x+iter)-*(v1_x+iter),*(v2_y+iter)-*(v1_y+iter),*(v2_z+iter)-*(v1_z+iter));
-            ////printf("\n edge 1 = [%f,%f,%f]",edge1.x,edge1.y,edge1.z);
-        edge2 = coords_set(*(v3_x+iter)-*(v1_x+iter),*(v3_y+iter)-*(v1_y+iter),*(v3_z+iter)-*(v1_z+iter));
-        //h = vec_prod(rotated_velocity,edge2);
-        vec_prod(h.x,h.y,h.z,rotated_velocity.x,rotated_velocity.y,rotated_velocity.z,edge2.x,edge2.y,edge2.z);
-        ////printf("\n h = [%f,%f,%f]",h.x,h.y,h.z);
-        ////printf("\n rotated_velocity = [%f,%f,%f]",rotated_velocity.x,rotated_velocity.y,rotated_velocity.z);
-        ////printf("\n edge2 = [%f,%f,%f]",edge2.x,edge2.y,edge2.z);
-        //h = coord_set(rotated_velocity.y*edge2.z-rotated_velocity.z*edge2.y, rotated_velocity.z*edge2.x-rotated_velocity.x*edge2.z, rotated_velocity.x*edge2.y-rotated_velocity.y*edge2.x);
-        //a = Dot(h,edge1);
-        a = Dot(edge1,h);
-        ////printf("\n a=%f",a);
-        //if (a > -UNION_EPSILON && a < UNION_EPSILON){
-            ////printf("\n UNION_EPSILON fail");
-        //} else{
-            f = 1.0/a;
-            s = coords_sub(rotated_coordinates, coords_set(*(v1_x+iter),*(v1_y+iter),*(v1_z+iter)));
-            u = f * (Dot(s,h));
-            if (u < 0.0 || u > 1.0){
-                ////printf("\n Nope 1");
-            }else{
-                //q = vec_prod(s,edge1);
-                vec_prod(q.x,q.y,q.z,s.x,s.y,s.z,edge1.x,edge1.y,edge1.z);
-                V = f * Dot(rotated_velocity,q);
-                if (V < 0.0 || u + V > 1.0){
-                    ////printf("\n Nope 2");
-                } else {
-                    // At this stage we can compute t to find out where the intersection point is on the line.
-                    //tmp = Dot(q,edge2)
-                    ////printf("\nt inside loop = %f",f* Dot(q,edge2));
-                    if (f* Dot(q,edge2) > 0){
-                        
-                        t_intersect[counter] = f* Dot(q,edge2);
-                        //printf("\nIntersects at time: t= %f\n",t_intersect[counter] );
-                        counter++;
-                        
-                        //intersect_pos = coords_set(rotated_coordinates.x+t_intersect[counter]*rotated_velocity.x,rotated_coordinates.y+t_intersect[counter]*rotated_velocity.y,rotated_coordinates.z+t_intersect[counter]*rotated_velocity.z);
-                        //////printf("\n intersects at [%f,%f,%f]",intersect_pos.x,intersect_pos.y,intersect_pos.z);
-                    }
-                    
-                    
-                    
-                }
-            }
-        //}
-    }
-    free(t_intersect);
-    
-    // find two smallest non-zero intersections:
-    /*
-    double t_min = -1.0;
-    double t_second_min= -1.0;
-    for (iter = 0 ; iter < counter; iter++){
-        // test
-        if (t_min == -1 && t_intersect[iter] > 0.0){
-            t_min = t_intersect[iter];
-
-        } else{
-            if (t_intersect[iter] > 0.0 && t_intersect[iter] < t_min) {
-                t_second_min = t_min;
-                t_min = t_intersect[iter];
-     
-            }
-            if (t_intersect[iter] > 0.0 && t_intersect[iter] > t_min) {
-                if (t_intersect[iter] < t_second_min || t_second_min == -1.0){
-                    t_second_min = t_intersect[iter];
-                }
-            }
-        }
-     
-     
-    }
-    
-    //printf("\n number of intersections: %i\n",counter);
-    
-    
-    
-    
-    if (t_second_min > 0) {
-        if (counter % 2 == 0){
-            t[0] = t_second_min;
-            t[1] = t_min;
-            *num_solutions = 2;
-            //printf("\n t[0] = %f   t[1] = %f \n",t_min,t_second_min);
-        } else{
-            t[0] = -1;
-            t[1] = t_min;
-            *num_solutions = 1;
-            //printf("\n t[0] = %f   t[1] = %f \n",t_min,t_second_min);
-        }
-            ////printf("\n t[0] = %f   t[1] = %f \n",t[0],t[1]);
-     
-            //printf("\n num_solutions: %i\n",*num_solutions);
-            return 1;
-    }else if (t_min>0) {
-            t[0] = t_min;
-            t[1] = -1;
-            *num_solutions = 1;
-            //printf("\n num_solutions: %i\n",*num_solutions);
-            return 1;
-    } else {
-            t[0] = -1;
-            t[1] = -1;
-            *num_solutions = 0;
-            //printf("\n num_solutions: %i\n",*num_solutions);
-            return 0;
-    }
-    return 0;
-    */
-
-
-    //for (iter=0;iter<99;iter++){
-    //    printf("\n t[%i] = %f",iter,t[iter]);
-    //    t[iter] = -1;
-    //}
+    // Facets crossed for t > 0, the hierarchy only visits facets whose boxes the ray passes
+    int iter;
+    struct mesh_storage *storage = geometry->geometry_parameters.p_mesh_storage;
+    int counter = mesh_bvh_hits(&storage->bvh, rotated_coordinates.x, rotated_coordinates.y, rotated_coordinates.z,
+                                rotated_velocity.x, rotated_velocity.y, rotated_velocity.z, 0, 0);
+    double *t_intersect = storage->bvh.scratch;
     
     // Return all t
-    int counter2=0;
-    *num_solutions =0;
+    *num_solutions = 0;
     for (iter=0; iter < counter ; iter++){
-        if (t_intersect[iter] > 0.0){
-            t[counter2] = t_intersect[iter];
-            counter2++;
-            *num_solutions = counter2;
-        }
+        t[iter] = t_intersect[iter];
     }
-    // Sort t:
+    *num_solutions = counter;
     
     if (*num_solutions == 0){
         return 0;
     }
+    // Sort t:
     qsort(t,*num_solutions,sizeof (double), Sample_compare_doubles);
-    if (*num_solutions > 2){
-        //printf("\n T(0) = %f T(1) = %f  T(2) = %f T(3) = %f T(4) = %f",t[0],t[1],t[2],t[3],t[4]);
-        //printf("\n TEST");
-    }
     return 1;
     
 };
@@ -5934,6 +5517,250 @@ int r_within_function(Coords pos,struct geometry_struct *geometry) {
 };
 
 
+// -------------    Broad phase over volume bounding spheres   --------------------------------------------
+// Each Union_master keeps a small hierarchy over the bounding spheres of its volumes. The first time an intersection
+// is needed on a straight ray segment, the line is run through the hierarchy once, and volumes whose sphere it misses
+// get an empty entry in the intersection table without calling their intersect function.
+
+struct volume_bounds_struct {
+int num_volumes;
+Coords *center;    // bounding sphere of each volume in the master frame, volume 0 is never culled
+double *radius;    // negative when the shape has no known bound
+int num_nodes;     // flattened depth first, the first child of an interior node is the next node
+double *node_min;  // 3 doubles per node
+double *node_max;
+int *node_index;   // interior: index of the second child, leaf: volume index
+int *node_leaf;
+int *candidate;    // candidate[volume] == stamp when the current segment can hit the volume
+int stamp;
+int queried;       // 0 until the current segment has been run through the hierarchy
+};
+
+double geometry_bounding_radius(struct geometry_struct *geometry) {
+    // Radius of a sphere around geometry->center that contains the shape, all shapes are centered on their center
+    double r_max, h, d2, max_d2;
+    int iterate;
+    struct mesh_storage *mesh_data;
+    
+    switch(geometry->eShape) {
+        case sphere:
+            return geometry->geometry_parameters.p_sphere_storage->sph_radius;
+        case cylinder:
+            r_max = geometry->geometry_parameters.p_cylinder_storage->cyl_radius;
+            h = 0.5*geometry->geometry_parameters.p_cylinder_storage->height;
+            return sqrt(r_max*r_max + h*h);
+        case cone:
+            r_max = fmax(geometry->geometry_parameters.p_cone_storage->cone_radius_top,geometry->geometry_parameters.p_cone_storage->cone_radius_bottom);
+            h = 0.5*geometry->geometry_parameters.p_cone_storage->height;
+            return sqrt(r_max*r_max + h*h);
+        case box:
+            return 0.5*sqrt(pow(fmax(geometry->geometry_parameters.p_box_storage->x_width1,geometry->geometry_parameters.p_box_storage->x_width2),2)
+                          + pow(fmax(geometry->geometry_parameters.p_box_storage->y_height1,geometry->geometry_parameters.p_box_storage->y_height2),2)
+                          + pow(geometry->geometry_parameters.p_box_storage->z_depth,2));
+        case mesh:
+            // vertices are stored relative to the center, so the rotation does not matter
+            mesh_data = geometry->geometry_parameters.p_mesh_storage;
+            max_d2 = 0;
+            for (iterate=0;iterate<mesh_data->n_facets;iterate++) {
+                d2 = mesh_data->v1_x[iterate]*mesh_data->v1_x[iterate] + mesh_data->v1_y[iterate]*mesh_data->v1_y[iterate] + mesh_data->v1_z[iterate]*mesh_data->v1_z[iterate];
+                if (d2 > max_d2) max_d2 = d2;
+                d2 = mesh_data->v2_x[iterate]*mesh_data->v2_x[iterate] + mesh_data->v2_y[iterate]*mesh_data->v2_y[iterate] + mesh_data->v2_z[iterate]*mesh_data->v2_z[iterate];
+                if (d2 > max_d2) max_d2 = d2;
+                d2 = mesh_data->v3_x[iterate]*mesh_data->v3_x[iterate] + mesh_data->v3_y[iterate]*mesh_data->v3_y[iterate] + mesh_data->v3_z[iterate]*mesh_data->v3_z[iterate];
+                if (d2 > max_d2) max_d2 = d2;
+            }
+            return sqrt(max_d2);
+        default:
+            return -1;
+    }
+};
+
+double volume_bounds_axis(struct volume_bounds_struct *bounds, int volume_index, int axis) {
+    Coords c = bounds->center[volume_index];
+    return axis == 0 ? c.x : (axis == 1 ? c.y : c.z);
+};
+
+int build_volume_bounds_node(struct volume_bounds_struct *bounds, int *volume_indices, int n) {
+    // Adds the node over volume_indices[0..n) and its subtree, splitting at the median center along the widest axis
+    int node = bounds->num_nodes++;
+    int iterate, axis, widest, left, right, smallest, swap;
+    double lo[3], hi[3], c_lo[3], c_hi[3], value;
+    
+    for (axis=0;axis<3;axis++) {
+        lo[axis] = c_lo[axis] = 1e300;
+        hi[axis] = c_hi[axis] = -1e300;
+    }
+    for (iterate=0;iterate<n;iterate++) {
+        for (axis=0;axis<3;axis++) {
+            value = volume_bounds_axis(bounds,volume_indices[iterate],axis);
+            lo[axis] = fmin(lo[axis], value - bounds->radius[volume_indices[iterate]]);
+            hi[axis] = fmax(hi[axis], value + bounds->radius[volume_indices[iterate]]);
+            c_lo[axis] = fmin(c_lo[axis], value);
+            c_hi[axis] = fmax(c_hi[axis], value);
+        }
+    }
+    for (axis=0;axis<3;axis++) {
+        bounds->node_min[3*node+axis] = lo[axis];
+        bounds->node_max[3*node+axis] = hi[axis];
+    }
+    
+    if (n == 1) {
+        bounds->node_leaf[node] = 1;
+        bounds->node_index[node] = volume_indices[0];
+        return node;
+    }
+    
+    widest = 0;
+    for (axis=1;axis<3;axis++) if (c_hi[axis] - c_lo[axis] > c_hi[widest] - c_lo[widest]) widest = axis;
+    
+    // Partial selection sort is enough for the handful of volumes in a master
+    for (left=0;left<n/2;left++) {
+        smallest = left;
+        for (right=left+1;right<n;right++) {
+            if (volume_bounds_axis(bounds,volume_indices[right],widest) < volume_bounds_axis(bounds,volume_indices[smallest],widest)) smallest = right;
+        }
+        swap = volume_indices[left]; volume_indices[left] = volume_indices[smallest]; volume_indices[smallest] = swap;
+    }
+    
+    bounds->node_leaf[node] = 0;
+    build_volume_bounds_node(bounds, volume_indices, n/2);
+    bounds->node_index[node] = build_volume_bounds_node(bounds, volume_indices + n/2, n - n/2);
+    return node;
+};
+
+void build_volume_bounds(struct volume_bounds_struct *bounds, struct Volume_struct **Volumes, int number_of_volumes) {
+    int volume_index, n_bounded = 0;
+    int *volume_indices = malloc(number_of_volumes*sizeof(int));
+    
+    bounds->num_volumes = number_of_volumes;
+    bounds->center = malloc(number_of_volumes*sizeof(Coords));
+    bounds->radius = malloc(number_of_volumes*sizeof(double));
+    bounds->candidate = calloc(number_of_volumes, sizeof(int));
+    bounds->stamp = 0;
+    bounds->queried = 0;
+    
+    bounds->radius[0] = -1;
+    for (volume_index=1;volume_index<number_of_volumes;volume_index++) {
+        bounds->center[volume_index] = Volumes[volume_index]->geometry.center;
+        bounds->radius[volume_index] = geometry_bounding_radius(&Volumes[volume_index]->geometry);
+        // Padded so rays grazing the surface are never culled by rounding
+        if (bounds->radius[volume_index] >= 0) {
+            bounds->radius[volume_index] = bounds->radius[volume_index]*(1 + 1e-9) + 1e-12;
+            volume_indices[n_bounded++] = volume_index;
+        }
+    }
+    
+    bounds->num_nodes = 0;
+    bounds->node_min = malloc(3*(2*n_bounded+1)*sizeof(double));
+    bounds->node_max = malloc(3*(2*n_bounded+1)*sizeof(double));
+    bounds->node_index = malloc((2*n_bounded+1)*sizeof(int));
+    bounds->node_leaf = malloc((2*n_bounded+1)*sizeof(int));
+    if (n_bounded > 0) build_volume_bounds_node(bounds, volume_indices, n_bounded);
+    
+    free(volume_indices);
+};
+
+void free_volume_bounds(struct volume_bounds_struct *bounds) {
+    free(bounds->center);
+    free(bounds->radius);
+    free(bounds->candidate);
+    free(bounds->node_min);
+    free(bounds->node_max);
+    free(bounds->node_index);
+    free(bounds->node_leaf);
+};
+
+void query_volume_bounds(struct volume_bounds_struct *bounds, double *r, double *v) {
+    // Stamps every volume whose bounding sphere the line through r along v passes, both directions are kept
+    //  as the intersection table holds negative times as well
+    int stack[64], stack_size = 0, node, axis, volume_index;
+    double t_min, t_max, t1, t2, inv, v2, cx, cy, cz, px, py, pz;
+    
+    bounds->stamp++;
+    bounds->queried = 1;
+    if (bounds->num_nodes == 0) return;
+    v2 = v[0]*v[0] + v[1]*v[1] + v[2]*v[2];
+    
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        node = stack[--stack_size];
+        if (bounds->node_leaf[node] == 1) {
+            // Distance from the center to the line, |(c - r) x v|^2 <= radius^2 |v|^2
+            volume_index = bounds->node_index[node];
+            cx = bounds->center[volume_index].x - r[0];
+            cy = bounds->center[volume_index].y - r[1];
+            cz = bounds->center[volume_index].z - r[2];
+            px = cy*v[2] - cz*v[1];
+            py = cz*v[0] - cx*v[2];
+            pz = cx*v[1] - cy*v[0];
+            if (px*px + py*py + pz*pz <= bounds->radius[volume_index]*bounds->radius[volume_index]*v2)
+                bounds->candidate[volume_index] = bounds->stamp;
+            continue;
+        }
+        
+        t_min = -1e300; t_max = 1e300;
+        for (axis=0;axis<3;axis++) {
+            if (v[axis] == 0) {
+                if (r[axis] < bounds->node_min[3*node+axis] || r[axis] > bounds->node_max[3*node+axis]) t_min = 1e300;
+            } else {
+                inv = 1.0/v[axis];
+                t1 = (bounds->node_min[3*node+axis] - r[axis])*inv;
+                t2 = (bounds->node_max[3*node+axis] - r[axis])*inv;
+                t_min = fmax(t_min, fmin(t1,t2));
+                t_max = fmin(t_max, fmax(t1,t2));
+            }
+        }
+        if (t_min > t_max) continue;
+        
+        if (stack_size + 2 > 64) {
+            // Deeper than any master would build, stop culling for this segment
+            for (volume_index=1;volume_index<bounds->num_volumes;volume_index++) bounds->candidate[volume_index] = bounds->stamp;
+            return;
+        }
+        stack[stack_size++] = bounds->node_index[node];
+        stack[stack_size++] = node + 1;
+    }
+};
+
+int volume_bounds_candidate(struct volume_bounds_struct *bounds, int volume_index) {
+    return bounds->radius[volume_index] < 0 || bounds->candidate[volume_index] == bounds->stamp;
+};
+
+// -------------    Intersection table with broad phase   ------------------------------------------------
+void reset_intersection_table(struct intersection_time_table_struct *intersection_time_table, struct volume_bounds_struct *bounds) {
+    // As clear_intersection_table, but only the volumes calculated since the last reset are visited, and the broad
+    //  phase is queried again for the next segment
+    int iterate, volume_index, iterate_solutions;
+    
+    for (iterate=0;iterate<intersection_time_table->num_calculated;iterate++) {
+        volume_index = intersection_time_table->calculated_list[iterate];
+        intersection_time_table->calculated[volume_index] = 0;
+        for (iterate_solutions = 0;iterate_solutions < intersection_time_table->n_elements[volume_index];iterate_solutions++) {
+            intersection_time_table->intersection_times[volume_index][iterate_solutions] = -1;
+        }
+    }
+    intersection_time_table->num_calculated = 0;
+    bounds->queried = 0;
+};
+
+int calculate_intersection_table_entry(struct intersection_time_table_struct *intersection_time_table, struct volume_bounds_struct *bounds, int volume_index, int *num_solutions, double *r, double *v, struct geometry_struct *geometry) {
+    // Fills the intersection times of one volume for the segment starting at r along v, which stays the same until the next reset
+    int output = 0;
+    
+    if (bounds->queried == 0) query_volume_bounds(bounds, r, v);
+    
+    if (volume_bounds_candidate(bounds, volume_index)) {
+        output = intersect_function(intersection_time_table->intersection_times[volume_index], num_solutions, r, v, geometry);
+    } else {
+        *num_solutions = 0; // times are already -1 from the last reset
+    }
+    
+    intersection_time_table->calculated[volume_index] = 1;
+    intersection_time_table->calculated_list[intersection_time_table->num_calculated++] = volume_index;
+    return output;
+};
+
+
 // -------------    List generator functions   --------------------------------------------------
 
 
@@ -0,0 +1,71 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/union_arena-lib.c
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Bump arena for Union allocations, see union_arena-lib.h.
+*
+* Usage: within SHARE, before union-lib.c
+* %include "union_arena-lib"
+*
+*******************************************************************************/
+
+#ifndef UNION_ARENA_LIB_H
+#error McStas : please import this library with %include "union_arena-lib"
+#endif
+
+/* header size, rounded so that the data of a block is aligned */
+#define UNION_ARENA_HEADER ((sizeof(struct union_arena_block) + UNION_ARENA_ALIGN - 1) & ~(size_t)(UNION_ARENA_ALIGN - 1))
+
+void union_arena_init(struct union_arena *arena, size_t block_size) {
+  memset(arena, 0, sizeof(struct union_arena));
+  arena->block_size = block_size > 0 ? block_size : 65536;
+}
+
+void *union_arena_alloc(struct union_arena *arena, size_t size) {
+  struct union_arena_block *block = arena->head;
+
+  size = (size + UNION_ARENA_ALIGN - 1) & ~(size_t)(UNION_ARENA_ALIGN - 1);
+  if (size == 0) size = UNION_ARENA_ALIGN;
+
+  if (block == NULL || block->used + size > block->size) {
+    size_t data = size > arena->block_size ? size : arena->block_size;
+    block = (struct union_arena_block*) malloc(UNION_ARENA_HEADER + data);
+    if (block == NULL) {
+      printf("ERROR, Union arena could not allocate %ld bytes\n", (long)(UNION_ARENA_HEADER + data));
+      return NULL;
+    }
+    block->next = arena->head;
+    block->used = 0;
+    block->size = data;
+    arena->head = block;
+    arena->blocks++;
+  }
+
+  arena->allocations++;
+  arena->bytes += size;
+  block->used += size;
+  return (char*) block + UNION_ARENA_HEADER + block->used - size;
+}
+
+void union_arena_free(struct union_arena *arena) {
+  struct union_arena_block *block = arena->head;
+  while (block) {
+    struct union_arena_block *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->head = NULL;
+}
+
+/* end of union_arena-lib.c */
@@ -0,0 +1,53 @@
+/*******************************************************************************
+*
+* McStas, neutron ray-tracing package
+*         Written for mcparse, https://github.com/climbcat/mcparse,
+*         not part of the McStas distribution
+*
+* Library: share/union_arena-lib.h
+*
+* %Identification
+* Written by: mcparse contributors, see the mcparse git history
+* Date: Oct 19, 2026
+* Origin: mcparse
+* Release: mcparse 0.1.0
+* Version: $Revision$
+*
+* Bump arena for Union allocations that live until they are released all at
+* once, like the nodes of the tagging tree of a Union_master. Memory is cut
+* from blocks of at least block_size bytes, so allocating a node in trace is
+* a pointer increment. An arena is not safe for concurrent use.
+*
+* Usage: within SHARE, before union-lib.c
+* %include "union_arena-lib"
+*
+*******************************************************************************/
+
+#ifndef UNION_ARENA_LIB_H
+
+#define UNION_ARENA_LIB_H "$Revision$"
+#define UNION_ARENA_ALIGN 16     /* alignment of every allocation */
+
+  struct union_arena_block
+  {
+    struct union_arena_block *next;
+    size_t used;
+    size_t size;                 /* bytes of data after the header */
+  };
+
+  struct union_arena
+  {
+    struct union_arena_block *head;   /* block being filled */
+    size_t block_size;
+    long   allocations;          /* allocations served */
+    long   blocks;               /* blocks taken from malloc */
+    size_t bytes;                /* bytes served */
+  };
+
+  void  union_arena_init(struct union_arena *arena, size_t block_size);
+  void *union_arena_alloc(struct union_arena *arena, size_t size);
+  void  union_arena_free(struct union_arena *arena);
+
+#endif
+
+/* end of union_arena-lib.h */
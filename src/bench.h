@@ -0,0 +1,374 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+
+//
+//  Benchmark mode
+//
+//  mcparse --bench <lib-path> --reps N runs every pipeline stage N times over the .comp and .instr files of a
+//  library, each repetition into a cleared arena. Files are loaded twice per repetition: cold, after asking the
+//  kernel to drop them from the page cache, and warm. The later stages work on the warm texts and write nothing.
+//  Results can be saved as JSON and compared against an earlier run, stage by stage on the median.
+
+
+enum BenchStage {
+    BS_LOAD_COLD,
+    BS_LOAD_WARM,
+    BS_TOKENIZE,
+    BS_PARSE_COMPS,
+    BS_PARSE_INSTRS,
+    BS_CHECK,
+    BS_COGEN_COMPS,
+    BS_COGEN_INSTRS,
+
+    BS_CNT
+};
+
+static const char *g_bench_stage_names[BS_CNT] = {
+    "load_cold",
+    "load_warm",
+    "tokenize",
+    "parse_comps",
+    "parse_instrs",
+    "check",
+    "cogen_comps",
+    "cogen_instrs",
+};
+
+struct BenchStageResult {
+    f64 *secs;      // one per repetition
+    u64 bytes;      // input bytes, or generated bytes for the cogen stages
+    u64 tokens;
+    u64 arena_bytes;
+    f64 min;
+    f64 median;
+    f64 p99;
+};
+
+struct BenchResult {
+    s32 reps;
+    s32 comp_cnt;
+    s32 instr_cnt;
+    BenchStageResult stages[BS_CNT];
+};
+
+static f64 BenchNow() {
+    using namespace std::chrono;
+    return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void _BenchEvict(Str path) {
+    // drops clean pages of the file from the page cache, advisory
+    s32 fd = open(StrZ(path), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static u64 _BenchArenaUsed(MArena *a_rep) {
+    // cogen allocates from the context arenas
+    MContext *ctx = GetContext();
+    return a_rep->used + ctx->a_tmp->used + ctx->a_life->used;
+}
+
+static s32 _BenchCompareF64(const void *a, const void *b) {
+    f64 x = *(f64*) a;
+    f64 y = *(f64*) b;
+    return (x > y) - (x < y);
+}
+
+static void _BenchStats(BenchStageResult *s, s32 reps) {
+    f64 *sorted = (f64*) ArenaPush(GetContext()->a_tmp, s->secs, sizeof(f64) * reps);
+    qsort(sorted, reps, sizeof(f64), _BenchCompareF64);
+
+    // nearest rank
+    s32 p99 = (s32) ceil(0.99 * reps) - 1;
+    s->min = sorted[0];
+    s->median = sorted[reps / 2];
+    s->p99 = sorted[p99 < 0 ? 0 : p99];
+}
+
+static void _BenchLoad(MArena *a_dest, Array<Str> paths, Array<Str> texts, BenchStageResult *s, s32 rep, bool cold) {
+    if (cold) {
+        for (u32 i = 0; i < paths.len; ++i) {
+            _BenchEvict(paths.arr[i]);
+        }
+    }
+
+    u64 used = _BenchArenaUsed(a_dest);
+    f64 t0 = BenchNow();
+    for (u32 i = 0; i < paths.len; ++i) {
+        texts.arr[i] = LoadTextFileFSeek(a_dest, paths.arr[i]);
+    }
+    s->secs[rep] += BenchNow() - t0;
+
+    if (rep == 0) {
+        for (u32 i = 0; i < texts.len; ++i) {
+            s->bytes += texts.arr[i].len;
+        }
+        s->arena_bytes += _BenchArenaUsed(a_dest) - used;
+    }
+}
+
+BenchResult RunBench(const char *lib_path, s32 reps) {
+    MContext *ctx = InitBaselayer();
+
+    BenchResult res = {};
+    res.reps = reps;
+    for (s32 k = 0; k < BS_CNT; ++k) {
+        res.stages[k].secs = (f64*) ArenaAlloc(ctx->a_life, sizeof(f64) * reps);
+    }
+
+    StrLst *comp_files = GetFiles(lib_path, "comp", true);
+    StrLst *instr_files = GetFiles(lib_path, "instr", true);
+    Array<Str> comp_paths = InitArray<Str>(ctx->a_life, StrListLen(comp_files));
+    Array<Str> instr_paths = InitArray<Str>(ctx->a_life, StrListLen(instr_files));
+    while (comp_files) {
+        comp_paths.Add(StrLstNext(&comp_files));
+    }
+    while (instr_files) {
+        instr_paths.Add(StrLstNext(&instr_files));
+    }
+    res.comp_cnt = comp_paths.len;
+    res.instr_cnt = instr_paths.len;
+
+    Array<Str> comp_texts = InitArray<Str>(ctx->a_life, comp_paths.len);
+    Array<Str> instr_texts = InitArray<Str>(ctx->a_life, instr_paths.len);
+    comp_texts.len = comp_paths.len;
+    instr_texts.len = instr_paths.len;
+    Array<ComponentParse*> comps = InitArray<ComponentParse*>(ctx->a_life, comp_paths.len);
+    Array<InstrumentParse*> instrs = InitArray<InstrumentParse*>(ctx->a_life, instr_paths.len);
+    EmitBuff b = EmitBuffInit();
+
+    // the parser and checker report as they go, which is part of the cost but not of the benchmark output
+    fflush(stdout);
+    s32 stdout_fd = dup(1);
+    s32 devnull = open("/dev/null", O_WRONLY);
+
+    MArena a_rep = ArenaCreate();
+    for (s32 rep = 0; rep < reps; ++rep) {
+        ArenaClear(&a_rep);
+        comps.len = 0;
+        instrs.len = 0;
+        BenchStageResult *s;
+        u64 used;
+        f64 t0;
+
+        fflush(stdout);
+        dup2(devnull, 1);
+
+        // load
+        _BenchLoad(&a_rep, comp_paths, comp_texts, res.stages + BS_LOAD_COLD, rep, true);
+        _BenchLoad(&a_rep, instr_paths, instr_texts, res.stages + BS_LOAD_COLD, rep, true);
+        _BenchLoad(&a_rep, comp_paths, comp_texts, res.stages + BS_LOAD_WARM, rep, false);
+        _BenchLoad(&a_rep, instr_paths, instr_texts, res.stages + BS_LOAD_WARM, rep, false);
+
+        // tokenize
+        s = res.stages + BS_TOKENIZE;
+        u64 tokens[2] = {};
+        t0 = BenchNow();
+        for (s32 k = 0; k < 2; ++k) {
+            Array<Str> texts = k ? instr_texts : comp_texts;
+            for (u32 i = 0; i < texts.len; ++i) {
+                Tokenizer t = {};
+                t.Init(texts.arr[i].str);
+                while (GetToken(&t).type != TOK_ENDOFSTREAM) {
+                    tokens[k]++;
+                }
+            }
+        }
+        s->secs[rep] = BenchNow() - t0;
+        if (rep == 0) {
+            s->tokens = tokens[0] + tokens[1];
+            s->bytes = res.stages[BS_LOAD_WARM].bytes;
+            res.stages[BS_PARSE_COMPS].tokens = tokens[0];
+            res.stages[BS_PARSE_INSTRS].tokens = tokens[1];
+        }
+
+        // parse
+        s = res.stages + BS_PARSE_COMPS;
+        used = _BenchArenaUsed(&a_rep);
+        HashMap comp_map = InitMap(&a_rep, comp_paths.len * 3);
+        t0 = BenchNow();
+        for (u32 i = 0; i < comp_texts.len; ++i) {
+            ComponentParse *comp = ParseComponent(&a_rep, comp_texts.arr[i]);
+            if (comp->parse_error == false && MapGet(&comp_map, (u64) comp->type_sym) == 0) {
+                comp->file_path = comp_paths.arr[i];
+                MapPut(&comp_map, (u64) comp->type_sym, comp);
+                comps.Add(comp);
+            }
+        }
+        s->secs[rep] = BenchNow() - t0;
+        if (rep == 0) {
+            for (u32 i = 0; i < comp_texts.len; ++i) {
+                s->bytes += comp_texts.arr[i].len;
+            }
+            s->arena_bytes = _BenchArenaUsed(&a_rep) - used;
+        }
+
+        s = res.stages + BS_PARSE_INSTRS;
+        used = _BenchArenaUsed(&a_rep);
+        t0 = BenchNow();
+        for (u32 i = 0; i < instr_texts.len; ++i) {
+            InstrumentParse *instr = ParseInstrument(&a_rep, instr_texts.arr[i]);
+            instr->path = instr_paths.arr[i];
+            if (instr->parse_error == false) {
+                instrs.Add(instr);
+            }
+        }
+        s->secs[rep] = BenchNow() - t0;
+        if (rep == 0) {
+            for (u32 i = 0; i < instr_texts.len; ++i) {
+                s->bytes += instr_texts.arr[i].len;
+            }
+            s->arena_bytes = _BenchArenaUsed(&a_rep) - used;
+        }
+
+        // check
+        s = res.stages + BS_CHECK;
+        used = _BenchArenaUsed(&a_rep);
+        ParseStats stats = {};
+        t0 = BenchNow();
+        for (u32 i = 0; i < instrs.len; ++i) {
+            CheckInstrument(&a_rep, instrs.arr[i], &comp_map, &stats);
+        }
+        s->secs[rep] = BenchNow() - t0;
+        if (rep == 0) {
+            s->bytes = res.stages[BS_PARSE_INSTRS].bytes;
+            s->arena_bytes = _BenchArenaUsed(&a_rep) - used;
+        }
+
+        // cogen, output is discarded
+        s = res.stages + BS_COGEN_COMPS;
+        used = _BenchArenaUsed(&a_rep);
+        u64 bytes = 0;
+        t0 = BenchNow();
+        for (u32 i = 0; i < comps.len; ++i) {
+            EmitBuffClear(&b);
+            CogenComponent(&b, comps.arr[i]);
+            bytes += b.len;
+        }
+        s->secs[rep] = BenchNow() - t0;
+        if (rep == 0) {
+            s->bytes = bytes;
+            s->arena_bytes = _BenchArenaUsed(&a_rep) - used;
+        }
+
+        s = res.stages + BS_COGEN_INSTRS;
+        used = _BenchArenaUsed(&a_rep);
+        bytes = 0;
+        t0 = BenchNow();
+        for (u32 i = 0; i < instrs.len; ++i) {
+            if (instrs.arr[i]->namerefs_checked) {
+                EmitBuffClear(&b);
+                CogenInstrumentConfig(&b, instrs.arr[i]);
+                bytes += b.len;
+            }
+        }
+        s->secs[rep] = BenchNow() - t0;
+        if (rep == 0) {
+            s->bytes = bytes;
+            s->arena_bytes = _BenchArenaUsed(&a_rep) - used;
+        }
+
+        fflush(stdout);
+        dup2(stdout_fd, 1);
+    }
+    close(devnull);
+    close(stdout_fd);
+
+    for (s32 k = 0; k < BS_CNT; ++k) {
+        _BenchStats(res.stages + k, reps);
+    }
+    return res;
+}
+
+void BenchPrint(BenchResult *res) {
+    printf("Benchmark: %d components, %d instruments, %d repetitions\n\n", res->comp_cnt, res->instr_cnt, res->reps);
+    printf("%-14s %10s %10s %10s %10s %10s %10s\n", "stage", "min ms", "median ms", "p99 ms", "MB/s", "Mtok/s", "alloc KB");
+    for (s32 k = 0; k < BS_CNT; ++k) {
+        BenchStageResult *s = res->stages + k;
+        f64 mbs = s->median > 0 ? s->bytes / s->median / (1024 * 1024) : 0;
+        printf("%-14s %10.3f %10.3f %10.3f %10.1f ", g_bench_stage_names[k], s->min * 1000, s->median * 1000, s->p99 * 1000, mbs);
+        if (s->tokens && s->median > 0) {
+            printf("%10.2f ", s->tokens / s->median / 1e6);
+        }
+        else {
+            printf("%10s ", "-");
+        }
+        printf("%10lu\n", s->arena_bytes / 1024);
+    }
+    printf("\n");
+}
+
+bool BenchSaveJson(BenchResult *res, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        printf("ERROR: could not write %s\n", path);
+        return false;
+    }
+
+    // one stage per line, BenchLoadMedian reads it back
+    fprintf(f, "{\n");
+    fprintf(f, "  \"reps\": %d,\n", res->reps);
+    fprintf(f, "  \"components\": %d,\n", res->comp_cnt);
+    fprintf(f, "  \"instruments\": %d,\n", res->instr_cnt);
+    fprintf(f, "  \"stages\": {\n");
+    for (s32 k = 0; k < BS_CNT; ++k) {
+        BenchStageResult *s = res->stages + k;
+        fprintf(f, "    \"%s\": { \"min_ms\": %.6f, \"median_ms\": %.6f, \"p99_ms\": %.6f, \"bytes\": %lu, \"tokens\": %lu, \"arena_bytes\": %lu }%s\n",
+            g_bench_stage_names[k], s->min * 1000, s->median * 1000, s->p99 * 1000, s->bytes, s->tokens, s->arena_bytes, k + 1 < BS_CNT ? "," : "");
+    }
+    fprintf(f, "  }\n");
+    fprintf(f, "}\n");
+    fclose(f);
+
+    return true;
+}
+
+bool BenchLoadMedian(Str json, const char *stage, f64 *median_ms) {
+    char key[64];
+    snprintf(key, 64, "\"%s\":", stage);
+
+    char *at = strstr(json.str, key);
+    char *eol = at ? strchr(at, '\n') : NULL;
+    char *val = at ? strstr(at, "\"median_ms\":") : NULL;
+    if (val == NULL || (eol && val > eol)) {
+        return false;
+    }
+    *median_ms = strtod(val + 12, NULL);
+    return true;
+}
+
+s32 BenchCompare(BenchResult *res, const char *baseline_path, f64 threshold_pct) {
+    // stages slower than the baseline median by more than the threshold count as regressions
+    Str json = LoadTextFileFSeek(GetContext()->a_tmp, StrL((char*) baseline_path));
+    if (json.len == 0) {
+        printf("ERROR: could not read baseline %s\n", baseline_path);
+        return -1;
+    }
+
+    s32 regressions = 0;
+    printf("Baseline: %s, threshold %.1f%%\n\n", baseline_path, threshold_pct);
+    printf("%-14s %12s %12s %9s\n", "stage", "baseline ms", "median ms", "change");
+    for (s32 k = 0; k < BS_CNT; ++k) {
+        f64 base;
+        f64 cur = res->stages[k].median * 1000;
+        if (BenchLoadMedian(json, g_bench_stage_names[k], &base) == false || base <= 0) {
+            printf("%-14s %12s %12.3f\n", g_bench_stage_names[k], "-", cur);
+            continue;
+        }
+
+        f64 change = (cur - base) / base * 100;
+        bool regressed = change > threshold_pct;
+        regressions += regressed;
+        printf("%-14s %12.3f %12.3f %+8.1f%%%s\n", g_bench_stage_names[k], base, cur, change, regressed ? "  REGRESSION" : "");
+    }
+    printf("\n");
+
+    return regressions;
+}
+
+
+#endif
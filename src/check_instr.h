@@ -0,0 +1,371 @@
+#ifndef __CHECK_INSTR_H__
+#define __CHECK_INSTR_H__
+
+
+struct ParseStats {
+    s32 total_cnt = 0;
+    s32 parsed_cnt = 0;
+    s32 registered_cnt = 0;
+    s32 duplicate_cnt = 0;
+    s32 parse_error_cnt = 0;
+    s32 type_error_cnt = 0;
+    s32 nameref_error_cnt = 0;
+};
+
+
+//
+//  Instance name resolution
+//
+//  The check registers instance names in a name -> index table as it walks the component list, so that
+//  COPY and AT/ROTATED RELATIVE references (which must point backwards) are resolved with one lookup each.
+//  JUMP targets may point forwards and are resolved against the complete table after the walk.
+//  All errors are reported in the same pass.
+//
+//  The walk is split into CheckBegin / CheckComponent / CheckEnd, so that it can run on a stream of component
+//  calls. In that case instr->comps is empty, and COPY sources are retained through copy_sources: names found by
+//  PreScanCopySources, mapped to 1 until seen and then to a retained copy of the component call.
+//
+//  A "%include "X.instr"" in TRACE inserts the component calls of another instrument at that point. The included
+//  instrument is loaded and parsed when the walk reaches it, and its instance names are entered in map_included
+//  (name -> retained component call), so that PREVIOUS, RELATIVE, COPY and JUMP may refer to them. REMOVABLE calls
+//  are dropped, and the included calls are not part of instr->comps. If an include can not be found, a warning is printed and references that
+//  are not found are not reported as errors.
+
+
+struct JumpRef {
+    Str name;
+    Str jump;
+    Sym jump_sym;
+    s32 idx;
+    bool has_prev;
+};
+
+struct CheckState {
+    MArena *a_tmp;
+    InstrumentParse *instr;
+    HashMap *comps;
+    ParseStats *stats;
+    HashMap *copy_sources;
+
+    HashMap map_names;
+    HashMap map_cpys;
+    HashMap map_included;
+    Array<JumpRef> jumps;
+    ComponentCall prev;
+    s32 idx;
+    u32 includes_done;
+
+    bool has_prev;
+    bool includes_unresolved;
+    bool type_error;
+    bool nameref_error;
+    bool dbg_print_missing_types;
+};
+
+
+static s32 _NameIndex(HashMap *map_names, Sym name) {
+    // the table stores index + 1, zero means "not found"
+    return (s32) MapGet(map_names, (u64) name) - 1;
+}
+
+static void _PrintNameRefError(ComponentCall *c, s32 idx, const char *what, Str ref) {
+    printf("\n    ERROR: %s \"%.*s\" not found (idx %d, %.*s)", what, ref.len, ref.str, idx, c->name.len, c->name.str);
+}
+
+static bool _NameKnown(CheckState *cs, Sym name) {
+    return _NameIndex(&cs->map_names, name) >= 0 || MapGet(&cs->map_included, (u64) name) != 0;
+}
+
+static bool _ResolveRelative(CheckState *cs, ComponentCall *c, Str *relative_to, Sym *relative_sym, bool *absolute) {
+    if (relative_to->len == 0) {
+        return true;
+    }
+    if (*relative_sym == SYM_KW_ABSOLUTE) {
+        *absolute = true;
+        return true;
+    }
+    if (*relative_sym == SYM_KW_PREVIOUS) {
+        if (cs->has_prev == false) {
+            if (cs->includes_unresolved) {
+                return true;
+            }
+            printf("\n    ERROR: RELATIVE PREVIOUS used by the first component call");
+            return false;
+        }
+        *relative_to = cs->prev.name;
+        *relative_sym = cs->prev.name_sym;
+        return true;
+    }
+    if (_NameKnown(cs, *relative_sym) == false && cs->includes_unresolved == false) {
+        _PrintNameRefError(c, cs->idx, "RELATIVE reference", *relative_to);
+        return false;
+    }
+    return true;
+}
+
+static ComponentCall *_CopySource(CheckState *cs, s32 org_idx, Sym name) {
+    if (org_idx < 0) {
+        return (ComponentCall*) MapGet(&cs->map_included, (u64) name);
+    }
+    if (cs->copy_sources) {
+        u64 org = MapGet(cs->copy_sources, (u64) name);
+        return (org > 1) ? (ComponentCall*) org : NULL;
+    }
+    return cs->instr->comps.arr + org_idx;
+}
+
+static void _ExpandCopyName(CheckState *cs, ComponentCall *c) {
+    // We don't need to check that a component by name exists unless we are dealing with PREVIOUS.
+    // We just need the index to put in the component name.
+    u64 copy_name_index = MapGet(&cs->map_cpys, (u64) c->copy_name_sym);
+    copy_name_index++;
+    MapPut(&cs->map_cpys, (u64) c->copy_name_sym, (void*) copy_name_index);
+
+    c->name = StrAlloc(c->copy_name.len + 12);
+    StrCopy(c->copy_name, c->name);
+
+    char subscript[12];
+    sprintf(subscript, "_%lu", copy_name_index);
+    strcat(c->name.str, subscript);
+    c->name.len = strlen(c->name.str);
+    c->name_sym = StrIntern(c->name);
+}
+
+#define CHECK_INCLUDE_DEPTH_MAX 8
+
+static InstrumentParse *_LoadInclude(CheckState *cs, Str dir, Str include) {
+    // include paths are relative to the including instrument or to one of its parent directories
+    if (include.len >= 2 && include.str[0] == '"') {
+        include = Str { include.str + 1, include.len - 2 };
+    }
+    while (true) {
+        Str path = dir.len ? StrCat(StrCat(dir, "/"), include) : include;
+        Str text = LoadTextFileFSeek(cs->a_tmp, path);
+        if (text.len) {
+            InstrumentParse *incl = ParseInstrument(cs->a_tmp, text);
+            incl->path = path;
+            return incl->parse_error ? NULL : incl;
+        }
+        if (dir.len == 0) {
+            return NULL;
+        }
+        dir = StrDirPath(dir);
+    }
+}
+
+static void _SeedIncluded(CheckState *cs, ComponentCall *c) {
+    if (c->copy_name.len) {
+        _ExpandCopyName(cs, c);
+    }
+    if (c->copy_type.len) {
+        ComponentCall *org = NULL;
+        if (c->copy_type_sym == SYM_KW_PREVIOUS) {
+            org = cs->has_prev ? &cs->prev : NULL;
+        }
+        else {
+            org = (ComponentCall*) MapGet(&cs->map_included, (u64) c->copy_type_sym);
+        }
+        if (org) {
+            c->type = org->type;
+            c->type_sym = org->type_sym;
+            c->args = org->args;
+        }
+    }
+    MapPut(&cs->map_included, (u64) c->name_sym, c);
+    cs->prev = *c;
+    cs->has_prev = true;
+}
+
+static void _CheckInclude(CheckState *cs, Str dir, Str include, s32 depth) {
+    InstrumentParse *incl = NULL;
+    if (depth < CHECK_INCLUDE_DEPTH_MAX) {
+        incl = _LoadInclude(cs, dir, include);
+    }
+    if (incl == NULL) {
+        cs->includes_unresolved = true;
+        printf("\n    WARNING: %%include %.*s not loaded, instance names are not checked against it", include.len, include.str);
+        return;
+    }
+
+    // seed the included calls and, recursively, the instruments they include, in TRACE order
+    Str incl_dir = StrDirPath(incl->path);
+    u32 j = 0;
+    for (s32 i = 0; i <= incl->comps.len; ++i) {
+        while (j < incl->includes.len && incl->includes_at.arr[j] <= i) {
+            _CheckInclude(cs, incl_dir, incl->includes.arr[j], depth + 1);
+            j++;
+        }
+        // REMOVABLE calls are left out when an instrument is included
+        if (i < incl->comps.len && incl->comps.arr[i].removable == false) {
+            _SeedIncluded(cs, incl->comps.arr + i);
+        }
+    }
+}
+
+static void _CheckIncludesBefore(CheckState *cs, s32 calls_cnt) {
+    InstrumentParse *instr = cs->instr;
+    while (cs->includes_done < instr->includes.len && instr->includes_at.arr[cs->includes_done] <= calls_cnt) {
+        _CheckInclude(cs, StrDirPath(instr->path), instr->includes.arr[cs->includes_done], 0);
+        cs->includes_done++;
+    }
+}
+
+CheckState CheckBegin(MArena *a_tmp, InstrumentParse *instr, HashMap *comps, ParseStats *stats, s32 comps_cnt, HashMap *copy_sources = NULL, bool dbg_print_missing_types = false) {
+    CheckState cs = {};
+    cs.a_tmp = a_tmp;
+    cs.instr = instr;
+    cs.comps = comps;
+    cs.stats = stats;
+    cs.copy_sources = copy_sources;
+    cs.dbg_print_missing_types = dbg_print_missing_types;
+    cs.map_names = InitMap(a_tmp, comps_cnt * 2 + 1);
+    cs.map_cpys = InitMap(a_tmp, comps_cnt / 4 + 1);
+    cs.map_included = InitMap(a_tmp, instr->includes.len ? 256 : 1);
+
+    printf("checking  #%d: ", instr->check_idx);
+    StrPrint(instr->name);
+
+    return cs;
+}
+
+void CheckComponent(CheckState *cs, ComponentCall *c) {
+    s32 i = cs->idx;
+    _CheckIncludesBefore(cs, i);
+
+    // Handle "... = COPY (copy_type)":
+    //      Meaning, we eliminate any COPY notes and reference the .type and .args.
+    if (c->copy_type.len) {
+        if (c->copy_type_sym == SYM_KW_PREVIOUS) {
+            if (cs->has_prev == false) {
+                if (cs->includes_unresolved == false) {
+                    cs->nameref_error = true;
+                    printf("\n    ERROR: COPY(PREVIOUS) can not be the first component call");
+                }
+            }
+            else {
+                c->type = cs->prev.type;
+                c->type_sym = cs->prev.type_sym;
+            }
+        }
+        else {
+            s32 org_idx = _NameIndex(&cs->map_names, c->copy_type_sym);
+            ComponentCall *org_comp = _CopySource(cs, org_idx, c->copy_type_sym);
+            if (org_comp == NULL) {
+                if (cs->includes_unresolved == false) {
+                    cs->nameref_error = true;
+                    _PrintNameRefError(c, i, "COPY source", c->copy_type);
+                }
+            }
+            else {
+                // reference the type and args of the copied component
+                c->type = org_comp->type;
+                c->type_sym = org_comp->type_sym;
+                c->args = org_comp->args;
+            }
+        }
+    }
+
+    // Handle "COPY (copy_name) = ...":
+    //      Meaning, we eliminate any COPY notes and coyp the .name.
+    if (c->copy_name.len) {
+        _ExpandCopyName(cs, c);
+    }
+
+    // placement references must name an earlier component
+    if (c->at_absolute == false) {
+        cs->nameref_error |= ! _ResolveRelative(cs, c, &c->at_relative_to, &c->at_relative_sym, &c->at_absolute);
+    }
+    if (c->rot_defined && c->rot_absolute == false) {
+        cs->nameref_error |= ! _ResolveRelative(cs, c, &c->rot_relative_to, &c->rot_relative_sym, &c->rot_absolute);
+    }
+
+    // register the instance name
+    if (_NameKnown(cs, c->name_sym)) {
+        cs->nameref_error = true;
+        printf("\n    ERROR: Duplicate component instance name \"%.*s\" (idx %d)", c->name.len, c->name.str, i);
+    }
+    else {
+        MapPut(&cs->map_names, (u64) c->name_sym, (u64) i + 1);
+    }
+
+    // JUMP targets are resolved in CheckEnd
+    if (c->jump.len) {
+        JumpRef jr = { c->name, c->jump, c->jump_sym, i, cs->has_prev };
+        ArrayAddGrow(cs->a_tmp, &cs->jumps, jr);
+    }
+
+    // streaming: keep the calls that later COPY statements refer to
+    if (cs->copy_sources && MapGet(cs->copy_sources, (u64) c->name_sym)) {
+        ComponentCall *keep = (ComponentCall*) ArenaAlloc(cs->a_tmp, sizeof(ComponentCall));
+        *keep = *c;
+        keep->args = InitArray<Parameter>(cs->a_tmp, c->args.len);
+        for (s32 j = 0; j < c->args.len; ++j) {
+            keep->args.Add(c->args.arr[j]);
+        }
+        MapPut(cs->copy_sources, (u64) c->name_sym, keep);
+    }
+
+    u64 comp_exists = MapGet(cs->comps, (u64) c->type_sym);
+    if (comp_exists == 0) {
+        cs->type_error = true;
+        cs->stats->type_error_cnt++;
+
+        if (cs->dbg_print_missing_types) {
+            printf("\n");
+            printf("    Missing component type (idx %d): ", i);
+            StrPrint(c->type);
+        }
+    }
+
+    cs->prev = *c;
+    cs->has_prev = true;
+    cs->idx++;
+}
+
+bool CheckEnd(CheckState *cs) {
+    InstrumentParse *instr = cs->instr;
+    _CheckIncludesBefore(cs, cs->idx);
+
+    // JUMP targets may reference any component, including later ones
+    for (u32 i = 0; i < cs->jumps.len; ++i) {
+        JumpRef jr = cs->jumps.arr[i];
+
+        if (jr.jump_sym == SYM_KW_PREVIOUS) {
+            if (jr.has_prev == false && cs->includes_unresolved == false) {
+                cs->nameref_error = true;
+                printf("\n    ERROR: JUMP PREVIOUS used by the first component call");
+            }
+        }
+        else if (_NameKnown(cs, jr.jump_sym) == false && cs->includes_unresolved == false && ! StrEqual(jr.jump, "MYSELF") && ! StrEqual(jr.jump, "NEXT")) {
+            cs->nameref_error = true;
+            printf("\n    ERROR: JUMP target \"%.*s\" not found (idx %d, %.*s)", jr.jump.len, jr.jump.str, jr.idx, jr.name.len, jr.name.str);
+        }
+    }
+    if (cs->nameref_error) {
+        cs->stats->nameref_error_cnt++;
+    }
+
+    instr->type_checked = ! cs->type_error;
+    instr->namerefs_checked = ! cs->nameref_error;
+
+    if ((instr->type_checked == true) && (instr->namerefs_checked == true)) { printf(" - OK"); }
+    if ((instr->type_checked == false && cs->dbg_print_missing_types == false)) { printf("\n    ERROR: Missing component types"); }
+    if ((instr->namerefs_checked == false)) { printf("\n    ERROR: Component instance name reference"); }
+    if ((cs->type_error || cs->nameref_error) && cs->dbg_print_missing_types) { printf("\n"); }
+    printf("\n");
+
+    return (! cs->type_error) && (! cs->nameref_error);
+}
+
+bool CheckInstrument(MArena *a_tmp, InstrumentParse *instr, HashMap *comps, ParseStats *stats, bool dbg_print_missing_types = false) {
+    TimeFunction;
+
+    CheckState cs = CheckBegin(a_tmp, instr, comps, stats, instr->comps.len, NULL, dbg_print_missing_types);
+    for (s32 i = 0; i < instr->comps.len; ++i) {
+        CheckComponent(&cs, instr->comps.arr + i);
+    }
+    return CheckEnd(&cs);
+}
+
+
+#endif
@@ -2,83 +2,350 @@
 #define __COGENCOMP_H__
 
 
-void PrintDefines(StrBuff *b, ComponentParse *comp) {
+void PrintDefines(EmitBuff *b, ComponentParse *comp) {
     for (s32 i = 0; i < comp->setting_params.len; ++i) {
         Parameter p = comp->setting_params.arr[i];
-        StrBuffPrint1K(b, "    #define %.*s comp->%.*s\n", 4, p.name.len, p.name.str, p.name.len, p.name.str);
+        Emit(b, "    #define ", p.name, " comp->", p.name, "\n");
     }
-    StrBuffPrint1K(b, "\n", 0);
+    Emit(b, "\n");
     for (s32 i = 0; i < comp->declare_members.len; ++i) {
         StructMember m = comp->declare_members.arr[i];
-        StrBuffPrint1K(b, "    #define %.*s comp->%.*s\n", 4, m.name.len, m.name.str, m.name.len, m.name.str);
+        Emit(b, "    #define ", m.name, " comp->", m.name, "\n");
     }
 
     // TODO: output, state, ..., params
 }
-void PrintUndefs(StrBuff *b, ComponentParse *comp) {
+void PrintUndefs(EmitBuff *b, ComponentParse *comp) {
     for (s32 i = 0; i < comp->setting_params.len; ++i) {
         Parameter p = comp->setting_params.arr[i];
-        StrBuffPrint1K(b, "    #undef %.*s\n", 2, p.name.len, p.name.str);
+        Emit(b, "    #undef ", p.name, "\n");
     }
-    StrBuffPrint1K(b, "\n", 0);
+    Emit(b, "\n");
     for (s32 i = 0; i < comp->declare_members.len; ++i) {
         StructMember m = comp->declare_members.arr[i];
-        StrBuffPrint1K(b, "    #undef %.*s\n", 2, m.name.len, m.name.str);
+        Emit(b, "    #undef ", m.name, "\n");
     }
 
     // TODO: output, state, ..., params
 }
 
 
-void CogenComponent(StrBuff *b, ComponentParse *comp) {
+//
+//  Shared code
+//
+//  SHARE blocks are split into their %include directives and the remaining code. The %included libraries and
+//  any code that is identical in two or more components (keyed by a content hash) are hoisted into
+//  comps_shared.h, which comps_meta.h includes once before the component headers. Library files are included
+//  by name, so the library share directory must be on the include path.
+//
+//  An %include is only hoisted when it is outside any #if and no code precedes it in the SHARE block, since code
+//  before it may set up the library (#define USE_CUDA) or decide whether it is needed (#ifndef OPENACC). Other
+//  %includes stay where they are, as #includes. Every library is wrapped in a guard named after it, so that it is
+//  compiled once per instrument whether it was hoisted, included inline, or both, as McStas does.
+
+
+struct ShareLib {
+    Str name;
+    s32 users;
+};
+
+struct ShareBlock {
+    u64 hash;
+    Str code;
+    s32 users;
+};
+
+struct ShareIndex {
+    Array<ShareLib> libs;
+    Array<ShareBlock> blocks;
+    HashMap libs_map;   // name symbol -> index + 1
+    HashMap blocks_map; // content hash -> index + 1
+};
+
+struct ShareSplit {
+    Array<Str> includes;
+    Str code;
+};
+
+u64 ShareHash(Str s) {
+    // FNV-1a
+    u64 h = 14695981039346656037ull;
+    for (u32 i = 0; i < s.len; ++i) {
+        h ^= (u8) s.str[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+void CogenShareLib(EmitBuff *b, Str name) {
+    Emit(b, "#ifndef __SHARE_LIB_", ShareHash(name), "__\n");
+    Emit(b, "#define __SHARE_LIB_", ShareHash(name), "__\n");
+    if (StrExtension(name).len) {
+        Emit(b, "#include \"", name, "\"\n");
+    }
+    else {
+        Emit(b, "#include \"", name, ".h\"\n");
+        Emit(b, "#include \"", name, ".c\"\n");
+    }
+    Emit(b, "#endif\n");
+}
+
+static bool _ShareLineStarts(char *c, char *next, const char *word) {
+    u32 len = strlen(word);
+    return next - c >= len && strncmp(c, word, len) == 0;
+}
+
+ShareSplit ShareSplitBlock(MArena *a_dest, Str share) {
+    // lifts the '%include "name"' lines that can be hoisted out of a SHARE block, and turns the others into #includes
+    ShareSplit split = {};
+    static EmitBuff code = {};
+    EmitBuffClear(&code);
+
+    s32 depth = 0;
+    bool code_seen = false;
+    bool in_comment = false;
+
+    char *at = share.str;
+    char *end = share.str + share.len;
+    while (at < end) {
+        char *eol = (char*) memchr(at, '\n', end - at);
+        char *next = eol ? eol + 1 : end;
+
+        char *c = at;
+        while (c < next && (*c == ' ' || *c == '\t')) {
+            ++c;
+        }
+        char *close = NULL;
+        if (in_comment) {
+            in_comment = (memmem(c, next - c, "*/", 2) == NULL);
+        }
+        else if (_ShareLineStarts(c, next, "%include")) {
+            char *q0 = (char*) memchr(c, '"', next - c);
+            char *q1 = q0 ? (char*) memchr(q0 + 1, '"', next - q0 - 1) : NULL;
+            if (q1) {
+                Str name = Str { q0 + 1, (u32) (q1 - q0 - 1) };
+                if (depth == 0 && code_seen == false) {
+                    ArrayAddGrow(a_dest, &split.includes, name);
+                }
+                else {
+                    CogenShareLib(&code, name);
+                }
+                at = next;
+                continue;
+            }
+            code_seen = true;
+        }
+        else if (c == next || IsWhitespace(*c) || _ShareLineStarts(c, next, "//")) {
+            // blank or comment line
+        }
+        else if (_ShareLineStarts(c, next, "/*") && ((close = (char*) memmem(c + 2, next - c - 2, "*/", 2)) == NULL)) {
+            in_comment = true;
+        }
+        else if (close) {
+            // a one-line comment is only a comment line when nothing follows it
+            char *rest = close + 2;
+            while (rest < next && IsWhitespace(*rest)) {
+                ++rest;
+            }
+            code_seen |= (rest < next);
+        }
+        else {
+            if (*c == '#') {
+                char *d = c + 1;
+                while (d < next && (*d == ' ' || *d == '\t')) {
+                    ++d;
+                }
+                if (_ShareLineStarts(d, next, "if")) {
+                    depth++;
+                }
+                else if (_ShareLineStarts(d, next, "endif")) {
+                    depth--;
+                }
+            }
+            code_seen = true;
+        }
+        _EmitBytes(&code, at, (u32) (next - at));
+        at = next;
+    }
+
+    split.code = StrAlloc(a_dest, code.len);
+    memcpy(split.code.str, code.str, code.len);
+
+    // identical code may differ in surrounding whitespace
+    while (split.code.len && IsWhitespace(split.code.str[0])) {
+        split.code.str++;
+        split.code.len--;
+    }
+    while (split.code.len && IsWhitespace(split.code.str[split.code.len - 1])) {
+        split.code.len--;
+    }
+    return split;
+}
+
+static int _ShareCompareComps(const void *a, const void *b) {
+    Str pa = (*(ComponentParse**) a)->file_path;
+    Str pb = (*(ComponentParse**) b)->file_path;
+    s32 cmp = strncmp(pa.str, pb.str, pa.len < pb.len ? pa.len : pb.len);
+    return cmp ? cmp : (s32) pa.len - (s32) pb.len;
+}
+
+ShareIndex ShareIndexBuild(MArena *a_dest, HashMap *components) {
+    ShareIndex si = {};
+    si.libs_map = InitMap(a_dest, 256);
+    si.blocks_map = InitMap(a_dest, components->nslots);
+
+    // visit the components by file path, not map order, so that libraries are listed in a stable order: the order
+    // in which they are first %included, each component's own includes in its order
+    Array<ComponentParse*> comps = InitArray<ComponentParse*>(a_dest, components->slots_used + 1);
+    MapIter iter = {};
+    while (ComponentParse *comp = (ComponentParse*) MapNextVal(components, &iter)) {
+        ArrayAddGrow(a_dest, &comps, comp);
+    }
+    qsort(comps.arr, comps.len, sizeof(ComponentParse*), _ShareCompareComps);
+
+    for (u32 k = 0; k < comps.len; ++k) {
+        ComponentParse *comp = comps.arr[k];
+        ShareSplit split = ShareSplitBlock(a_dest, comp->share_block);
+
+        for (u32 i = 0; i < split.includes.len; ++i) {
+            Sym name = StrIntern(split.includes.arr[i]);
+            s32 idx = (s32) MapGet(&si.libs_map, (u64) name) - 1;
+            if (idx < 0) {
+                ShareLib lib = { split.includes.arr[i], 0 };
+                ArrayAddGrow(a_dest, &si.libs, lib);
+                idx = si.libs.len - 1;
+                MapPut(&si.libs_map, (u64) name, (u64) idx + 1);
+            }
+            si.libs.arr[idx].users++;
+        }
+
+        if (split.code.len) {
+            u64 hash = ShareHash(split.code);
+            s32 idx = (s32) MapGet(&si.blocks_map, hash) - 1;
+            if (idx < 0) {
+                ShareBlock block = { hash, split.code, 0 };
+                ArrayAddGrow(a_dest, &si.blocks, block);
+                idx = si.blocks.len - 1;
+                MapPut(&si.blocks_map, hash, (u64) idx + 1);
+            }
+            si.blocks.arr[idx].users++;
+        }
+    }
+    return si;
+}
+
+bool ShareIsHoisted(ShareIndex *si, Str code) {
+    s32 idx = (s32) MapGet(&si->blocks_map, ShareHash(code)) - 1;
+    return idx >= 0 && si->blocks.arr[idx].users > 1;
+}
+
+void CogenComponentShared(EmitBuff *b, ShareIndex *si) {
+    Emit(b, "#ifndef __COMPS_SHARED___\n");
+    Emit(b, "#define __COMPS_SHARED___\n\n\n");
+
+    // libraries, in the order components include them
+    Emit(b, "// %include libraries\n\n");
+    for (u32 i = 0; i < si->libs.len; ++i) {
+        ShareLib lib = si->libs.arr[i];
+        Emit(b, "// ", lib.name, " (used by ", lib.users, ")\n");
+        CogenShareLib(b, lib.name);
+    }
+    Emit(b, "\n\n");
+
+    // share code used by more than one component
+    Emit(b, "// identical share blocks\n\n");
+    for (u32 i = 0; i < si->blocks.len; ++i) {
+        ShareBlock block = si->blocks.arr[i];
+        if (block.users < 2) {
+            continue;
+        }
+        Emit(b, "#ifndef __SHARE_", block.hash, "__\n");
+        Emit(b, "#define __SHARE_", block.hash, "__\n");
+        Emit(b, "// used by ", block.users, "\n\n");
+        Emit(b, block.code);
+        Emit(b, "\n\n#endif\n\n");
+    }
+
+    Emit(b, "\n#endif\n");
+}
+
+
+void CogenComponentPCH(EmitBuff *b) {
+    // stable part of every instrument translation unit, precompiled once
+    Emit(b, "#ifndef __COMPS_PCH___\n");
+    Emit(b, "#define __COMPS_PCH___\n\n\n");
+    Emit(b, "#include \"comps_meta.h\"\n");
+    Emit(b, "\n\n#endif\n");
+}
+
+void CogenComponentPCHScript(EmitBuff *b, Str share_dir) {
+    Emit(b, "#!/bin/sh\n");
+    Emit(b, "# builds comps_pch.h.gch, which g++ picks up in place of comps_pch.h; compile with the same flags\n");
+    Emit(b, "cd \"$(dirname \"$0\")\"\n");
+    Emit(b, "g++ -x c++-header -O2 ${CXXFLAGS} -I \"", share_dir, "\" comps_pch.h -o comps_pch.h.gch\n");
+}
+
+
+void CogenComponent(EmitBuff *b, ComponentParse *comp, ShareIndex *si = NULL) {
     // header guard
-    StrBuffPrint1K(b, "#ifndef __%.*s__\n", 2, comp->type.len, comp->type.str);
-    StrBuffPrint1K(b, "#define __%.*s__\n", 2, comp->type.len, comp->type.str);
-    StrBuffPrint1K(b, "\n\n", 0);
+    Emit(b, "#ifndef __", comp->type, "__\n");
+    Emit(b, "#define __", comp->type, "__\n");
+    Emit(b, "\n\n");
 
     //
     // share block
 
-    StrBuffPrint1K(b, "// share block\n", 0);
-    StrBuffPrint1K(b, "\n\n", 0);
-    if (comp->share_block.len) {
-        StrBuffAppend(b, comp->share_block);
-        StrBuffPrint1K(b, "\n\n", 0);
+    Emit(b, "// share block\n");
+    Emit(b, "\n\n");
+    if (si && comp->share_block.len) {
+        ShareSplit split = ShareSplitBlock(GetContext()->a_tmp, comp->share_block);
+        for (u32 i = 0; i < split.includes.len; ++i) {
+            Emit(b, "// %include \"", split.includes.arr[i], "\" in comps_shared.h\n");
+        }
+        if (split.code.len && ShareIsHoisted(si, split.code)) {
+            Emit(b, "// share code __SHARE_", ShareHash(split.code), "__ in comps_shared.h\n");
+        }
+        else if (split.code.len) {
+            Emit(b, "\n", split.code);
+        }
+        Emit(b, "\n\n");
+    }
+    else if (comp->share_block.len) {
+        Emit(b, comp->share_block);
+        Emit(b, "\n\n");
     }
 
     //
     // component struct
 
-    StrBuffPrint1K(b, "struct %.*s {\n", 2, comp->type.len, comp->type.str);
-    StrBuffPrint1K(b, "    int index;\n", 0);
-    StrBuffPrint1K(b, "    char *name;\n", 0);
-    StrBuffPrint1K(b, "    char *type;\n", 0);
-    StrBuffPrint1K(b, "    Coords position_absolute;\n", 0);
-    StrBuffPrint1K(b, "    Coords position_relative;\n", 0);
-    StrBuffPrint1K(b, "    Rotation rotation_absolute;\n", 0);
-    StrBuffPrint1K(b, "    Rotation rotation_relative;\n", 0);
-    StrBuffPrint1K(b, "\n    // parameters\n", 0);
+    Emit(b, "struct ", comp->type, " {\n");
+    Emit(b, "    int index;\n");
+    Emit(b, "    char *name;\n");
+    Emit(b, "    char *type;\n");
+    Emit(b, "    Coords position_absolute;\n");
+    Emit(b, "    Coords position_relative;\n");
+    Emit(b, "    Rotation rotation_absolute;\n");
+    Emit(b, "    Rotation rotation_relative;\n");
+    Emit(b, "\n    // parameters\n");
 
     // struct parameters
-    Str string_s { (char*) "string", 6 };
-    Str vector_s { (char*) "vector", 6 };
     for (s32 i = 0; i < comp->setting_params.len; ++i) {
         Parameter p = comp->setting_params.arr[i];
 
-        if (StrEqual(p.type, string_s)) {
-            StrBuffPrint1K(b, "    char *", 0);
+        if (p.type_sym == SYM_string) {
+            Emit(b, "    char *");
         }
-        else if (StrEqual(p.type, vector_s)) {
-            StrBuffPrint1K(b, "    double ", 0);
+        else if (p.type_sym == SYM_vector) {
+            Emit(b, "    double ");
         }
         else if (p.type.len) {
-            StrBuffPrint1K(b, "    %.*s ", 2, p.type.len, p.type.str);
+            Emit(b, "    ", p.type, " ");
         }
         else {
-            StrBuffPrint1K(b, "    double ", 0);
+            Emit(b, "    double ");
         }
 
-        if (StrEqual(p.type, vector_s)) {
+        if (p.type_sym == SYM_vector) {
             // just scan how many commas it has
             assert(p.default_val.len > 0);
             s32 cnt = 1;
@@ -87,313 +354,338 @@ void CogenComponent(StrBuff *b, ComponentParse *comp) {
                     ++cnt;
                 }
             }
-            StrBuffPrint1K(b, "%.*s[%d]", 3, p.name.len, p.name.str, cnt);
+            Emit(b, p.name, "[", cnt, "]");
         }
         else {
-            StrBuffPrint1K(b, "%.*s", 2, p.name.len, p.name.str);
+            Emit(b, p.name);
         }
 
         if (p.default_val.len) {
-            if (StrEqual(p.type, string_s)) {
-                StrBuffPrint1K(b, " = (char*) %.*s", 2, p.default_val.len, p.default_val.str);
+            if (p.type_sym == SYM_string) {
+                Emit(b, " = (char*) ", p.default_val);
             }
             else {
-                StrBuffPrint1K(b, " = %.*s", 2, p.default_val.len, p.default_val.str);
+                Emit(b, " = ", p.default_val);
             }
         }
-        StrBuffPrint1K(b, ";\n", 0);
+        Emit(b, ";\n");
     }
 
     // declare members
-    StrBuffPrint1K(b, "\n    // declares\n", 0);
+    Emit(b, "\n    // declares\n");
     for (s32 i = 0; i < comp->declare_members.len; ++i) {
         StructMember m = comp->declare_members.arr[i];
 
-        StrBuffPrint1K(b, "    %.*s ", 2, m.type.len, m.type.str);
+        Emit(b, "    ", m.type, " ");
         if (m.is_pointer_type) {
-            StrBuffPrint1K(b, "*", 0);
+            Emit(b, "*");
         }
-        StrBuffPrint1K(b, "%.*s", 2, m.name.len, m.name.str);
+        Emit(b, m.name);
 
         if (m.is_array_type) {
-            StrBuffPrint1K(b, "[%d]", 1, m.array_type_sz);
+            Emit(b, "[", m.array_type_sz, "]");
         }
 
         if (m.defval.len) {
-            StrBuffPrint1K(b, " = %.*s", 2, m.defval.len, m.defval.str);
+            Emit(b, " = ", m.defval);
         }
-        StrBuffPrint1K(b, ";\n", 0);
+        Emit(b, ";\n");
     }
-    StrBuffPrint1K(b, "};\n\n", 0);
+    Emit(b, "};\n\n");
 
     //
     //  Constructor
 
-    StrBuffPrint1K(b, "%.*s Create_%.*s(s32 index, char *name) {\n", 4, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
-    StrBuffPrint1K(b, "    %.*s _comp = {};\n", 2, comp->type.len, comp->type.str);
-    StrBuffPrint1K(b, "    %.*s *comp = &_comp;\n", 2, comp->type.len, comp->type.str);
-    StrBuffPrint1K(b, "    comp->type = (char*) \"%.*s\";\n", 2, comp->type.len, comp->type.str);
-    StrBuffPrint1K(b, "    comp->name = name;\n", 0);
-    StrBuffPrint1K(b, "    comp->index = index;\n", 0);
-    StrBuffPrint1K(b, "\n", 0);
-    StrBuffPrint1K(b, "    return _comp;\n", 0);
-    StrBuffPrint1K(b, "}\n\n", 0);
+    Emit(b, comp->type, " Create_", comp->type, "(s32 index, char *name) {\n");
+    Emit(b, "    ", comp->type, " _comp = {};\n");
+    Emit(b, "    ", comp->type, " *comp = &_comp;\n");
+    Emit(b, "    comp->type = (char*) \"", comp->type, "\";\n");
+    Emit(b, "    comp->name = name;\n");
+    Emit(b, "    comp->index = index;\n");
+    Emit(b, "\n");
+    Emit(b, "    return _comp;\n");
+    Emit(b, "}\n\n");
 
     //
     //  Init
 
-    StrBuffPrint1K(b, "void Init_%.*s(%.*s *comp, Instrument *instrument) {\n", 4, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
-    StrBuffPrint1K(b, "\n", 0);
+    Emit(b, "void Init_", comp->type, "(", comp->type, " *comp, Instrument *instrument) {\n");
+    Emit(b, "\n");
     if (comp->initalize_block.len) {
         PrintDefines(b, comp);
-        StrBuffPrint1K(b, "    ////////////////////////////////////////////////////////////////\n\n", 0);
+        Emit(b, "    ////////////////////////////////////////////////////////////////\n\n");
 
-        StrBuffAppend(b, comp->initalize_block);
+        Emit(b, comp->initalize_block);
 
-        StrBuffPrint1K(b, "\n\n    ////////////////////////////////////////////////////////////////\n", 0);
+        Emit(b, "\n\n    ////////////////////////////////////////////////////////////////\n");
         PrintUndefs(b, comp);
-        StrBuffPrint1K(b, "\n", 0);
+        Emit(b, "\n");
     }
-    StrBuffPrint1K(b, "}\n\n", 0);
+    Emit(b, "}\n\n");
 
     //
     //  Trace
 
-    StrBuffPrint1K(b, "void Trace_%.*s(%.*s *comp, Neutron *particle, Instrument *instrument) {\n", 4, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
+    Emit(b, "void Trace_", comp->type, "(", comp->type, " *comp, Neutron *particle, Instrument *instrument) {\n");
     if (comp->trace_block.len) {
-        StrBuffPrint1K(b, "    #define x particle->x\n", 0);
-        StrBuffPrint1K(b, "    #define y particle->y\n", 0);
-        StrBuffPrint1K(b, "    #define z particle->z\n", 0);
-        StrBuffPrint1K(b, "    #define vx particle->vx\n", 0);
-        StrBuffPrint1K(b, "    #define vy particle->vy\n", 0);
-        StrBuffPrint1K(b, "    #define vz particle->vz\n", 0);
-        StrBuffPrint1K(b, "    #define sx particle->sx\n", 0);
-        StrBuffPrint1K(b, "    #define sy particle->sy\n", 0);
-        StrBuffPrint1K(b, "    #define sz particle->sz\n", 0);
-        StrBuffPrint1K(b, "    #define t particle->t\n", 0);
-        StrBuffPrint1K(b, "    #define p particle->p\n", 0);
-
-        StrBuffPrint1K(b, "\n", 0);
+        Emit(b, "    #define x particle->x\n");
+        Emit(b, "    #define y particle->y\n");
+        Emit(b, "    #define z particle->z\n");
+        Emit(b, "    #define vx particle->vx\n");
+        Emit(b, "    #define vy particle->vy\n");
+        Emit(b, "    #define vz particle->vz\n");
+        Emit(b, "    #define sx particle->sx\n");
+        Emit(b, "    #define sy particle->sy\n");
+        Emit(b, "    #define sz particle->sz\n");
+        Emit(b, "    #define t particle->t\n");
+        Emit(b, "    #define p particle->p\n");
+
+        Emit(b, "\n");
         PrintDefines(b, comp);
-        StrBuffPrint1K(b, "    ////////////////////////////////////////////////////////////////\n\n", 0);
+        Emit(b, "    ////////////////////////////////////////////////////////////////\n\n");
 
-        StrBuffAppend(b, comp->trace_block);
+        Emit(b, comp->trace_block);
 
-        StrBuffPrint1K(b, "\n\n    ////////////////////////////////////////////////////////////////\n", 0);
+        Emit(b, "\n\n    ////////////////////////////////////////////////////////////////\n");
         PrintUndefs(b, comp);
-        StrBuffPrint1K(b, "\n", 0);
-
-        StrBuffPrint1K(b, "    #undef x\n", 0);
-        StrBuffPrint1K(b, "    #undef y\n", 0);
-        StrBuffPrint1K(b, "    #undef z\n", 0);
-        StrBuffPrint1K(b, "    #undef vx\n", 0);
-        StrBuffPrint1K(b, "    #undef vy\n", 0);
-        StrBuffPrint1K(b, "    #undef vz\n", 0);
-        StrBuffPrint1K(b, "    #undef sx\n", 0);
-        StrBuffPrint1K(b, "    #undef sy\n", 0);
-        StrBuffPrint1K(b, "    #undef sz\n", 0);
-        StrBuffPrint1K(b, "    #undef t\n", 0);
-        StrBuffPrint1K(b, "    #undef p\n", 0);
-    }
-    StrBuffPrint1K(b, "}\n\n", 0);
+        Emit(b, "\n");
+
+        Emit(b, "    #undef x\n");
+        Emit(b, "    #undef y\n");
+        Emit(b, "    #undef z\n");
+        Emit(b, "    #undef vx\n");
+        Emit(b, "    #undef vy\n");
+        Emit(b, "    #undef vz\n");
+        Emit(b, "    #undef sx\n");
+        Emit(b, "    #undef sy\n");
+        Emit(b, "    #undef sz\n");
+        Emit(b, "    #undef t\n");
+        Emit(b, "    #undef p\n");
+    }
+    Emit(b, "}\n\n");
 
     //
     //  Save
 
-    StrBuffPrint1K(b, "void Save_%.*s(%.*s *comp) {\n", 4, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
-    StrBuffPrint1K(b, "\n", 0);
+    Emit(b, "void Save_", comp->type, "(", comp->type, " *comp) {\n");
+    Emit(b, "\n");
     if (comp->save_block.len) {
         PrintDefines(b, comp);
-        StrBuffPrint1K(b, "    ////////////////////////////////////////////////////////////////\n\n", 0);
+        Emit(b, "    ////////////////////////////////////////////////////////////////\n\n");
 
-        StrBuffAppend(b, comp->save_block);
+        Emit(b, comp->save_block);
 
-        StrBuffPrint1K(b, "\n\n    ////////////////////////////////////////////////////////////////\n", 0);
+        Emit(b, "\n\n    ////////////////////////////////////////////////////////////////\n");
         PrintUndefs(b, comp);
     }
-    StrBuffPrint1K(b, "}\n\n", 0);
+    Emit(b, "}\n\n");
 
     //
     //  Finally
 
-    StrBuffPrint1K(b, "void Finally_%.*s(%.*s *comp) {\n", 4, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
-    StrBuffPrint1K(b, "\n", 0);
+    Emit(b, "void Finally_", comp->type, "(", comp->type, " *comp) {\n");
+    Emit(b, "\n");
     if (comp->finally_block.len) {
         PrintDefines(b, comp);
-        StrBuffPrint1K(b, "    ////////////////////////////////////////////////////////////////\n\n", 0);
+        Emit(b, "    ////////////////////////////////////////////////////////////////\n\n");
 
-        StrBuffAppend(b, comp->finally_block);
+        Emit(b, comp->finally_block);
 
-        StrBuffPrint1K(b, "\n\n    ////////////////////////////////////////////////////////////////\n", 0);
+        Emit(b, "\n\n    ////////////////////////////////////////////////////////////////\n");
         PrintUndefs(b, comp);
     }
-    StrBuffPrint1K(b, "}\n\n", 0);
+    Emit(b, "}\n\n");
 
     //
     //  Display
 
-    StrBuffPrint1K(b, "void Display_%.*s(%.*s *comp) {\n", 4, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
+    Emit(b, "void Display_", comp->type, "(", comp->type, " *comp) {\n");
     if (comp->display_block.len) {
-        StrBuffPrint1K(b, "    #define magnify mcdis_magnify\n", 0);
-        StrBuffPrint1K(b, "    #define line mcdis_line\n", 0);
-        StrBuffPrint1K(b, "    #define dashed_line mcdis_dashed_line\n", 0);
-        StrBuffPrint1K(b, "    #define multiline mcdis_multiline\n", 0);
-        StrBuffPrint1K(b, "    #define rectangle mcdis_rectangle\n", 0);
-        StrBuffPrint1K(b, "    #define box mcdis_box\n", 0);
-        StrBuffPrint1K(b, "    #define circle mcdis_circle\n", 0);
-        StrBuffPrint1K(b, "    #define Circle mcdis_Circle\n", 0);
-        StrBuffPrint1K(b, "    #define cylinder mcdis_cylinder\n", 0);
-        StrBuffPrint1K(b, "    #define cone mcdis_cone\n", 0);
-        StrBuffPrint1K(b, "    #define sphere mcdis_sphere\n", 0);
-
-        StrBuffPrint1K(b, "\n", 0);
+        Emit(b, "    #define magnify mcdis_magnify\n");
+        Emit(b, "    #define line mcdis_line\n");
+        Emit(b, "    #define dashed_line mcdis_dashed_line\n");
+        Emit(b, "    #define multiline mcdis_multiline\n");
+        Emit(b, "    #define rectangle mcdis_rectangle\n");
+        Emit(b, "    #define box mcdis_box\n");
+        Emit(b, "    #define circle mcdis_circle\n");
+        Emit(b, "    #define Circle mcdis_Circle\n");
+        Emit(b, "    #define cylinder mcdis_cylinder\n");
+        Emit(b, "    #define cone mcdis_cone\n");
+        Emit(b, "    #define sphere mcdis_sphere\n");
+
+        Emit(b, "\n");
         PrintDefines(b, comp);
-        StrBuffPrint1K(b, "    ////////////////////////////////////////////////////////////////\n\n", 0);
+        Emit(b, "    ////////////////////////////////////////////////////////////////\n\n");
 
-        StrBuffAppend(b, comp->display_block);
+        Emit(b, comp->display_block);
 
-        StrBuffPrint1K(b, "\n\n    ////////////////////////////////////////////////////////////////\n", 0);
+        Emit(b, "\n\n    ////////////////////////////////////////////////////////////////\n");
         PrintUndefs(b, comp);
-        StrBuffPrint1K(b, "\n", 0);
-
-        StrBuffPrint1K(b, "    #undef magnify\n", 0);
-        StrBuffPrint1K(b, "    #undef line\n", 0);
-        StrBuffPrint1K(b, "    #undef dashed_line\n", 0);
-        StrBuffPrint1K(b, "    #undef multiline\n", 0);
-        StrBuffPrint1K(b, "    #undef rectangle\n", 0);
-        StrBuffPrint1K(b, "    #undef box\n", 0);
-        StrBuffPrint1K(b, "    #undef circle\n", 0);
-        StrBuffPrint1K(b, "    #undef Circle\n", 0);
-        StrBuffPrint1K(b, "    #undef cylinder\n", 0);
-        StrBuffPrint1K(b, "    #undef cone\n", 0);
-        StrBuffPrint1K(b, "    #undef sphere\n", 0);
+        Emit(b, "\n");
+
+        Emit(b, "    #undef magnify\n");
+        Emit(b, "    #undef line\n");
+        Emit(b, "    #undef dashed_line\n");
+        Emit(b, "    #undef multiline\n");
+        Emit(b, "    #undef rectangle\n");
+        Emit(b, "    #undef box\n");
+        Emit(b, "    #undef circle\n");
+        Emit(b, "    #undef Circle\n");
+        Emit(b, "    #undef cylinder\n");
+        Emit(b, "    #undef cone\n");
+        Emit(b, "    #undef sphere\n");
     }
-    StrBuffPrint1K(b, "}\n\n\n", 0);
+    Emit(b, "}\n\n\n");
 
 
     // close header guard
-    StrBuffPrint1K(b, "#endif\n", 0);
+    Emit(b, "#endif\n");
 }
 
 
-void CogenComponentMeta(StrBuff *b, HashMap *components) {
-    StrBuffPrint1K(b, "#ifndef __COMPS_META___\n", 0);
-    StrBuffPrint1K(b, "#define __COMPS_META___\n\n\n", 0);
+void CogenComponentIndex(EmitBuff *b, HashMap *components, Str lib_path) {
+    // library index: one entry per component, the header text up to the first code block, which is all that
+    // type checking an instrument needs. Entries start with
+    // '@ <file size> <file mtime> <blocks offset> <blocks line> <category> <path>', paths are relative to the library.
+    Emit(b, COMPONENT_INDEX_HEADER, "\n");
+
+    MapIter iter = {};
+    while (ComponentParse *comp = (ComponentParse*) MapNextVal(components, &iter)) {
+        Str category = comp->category.len ? comp->category : StrL("-");
+        Str header = { comp->text.str + comp->header_offset, comp->blocks_offset - comp->header_offset };
+        Str path = comp->file_path;
+        if (path.len > lib_path.len + 1 && strncmp(path.str, lib_path.str, lib_path.len) == 0 && path.str[lib_path.len] == '/') {
+            path.str += lib_path.len + 1;
+            path.len -= lib_path.len + 1;
+        }
+
+        Emit(b, "\n@ ", comp->file_size, ' ', comp->file_mtime, ' ', comp->blocks_offset, ' ', comp->blocks_line, ' ', category, ' ', path, '\n');
+        Emit(b, header, '\n');
+    }
+}
+
+
+void CogenComponentMeta(EmitBuff *b, HashMap *components, ShareIndex *si = NULL) {
+    Emit(b, "#ifndef __COMPS_META___\n");
+    Emit(b, "#define __COMPS_META___\n\n\n");
+    if (si) {
+        Emit(b, "#include \"comps_shared.h\"\n");
+    }
 
     // include component sources
     MArena *a_tmp = GetContext()->a_tmp;
     u32 component_cnt = 0;
     MapIter iter = {};
     while (ComponentParse *comp = (ComponentParse*) MapNextVal(components, &iter)) {
-        StrBuffPrint1K(b, "#include \"comps/%.*s.h\"\n", 2, comp->type.len, comp->type.str);
+        Emit(b, "#include \"comps/", comp->type, ".h\"\n");
 
         component_cnt++;
     }
-    StrBuffPrint1K(b, "\n\n", 0);
+    Emit(b, "\n\n");
 
     // build a category map
     HashMap comp_categories_tmp = InitMap(a_tmp, component_cnt);
 
     // type enum
-    StrBuffPrint1K(b, "enum CompType {\n", 0);
-    StrBuffPrint1K(b, "    CT_UNDEF,\n\n", 0);
+    Emit(b, "enum CompType {\n");
+    Emit(b, "    CT_UNDEF,\n\n");
     iter = {};
     while (ComponentParse *comp = (ComponentParse*) MapNextVal(components, &iter)) {
-        StrBuffPrint1K(b, "    CT_%.*s,\n", 2, comp->type.len, comp->type.str);
+        Emit(b, "    CT_", comp->type, ",\n");
 
         Str cat = FindDirCategory(comp->file_path);
         MapPut(&comp_categories_tmp, cat, ArenaPush(a_tmp, &cat, sizeof(Str)));
     }
-    StrBuffPrint1K(b, "\n    CT_CNT\n", 0);
-    StrBuffPrint1K(b, "};\n\n\n", 0);
+    Emit(b, "\n    CT_CNT\n");
+    Emit(b, "};\n\n\n");
 
     // categories
-    StrBuffPrint1K(b, "enum CompCategory {\n", 0);
-    StrBuffPrint1K(b, "    CCAT_UNDEF,\n\n", 0);
+    Emit(b, "enum CompCategory {\n");
+    Emit(b, "    CCAT_UNDEF,\n\n");
     iter = {};
     while (Str *cat = (Str*) MapNextVal(&comp_categories_tmp, &iter)) {
-        StrBuffPrint1K(b, "    CCAT_%.*s,\n", 2, cat->len, cat->str);
+        Emit(b, "    CCAT_", *cat, ",\n");
     }
-    StrBuffPrint1K(b, "    \n", 0);
-    StrBuffPrint1K(b, "    CCAT_CNT\n", 0);
-    StrBuffPrint1K(b, "};\n\n\n", 0);
+    Emit(b, "    \n");
+    Emit(b, "    CCAT_CNT\n");
+    Emit(b, "};\n\n\n");
 
-    StrBuffPrint1K(b, "Str StrLS(char *str) {\n", 0);
-    StrBuffPrint1K(b, "    return Str { str, (u32) strlen(str) };\n", 0);
-    StrBuffPrint1K(b, "}\n\n\n", 0);
+    Emit(b, "Str StrLS(char *str) {\n");
+    Emit(b, "    return Str { str, (u32) strlen(str) };\n");
+    Emit(b, "}\n\n\n");
 
     // create
-    StrBuffPrint1K(b, "Component *CreateComponent(MArena *a_dest, CompType type, s32 index, const char *name) {\n", 0);
-    StrBuffPrint1K(b, "    Component *comp = (Component*) ArenaAlloc(a_dest, sizeof(Component));\n", 0);
-    StrBuffPrint1K(b, "    comp->type = type;\n", 0);
-    StrBuffPrint1K(b, "\n", 0);
-    StrBuffPrint1K(b, "    switch (type) {\n", 0);
+    Emit(b, "Component *CreateComponent(MArena *a_dest, CompType type, s32 index, const char *name) {\n");
+    Emit(b, "    Component *comp = (Component*) ArenaAlloc(a_dest, sizeof(Component));\n");
+    Emit(b, "    comp->type = type;\n");
+    Emit(b, "\n");
+    Emit(b, "    switch (type) {\n");
     iter = {};
     while (ComponentParse *comp = (ComponentParse*) MapNextVal(components, &iter)) {
-        StrBuffPrint1K(b, "        case CT_%.*s: {\n", 2, comp->type.len, comp->type.str);
-        StrBuffPrint1K(b, "            %.*s comp_spec = Create_%.*s(index, (char*) name);\n", 6, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
-        StrBuffPrint1K(b, "            comp->comp = ArenaPush(a_dest, &comp_spec, sizeof(%.*s));\n", 2, comp->type.len, comp->type.str);
-        StrBuffPrint1K(b, "            comp->type_name = StrLS(comp_spec.type);\n", 0);
-        StrBuffPrint1K(b, "            comp->name = StrLS(comp_spec.name);\n", 0);
-        StrBuffPrint1K(b, "            comp->cat = CCAT_%.*s;\n", 2, comp->category.len, comp->category.str);
-        StrBuffPrint1K(b, "        } break;\n", 0);
-        StrBuffPrint1K(b, "\n", 0);
-    }
-    StrBuffPrint1K(b, "        default: { } break;\n    }\n\n", 0);
-    StrBuffPrint1K(b, "    return comp;\n}\n\n\n", 0);
+        Emit(b, "        case CT_", comp->type, ": {\n");
+        Emit(b, "            ", comp->type, " comp_spec = Create_", comp->type, "(index, (char*) name);\n");
+        Emit(b, "            comp->comp = ArenaPush(a_dest, &comp_spec, sizeof(", comp->type, "));\n");
+        Emit(b, "            comp->type_name = StrLS(comp_spec.type);\n");
+        Emit(b, "            comp->name = StrLS(comp_spec.name);\n");
+        Emit(b, "            comp->cat = CCAT_", comp->category, ";\n");
+        Emit(b, "        } break;\n");
+        Emit(b, "\n");
+    }
+    Emit(b, "        default: { } break;\n    }\n\n");
+    Emit(b, "    return comp;\n}\n\n\n");
 
     // init
-    StrBuffPrint1K(b, "void InitComponent(Component *comp, Instrument *instr = NULL) {\n", 0);
-    StrBuffPrint1K(b, "    switch (comp->type) {\n", 0);
+    Emit(b, "void InitComponent(Component *comp, Instrument *instr = NULL) {\n");
+    Emit(b, "    switch (comp->type) {\n");
     iter = {};
     while (ComponentParse *comp = (ComponentParse*) MapNextVal(components, &iter)) {
-        StrBuffPrint1K(b, "        case CT_%.*s: { Init_%.*s((%.*s*) comp->comp, instr); } break;\n", 6, comp->type.len, comp->type.str, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
+        Emit(b, "        case CT_", comp->type, ": { Init_", comp->type, "((", comp->type, "*) comp->comp, instr); } break;\n");
     }
-    StrBuffPrint1K(b, "\n", 0);
-    StrBuffPrint1K(b, "        default: { } break;\n    }\n}\n\n\n", 0);
+    Emit(b, "\n");
+    Emit(b, "        default: { } break;\n    }\n}\n\n\n");
 
     // display
-    StrBuffPrint1K(b, "void DisplayComponent(Component *comp) {\n", 0);
-    StrBuffPrint1K(b, "    switch (comp->type) {\n", 0);
+    Emit(b, "void DisplayComponent(Component *comp) {\n");
+    Emit(b, "    switch (comp->type) {\n");
     iter = {};
     while (ComponentParse *comp = (ComponentParse*) MapNextVal(components, &iter)) {
-        StrBuffPrint1K(b, "        case CT_%.*s: { Display_%.*s((%.*s*) comp->comp); } break;\n", 6, comp->type.len, comp->type.str, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
+        Emit(b, "        case CT_", comp->type, ": { Display_", comp->type, "((", comp->type, "*) comp->comp); } break;\n");
     }
-    StrBuffPrint1K(b, "\n", 0);
-    StrBuffPrint1K(b, "        default: { } break;\n    }\n}\n\n\n", 0);
+    Emit(b, "\n");
+    Emit(b, "        default: { } break;\n    }\n}\n\n\n");
 
     // trace
-    StrBuffPrint1K(b, "void TraceComponent(Component *comp, Neutron *particle, Instrument *instr = NULL) {\n", 0);
-    StrBuffPrint1K(b, "    switch (comp->type) {\n", 0);
+    Emit(b, "void TraceComponent(Component *comp, Neutron *particle, Instrument *instr = NULL) {\n");
+    Emit(b, "    switch (comp->type) {\n");
     iter = {};
     while (ComponentParse *comp = (ComponentParse*) MapNextVal(components, &iter)) {
-        StrBuffPrint1K(b, "        case CT_%.*s: { Trace_%.*s((%.*s*) comp->comp, particle, instr); } break;\n", 6, comp->type.len, comp->type.str, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
+        Emit(b, "        case CT_", comp->type, ": { Trace_", comp->type, "((", comp->type, "*) comp->comp, particle, instr); } break;\n");
     }
-    StrBuffPrint1K(b, "\n", 0);
-    StrBuffPrint1K(b, "        default: { } break;\n    }\n}\n\n\n", 0);
+    Emit(b, "\n");
+    Emit(b, "        default: { } break;\n    }\n}\n\n\n");
 
     // save
-    StrBuffPrint1K(b, "void SaveComponent(Component *comp) {\n", 0);
-    StrBuffPrint1K(b, "    switch (comp->type) {\n", 0);
+    Emit(b, "void SaveComponent(Component *comp) {\n");
+    Emit(b, "    switch (comp->type) {\n");
     iter = {};
     while (ComponentParse *comp = (ComponentParse*) MapNextVal(components, &iter)) {
-        StrBuffPrint1K(b, "        case CT_%.*s: { Save_%.*s((%.*s*) comp->comp); } break;\n", 6, comp->type.len, comp->type.str, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
+        Emit(b, "        case CT_", comp->type, ": { Save_", comp->type, "((", comp->type, "*) comp->comp); } break;\n");
     }
-    StrBuffPrint1K(b, "\n", 0);
-    StrBuffPrint1K(b, "        default: { } break;\n    }\n}\n\n\n", 0);
+    Emit(b, "\n");
+    Emit(b, "        default: { } break;\n    }\n}\n\n\n");
 
     // finally
-    StrBuffPrint1K(b, "void FinallyComponent(Component *comp) {\n", 0);
-    StrBuffPrint1K(b, "    switch (comp->type) {\n", 0);
+    Emit(b, "void FinallyComponent(Component *comp) {\n");
+    Emit(b, "    switch (comp->type) {\n");
     iter = {};
     while (ComponentParse *comp = (ComponentParse*) MapNextVal(components, &iter)) {
-        StrBuffPrint1K(b, "        case CT_%.*s: { Finally_%.*s((%.*s*) comp->comp); } break;\n", 6, comp->type.len, comp->type.str, comp->type.len, comp->type.str, comp->type.len, comp->type.str);
+        Emit(b, "        case CT_", comp->type, ": { Finally_", comp->type, "((", comp->type, "*) comp->comp); } break;\n");
     }
-    StrBuffPrint1K(b, "\n", 0);
-    StrBuffPrint1K(b, "        default: { } break;\n    }\n}\n\n\n", 0);
+    Emit(b, "\n");
+    Emit(b, "        default: { } break;\n    }\n}\n\n\n");
 
     // close header guard
-    StrBuffPrint1K(b, "#endif // __META_COMPS__\n", 0);
+    Emit(b, "#endif // __META_COMPS__\n");
 }
 
 
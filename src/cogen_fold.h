@@ -0,0 +1,458 @@
+#ifndef __COGEN_FOLD_H__
+#define __COGEN_FOLD_H__
+
+
+//
+//  Cogen-time constant folding of component placement.
+//
+//  AT/ROTATED expressions are evaluated here when they only use numeric literals, PI/DEG2RAD/RAD2DEG, a few
+//  math functions, and - if enabled with --scan - the instrument parameters that are not scanned, at their
+//  default values. Components whose placement and parents all fold get their absolute pose computed at cogen
+//  time. Those are written as one flat table in component order, which is a topological order since RELATIVE
+//  references point backwards. Their scene graph nodes have no parent, so the chain of relative transforms is
+//  only built at init for the components whose placement is parameter dependent.
+//
+//  Rotations follow t_loc = T(at) * Rz(phi_z) * Ry(phi_y) * Rx(phi_x) with column vectors, a world transform
+//  is parent world * t_loc, and a separate ROTATED parent replaces the parent rotation.
+
+
+static bool g_cogen_fold = true;
+static bool g_cogen_fold_params = false;
+static Str g_cogen_scan_params = {};
+
+
+//
+//  Expression evaluation
+
+
+struct EvalState {
+    Tokenizer t;
+    char *end;
+    Token tok;
+    HashMap *consts; // Sym -> f64*, may be NULL
+    bool ok;
+};
+
+static void _EvalNext(EvalState *es) {
+    es->tok = GetToken(&es->t);
+    if (es->tok.text >= es->end) {
+        es->tok.type = TOK_ENDOFSTREAM;
+    }
+}
+
+static bool _EvalNumber(Token tok, f64 *val) {
+    char buff[64];
+    if (tok.len == 0 || tok.len >= 64) {
+        return false;
+    }
+    memcpy(buff, tok.text, tok.len);
+    buff[tok.len] = '\0';
+
+    char *at = NULL;
+    *val = strtod(buff, &at);
+    if (at == buff) {
+        return false;
+    }
+    // literal suffixes
+    if (*at == 'f' || *at == 'F' || *at == 'l' || *at == 'L') {
+        ++at;
+    }
+    return *at == '\0';
+}
+
+static bool _EvalNamedConst(Str name, f64 *val) {
+    if (StrEqual(name, "PI") || StrEqual(name, "M_PI")) { *val = M_PI; return true; }
+    if (StrEqual(name, "DEG2RAD")) { *val = M_PI / 180; return true; }
+    if (StrEqual(name, "RAD2DEG")) { *val = 180 / M_PI; return true; }
+    return false;
+}
+
+static bool _EvalFunction(Str name, f64 *args, s32 args_cnt, f64 *val) {
+    if (args_cnt == 1) {
+        f64 x = args[0];
+        if (StrEqual(name, "sin")) { *val = sin(x); return true; }
+        if (StrEqual(name, "cos")) { *val = cos(x); return true; }
+        if (StrEqual(name, "tan")) { *val = tan(x); return true; }
+        if (StrEqual(name, "asin")) { *val = asin(x); return true; }
+        if (StrEqual(name, "acos")) { *val = acos(x); return true; }
+        if (StrEqual(name, "atan")) { *val = atan(x); return true; }
+        if (StrEqual(name, "sqrt")) { *val = sqrt(x); return true; }
+        if (StrEqual(name, "fabs")) { *val = fabs(x); return true; }
+        if (StrEqual(name, "exp")) { *val = exp(x); return true; }
+        if (StrEqual(name, "log")) { *val = log(x); return true; }
+    }
+    if (args_cnt == 2) {
+        if (StrEqual(name, "atan2")) { *val = atan2(args[0], args[1]); return true; }
+        if (StrEqual(name, "pow")) { *val = pow(args[0], args[1]); return true; }
+    }
+    return false;
+}
+
+static f64 _EvalSum(EvalState *es);
+
+static f64 _EvalPrimary(EvalState *es) {
+    Token tok = es->tok;
+    f64 val = 0;
+
+    if (tok.type == TOK_LBRACK) {
+        _EvalNext(es);
+        val = _EvalSum(es);
+        if (es->tok.type != TOK_RBRACK) {
+            es->ok = false;
+        }
+        _EvalNext(es);
+    }
+    else if (tok.type == TOK_INT || tok.type == TOK_FLOAT || tok.type == TOK_SCI) {
+        es->ok &= _EvalNumber(tok, &val);
+        _EvalNext(es);
+    }
+    else if (tok.type == TOK_IDENTIFIER) {
+        Str name = tok.GetValue();
+        _EvalNext(es);
+
+        if (es->tok.type == TOK_LBRACK) {
+            f64 args[2];
+            s32 args_cnt = 0;
+            _EvalNext(es);
+            while (es->ok && es->tok.type != TOK_RBRACK) {
+                if (args_cnt == 2 || es->tok.type == TOK_ENDOFSTREAM) {
+                    es->ok = false;
+                    break;
+                }
+                args[args_cnt++] = _EvalSum(es);
+                if (es->tok.type == TOK_COMMA) {
+                    _EvalNext(es);
+                }
+            }
+            _EvalNext(es);
+            es->ok &= _EvalFunction(name, args, args_cnt, &val);
+        }
+        else if (_EvalNamedConst(name, &val) == false) {
+            f64 *cval = es->consts ? (f64*) MapGet(es->consts, (u64) tok.sym) : NULL;
+            if (cval) {
+                val = *cval;
+            }
+            else {
+                es->ok = false;
+            }
+        }
+    }
+    else {
+        es->ok = false;
+    }
+    return val;
+}
+
+static f64 _EvalUnary(EvalState *es) {
+    if (es->tok.type == TOK_DASH) {
+        _EvalNext(es);
+        return - _EvalUnary(es);
+    }
+    if (es->tok.type == TOK_PLUS) {
+        _EvalNext(es);
+        return _EvalUnary(es);
+    }
+    return _EvalPrimary(es);
+}
+
+static f64 _EvalProduct(EvalState *es) {
+    f64 val = _EvalUnary(es);
+    while (es->ok && (es->tok.type == TOK_ASTERISK || es->tok.type == TOK_SLASH)) {
+        bool div = es->tok.type == TOK_SLASH;
+        _EvalNext(es);
+        f64 rhs = _EvalUnary(es);
+        val = div ? val / rhs : val * rhs;
+    }
+    return val;
+}
+
+static f64 _EvalSum(EvalState *es) {
+    f64 val = _EvalProduct(es);
+    while (es->ok && (es->tok.type == TOK_PLUS || es->tok.type == TOK_DASH)) {
+        bool sub = es->tok.type == TOK_DASH;
+        _EvalNext(es);
+        f64 rhs = _EvalProduct(es);
+        val = sub ? val - rhs : val + rhs;
+    }
+    return val;
+}
+
+bool EvalExpression(Str expr, HashMap *consts, f64 *result) {
+    // Evaluates an expression as returned by ParseExpression, returns false unless every term is a known constant.
+    if (expr.len == 0) {
+        return false;
+    }
+    EvalState es = {};
+    es.t.Init(expr.str);
+    es.end = expr.str + expr.len;
+    es.consts = consts;
+    es.ok = true;
+
+    _EvalNext(&es);
+    f64 val = _EvalSum(&es);
+    if (es.ok == false || es.tok.type != TOK_ENDOFSTREAM || std::isfinite(val) == false) {
+        return false;
+    }
+    *result = val;
+    return true;
+}
+
+
+//
+//  Constant instrument parameters
+
+
+static bool _IsAssignedIn(Str block, Sym name) {
+    // true if name is assigned, incremented or has its address taken anywhere in block
+    if (block.len == 0) {
+        return false;
+    }
+    char *end = block.str + block.len;
+    Tokenizer t = {};
+    t.Init(block.str);
+
+    Token prev2 = {};
+    Token prev = {};
+    Token tok = GetToken(&t);
+    while (tok.type != TOK_ENDOFSTREAM && tok.text < end) {
+        Tokenizer save = t;
+        Token next = GetToken(&t);
+        Token next2 = GetToken(&t);
+        t = save;
+
+        if (tok.type == TOK_IDENTIFIER && tok.sym == name && (prev.type != TOK_DOT)) {
+            bool op = next.type == TOK_PLUS || next.type == TOK_DASH || next.type == TOK_ASTERISK || next.type == TOK_SLASH;
+            if (next.type == TOK_ASSIGN) return true;
+            if (op && next2.type == TOK_ASSIGN && next2.text == next.text + 1) return true;
+            if ((next.type == TOK_PLUS || next.type == TOK_DASH) && next2.type == next.type) return true;
+            if ((prev.type == TOK_PLUS || prev.type == TOK_DASH) && prev2.type == prev.type) return true;
+            if (prev.type == TOK_AND) return true;
+        }
+        prev2 = prev;
+        prev = tok;
+        tok = GetToken(&t);
+    }
+    return false;
+}
+
+HashMap FoldInstrumentConstants(MArena *a_dest, InstrumentParse *instr) {
+    // non-scanned parameters with a numeric default that INITIALIZE does not write to
+    HashMap consts = InitMap(a_dest, instr->params.len * 2 + 1);
+    if (g_cogen_fold_params == false) {
+        return consts;
+    }
+
+    HashMap scanned = InitMap(a_dest, 16);
+    StrLst *scan = StrSplit(g_cogen_scan_params, ',');
+    while (scan) {
+        MapPut(&scanned, (u64) StrIntern(StrLstNext(&scan)), (u64) 1);
+    }
+
+    for (s32 i = 0; i < instr->params.len; ++i) {
+        Parameter p = instr->params.arr[i];
+        Sym name = StrIntern(p.name);
+
+        if (p.type_sym == SYM_string || p.type_sym == SYM_vector || MapGet(&scanned, (u64) name)) {
+            continue;
+        }
+        if (_IsAssignedIn(instr->initalize_block, name)) {
+            continue;
+        }
+        f64 val;
+        if (EvalExpression(p.default_val, &consts, &val)) {
+            f64 *cval = (f64*) ArenaAlloc(a_dest, sizeof(f64));
+            *cval = val;
+            MapPut(&consts, (u64) name, cval);
+        }
+    }
+    return consts;
+}
+
+
+//
+//  Placement
+
+
+struct FoldPose {
+    f64 rot[9]; // row-major
+    f64 pos[3];
+};
+
+struct FoldState {
+    HashMap consts;
+    HashMap used;   // the folded parameters that placements depend on
+    FoldPose *poses;
+    s32 *rows;      // per component: row in the placement table, or -1
+    s32 rows_cnt;
+    s32 comps_cnt;
+};
+
+static void _RotMul(f64 *dest, f64 *a, f64 *b) {
+    f64 r[9];
+    for (s32 i = 0; i < 3; ++i) {
+        for (s32 j = 0; j < 3; ++j) {
+            r[i*3 + j] = a[i*3 + 0] * b[0*3 + j] + a[i*3 + 1] * b[1*3 + j] + a[i*3 + 2] * b[2*3 + j];
+        }
+    }
+    memcpy(dest, r, sizeof(r));
+}
+
+static void _RotZYX(f64 *dest, f64 phi_x, f64 phi_y, f64 phi_z) {
+    // Rz(phi_z) * Ry(phi_y) * Rx(phi_x), radians
+    f64 ca = cos(phi_z), sa = sin(phi_z);
+    f64 cb = cos(phi_y), sb = sin(phi_y);
+    f64 cc = cos(phi_x), sc = sin(phi_x);
+
+    dest[0] = cb*ca;  dest[1] = ca*sb*sc - sa*cc;  dest[2] = ca*sb*cc + sa*sc;
+    dest[3] = cb*sa;  dest[4] = sa*sb*sc + ca*cc;  dest[5] = sa*sb*cc - ca*sc;
+    dest[6] = -sb;    dest[7] = cb*sc;             dest[8] = cb*cc;
+}
+
+void FoldRotToAngles(f64 *rot, f64 *phi_x, f64 *phi_y, f64 *phi_z) {
+    // inverse of _RotZYX
+    f64 cb = sqrt(rot[0]*rot[0] + rot[3]*rot[3]);
+    *phi_y = atan2(-rot[6], cb);
+    if (cb > 1e-12) {
+        *phi_z = atan2(rot[3], rot[0]);
+        *phi_x = atan2(rot[7], rot[8]);
+    }
+    else {
+        // gimbal lock, put it all in phi_x
+        *phi_z = 0;
+        *phi_x = atan2(-rot[5], rot[4]);
+    }
+}
+
+static void _MarkUsed(Str expr, HashMap *consts, HashMap *used) {
+    char *end = expr.str + expr.len;
+    Tokenizer t = {};
+    t.Init(expr.str);
+    Token tok = GetToken(&t);
+    while (tok.type != TOK_ENDOFSTREAM && tok.text < end) {
+        if (tok.type == TOK_IDENTIFIER && MapGet(consts, (u64) tok.sym)) {
+            MapPut(used, (u64) tok.sym, (u64) 1);
+        }
+        tok = GetToken(&t);
+    }
+}
+
+static FoldPose *_ParentPose(FoldState *fs, HashMap *map_names, Sym parent) {
+    s32 idx = (s32) MapGet(map_names, (u64) parent) - 1;
+    if (idx < 0 || fs->rows[idx] < 0) {
+        return NULL;
+    }
+    return fs->poses + idx;
+}
+
+FoldState FoldPlacements(MArena *a_dest, InstrumentParse *instr) {
+    // needs the full, checked component list (not available when streaming)
+    FoldState fs = {};
+    s32 ncomps = instr->comps.len;
+    fs.comps_cnt = ncomps;
+    fs.poses = (FoldPose*) ArenaAlloc(a_dest, sizeof(FoldPose) * ncomps);
+    fs.rows = (s32*) ArenaAlloc(a_dest, sizeof(s32) * ncomps);
+    for (s32 i = 0; i < ncomps; ++i) {
+        fs.rows[i] = -1;
+    }
+    fs.used = InitMap(a_dest, instr->params.len * 2 + 1);
+    if (g_cogen_fold == false) {
+        fs.consts = InitMap(a_dest, 1);
+        return fs;
+    }
+    fs.consts = FoldInstrumentConstants(a_dest, instr);
+
+    FoldPose identity = {};
+    identity.rot[0] = identity.rot[4] = identity.rot[8] = 1;
+
+    HashMap map_names = InitMap(a_dest, ncomps * 2 + 1);
+    for (s32 i = 0; i < ncomps; ++i) {
+        ComponentCall *c = instr->comps.arr + i;
+        MapPut(&map_names, (u64) c->name_sym, (u64) i + 1);
+
+        f64 at[3];
+        f64 phi[3] = {};
+        bool ok = true;
+        ok = ok && EvalExpression(c->at_x, &fs.consts, at + 0);
+        ok = ok && EvalExpression(c->at_y, &fs.consts, at + 1);
+        ok = ok && EvalExpression(c->at_z, &fs.consts, at + 2);
+        if (c->rot_defined) {
+            ok = ok && EvalExpression(c->rot_x, &fs.consts, phi + 0);
+            ok = ok && EvalExpression(c->rot_y, &fs.consts, phi + 1);
+            ok = ok && EvalExpression(c->rot_z, &fs.consts, phi + 2);
+        }
+
+        // parents, which must themselves be folded
+        FoldPose *at_parent = c->at_absolute ? &identity : NULL;
+        if (ok && c->at_absolute == false && c->at_relative_to.len) {
+            at_parent = _ParentPose(&fs, &map_names, c->at_relative_sym);
+        }
+        FoldPose *rot_parent = at_parent;
+        if (ok && c->rot_defined) {
+            if (c->rot_absolute) {
+                rot_parent = &identity;
+            }
+            else if (c->rot_relative_to.len) {
+                rot_parent = _ParentPose(&fs, &map_names, c->rot_relative_sym);
+            }
+            else {
+                rot_parent = NULL;
+            }
+        }
+        if (ok == false || at_parent == NULL || rot_parent == NULL) {
+            continue;
+        }
+
+        // world = at-parent world * T(at), with the rotation of the ROTATED parent
+        FoldPose *pose = fs.poses + i;
+        f64 *r = at_parent->rot;
+        for (s32 k = 0; k < 3; ++k) {
+            pose->pos[k] = at_parent->pos[k] + r[k*3 + 0] * at[0] + r[k*3 + 1] * at[1] + r[k*3 + 2] * at[2];
+        }
+        f64 rot_loc[9];
+        _RotZYX(rot_loc, phi[0] * M_PI / 180, phi[1] * M_PI / 180, phi[2] * M_PI / 180);
+        _RotMul(pose->rot, rot_parent->rot, rot_loc);
+
+        fs.rows[i] = fs.rows_cnt++;
+
+        _MarkUsed(c->at_x, &fs.consts, &fs.used);
+        _MarkUsed(c->at_y, &fs.consts, &fs.used);
+        _MarkUsed(c->at_z, &fs.consts, &fs.used);
+        if (c->rot_defined) {
+            _MarkUsed(c->rot_x, &fs.consts, &fs.used);
+            _MarkUsed(c->rot_y, &fs.consts, &fs.used);
+            _MarkUsed(c->rot_z, &fs.consts, &fs.used);
+        }
+    }
+
+    // defaults only refer to earlier parameters
+    for (s32 i = instr->params.len - 1; i >= 0; --i) {
+        Parameter p = instr->params.arr[i];
+        if (MapGet(&fs.used, (u64) StrIntern(p.name))) {
+            _MarkUsed(p.default_val, &fs.consts, &fs.used);
+        }
+    }
+    return fs;
+}
+
+void CogenPlacementTable(EmitBuff *b, InstrumentParse *instr, FoldState *fs) {
+    if (fs->rows_cnt == 0) {
+        return;
+    }
+    Emit(b, "// absolute placement of the components with constant AT/ROTATED, folded at cogen time\n");
+    Emit(b, "// rows in component order: x, y, z, phi_z, phi_y, phi_x (radians)\n");
+    Emit(b, "static f32 ", instr->name, "_placements[", fs->rows_cnt, "][6] = {\n");
+    for (s32 i = 0; i < instr->comps.len; ++i) {
+        if (fs->rows[i] < 0) {
+            continue;
+        }
+        FoldPose *pose = fs->poses + i;
+        f64 phi_x, phi_y, phi_z;
+        FoldRotToAngles(pose->rot, &phi_x, &phi_y, &phi_z);
+
+        Emit(b, "    { ", pose->pos[0], ", ", pose->pos[1], ", ", pose->pos[2], ", ", phi_z, ", ", phi_y, ", ", phi_x, " }, // ", instr->comps.arr[i].name, "\n");
+    }
+    Emit(b, "};\n\n");
+}
+
+
+#endif
@@ -2,85 +2,161 @@
 #define __COGEN_INSTR_H__
 
 
-void PrintDefines(StrBuff *b, InstrumentParse *instr) {
+void PrintDefines(EmitBuff *b, InstrumentParse *instr) {
     for (s32 i = 0; i < instr->params.len; ++i) {
         Parameter p = instr->params.arr[i];
-        StrBuffPrint1K(b, "    #define %.*s spec->%.*s\n", 4, p.name.len, p.name.str, p.name.len, p.name.str);
+        Emit(b, "    #define ", p.name, " spec->", p.name, "\n");
     }
-    StrBuffPrint1K(b, "\n", 0);
+    Emit(b, "\n");
     for (s32 i = 0; i < instr->declare_members.len; ++i) {
         StructMember m = instr->declare_members.arr[i];
-        StrBuffPrint1K(b, "    #define %.*s spec->%.*s\n", 4, m.name.len, m.name.str, m.name.len, m.name.str);
+        Emit(b, "    #define ", m.name, " spec->", m.name, "\n");
     }
 }
 
-void PrintUndefs(StrBuff *b, InstrumentParse *instr) {
+void PrintUndefs(EmitBuff *b, InstrumentParse *instr) {
     for (s32 i = 0; i < instr->params.len; ++i) {
         Parameter p = instr->params.arr[i];
-        StrBuffPrint1K(b, "    #undef %.*s\n", 2, p.name.len, p.name.str);
+        Emit(b, "    #undef ", p.name, "\n");
     }
-    StrBuffPrint1K(b, "\n", 0);
+    Emit(b, "\n");
     for (s32 i = 0; i < instr->declare_members.len; ++i) {
         StructMember m = instr->declare_members.arr[i];
-        StrBuffPrint1K(b, "    #undef %.*s\n", 2, m.name.len, m.name.str);
+        Emit(b, "    #undef ", m.name, "\n");
     }
 }
 
-void AmendIdentifiesInRValue(Str *value) {
-    Tokenizer t = {};
-    t.Init(value->str);
-    char *t_at0 = t.at;
+bool _IsMemberAccess(Str value, char *at) {
+    // true if the identifier at "at" follows a '.' or a "->"
+    while (at > value.str && IsWhitespace(at[-1])) {
+        --at;
+    }
+    if (at > value.str && at[-1] == '.') {
+        return true;
+    }
+    if (at > value.str + 1 && at[-1] == '>' && at[-2] == '-') {
+        return true;
+    }
+    return false;
+}
 
-    while (true) {
-        Token tok = GetToken(&t);
-        if (tok.type == TOK_IDENTIFIER) {
-            Str identifier = tok.GetValue();
-            Str amend = StrCat(StrL("spec->"), identifier);
-            *value = StrInsertReplace(*value, amend, identifier);
+void CogenRValue(EmitBuff *b, Str value, HashMap *instr_vars) {
+    // Appends value to b, putting "spec->" in front of the instrument parameters and declares it uses.
+    // Single pass over the tokens, the text between rewritten identifiers is copied through as-is.
+    char *end = value.str + value.len;
+    char *copied = value.str;
 
-            s32 t_advance = t.at - t_at0;
-            t.at = value->str;
-            t_at0 = t.at;
-            t.at += t_advance + 6;
+    Tokenizer t = {};
+    t.Init(value.str);
+    while (t.at < end) {
+        Token tok = GetToken(&t);
+        if (tok.type == TOK_ENDOFSTREAM || tok.text >= end) {
+            break;
         }
+        if (tok.type == TOK_IDENTIFIER && MapGet(instr_vars, (u64) tok.sym) && _IsMemberAccess(value, tok.text) == false) {
+            Emit(b, Str { copied, (u32) (tok.text - copied) }, "spec->");
+            copied = tok.text;
+        }
+    }
+    Emit(b, Str { copied, (u32) (end - copied) });
+}
+
+
+struct CogenInstrState {
+    HashMap instr_vars; // symbols of instrument parameters and declares
+    MonNDSpec *monnd_specs;
+    bool *monnd_ok;
+    s32 monnd_cnt;
+
+    Str instr_name;
+    FoldState fold;
+    s32 comp_idx;
+
+    HashMap param_idx;  // parameter symbol -> index + 1
+    s32 deps_words;
+    u64 *init_deps;     // parameters read by INITIALIZE, and so by the declares
+};
+
 
-        if (t.at >= (value->str + value->len)) {
+//
+//  Parameter dependencies
+//
+//  A dependency set is a bitset over the instrument parameters, in declaration order. Expressions depend on the
+//  parameters they name, and on the INITIALIZE set if they use a declare.
+
+
+void _CollectDeps(CogenInstrState *cs, Str expr, u64 *deps) {
+    char *end = expr.str + expr.len;
+    Tokenizer t = {};
+    t.Init(expr.str);
+    while (t.at < end) {
+        Token tok = GetToken(&t);
+        if (tok.type == TOK_ENDOFSTREAM || tok.text >= end) {
             break;
         }
+        if (tok.type != TOK_IDENTIFIER || MapGet(&cs->instr_vars, (u64) tok.sym) == 0 || _IsMemberAccess(expr, tok.text)) {
+            continue;
+        }
+        s32 idx = (s32) MapGet(&cs->param_idx, (u64) tok.sym) - 1;
+        if (idx >= 0) {
+            deps[idx / 64] |= (u64) 1 << (idx % 64);
+        }
+        else {
+            for (s32 w = 0; w < cs->deps_words; ++w) {
+                deps[w] |= cs->init_deps[w];
+            }
+        }
     }
 }
 
+bool _HasDeps(CogenInstrState *cs, u64 *deps) {
+    for (s32 w = 0; w < cs->deps_words; ++w) {
+        if (deps[w]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void _EmitDeps(EmitBuff *b, CogenInstrState *cs, u64 *deps) {
+    Emit(b, "{ ");
+    for (s32 w = 0; w < cs->deps_words; ++w) {
+        if (w) {
+            Emit(b, ", ");
+        }
+        Emit(b, deps[w], "ull");
+    }
+    Emit(b, " }");
+}
 
-void CogenInstrumentConfig(StrBuff *b, InstrumentParse *instr) {
+CogenInstrState CogenInstrumentConfigBegin(EmitBuff *b, InstrumentParse *instr) {
     // header guard
-    StrBuffPrint1K(b, "#ifndef __%.*s__\n", 2, instr->name.len, instr->name.str);
-    StrBuffPrint1K(b, "#define __%.*s__\n", 2, instr->name.len, instr->name.str);
-    StrBuffPrint1K(b, "\n\n", 0);
+    Emit(b, "#ifndef __", instr->name, "__\n");
+    Emit(b, "#define __", instr->name, "__\n");
+    Emit(b, "\n\n");
 
     // struct
-    StrBuffPrint1K(b, "struct %.*s {\n", 2, instr->name.len, instr->name.str);
-    StrBuffPrint1K(b, "\n    // parameters\n", 0);
+    Emit(b, "struct ", instr->name, " {\n");
+    Emit(b, "\n    // parameters\n");
 
     // parameters
-    Str string_s { (char*) "string", 6 };
-    Str vector_s { (char*) "vector", 6 };
     for (s32 i = 0; i < instr->params.len; ++i) {
         Parameter p = instr->params.arr[i];
 
-        if (StrEqual(p.type, string_s)) {
-            StrBuffPrint1K(b, "    char *", 0);
+        if (p.type_sym == SYM_string) {
+            Emit(b, "    char *");
         }
-        else if (StrEqual(p.type, vector_s)) {
-            StrBuffPrint1K(b, "    double ", 0);
+        else if (p.type_sym == SYM_vector) {
+            Emit(b, "    double ");
         }
         else if (p.type.len) {
-            StrBuffPrint1K(b, "    %.*s ", 2, p.type.len, p.type.str);
+            Emit(b, "    ", p.type, " ");
         }
         else {
-            StrBuffPrint1K(b, "    double ", 0);
+            Emit(b, "    double ");
         }
 
-        if (StrEqual(p.type, vector_s)) {
+        if (p.type_sym == SYM_vector) {
             // just scan how many commas it has
             assert(p.default_val.len > 0);
             s32 cnt = 1;
@@ -89,203 +165,473 @@ void CogenInstrumentConfig(StrBuff *b, InstrumentParse *instr) {
                     ++cnt;
                 }
             }
-            StrBuffPrint1K(b, "%.*s[%d]", 3, p.name.len, p.name.str, cnt);
+            Emit(b, p.name, "[", cnt, "]");
         }
         else {
-            StrBuffPrint1K(b, "%.*s", 2, p.name.len, p.name.str);
+            Emit(b, p.name);
         }
 
         if (p.default_val.len) {
-            if (StrEqual(p.type, string_s)) {
-                StrBuffPrint1K(b, " = (char*) %.*s", 2, p.default_val.len, p.default_val.str);
+            if (p.type_sym == SYM_string) {
+                Emit(b, " = (char*) ", p.default_val);
             }
             else {
-                StrBuffPrint1K(b, " = %.*s", 2, p.default_val.len, p.default_val.str);
+                Emit(b, " = ", p.default_val);
             }
         }
-        StrBuffPrint1K(b, ";\n", 0);
+        Emit(b, ";\n");
     }
 
     // declare members
-    StrBuffPrint1K(b, "\n    // declares\n", 0);
+    Emit(b, "\n    // declares\n");
     for (s32 i = 0; i < instr->declare_members.len; ++i) {
         StructMember m = instr->declare_members.arr[i];
 
-        StrBuffPrint1K(b, "    %.*s ", 2, m.type.len, m.type.str);
+        Emit(b, "    ", m.type, " ");
         if (m.is_pointer_type) {
-            StrBuffPrint1K(b, "*", 0);
+            Emit(b, "*");
         }
-        StrBuffPrint1K(b, "%.*s", 2, m.name.len, m.name.str);
+        Emit(b, m.name);
 
         if (m.is_array_type) {
-            StrBuffPrint1K(b, "[%d]", 1, m.array_type_sz);
+            Emit(b, "[", m.array_type_sz, "]");
         }
 
         if (m.defval.len) {
-            StrBuffPrint1K(b, " = %.*s", 2, m.defval.len, m.defval.str);
+            Emit(b, " = ", m.defval);
+        }
+        Emit(b, ";\n");
+    }
+    Emit(b, "};\n\n\n");
+
+
+    // instrument variables, which are prefixed by "spec->" in component arguments and placement
+    CogenInstrState cs = {};
+    cs.instr_vars = InitMap(GetContext()->a_tmp, (instr->params.len + instr->declare_members.len) * 2 + 1);
+    for (s32 i = 0; i < instr->params.len; ++i) {
+        MapPut(&cs.instr_vars, (u64) StrIntern(instr->params.arr[i].name), (u64) 1);
+    }
+    for (s32 i = 0; i < instr->declare_members.len; ++i) {
+        MapPut(&cs.instr_vars, (u64) StrIntern(instr->declare_members.arr[i].name), (u64) 1);
+    }
+    cs.param_idx = InitMap(GetContext()->a_tmp, instr->params.len * 2 + 1);
+    for (s32 i = 0; i < instr->params.len; ++i) {
+        MapPut(&cs.param_idx, (u64) StrIntern(instr->params.arr[i].name), (u64) i + 1);
+    }
+    cs.deps_words = instr->params.len / 64 + 1;
+    cs.init_deps = (u64*) ArenaAlloc(GetContext()->a_tmp, sizeof(u64) * cs.deps_words);
+    memset(cs.init_deps, 0, sizeof(u64) * cs.deps_words);
+    _CollectDeps(&cs, instr->initalize_block, cs.init_deps);
+
+    // specialised component instances (needs the full component list, so not available when streaming)
+    cs.monnd_specs = (MonNDSpec*) ArenaAlloc(GetContext()->a_tmp, sizeof(MonNDSpec) * instr->comps.len);
+    cs.monnd_ok = (bool*) ArenaAlloc(GetContext()->a_tmp, sizeof(bool) * instr->comps.len);
+    for (s32 i = 0; i < instr->comps.len && g_cogen_specialise; ++i) {
+        ComponentCall *c = instr->comps.arr + i;
+
+        cs.monnd_ok[i] = MonNDSpecialisable(c, cs.monnd_specs + i);
+        if (cs.monnd_ok[i]) {
+            if (cs.monnd_cnt == 0) {
+                CogenMonitorNDHelpers(b);
+            }
+            CogenMonitorNDTrace(b, c, cs.monnd_specs + i);
+            cs.monnd_cnt++;
         }
-        StrBuffPrint1K(b, ";\n", 0);
     }
-    StrBuffPrint1K(b, "};\n\n\n", 0);
+    if (cs.monnd_cnt) {
+        Emit(b, "\n");
+    }
+
+    // constant placements (needs the full component list as well)
+    cs.instr_name = instr->name;
+    cs.fold = FoldPlacements(GetContext()->a_tmp, instr);
+    CogenPlacementTable(b, instr, &cs.fold);
 
 
     // signature
-    StrBuffPrint1K(b, "static %.*s %.*s_var;\n\n\n", 4, instr->name.len, instr->name.str, instr->name.len, instr->name.str);
-    StrBuffPrint1K(b, "InstrumentConfig InitAndConfig_%.*s(MArena *a_dest, u32 ncount) {\n", 4, instr->name.len, instr->name.str);
-    StrBuffPrint1K(b, "    %.*s *spec = &%.*s_var;\n", 4, instr->name.len, instr->name.str, instr->name.len, instr->name.str);
-    StrBuffPrint1K(b, "\n", 0);
-    StrBuffPrint1K(b, "    // NOTE: mcncount must be set BEFORE initialization:\n", 0);
-    StrBuffPrint1K(b, "    //      This is used by API call mcget_ncount(), and called by some components during init (SourceMaxwell)\n", 0);
-    StrBuffPrint1K(b, "    mcset_ncount(ncount);\n", 0);
-    StrBuffPrint1K(b, "\n\n    // initialize\n\n\n", 0);
+    Emit(b, "static ", instr->name, " ", instr->name, "_var;\n\n\n");
+    Emit(b, "InstrumentConfig InitAndConfig_", instr->name, "(MArena *a_dest, u32 ncount) {\n");
+    Emit(b, "    ", instr->name, " *spec = &", instr->name, "_var;\n");
+    Emit(b, "\n");
+    Emit(b, "    // NOTE: mcncount must be set BEFORE initialization:\n");
+    Emit(b, "    //      This is used by API call mcget_ncount(), and called by some components during init (SourceMaxwell)\n");
+    Emit(b, "    mcset_ncount(ncount);\n");
+
+    // the placement table holds these parameters at their default values
+    bool folded_params = false;
+    for (s32 i = 0; i < instr->params.len; ++i) {
+        Parameter p = instr->params.arr[i];
+        if (MapGet(&cs.fold.used, (u64) StrIntern(p.name)) == 0) {
+            continue;
+        }
+        if (folded_params == false) {
+            Emit(b, "\n    // parameters folded at cogen time, vary them with --scan\n");
+            folded_params = true;
+        }
+        Emit(b, "    assert(spec->", p.name, " == (");
+        CogenRValue(b, p.default_val, &cs.instr_vars);
+        Emit(b, ") && \"", p.name, " is folded into the placements\");\n");
+    }
+    Emit(b, "\n\n    // initialize\n\n\n");
 
 
     // init instrument
     if (instr->initalize_block.len) {
         PrintDefines(b, instr);
-        StrBuffPrint1K(b, "    ////////////////////////////////////////////////////////////////\n\n", 0);
+        Emit(b, "    ////////////////////////////////////////////////////////////////\n\n");
 
-        StrBuffAppend(b, instr->initalize_block);
+        Emit(b, instr->initalize_block);
 
-        StrBuffPrint1K(b, "\n\n    ////////////////////////////////////////////////////////////////\n", 0);
+        Emit(b, "\n\n    ////////////////////////////////////////////////////////////////\n");
         PrintUndefs(b, instr);
     }
-    StrBuffPrint1K(b, "\n\n", 0);
+    Emit(b, "\n\n");
 
 
     // "trace" e.g. configure & initialize components
-    StrBuffPrint1K(b, "    // configuration pre-amble\n\n\n", 0);
-    StrBuffPrint1K(b, "    InstrumentConfig config = {};\n", 0);
-    StrBuffPrint1K(b, "    config.scenegraph = SceneGraphInit(cbui.ctx->a_pers);\n", 0);
-    StrBuffPrint1K(b, "    Instrument *instr = &config.instr;\n", 0);
-    StrBuffPrint1K(b, "    SceneGraphHandle *sg = &config.scenegraph;\n", 0);
-    StrBuffPrint1K(b, "\n", 0);
-    StrBuffPrint1K(b, "    instr->name = (char*) \"%.*s\";\n", 2, instr->name.len, instr->name.str);
-    StrBuffPrint1K(b, "    config.comps = InitArray<Component*>(a_dest, 32);\n", 0);
-    StrBuffPrint1K(b, "    f32 at_x, at_y, at_z;\n", 0);
-    StrBuffPrint1K(b, "    f32 phi_x, phi_y, phi_z;\n", 0);
-    StrBuffPrint1K(b, "    s32 index = 0;\n", 0);
-    StrBuffPrint1K(b, "\n\n", 0);
-    StrBuffPrint1K(b, "    // configure components\n\n\n", 0);
-
-    for (s32 i = 0; i < instr->comps.len; ++i) {
-        ComponentCall c = instr->comps.arr[i];
+    Emit(b, "    // configuration pre-amble\n\n\n");
+    Emit(b, "    InstrumentConfig config = {};\n");
+    Emit(b, "    config.scenegraph = SceneGraphInit(cbui.ctx->a_pers);\n");
+    Emit(b, "    Instrument *instr = &config.instr;\n");
+    Emit(b, "    SceneGraphHandle *sg = &config.scenegraph;\n");
+    Emit(b, "\n");
+    Emit(b, "    instr->name = (char*) \"", instr->name, "\";\n");
+    Emit(b, "    config.comps = InitArray<Component*>(a_dest, 32);\n");
+    Emit(b, "    f32 at_x, at_y, at_z;\n");
+    Emit(b, "    f32 phi_x, phi_y, phi_z;\n");
+    if (cs.fold.rows_cnt) {
+        Emit(b, "    f32 *pl;\n");
+    }
+    Emit(b, "    s32 index = 0;\n");
+    Emit(b, "\n\n");
+    Emit(b, "    // configure components\n\n\n");
 
-        StrBuffPrint1K(b, "    Component *%.*s = CreateComponent(a_dest, CT_%.*s, index++, \"%.*s\");\n", 6, c.name.len, c.name.str, c.type.len, c.type.str, c.name.len, c.name.str);
-        StrBuffPrint1K(b, "    config.comps.Add(%.*s);\n", 2, c.name.len, c.name.str);
-        StrBuffPrint1K(b, "    %.*s *%.*s_comp = (%.*s*) %.*s->comp;\n", 8, c.type.len, c.type.str, c.name.len, c.name.str, c.type.len, c.type.str, c.name.len, c.name.str);
+    return cs;
+}
 
+void _CogenAssignRValue(EmitBuff *b, Str ind, const char *lvalue, Str rvalue, HashMap *instr_vars) {
+    Emit(b, ind, StrL(lvalue), " = ");
+    CogenRValue(b, rvalue, instr_vars);
+    Emit(b, ";\n");
+}
 
-        // TODO: move to dedicated code section
-        // amend parameter asignments
-        for (s32 j = 0; j < c.args.len; ++j) {
-            Parameter *p = c.args.arr + j;
+void _CogenComponentArgs(EmitBuff *b, CogenInstrState *cs, ComponentCall *c, Str ind) {
+    for (s32 j = 0; j < c->args.len; ++j) {
+        Parameter p = c->args.arr[j];
 
-            // put "spec->" in front of identifiers in these rvalues
-            AmendIdentifiesInRValue(&p->default_val);
+        // instrument variables in these rvalues get "spec->" in front
+        if (p.default_val.len && p.default_val.str[0] == '"') {
+            Emit(b, ind, c->name, "_comp->", p.name, " = (char*) ");
         }
-
-        for (s32 j = 0; j < c.args.len; ++j) {
-            Parameter p = c.args.arr[j];
-            if (p.default_val.len && p.default_val.str[0] == '"') {
-                StrBuffPrint1K(b, "    %.*s_comp->%.*s = (char*) %.*s;\n", 6, c.name.len, c.name.str, p.name.len, p.name.str, p.default_val.len, p.default_val.str);
-            }
-            else {
-                StrBuffPrint1K(b, "    %.*s_comp->%.*s = %.*s;\n", 6, c.name.len, c.name.str, p.name.len, p.name.str, p.default_val.len, p.default_val.str);
-            }
+        else {
+            Emit(b, ind, c->name, "_comp->", p.name, " = ");
         }
-        StrBuffPrint1K(b, "    Init_%.*s(%.*s_comp, instr);\n", 4, c.type.len, c.type.str, c.name.len, c.name.str);
+        CogenRValue(b, p.default_val, &cs->instr_vars);
+        Emit(b, ";\n");
+    }
+    Emit(b, ind, "Init_", c->type, "(", c->name, "_comp, instr);\n");
+}
 
+void _CogenPlacementAssign(EmitBuff *b, CogenInstrState *cs, ComponentCall *c, Str ind) {
+    // instrument variables used in AT/ROT are written with "spec->"
+    HashMap *vars = &cs->instr_vars;
+
+    _CogenAssignRValue(b, ind, "at_x", c->at_x, vars);
+    _CogenAssignRValue(b, ind, "at_y", c->at_y, vars);
+    _CogenAssignRValue(b, ind, "at_z", c->at_z, vars);
+    if (c->rot_defined) {
+        _CogenAssignRValue(b, ind, "phi_x", c->rot_x, vars);
+        _CogenAssignRValue(b, ind, "phi_y", c->rot_y, vars);
+        _CogenAssignRValue(b, ind, "phi_z", c->rot_z, vars);
+    }
+}
 
-        // pre-fix instrument variable use in AT/ROT with "spec->" which makes those available in generated code
-        AmendIdentifiesInRValue(&c.at_x);
-        AmendIdentifiesInRValue(&c.at_y);
-        AmendIdentifiesInRValue(&c.at_z);
+void _CogenPlacementLocal(EmitBuff *b, ComponentCall *c, Str ind) {
+    if (c->rot_defined == false) {
+        Emit(b, ind, c->name, "->transform->t_loc = TransformBuildTranslation( { at_x, at_y, at_z } );\n");
+    }
+    else {
+        Emit(b, ind, c->name, "->transform->t_loc = TransformBuildTranslation( { at_x, at_y, at_z } ) * TransformBuildRotateZ( phi_z * deg2rad ) * TransformBuildRotateY( phi_y * deg2rad ) * TransformBuildRotateX( phi_x * deg2rad );\n");
+    }
+}
+
+void CogenComponentConfig(EmitBuff *b, CogenInstrState *cs, ComponentCall c, MonNDSpec *monnd_spec = NULL) {
+    Str ind = StrL("    ");
+
+    Emit(b, "    Component *", c.name, " = CreateComponent(a_dest, CT_", c.type, ", index++, \"", c.name, "\");\n");
+    Emit(b, "    config.comps.Add(", c.name, ");\n");
+    Emit(b, "    ", c.type, " *", c.name, "_comp = (", c.type, "*) ", c.name, "->comp;\n");
+
+    // amend parameter asignments
+    _CogenComponentArgs(b, cs, &c, ind);
+    if (monnd_spec) {
+        CogenMonitorNDCheck(b, &c, monnd_spec);
+    }
+
+
+    // comments show the AT/ROT expressions as given
+    // NOTE: RELATIVE PREVIOUS has been replaced by the previous instance name in CheckInstrument
+    // NOTE: The ABSOLUTE is handled inline using the flags at_absolute and rot_absolute
+    s32 row = (cs->comp_idx < cs->fold.comps_cnt) ? cs->fold.rows[cs->comp_idx] : -1;
+    cs->comp_idx++;
+
+    if (row >= 0) {
+
+        // absolute placement folded at cogen time, no parent
+        Emit(b, "    // case #0:      Constant placement, precomputed\n");
+        Emit(b, "    // AT:  (", c.at_x, ", ", c.at_y, ", ", c.at_z, ") RELATIVE ", c.at_relative_to, "\n");
         if (c.rot_defined) {
+            Emit(b, "    // ROT: (", c.rot_x, ", ", c.rot_y, ", ", c.rot_z, ") RELATIVE ", c.rot_relative_to, "\n");
+        }
+        Emit(b, "    pl = ", cs->instr_name, "_placements[", row, "];\n");
+        Emit(b, "    ", c.name, "->transform = SceneGraphAlloc(sg);\n");
+        Emit(b, "    ", c.name, "->transform->t_loc = TransformBuildTranslation( { pl[0], pl[1], pl[2] } ) * TransformBuildRotateZ( pl[3] ) * TransformBuildRotateY( pl[4] ) * TransformBuildRotateX( pl[5] );\n");
+        Emit(b, "\n");
+        return;
+    }
+
+    bool same_at_rot_relative = StrEqual(c.at_relative_to, c.rot_relative_to);
+    if (c.rot_defined == false) {
+        Emit(b, "    // case #1:      Only AT is defined\n");
+        Emit(b, "    // AT:  (", c.at_x, ", ", c.at_y, ", ", c.at_z, ") RELATIVE ", c.at_relative_to, "\n");
+    }
+    else {
+        if (same_at_rot_relative) {
+            Emit(b, "    // case #2:      AT and ROT are defined RELATIVE to the same parent (defined through SceneGraphAlloc)\n");
+        }
+        else {
+            Emit(b, "    // case #3:      AT and ROT are defined RELATIVE to different parents (SceneGraphAlloc defines the AT-parent, SceneGraphSetRotParent defines the ROT-parent)\n");
+        }
+        Emit(b, "    // AT:  (", c.at_x, ", ", c.at_y, ", ", c.at_z, ") RELATIVE ", c.at_relative_to, "\n");
+        Emit(b, "    // ROT: (", c.rot_x, ", ", c.rot_y, ", ", c.rot_z, ") RELATIVE ", c.rot_relative_to, "\n");
+    }
+    _CogenPlacementAssign(b, cs, &c, ind);
+
+    if (c.at_absolute) {
+        Emit(b, "    ", c.name, "->transform = SceneGraphAlloc(sg);\n");
+    }
+    else {
+        Emit(b, "    ", c.name, "->transform = SceneGraphAlloc(sg, ", c.at_relative_to, "->transform);\n");
+    }
+    _CogenPlacementLocal(b, &c, ind);
 
-            // TODO: move to dedicated code section
-            AmendIdentifiesInRValue(&c.rot_x);
-            AmendIdentifiesInRValue(&c.rot_y);
-            AmendIdentifiesInRValue(&c.rot_z);
+    // amend for case #3, ROTATED ABSOLUTE has no parent
+    if (c.rot_defined && same_at_rot_relative == false) {
+        if (c.rot_absolute) {
+            Emit(b, "    SceneGraphSetRotParent(sg, ", c.name, "->transform, NULL);\n");
         }
+        else {
+            Emit(b, "    SceneGraphSetRotParent(sg, ", c.name, "->transform, ", c.rot_relative_to, "->transform);\n");
+        }
+    }
+    Emit(b, "\n");
+}
 
-        // eliminate any use of the PREVIOUS keyword
-        if ( StrEqual(c.at_relative_to, StrL("PREVIOUS")) ) {
-            assert(i > 0);
-            c.at_relative_to = instr->comps.arr[i-1].name;
+void CogenReconfigure(EmitBuff *b, InstrumentParse *instr, CogenInstrState *cs) {
+    // Reconfigure_<instr> re-runs INITIALIZE, component Init and placements only where a changed parameter is used.
+    // Needs the full component list, so not available when streaming.
+    s32 ncomps = instr->comps.len;
+    s32 words = cs->deps_words;
+    u64 *arg_deps = (u64*) ArenaAlloc(GetContext()->a_tmp, sizeof(u64) * words * ncomps);
+    u64 *place_deps = (u64*) ArenaAlloc(GetContext()->a_tmp, sizeof(u64) * words * ncomps);
+    memset(arg_deps, 0, sizeof(u64) * words * ncomps);
+    memset(place_deps, 0, sizeof(u64) * words * ncomps);
+
+    for (s32 i = 0; i < ncomps; ++i) {
+        ComponentCall *c = instr->comps.arr + i;
+        for (s32 j = 0; j < c->args.len; ++j) {
+            _CollectDeps(cs, c->args.arr[j].default_val, arg_deps + i * words);
         }
-        if ( StrEqual(c.rot_relative_to, StrL("PREVIOUS")) ) {
-            assert(i > 0);
-            c.rot_relative_to = instr->comps.arr[i-1].name;
+        if (cs->fold.rows[i] < 0) {
+            _CollectDeps(cs, c->at_x, place_deps + i * words);
+            _CollectDeps(cs, c->at_y, place_deps + i * words);
+            _CollectDeps(cs, c->at_z, place_deps + i * words);
+            if (c->rot_defined) {
+                _CollectDeps(cs, c->rot_x, place_deps + i * words);
+                _CollectDeps(cs, c->rot_y, place_deps + i * words);
+                _CollectDeps(cs, c->rot_z, place_deps + i * words);
+            }
         }
+    }
 
-        // NOTE: The ABSOLUTE is handled inline using the flags at_absolute and rot_absolute
-        if (c.rot_defined == false) {
+    // dependency map
+    Emit(b, "// parameter sets are bitsets, parameter p is bit p % 64 of word p / 64\n");
+    Emit(b, "enum ", instr->name, "_Param {\n");
+    for (s32 i = 0; i < instr->params.len; ++i) {
+        Emit(b, "    ", instr->name, "_P_", instr->params.arr[i].name, ",\n");
+    }
+    Emit(b, "    ", instr->name, "_P_CNT\n");
+    Emit(b, "};\n\n");
+
+    Emit(b, "static u64 ", instr->name, "_init_deps[", words, "] = ");
+    _EmitDeps(b, cs, cs->init_deps);
+    Emit(b, ";\n");
+    Emit(b, "static u64 ", instr->name, "_arg_deps[", ncomps, "][", words, "] = {\n");
+    for (s32 i = 0; i < ncomps; ++i) {
+        Emit(b, "    ");
+        _EmitDeps(b, cs, arg_deps + i * words);
+        Emit(b, ", // ", instr->comps.arr[i].name, "\n");
+    }
+    Emit(b, "};\n");
+    Emit(b, "static u64 ", instr->name, "_place_deps[", ncomps, "][", words, "] = {\n");
+    for (s32 i = 0; i < ncomps; ++i) {
+        Emit(b, "    ");
+        _EmitDeps(b, cs, place_deps + i * words);
+        Emit(b, ", // ", instr->comps.arr[i].name, "\n");
+    }
+    Emit(b, "};\n\n");
 
-            // only AT is defined
-            StrBuffPrint1K(b, "    // case #1:      Only AT is defined\n", 0);
-            StrBuffPrint1K(b, "    // AT:  (%.*s, %.*s, %.*s) RELATIVE %.*s\n", 8, c.at_x.len, c.at_x.str, c.at_y.len, c.at_y.str, c.at_z.len, c.at_z.str, c.at_relative_to.len, c.at_relative_to.str);
+    Emit(b, "static bool ", instr->name, "_DepsChanged(u64 *changed, u64 *deps) {\n");
+    Emit(b, "    for (s32 i = 0; i < ", words, "; ++i) {\n");
+    Emit(b, "        if (changed[i] & deps[i]) { return true; }\n");
+    Emit(b, "    }\n");
+    Emit(b, "    return false;\n");
+    Emit(b, "}\n\n\n");
 
-            StrBuffPrint1K(b, "    at_x = %.*s;\n", 2, c.at_x.len, c.at_x.str);
-            StrBuffPrint1K(b, "    at_y = %.*s;\n", 2, c.at_y.len, c.at_y.str);
-            StrBuffPrint1K(b, "    at_z = %.*s;\n", 2, c.at_z.len, c.at_z.str);
 
-            if (c.at_absolute) {
-                StrBuffPrint1K(b, "    %.*s->transform = SceneGraphAlloc(sg);\n", 2, c.name.len, c.name.str);
-            }
-            else {
-                StrBuffPrint1K(b, "    %.*s->transform = SceneGraphAlloc(sg, %.*s->transform);\n", 4, c.name.len, c.name.str, c.at_relative_to.len, c.at_relative_to.str);
-            }
-            StrBuffPrint1K(b, "    %.*s->transform->t_loc = TransformBuildTranslation( { at_x, at_y, at_z } );\n", 2, c.name.len, c.name.str);
+    // signature
+    Emit(b, "void Reconfigure_", instr->name, "(InstrumentConfig *config, u64 *changed) {\n");
+    Emit(b, "    ", instr->name, " *spec = &", instr->name, "_var;\n");
+    Emit(b, "    Instrument *instr = &config->instr;\n");
+    Emit(b, "    SceneGraphHandle *sg = &config->scenegraph;\n");
+    Emit(b, "    f32 at_x, at_y, at_z;\n");
+    Emit(b, "    f32 phi_x, phi_y, phi_z;\n");
+    Emit(b, "    bool moved = false;\n");
+    Emit(b, "    bool reinit = false;\n");
+    Emit(b, "\n");
+
+    // the placement table can not follow a change to a parameter folded into it
+    bool folded_params = false;
+    for (s32 i = 0; i < instr->params.len; ++i) {
+        Parameter p = instr->params.arr[i];
+        if (MapGet(&cs->fold.used, (u64) StrIntern(p.name)) == 0) {
+            continue;
+        }
+        if (folded_params == false) {
+            Emit(b, "    // parameters folded at cogen time, vary them with --scan\n");
+            folded_params = true;
         }
+        Emit(b, "    assert((changed[", instr->name, "_P_", p.name, " / 64] & (1ull << (", instr->name, "_P_", p.name, " % 64))) == 0 && \"", p.name, " is folded into the placements\");\n");
+    }
+    if (folded_params) {
+        Emit(b, "\n");
+    }
 
-        else if (c.rot_defined) {
+    if (instr->initalize_block.len && _HasDeps(cs, cs->init_deps)) {
+        Emit(b, "    if (", instr->name, "_DepsChanged(changed, ", instr->name, "_init_deps)) {\n");
+        PrintDefines(b, instr);
+        Emit(b, "    ////////////////////////////////////////////////////////////////\n\n");
 
-            bool same_at_rot_relative = StrEqual(c.at_relative_to, c.rot_relative_to);
-            if (same_at_rot_relative) {
-                StrBuffPrint1K(b, "    // case #2:      AT and ROT are defined RELATIVE to the same parent (defined through SceneGraphAlloc)\n", 0);
-            }
-            else {
-                StrBuffPrint1K(b, "    // case #3:      AT and ROT are defined RELATIVE to different parents (SceneGraphAlloc defines the AT-parent, SceneGraphSetRotParent defines the ROT-parent)\n", 0);
-            }
+        Emit(b, instr->initalize_block);
 
-            StrBuffPrint1K(b, "    // AT:  (%.*s, %.*s, %.*s) RELATIVE %.*s\n", 8, c.at_x.len, c.at_x.str, c.at_y.len, c.at_y.str, c.at_z.len, c.at_z.str, c.at_relative_to.len, c.at_relative_to.str);
-            StrBuffPrint1K(b, "    // ROT: (%.*s, %.*s, %.*s) RELATIVE %.*s\n", 8, c.rot_x.len, c.rot_x.str, c.rot_y.len, c.rot_y.str, c.rot_z.len, c.rot_z.str, c.rot_relative_to.len, c.rot_relative_to.str);
+        Emit(b, "\n\n    ////////////////////////////////////////////////////////////////\n");
+        PrintUndefs(b, instr);
+        Emit(b, "    }\n\n");
+    }
 
-            StrBuffPrint1K(b, "    at_x = %.*s;\n", 2, c.at_x.len, c.at_x.str);
-            StrBuffPrint1K(b, "    at_y = %.*s;\n", 2, c.at_y.len, c.at_y.str);
-            StrBuffPrint1K(b, "    at_z = %.*s;\n", 2, c.at_z.len, c.at_z.str);
-            StrBuffPrint1K(b, "    phi_x = %.*s;\n", 2, c.rot_x.len, c.rot_x.str);
-            StrBuffPrint1K(b, "    phi_y = %.*s;\n", 2, c.rot_y.len, c.rot_y.str);
-            StrBuffPrint1K(b, "    phi_z = %.*s;\n", 2, c.rot_z.len, c.rot_z.str);
+    Str ind = StrL("        ");
+    for (s32 i = 0; i < ncomps; ++i) {
+        ComponentCall *c = instr->comps.arr + i;
+        if (_HasDeps(cs, arg_deps + i * words) == false) {
+            continue;
+        }
+        Emit(b, "    if (", instr->name, "_DepsChanged(changed, ", instr->name, "_arg_deps[", i, "])) {\n");
+        Emit(b, "        ", c->type, " *", c->name, "_comp = (", c->type, "*) config->comps.arr[", i, "]->comp;\n");
+        // Init may have rewritten parameters left at their default, e.g. Slit sets xmin from xwidth
+        Emit(b, "        *", c->name, "_comp = Create_", c->type, "(", c->name, "_comp->index, ", c->name, "_comp->name);\n");
+        _CogenComponentArgs(b, cs, c, ind);
+        Emit(b, "        reinit = true;\n");
+        Emit(b, "    }\n");
+    }
+    Emit(b, "\n");
 
-            if (c.at_absolute) {
-                StrBuffPrint1K(b, "    %.*s->transform = SceneGraphAlloc(sg);\n", 2, c.name.len, c.name.str);
-            }
-            else {
-                StrBuffPrint1K(b, "    %.*s->transform = SceneGraphAlloc(sg, %.*s->transform);\n", 4, c.name.len, c.name.str, c.at_relative_to.len, c.at_relative_to.str);
-            }
-            StrBuffPrint1K(b, "    %.*s->transform->t_loc = TransformBuildTranslation( { at_x, at_y, at_z } ) * TransformBuildRotateZ( phi_z * deg2rad ) * TransformBuildRotateY( phi_y * deg2rad ) * TransformBuildRotateX( phi_x * deg2rad );\n", 2, c.name.len, c.name.str);
+    for (s32 i = 0; i < ncomps; ++i) {
+        ComponentCall *c = instr->comps.arr + i;
+        if (_HasDeps(cs, place_deps + i * words) == false) {
+            continue;
+        }
+        Emit(b, "    if (", instr->name, "_DepsChanged(changed, ", instr->name, "_place_deps[", i, "])) {\n");
+        Emit(b, "        Component *", c->name, " = config->comps.arr[", i, "];\n");
+        _CogenPlacementAssign(b, cs, c, ind);
+        _CogenPlacementLocal(b, c, ind);
+        Emit(b, "        moved = true;\n");
+        Emit(b, "    }\n");
+    }
+    Emit(b, "    if (moved) {\n");
+    Emit(b, "        SceneGraphUpdate(sg);\n");
+    Emit(b, "    }\n");
+    Emit(b, "    if (moved || reinit) {\n");
+    Emit(b, "        UpdateLegacyTransforms(config->comps);\n");
+    Emit(b, "    }\n");
+    Emit(b, "}\n\n\n");
+}
 
-            // amend for case #3
-            if (same_at_rot_relative == false) {
-                StrBuffPrint1K(b, "    SceneGraphSetRotParent(sg, %.*s->transform, %.*s->transform);\n", 4, c.name.len, c.name.str, c.rot_relative_to.len, c.rot_relative_to.str);
+void CogenInstrumentConfigEnd(EmitBuff *b, InstrumentParse *instr, CogenInstrState *cs) {
+    Emit(b, "    SceneGraphUpdate(sg);\n");
+    Emit(b, "    UpdateLegacyTransforms(config.comps);\n");
+    Emit(b, "\n");
+    Emit(b, "    return config;\n");
+    Emit(b, "}\n\n\n");
+
+
+    // trace dispatch, routing specialised instances past the generic TraceComponent
+    Emit(b, "void TraceComponent_", instr->name, "(Component *comp, Neutron *particle, Instrument *instr = NULL) {\n");
+    if (cs->monnd_cnt) {
+        Emit(b, "    if (comp->type == CT_Monitor_nD) {\n");
+        Emit(b, "        Monitor_nD *mon = (Monitor_nD*) comp->comp;\n");
+        Emit(b, "        switch (mon->index) {\n");
+        for (s32 i = 0; i < instr->comps.len; ++i) {
+            if (cs->monnd_ok[i]) {
+                Str name = instr->comps.arr[i].name;
+                Emit(b, "            case ", i, ": { Trace_Monitor_nD_", name, "(mon, particle, instr); } return;\n");
             }
         }
-        StrBuffPrint1K(b, "\n", 0);
+        Emit(b, "            default: { } break;\n");
+        Emit(b, "        }\n");
+        Emit(b, "    }\n");
+    }
+    Emit(b, "    TraceComponent(comp, particle, instr);\n");
+    Emit(b, "}\n\n\n");
+
+
+    // parameter scans
+    if (instr->comps.len) {
+        CogenReconfigure(b, instr, cs);
     }
-    StrBuffPrint1K(b, "    SceneGraphUpdate(sg);\n", 0);
-    StrBuffPrint1K(b, "    UpdateLegacyTransforms(config.comps);\n", 0);
-    StrBuffPrint1K(b, "\n", 0);
-    StrBuffPrint1K(b, "    return config;\n", 0);
-    StrBuffPrint1K(b, "}\n\n\n", 0);
 
 
     // TODO: cogen FINALLY section
 
 
     // close header guard
-    StrBuffPrint1K(b, "#endif // %.*s\n", 2, instr->name.len, instr->name.str);
+    Emit(b, "#endif // ", instr->name, "\n");
+}
+
+void CogenInstrumentConfig(EmitBuff *b, InstrumentParse *instr) {
+    CogenInstrState cs = CogenInstrumentConfigBegin(b, instr);
+    for (s32 i = 0; i < instr->comps.len; ++i) {
+        bool spec = g_cogen_specialise && cs.monnd_ok[i];
+        CogenComponentConfig(b, &cs, instr->comps.arr[i], spec ? cs.monnd_specs + i : NULL);
+    }
+    CogenInstrumentConfigEnd(b, instr, &cs);
+}
+
+
+void CogenInstrumentUnity(EmitBuff *b, HashMap *instrs, bool pch) {
+    // all instrument configs in one translation unit, the component headers are parsed once
+    if (pch) {
+        Emit(b, "#include \"comps_pch.h\"\n\n");
+    }
+    else {
+        Emit(b, "#include \"comps_meta.h\"\n\n");
+    }
+
+    MapIter iter = {};
+    while (InstrumentParse *instr = (InstrumentParse*) MapNextVal(instrs, &iter)) {
+        if (instr->parse_error == false && instr->namerefs_checked) {
+            Emit(b, "#include \"", instr->name, "_config.h\"\n");
+        }
+    }
 }
 
 
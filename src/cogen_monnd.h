@@ -0,0 +1,485 @@
+#ifndef __COGEN_MONND_H__
+#define __COGEN_MONND_H__
+
+
+//
+//  Cogen-time specialisation of Monitor_nD instances.
+//
+//  Monitor_nD parses its 'options' string at Init (monitor_nd-lib.c) and then branches on the resulting
+//  Flag_* and Coord_* fields for every neutron. When options is a string literal in the instrument file,
+//  we evaluate it here instead, and emit a Trace function for that instance with the coordinate variables,
+//  bin counts, literal limits and shape branch resolved. Anything we do not fully understand falls back
+//  to the generic Trace_Monitor_nD. Opt-in with --spec.
+
+
+#define MONND_SPEC_MAX_COORDS 8
+
+
+static bool g_cogen_specialise = false;
+
+
+enum MonNDCoord {
+    MND_NONE,
+
+    MND_X,
+    MND_Y,
+    MND_Z,
+    MND_VX,
+    MND_VY,
+    MND_VZ,
+    MND_KX,
+    MND_KY,
+    MND_KZ,
+    MND_SX,
+    MND_SY,
+    MND_SZ,
+    MND_T,
+    MND_V,
+    MND_K,
+    MND_ENERGY,
+    MND_LAMBDA,
+    MND_HDIV,
+    MND_VDIV,
+
+    MND_UNSUPPORTED,
+};
+
+enum MonNDShape {
+    MND_SHAPE_SQUARE,
+    MND_SHAPE_DISK,
+};
+
+enum MonNDMode {
+    MND_MODE_VAR,
+    MND_MODE_MIN,
+    MND_MODE_MAX,
+    MND_MODE_DIM,
+    MND_MODE_FIL,
+};
+
+struct MonNDSpec {
+    MonNDShape shape;
+    bool multiple;
+
+    // index 0 is the intensity, as in Vars.Coord_*
+    s32 coord_cnt;
+    MonNDCoord coords[MONND_SPEC_MAX_COORDS + 1];
+    s32 bins[MONND_SPEC_MAX_COORDS + 1];
+    bool min_known[MONND_SPEC_MAX_COORDS + 1];
+    bool max_known[MONND_SPEC_MAX_COORDS + 1];
+    f64 min[MONND_SPEC_MAX_COORDS + 1];
+    f64 max[MONND_SPEC_MAX_COORDS + 1];
+};
+
+
+MonNDCoord MonNDCoordFromToken(Str tok, f64 *lmin, f64 *lmax, bool *limits_known) {
+    *limits_known = true;
+
+    // spatial coordinates take their default limits from xwidth/yheight/zdepth, known only at Init
+    if (StrEqual(tok, "x")) { *limits_known = false; return MND_X; }
+    if (StrEqual(tok, "y")) { *limits_known = false; return MND_Y; }
+    if (StrEqual(tok, "z")) { *limits_known = false; return MND_Z; }
+
+    if (StrEqual(tok, "vx")) { *lmin = -1000; *lmax = 1000; return MND_VX; }
+    if (StrEqual(tok, "vy")) { *lmin = -1000; *lmax = 1000; return MND_VY; }
+    if (StrEqual(tok, "vz")) { *lmin = -10000; *lmax = 10000; return MND_VZ; }
+    if (StrEqual(tok, "kx")) { *lmin = -1; *lmax = 1; return MND_KX; }
+    if (StrEqual(tok, "ky")) { *lmin = -1; *lmax = 1; return MND_KY; }
+    if (StrEqual(tok, "kz")) { *lmin = -10; *lmax = 10; return MND_KZ; }
+    if (StrEqual(tok, "sx")) { *lmin = -1; *lmax = 1; return MND_SX; }
+    if (StrEqual(tok, "sy")) { *lmin = -1; *lmax = 1; return MND_SY; }
+    if (StrEqual(tok, "sz")) { *lmin = -1; *lmax = 1; return MND_SZ; }
+    if (StrEqual(tok, "t") || StrEqual(tok, "time") || StrEqual(tok, "tof")) { *lmin = 0; *lmax = 1; return MND_T; }
+    if (StrEqual(tok, "v")) { *lmin = 0; *lmax = 10000; return MND_V; }
+    if (StrEqual(tok, "k") || StrEqual(tok, "wavevector")) { *lmin = 0; *lmax = 10; return MND_K; }
+    if (StrEqual(tok, "energy") || StrEqual(tok, "omega") || StrEqual(tok, "e")) { *lmin = 0; *lmax = 100; return MND_ENERGY; }
+    if (StrEqual(tok, "lambda") || StrEqual(tok, "wavelength") || StrEqual(tok, "l")) { *lmin = 0; *lmax = 100; return MND_LAMBDA; }
+    if (StrEqual(tok, "hdiv") || StrEqual(tok, "divergence") || StrEqual(tok, "xdiv") || StrEqual(tok, "hd") || StrEqual(tok, "dx")) { *lmin = -5; *lmax = 5; return MND_HDIV; }
+    if (StrEqual(tok, "vdiv") || StrEqual(tok, "ydiv") || StrEqual(tok, "vd") || StrEqual(tok, "dy")) { *lmin = -5; *lmax = 5; return MND_VDIV; }
+
+    // variables known to the library, which we leave to the generic path
+    const char *unsupported[] = {
+        "p", "i", "intensity", "flux", "radius", "r", "xy", "yz", "xz", "vxy", "kxy", "vyz", "kyz", "vxz", "kxz",
+        "angle", "a", "theta", "longitude", "th", "phi", "latitude", "ph", "ncounts", "n", "neutron", "id", "pixel",
+        "user", "user1", "u1", "user2", "u2", "user3", "u3"
+    };
+    for (u32 i = 0; i < sizeof(unsupported) / sizeof(char*); ++i) {
+        if (StrEqual(tok, unsupported[i])) {
+            return MND_UNSUPPORTED;
+        }
+    }
+    if (tok.len >= 3 && (strncmp(tok.str, "ud", 2) == 0 || strncmp(tok.str, "userdouble", 10) == 0)) {
+        return MND_UNSUPPORTED;
+    }
+
+    return MND_NONE;
+}
+
+bool MonNDIsBailKeyword(Str tok) {
+    // keywords that change the per-neutron logic in ways the specialised trace does not implement
+    const char *bail[] = {
+        "borders", "verbose", "log", "abs", "list", "events", "stream", "slit", "absorb", "inactivate", "sphere", "cylinder",
+        "banana", "box", "previous", "parallel", "capture", "auto", "premonitor", "3he_pressure", "pressure", "no",
+        "not", "signal", "mantid", "cm2", "cm^2", "source", "outgoing"
+    };
+    for (u32 i = 0; i < sizeof(bail) / sizeof(char*); ++i) {
+        if (StrEqual(tok, bail[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MonNDIsDelimiter(char c) {
+    return c == ' ' || c == '=' || c == ',' || c == ';' || c == '[' || c == ']' || c == '(' || c == ')' || c == '{' || c == '}' || c == ':';
+}
+
+bool MonNDParseOptions(Str options, MonNDSpec *spec) {
+    *spec = {};
+    spec->shape = MND_SHAPE_SQUARE;
+    spec->bins[0] = 1;
+
+    // mirrors the token loop in Monitor_nD_Init: strtok on " =,;[](){}:", lower-cased tokens
+    MonNDMode mode = MND_MODE_VAR;
+    bool flag_all = false;
+
+    char buf[1024];
+    if (options.len >= sizeof(buf)) {
+        return false;
+    }
+    for (u32 i = 0; i < options.len; ++i) {
+        buf[i] = tolower(options.str[i]);
+    }
+    buf[options.len] = '\0';
+
+    char *at = buf;
+    while (*at) {
+        while (*at && (MonNDIsDelimiter(*at) || IsWhitespace(*at))) {
+            ++at;
+        }
+        if (*at == '\0') {
+            break;
+        }
+        Str tok = { at, 0 };
+        while (*at && !MonNDIsDelimiter(*at) && !IsWhitespace(*at)) {
+            ++at;
+            ++tok.len;
+        }
+
+        // values of the preceding keyword; as in the library, the token is then also checked as a keyword
+        if (mode == MND_MODE_MAX) {
+            f64 val = atof(StrZ(tok));
+            for (s32 i = flag_all ? 0 : spec->coord_cnt; i <= spec->coord_cnt; ++i) {
+                spec->max[i] = val;
+                spec->max_known[i] = true;
+            }
+            mode = MND_MODE_VAR;
+            flag_all = false;
+        }
+        if (mode == MND_MODE_MIN) {
+            f64 val = atof(StrZ(tok));
+            for (s32 i = flag_all ? 0 : spec->coord_cnt; i <= spec->coord_cnt; ++i) {
+                spec->min[i] = val;
+                spec->min_known[i] = true;
+            }
+            mode = MND_MODE_MAX;
+        }
+        if (mode == MND_MODE_DIM) {
+            s32 val = atoi(StrZ(tok));
+            for (s32 i = flag_all ? 0 : spec->coord_cnt; i <= spec->coord_cnt; ++i) {
+                spec->bins[i] = val;
+            }
+            mode = MND_MODE_VAR;
+            flag_all = false;
+        }
+        if (mode == MND_MODE_FIL) {
+            // the file name only affects Save
+            mode = MND_MODE_VAR;
+        }
+
+        if (MonNDIsBailKeyword(tok)) {
+            return false;
+        }
+
+        if (StrEqual(tok, "all")) { flag_all = true; }
+        if (StrEqual(tok, "multiple")) { spec->multiple = true; }
+        if (StrEqual(tok, "square")) { spec->shape = MND_SHAPE_SQUARE; }
+        if (StrEqual(tok, "disk")) { spec->shape = MND_SHAPE_DISK; }
+        if (StrEqual(tok, "limits") || StrEqual(tok, "min")) { mode = MND_MODE_MIN; }
+        if (StrEqual(tok, "max")) { mode = MND_MODE_MAX; }
+        if (StrEqual(tok, "bins") || StrEqual(tok, "dim")) { mode = MND_MODE_DIM; }
+        if (StrEqual(tok, "file") || StrEqual(tok, "filename")) { mode = MND_MODE_FIL; }
+
+        f64 lmin = 0;
+        f64 lmax = 0;
+        bool limits_known = false;
+        MonNDCoord coord = MonNDCoordFromToken(tok, &lmin, &lmax, &limits_known);
+        if (coord == MND_UNSUPPORTED) {
+            return false;
+        }
+        else if (coord != MND_NONE) {
+            if (spec->coord_cnt == MONND_SPEC_MAX_COORDS) {
+                return false;
+            }
+            s32 idx = ++spec->coord_cnt;
+            spec->coords[idx] = coord;
+            spec->bins[idx] = 20;
+            spec->min_known[idx] = limits_known;
+            spec->max_known[idx] = limits_known;
+            spec->min[idx] = lmin;
+            spec->max[idx] = lmax;
+            mode = MND_MODE_VAR;
+            flag_all = false;
+        }
+
+        // anything else is ignored by the library too (binary, float, incoming, steradian, ...)
+    }
+
+    if (spec->coord_cnt == 0) {
+        return false;
+    }
+    for (s32 i = 1; i <= spec->coord_cnt; ++i) {
+        if (spec->bins[i] <= 0) {
+            return false;
+        }
+        if (spec->min_known[i] && spec->max_known[i] && spec->min[i] > spec->max[i]) {
+            f64 swap = spec->min[i];
+            spec->min[i] = spec->max[i];
+            spec->max[i] = swap;
+        }
+    }
+    if (spec->coord_cnt != 2) {
+        spec->multiple = true;
+    }
+
+    return true;
+}
+
+Parameter *_FindArg(ComponentCall *c, const char *name) {
+    for (s32 i = 0; i < c->args.len; ++i) {
+        if (StrEqual(c->args.arr[i].name, name)) {
+            return c->args.arr + i;
+        }
+    }
+    return NULL;
+}
+
+bool _ArgIsUnsetOrZero(ComponentCall *c, const char *name) {
+    Parameter *arg = _FindArg(c, name);
+    if (arg == NULL) {
+        return true;
+    }
+    Str v = arg->default_val;
+    return StrEqual(v, "0") || StrEqual(v, "0.0") || StrEqual(v, "\"NULL\"") || StrEqual(v, "NULL") || StrEqual(v, "\"\"");
+}
+
+bool MonNDSpecialisable(ComponentCall *c, MonNDSpec *spec) {
+    if (c->type_sym != SYM_Monitor_nD) {
+        return false;
+    }
+
+    // options must be a plain string literal
+    Parameter *options = _FindArg(c, "options");
+    if (options == NULL) {
+        return false;
+    }
+    Str lit = options->default_val;
+    if (lit.len < 2 || lit.str[0] != '"' || lit.str[lit.len - 1] != '"') {
+        return false;
+    }
+    for (u32 i = 1; i < lit.len - 1; ++i) {
+        if (lit.str[i] == '"' || lit.str[i] == '\\') {
+            return false;
+        }
+    }
+
+    // arguments which alter the flags or shape during Init
+    const char *unset_args[] = { "restore_neutron", "radius", "geometry", "zdepth", "zmin", "zmax", "user1", "user2", "user3", "min", "max" };
+    for (u32 i = 0; i < sizeof(unset_args) / sizeof(char*); ++i) {
+        if (_ArgIsUnsetOrZero(c, unset_args[i]) == false) {
+            return false;
+        }
+    }
+
+    Str opts = { lit.str + 1, lit.len - 2 };
+    if (MonNDParseOptions(opts, spec) == false) {
+        return false;
+    }
+
+    // Init appends " all bins=%ld" when the bins argument is set
+    Parameter *bins = _FindArg(c, "bins");
+    if (bins && _ArgIsUnsetOrZero(c, "bins") == false) {
+        Str v = bins->default_val;
+        for (u32 i = 0; i < v.len; ++i) {
+            if (IsNumeric(v.str[i]) == false) {
+                return false;
+            }
+        }
+        s32 nbins = ParseInt(v.str, v.len);
+        for (s32 i = 0; i <= spec->coord_cnt; ++i) {
+            spec->bins[i] = nbins;
+        }
+    }
+
+    return true;
+}
+
+
+void _CogenMonNDCoordExpr(EmitBuff *b, MonNDCoord coord) {
+    switch (coord) {
+        case MND_X: { Emit(b, "x"); } break;
+        case MND_Y: { Emit(b, "y"); } break;
+        case MND_Z: { Emit(b, "z"); } break;
+        case MND_VX: { Emit(b, "vx"); } break;
+        case MND_VY: { Emit(b, "vy"); } break;
+        case MND_VZ: { Emit(b, "vz"); } break;
+        case MND_KX: { Emit(b, "V2K*vx"); } break;
+        case MND_KY: { Emit(b, "V2K*vy"); } break;
+        case MND_KZ: { Emit(b, "V2K*vz"); } break;
+        case MND_SX: { Emit(b, "sx"); } break;
+        case MND_SY: { Emit(b, "sy"); } break;
+        case MND_SZ: { Emit(b, "sz"); } break;
+        case MND_T: { Emit(b, "t"); } break;
+        case MND_V: { Emit(b, "sqrt(vx*vx + vy*vy + vz*vz)"); } break;
+        case MND_K: { Emit(b, "V2K*sqrt(vx*vx + vy*vy + vz*vz)"); } break;
+        case MND_ENERGY: { Emit(b, "VS2E*(vx*vx + vy*vy + vz*vz)"); } break;
+        case MND_LAMBDA: { Emit(b, "_MonND_Lambda(vx, vy, vz)"); } break;
+        case MND_HDIV: { Emit(b, "RAD2DEG*atan2(vx, vz)"); } break;
+        case MND_VDIV: { Emit(b, "RAD2DEG*atan2(vy, vz)"); } break;
+
+        default: { assert(1 == 0 && "unsupported Monitor_nD coordinate"); } break;
+    }
+}
+
+void CogenMonitorNDTrace(EmitBuff *b, ComponentCall *c, MonNDSpec *spec) {
+    Str options = _FindArg(c, "options")->default_val;
+
+    Emit(b, "// Monitor_nD '", c->name, "' specialised at cogen time, options=", options, "\n");
+    Emit(b, "void Trace_Monitor_nD_", c->name, "(Monitor_nD *comp, Neutron *particle, Instrument *instrument) {\n");
+    Emit(b, "    #define x particle->x\n");
+    Emit(b, "    #define y particle->y\n");
+    Emit(b, "    #define z particle->z\n");
+    Emit(b, "    #define vx particle->vx\n");
+    Emit(b, "    #define vy particle->vy\n");
+    Emit(b, "    #define vz particle->vz\n");
+    Emit(b, "    #define sx particle->sx\n");
+    Emit(b, "    #define sy particle->sy\n");
+    Emit(b, "    #define sz particle->sz\n");
+    Emit(b, "    #define t particle->t\n");
+    Emit(b, "    #define p particle->p\n");
+    Emit(b, "    MonitornD_Variables_type *Vars = &comp->Vars;\n");
+    Emit(b, "\n");
+
+    // shape: propagate to the xy plane and test square / disk
+    Emit(b, "    double t0 = t;\n");
+    Emit(b, "    ALLOW_BACKPROP;\n");
+    Emit(b, "    PROP_Z0;\n");
+    if (spec->shape == MND_SHAPE_SQUARE) {
+        Emit(b, "    int intersect = (t >= t0) && (z == 0.0) && (x >= Vars->mxmin && x <= Vars->mxmax && y >= Vars->mymin && y <= Vars->mymax);\n");
+    }
+    else {
+        Emit(b, "    int intersect = (t >= t0) && (z == 0.0) && ((x*x + y*y) <= Vars->Sphere_Radius*Vars->Sphere_Radius);\n");
+    }
+    Emit(b, "    if (!intersect) {\n");
+    Emit(b, "        RESTORE_NEUTRON(INDEX_CURRENT_COMP, x, y, z, vx, vy, vz, t, sx, sy, sz, p);\n");
+    Emit(b, "    }\n");
+    Emit(b, "    else {\n");
+    Emit(b, "        Vars->Neutron_Counter++;\n");
+    Emit(b, "        double pp = p;\n");
+    Emit(b, "        long idx[", spec->coord_cnt + 1, "];\n");
+    Emit(b, "        double val;\n");
+
+    // coordinates and bin indices
+    for (s32 i = 1; i <= spec->coord_cnt; ++i) {
+        Emit(b, "\n        val = ");
+        _CogenMonNDCoordExpr(b, spec->coords[i]);
+        Emit(b, ";\n");
+
+        if (spec->bins[i] <= 1) {
+            Emit(b, "        idx[", i, "] = 0;\n");
+        }
+        else if (spec->min_known[i] && spec->max_known[i]) {
+            f64 range = spec->max[i] - spec->min[i];
+            if (range > 0) {
+                // same operation order as the library, floor((Coord-Min)*Bin/XY), so the bins match exactly
+                Emit(b, "        idx[", i, "] = (long) floor((val - (", spec->min[i], ")) * ", spec->bins[i], " / (", range, "));\n");
+            }
+            else {
+                Emit(b, "        idx[", i, "] = 0;\n");
+            }
+        }
+        else {
+            Emit(b, "        idx[", i, "] = (Vars->Coord_Max[", i, "] > Vars->Coord_Min[", i, "]) ? (long) floor((val - Vars->Coord_Min[", i, "]) * ", spec->bins[i], " / (Vars->Coord_Max[", i, "] - Vars->Coord_Min[", i, "])) : 0;\n");
+        }
+    }
+    Emit(b, "\n");
+
+    // accumulate
+    Emit(b, "        int outside = 0;\n");
+    if (spec->multiple == false) {
+        Emit(b, "        if (idx[1] >= 0 && idx[1] < ", spec->bins[1], " && idx[2] >= 0 && idx[2] < ", spec->bins[2], ") {\n");
+        Emit(b, "            if (Vars->Mon2D_N) {\n");
+        Emit(b, "                Vars->Mon2D_N[idx[1]][idx[2]] += 1;\n");
+        Emit(b, "                Vars->Mon2D_p[idx[1]][idx[2]] += pp;\n");
+        Emit(b, "                Vars->Mon2D_p2[idx[1]][idx[2]] += pp*pp;\n");
+        Emit(b, "            }\n");
+        Emit(b, "        }\n");
+        Emit(b, "        else {\n");
+        Emit(b, "            outside = 1;\n");
+        Emit(b, "        }\n");
+    }
+    else {
+        // n1D: the library stops at the first coordinate out of range
+        for (s32 i = 1; i <= spec->coord_cnt; ++i) {
+            Emit(b, "        if (!outside && idx[", i, "] >= 0 && idx[", i, "] < ", spec->bins[i], ") {\n");
+            Emit(b, "            if (Vars->Mon2D_N) {\n");
+            Emit(b, "                Vars->Mon2D_N[", i - 1, "][idx[", i, "]] += 1;\n");
+            Emit(b, "                Vars->Mon2D_p[", i - 1, "][idx[", i, "]] += pp;\n");
+            Emit(b, "                Vars->Mon2D_p2[", i - 1, "][idx[", i, "]] += pp*pp;\n");
+            Emit(b, "            }\n");
+            Emit(b, "        }\n");
+            Emit(b, "        else {\n");
+            Emit(b, "            outside = 1;\n");
+            Emit(b, "        }\n");
+        }
+    }
+    Emit(b, "        Vars->Nsum += 1;\n");
+    Emit(b, "        Vars->psum += pp;\n");
+    Emit(b, "        Vars->p2sum += pp*pp;\n");
+    Emit(b, "        if (!outside) {\n");
+    Emit(b, "            SCATTER;\n");
+    Emit(b, "        }\n");
+    Emit(b, "    }\n");
+    Emit(b, "\n");
+    Emit(b, "    #undef x\n");
+    Emit(b, "    #undef y\n");
+    Emit(b, "    #undef z\n");
+    Emit(b, "    #undef vx\n");
+    Emit(b, "    #undef vy\n");
+    Emit(b, "    #undef vz\n");
+    Emit(b, "    #undef sx\n");
+    Emit(b, "    #undef sy\n");
+    Emit(b, "    #undef sz\n");
+    Emit(b, "    #undef t\n");
+    Emit(b, "    #undef p\n");
+    Emit(b, "}\n\n");
+}
+
+void CogenMonitorNDCheck(EmitBuff *b, ComponentCall *c, MonNDSpec *spec) {
+    // guards that the generic Init arrived at the same configuration as we did
+    const char *shape = (spec->shape == MND_SHAPE_SQUARE) ? "SHAPE_SQUARE" : "SHAPE_DISK";
+    Emit(b, "    assert(", c->name, "_comp->Vars.Coord_Number == ", spec->coord_cnt, " && ", c->name, "_comp->Vars.Flag_Multiple == ", spec->multiple, " && abs(", c->name, "_comp->Vars.Flag_Shape) == ", c->name, "_comp->DEFS.", StrL(shape), ");\n");
+}
+
+void CogenMonitorNDHelpers(EmitBuff *b) {
+    Emit(b, "#ifndef __MONND_SPEC_HELPERS__\n");
+    Emit(b, "#define __MONND_SPEC_HELPERS__\n");
+    Emit(b, "inline double _MonND_Lambda(double vx, double vy, double vz) {\n");
+    Emit(b, "    double k = V2K*sqrt(vx*vx + vy*vy + vz*vz);\n");
+    Emit(b, "    return (k != 0) ? 2*PI/k : 0;\n");
+    Emit(b, "}\n");
+    Emit(b, "#endif\n\n");
+}
+
+
+#endif
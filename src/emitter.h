@@ -0,0 +1,129 @@
+#ifndef __EMITTER_H__
+#define __EMITTER_H__
+
+
+//
+//  Typed, append-only code emitter
+//
+//  Emit(b, "struct ", comp->type, " {\n") appends each argument by type: string literals are copied with their
+//  compile-time length, Str values as-is, integers through a small itoa. No format strings are parsed.
+//  The buffer grows by doubling and is meant to be cleared and reused between files.
+
+
+struct EmitBuff {
+    char *str;
+    u32 len;
+    u32 cap;
+};
+
+EmitBuff EmitBuffInit(u32 cap = 1024 * 1024) {
+    EmitBuff b = {};
+    b.str = (char*) malloc(cap);
+    b.cap = cap;
+    return b;
+}
+
+inline
+void EmitBuffClear(EmitBuff *b) {
+    b->len = 0;
+}
+
+inline
+Str EmitBuffGetStr(EmitBuff *b) {
+    return Str { b->str, b->len };
+}
+
+inline
+char *_EmitReserve(EmitBuff *b, u32 len) {
+    if (b->len + len > b->cap) {
+        u32 cap = b->cap ? b->cap * 2 : 4096;
+        while (b->len + len > cap) {
+            cap *= 2;
+        }
+        b->str = (char*) realloc(b->str, cap);
+        b->cap = cap;
+    }
+    char *dest = b->str + b->len;
+    b->len += len;
+    return dest;
+}
+
+inline
+void _EmitBytes(EmitBuff *b, const char *src, u32 len) {
+    if (len) {
+        memcpy(_EmitReserve(b, len), src, len);
+    }
+}
+
+template<u32 N>
+inline
+void _EmitOne(EmitBuff *b, const char (&lit)[N]) {
+    _EmitBytes(b, lit, N - 1);
+}
+
+inline
+void _EmitOne(EmitBuff *b, Str s) {
+    _EmitBytes(b, s.str, s.len);
+}
+
+inline
+void _EmitOne(EmitBuff *b, char c) {
+    *_EmitReserve(b, 1) = c;
+}
+
+inline
+void _EmitOne(EmitBuff *b, u64 v) {
+    char digits[20];
+    u32 cnt = 0;
+    do {
+        digits[cnt++] = '0' + (v % 10);
+        v /= 10;
+    } while (v);
+
+    char *dest = _EmitReserve(b, cnt);
+    for (u32 i = 0; i < cnt; ++i) {
+        dest[i] = digits[cnt - 1 - i];
+    }
+}
+
+inline
+void _EmitOne(EmitBuff *b, s64 v) {
+    if (v < 0) {
+        _EmitOne(b, '-');
+        _EmitOne(b, (u64) 0 - (u64) v);
+    }
+    else {
+        _EmitOne(b, (u64) v);
+    }
+}
+
+inline void _EmitOne(EmitBuff *b, u32 v) { _EmitOne(b, (u64) v); }
+inline void _EmitOne(EmitBuff *b, s32 v) { _EmitOne(b, (s64) v); }
+
+inline
+void _EmitOne(EmitBuff *b, f64 v) {
+    // the one formatted case, doubles must round-trip
+    char num[32];
+    s32 len = snprintf(num, 32, "%.17g", v);
+    _EmitBytes(b, num, len);
+}
+
+inline
+void Emit(EmitBuff *) {
+}
+
+template<typename T, typename... Args>
+inline
+void Emit(EmitBuff *b, const T &first, const Args &... rest) {
+    _EmitOne(b, first);
+    Emit(b, rest...);
+}
+
+inline
+void EmitIndent(EmitBuff *b, s32 level) {
+    u32 len = level * 4;
+    memset(_EmitReserve(b, len), ' ', len);
+}
+
+
+#endif
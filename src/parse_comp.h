@@ -5,6 +5,7 @@
 struct ComponentParse {
     Str file_path;
     Str type;
+    Sym type_sym;
     Str type_copy;
     Str category;
 
@@ -42,6 +43,17 @@ struct ComponentParse {
     Str finally_extend;
     Str display_extend;
 
+    // header-only parse: the text is kept, code blocks are parsed on demand from blocks_offset
+    Str text;
+    u32 header_offset;
+    u32 blocks_offset;
+    s32 blocks_line;
+    bool header_only;
+
+    // size and modification time of the .comp file, which a library index entry is valid for
+    u64 file_size;
+    s64 file_mtime;
+
     bool parse_error;
 };
 
@@ -62,42 +74,8 @@ Array<Parameter> ParseComponentParams(MArena *a_dest, Tokenizer *t, TokenType pa
 }
 
 
-ComponentParse *ParseComponent(MArena *a_dest, Str text) {
-    TimeFunction;
-
-    Tokenizer tokenizer = {};
-    tokenizer.Init(text.str);
-    Tokenizer *t = &tokenizer;
+void ParseComponentBlocks(MArena *a_dest, Tokenizer *t, ComponentParse *comp) {
     Token token;
-    ComponentParse *comp = (ComponentParse*) ArenaAlloc(a_dest, sizeof(ComponentParse));
-
-    // component type
-    Required(t, &token, TOK_MCSTAS_DEFINE);
-    Required(t, &token, TOK_MCSTAS_COMPONENT);
-    Required(t, &token, TOK_IDENTIFIER);
-    comp->type = token.GetValue();
-    if (Optional(t, &token, TOK_MCSTAS_COPY)) {
-        Required(t, &token, TOK_IDENTIFIER);
-        comp->type_copy = token.GetValue();
-    }
-
-    // parameters
-    comp->setting_params = ParseComponentParams(a_dest, t, TOK_MCSTAS_SETTING, false);
-    comp->out_params = ParseComponentParams(a_dest, t, TOK_MCSTAS_OUTPUT, true);
-    comp->state_params = ParseComponentParams(a_dest, t, TOK_MCSTAS_STATE, true);
-    comp->pol_params = ParseComponentParams(a_dest, t, TOK_MCSTAS_POLARISATION, true);
-
-    // flags
-    while (Optional(t, &token, TOK_IDENTIFIER)) {
-        if (StrEqual( StrL("DEPENDENCY"), token.GetValue())) { 
-            Required(t, &token, TOK_STRING);
-            comp->dependency_str = token.GetValue();
-        }
-
-        if (StrEqual( StrL("NOACC"), token.GetValue())) {
-            comp->flag_noacc;
-        }
-    }
 
     // code blocks
     TokenType options_blocks[] = {
@@ -145,9 +123,135 @@ ComponentParse *ParseComponent(MArena *a_dest, Str text) {
     // end
     Required(t, &token, TOK_MCSTAS_END);
     comp->parse_error = t->parse_error;
+}
+
+
+ComponentParse *ParseComponent(MArena *a_dest, Str text, bool header_only = false) {
+    TimeFunction;
+
+    Tokenizer tokenizer = {};
+    tokenizer.Init(text.str);
+    Tokenizer *t = &tokenizer;
+    Token token;
+    ComponentParse *comp = (ComponentParse*) ArenaAlloc(a_dest, sizeof(ComponentParse));
+
+    // component type
+    Required(t, &token, TOK_MCSTAS_DEFINE);
+    comp->header_offset = (u32) (token.text - text.str);
+    Required(t, &token, TOK_MCSTAS_COMPONENT);
+    Required(t, &token, TOK_IDENTIFIER);
+    comp->type = token.GetValue();
+    comp->type_sym = token.sym;
+    if (Optional(t, &token, TOK_MCSTAS_COPY)) {
+        Required(t, &token, TOK_IDENTIFIER);
+        comp->type_copy = token.GetValue();
+    }
+
+    // parameters
+    comp->setting_params = ParseComponentParams(a_dest, t, TOK_MCSTAS_SETTING, false);
+    comp->out_params = ParseComponentParams(a_dest, t, TOK_MCSTAS_OUTPUT, true);
+    comp->state_params = ParseComponentParams(a_dest, t, TOK_MCSTAS_STATE, true);
+    comp->pol_params = ParseComponentParams(a_dest, t, TOK_MCSTAS_POLARISATION, true);
+
+    // flags
+    while (Optional(t, &token, TOK_IDENTIFIER)) {
+        if (token.sym == SYM_DEPENDENCY) { 
+            Required(t, &token, TOK_STRING);
+            comp->dependency_str = token.GetValue();
+        }
+
+        if (token.sym == SYM_NOACC) {
+            comp->flag_noacc;
+        }
+    }
+
+    // everything type checking needs is above, the rest is parsed when the code is generated
+    comp->text = text;
+    comp->blocks_offset = (u32) (t->at - text.str);
+    comp->blocks_line = t->line;
+    if (header_only && t->parse_error == false) {
+        comp->header_only = true;
+        comp->parse_error = false;
+        return comp;
+    }
+
+    ParseComponentBlocks(a_dest, t, comp);
 
     return comp;
 }
 
 
+// first line of a library index, entries of other formats are not read
+#define COMPONENT_INDEX_HEADER "// mcparse component index, v2"
+
+bool ParseComponentDeferred(MArena *a_dest, ComponentParse *comp) {
+    // code blocks of a header-only parse, the text is reloaded if it was not kept (library index)
+    if (comp->header_only == false) {
+        return comp->parse_error == false;
+    }
+    if (comp->text.len == 0) {
+        comp->text = LoadTextFileFSeek(a_dest, comp->file_path);
+
+        // the file changed since the index was checked, the offsets into it no longer hold
+        if (comp->text.len && comp->text.len != comp->file_size) {
+            Str file_path = comp->file_path;
+            Str category = comp->category;
+            *comp = *ParseComponent(a_dest, comp->text);
+            comp->file_path = file_path;
+            comp->category = category;
+            return comp->parse_error == false;
+        }
+    }
+    if (comp->text.len <= comp->blocks_offset) {
+        comp->parse_error = true;
+        return false;
+    }
+
+    Tokenizer tokenizer = {};
+    tokenizer.Init(comp->text.str + comp->blocks_offset);
+    tokenizer.line = comp->blocks_line;
+    ParseComponentBlocks(a_dest, &tokenizer, comp);
+    comp->header_only = false;
+
+    return comp->parse_error == false;
+}
+
+
+Str _SignatureStr(MArena *a_dest, Str s) {
+    Str copy = StrAlloc(a_dest, s.len);
+    StrCopy(s, copy);
+    return copy;
+}
+
+Array<Parameter> _SignatureParams(MArena *a_dest, Array<Parameter> params) {
+    Array<Parameter> copy = InitArray<Parameter>(a_dest, params.len);
+    for (u32 i = 0; i < params.len; ++i) {
+        Parameter p = params.arr[i];
+        copy.Add({ _SignatureStr(a_dest, p.type), p.type_sym, _SignatureStr(a_dest, p.name), _SignatureStr(a_dest, p.default_val) });
+    }
+    return copy;
+}
+
+ComponentParse *ComponentSignature(MArena *a_dest, ComponentParse *comp) {
+    // what type checking and the meta file use, copied out of the arena the component was parsed into. The
+    // signature is header-only, ParseComponentDeferred re-reads the code blocks from the file.
+    ComponentParse *sig = (ComponentParse*) ArenaAlloc(a_dest, sizeof(ComponentParse));
+    sig->file_path = comp->file_path;
+    sig->category = comp->category;
+    sig->type = _SignatureStr(a_dest, comp->type);
+    sig->type_sym = comp->type_sym;
+    sig->type_copy = _SignatureStr(a_dest, comp->type_copy);
+    sig->setting_params = _SignatureParams(a_dest, comp->setting_params);
+    sig->out_params = _SignatureParams(a_dest, comp->out_params);
+    sig->blocks_offset = comp->blocks_offset;
+    sig->blocks_line = comp->blocks_line;
+    sig->file_size = comp->file_size;
+    sig->file_mtime = comp->file_mtime;
+    sig->header_only = true;
+    sig->parse_error = comp->parse_error;
+
+    return sig;
+}
+
+
 #endif
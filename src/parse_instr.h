@@ -10,9 +10,14 @@ struct ComponentCall {
     Str copy_name;
     Str copy_type;
     Str type;
+    Sym name_sym;
+    Sym copy_name_sym;
+    Sym copy_type_sym;
+    Sym type_sym;
     Str extend;
     Str when;
     Str jump;
+    Sym jump_sym;
     Str group;
 
     Str split;
@@ -23,6 +28,7 @@ struct ComponentCall {
     Str at_z;
 
     Str at_relative_to;
+    Sym at_relative_sym;
     bool at_absolute;
 
     bool rot_defined;
@@ -31,6 +37,7 @@ struct ComponentCall {
     Str rot_z;
 
     Str rot_relative_to;
+    Sym rot_relative_sym;
     bool rot_absolute;
 
     Array<Parameter> args;
@@ -39,11 +46,13 @@ struct ComponentCall {
 struct InstrumentParse {
     Str path;
     Str name;
+    Sym name_sym;
     Str dependency_str;
     Array<Parameter> params;
     Array<StructMember> declare_members;
     Array<ComponentCall> comps;
     Array<Str> includes;
+    Array<s32> includes_at; // number of component calls before each %include
 
     Str uservars_block;
     Str declare_block;
@@ -58,7 +67,75 @@ struct InstrumentParse {
 };
 
 
-InstrumentParse *ParseInstrument(MArena *a_dest, Str text) {
+struct InstrumentPreScan {
+    s32 comps_cnt;
+    s32 includes_cnt;
+};
+
+static s32 _CountKeyword(Str text, const char *keyword) {
+    s32 cnt = 0;
+    u32 len = strlen(keyword);
+    char *at = text.str;
+    char *end = text.str + text.len;
+    while (at + len <= end) {
+        at = (char*) memchr(at, keyword[0], end - at);
+        if (at == NULL || at + len > end) {
+            break;
+        }
+        if (memcmp(at, keyword, len) == 0) {
+            ++cnt;
+            at += len;
+        }
+        else {
+            ++at;
+        }
+    }
+    return cnt;
+}
+
+InstrumentPreScan PreScanInstrument(Str text) {
+    // Raw keyword counts, an upper bound since comments and strings are included.
+    InstrumentPreScan scan = {};
+    scan.comps_cnt = _CountKeyword(text, "COMPONENT");
+    scan.includes_cnt = _CountKeyword(text, "%include");
+    return scan;
+}
+
+void PreScanCopySources(Str text, HashMap *copy_sources) {
+    // Collects the identifiers in "COPY(name)", the only names whose component call must outlive streaming.
+    char *at = text.str;
+    char *end = text.str + text.len;
+    while (at + 4 <= end) {
+        at = (char*) memchr(at, 'C', end - at);
+        if (at == NULL || at + 4 > end) {
+            break;
+        }
+        if (memcmp(at, "COPY", 4) != 0) {
+            ++at;
+            continue;
+        }
+        at += 4;
+        while (at < end && IsWhitespace(*at)) { ++at; }
+        if (at == end || *at != '(') {
+            continue;
+        }
+        ++at;
+        while (at < end && IsWhitespace(*at)) { ++at; }
+        char *name = at;
+        while (at < end && (IsAlphaOrUnderscore(*at) || IsNumeric(*at))) { ++at; }
+        if (at > name) {
+            MapPut(copy_sources, (u64) StrIntern(name, at - name), (u64) 1);
+        }
+    }
+}
+
+
+// Called for each component call as it is parsed. The call, and anything it points to in the parse arena, only lives
+// until the callback returns.
+typedef void (*ComponentCallFunc)(InstrumentParse *instr, ComponentCall *c, void *data);
+
+
+InstrumentParse *ParseInstrument(MArena *a_dest, Str text, ComponentCallFunc stream_func = NULL, void *stream_data = NULL) {
     TimeFunction;
 
     Tokenizer tokenizer = {};
@@ -66,21 +143,27 @@ InstrumentParse *ParseInstrument(MArena *a_dest, Str text) {
     Tokenizer *t = &tokenizer;
     Token token;
     InstrumentParse *instr = (InstrumentParse*) ArenaAlloc(a_dest, sizeof(InstrumentParse));
-    instr->comps = InitArray<ComponentCall>(a_dest, 1000);
-    instr->includes = InitArray<Str>(a_dest, 10);
+
+    InstrumentPreScan scan = PreScanInstrument(text);
+    if (stream_func == NULL) {
+        instr->comps = InitArray<ComponentCall>(a_dest, scan.comps_cnt);
+    }
+    instr->includes = InitArray<Str>(a_dest, scan.includes_cnt);
+    instr->includes_at = InitArray<s32>(a_dest, scan.includes_cnt);
 
     // instrument name
     Required(t, &token, TOK_MCSTAS_DEFINE);
     Required(t, &token, TOK_MCSTAS_INSTRUMENT);
     Required(t, &token, TOK_IDENTIFIER);
     instr->name = token.GetValue();
+    instr->name_sym = token.sym;
 
     // parameters
     instr->params = ParseParameterList(a_dest, t);
 
     // flags
     while (Optional(t, &token, TOK_IDENTIFIER)) {
-        if (StrEqual( StrL("DEPENDENCY"), token.GetValue())) { 
+        if (token.sym == SYM_DEPENDENCY) { 
             Required(t, &token, TOK_STRING);
             instr->dependency_str = token.GetValue();
         }
@@ -105,13 +188,18 @@ InstrumentParse *ParseInstrument(MArena *a_dest, Str text) {
 
     // component calls
     Required(t, &token, TOK_MCSTAS_TRACE);
+    s32 calls_cnt = 0;
     while (true) {
 
         while (Optional(t, &token, TOK_MCSTAS_PINCLUDE)) {
             Required(t, &token, TOK_STRING);
-            instr->includes.Add(token.GetValue());
+            ArrayAddGrow(a_dest, &instr->includes, token.GetValue());
+            ArrayAddGrow(a_dest, &instr->includes_at, calls_cnt);
         }
 
+        // in streaming mode, per-call allocations are released after the callback
+        u64 stream_mark = a_dest->used;
+
         Tokenizer rewind = *t;
         if (OptionOfFive(t, &token, TOK_MCSTAS_COMPONENT, TOK_MCSTAS_SPLIT, TOK_MCSTAS_REMOVABLE, TOK_MCSTAS_FINALLY, TOK_MCSTAS_END)) {
             if (token.type == TOK_MCSTAS_END || token.type == TOK_MCSTAS_FINALLY) {
@@ -145,10 +233,12 @@ InstrumentParse *ParseInstrument(MArena *a_dest, Str text) {
                 Required(t, &token, TOK_LBRACK);
                 Required(t, &token, TOK_IDENTIFIER);
                 c.copy_name = token.GetValue();
+                c.copy_name_sym = token.sym;
                 Required(t, &token, TOK_RBRACK);
             }
             else {
                 c.name = token.GetValue();
+                c.name_sym = token.sym;
             }
             Required(t, &token, TOK_ASSIGN);
 
@@ -158,10 +248,12 @@ InstrumentParse *ParseInstrument(MArena *a_dest, Str text) {
                 Required(t, &token, TOK_LBRACK);
                 OptionOfTwo(t, &token, TOK_IDENTIFIER, TOK_MCSTAS_PREVIOUS);
                 c.copy_type = token.GetValue();
+                c.copy_type_sym = token.sym;
                 Required(t, &token, TOK_RBRACK);
             }
             else {
                 c.type = token.GetValue();
+                c.type_sym = token.sym;
             }
 
             // args
@@ -178,6 +270,7 @@ InstrumentParse *ParseInstrument(MArena *a_dest, Str text) {
             if (Optional(t, &token, TOK_MCSTAS_JUMP)) {
                 OptionOfTwo(t, &token, TOK_IDENTIFIER, TOK_MCSTAS_PREVIOUS);
                 c.jump = token.GetValue();
+                c.jump_sym = token.sym;
             }
             if (Optional(t, &token, TOK_MCSTAS_WHEN)) {
                 c.when = ParseExpression(t);
@@ -209,6 +302,7 @@ InstrumentParse *ParseInstrument(MArena *a_dest, Str text) {
             if (token.type == TOK_MCSTAS_RELATIVE) {
                 OptionOfThree(t, &token, TOK_IDENTIFIER, TOK_MCSTAS_PREVIOUS, TOK_MCSTAS_ABSOLUTE);
                 c.at_relative_to = token.GetValue();
+                c.at_relative_sym = token.sym;
             }
             else {
                 Required(t, &token, TOK_MCSTAS_ABSOLUTE);
@@ -242,6 +336,7 @@ InstrumentParse *ParseInstrument(MArena *a_dest, Str text) {
                 if (token.type == TOK_MCSTAS_RELATIVE) {
                     OptionOfThree(t, &token, TOK_IDENTIFIER, TOK_MCSTAS_PREVIOUS, TOK_MCSTAS_ABSOLUTE);
                     c.rot_relative_to = token.GetValue();
+                    c.rot_relative_sym = token.sym;
                 }
                 else {
                     c.rot_absolute = true;
@@ -258,13 +353,23 @@ InstrumentParse *ParseInstrument(MArena *a_dest, Str text) {
             if (Optional(t, &token, TOK_MCSTAS_JUMP)) {
                 Required(t, &token, TOK_IDENTIFIER);
                 c.jump = token.GetValue();
+                c.jump_sym = token.sym;
             }
             if (Optional(t, &token, TOK_MCSTAS_WHEN)) {
                 c.when = ParseExpression(t);
             }
 
             ParseCodeBlock(t, TOK_MCSTAS_EXTEND, &c.extend, &_, &_);
-            instr->comps.Add(c);
+            if (stream_func) {
+                if (t->parse_error == false) {
+                    stream_func(instr, &c, stream_data);
+                }
+                a_dest->used = stream_mark;
+            }
+            else {
+                ArrayAddGrow(a_dest, &instr->comps, c);
+            }
+            calls_cnt++;
         }
         else {
             break;
@@ -275,6 +275,190 @@ void TokenTypePrint(TokenType tpe, bool newline = true) {
 bool IsWhitespace(char c);
 
 
+//
+//  Symbol interning: identifiers become u32 ids when lexed, which lets type/name lookups compare
+//  and hash integers. Keywords are pre-interned in TokenType order, so GetToken resolves them by id.
+
+
+typedef u32 Sym;
+
+enum PredefinedSym {
+    SYM_NONE,
+
+    SYM_KW_NULL,
+    SYM_KW_null,
+    SYM_KW_DEFINE,
+    SYM_KW_INSTRUMENT,
+    SYM_KW_COMPONENT,
+    SYM_KW_COPY,
+    SYM_KW_EXTEND,
+    SYM_KW_SETTING,
+    SYM_KW_OUTPUT,
+    SYM_KW_STATE,
+    SYM_KW_POLARISATION,
+    SYM_KW_PARAMETERS,
+    SYM_KW_SHARE,
+    SYM_KW_USERVARS,
+    SYM_KW_DECLARE,
+    SYM_KW_INITIALIZE,
+    SYM_KW_TRACE,
+    SYM_KW_SAVE,
+    SYM_KW_FINALLY,
+    SYM_KW_MCDISPLAY,
+    SYM_KW_AT,
+    SYM_KW_RELATIVE,
+    SYM_KW_ABSOLUTE,
+    SYM_KW_PREVIOUS,
+    SYM_KW_ROTATED,
+    SYM_KW_SPLIT,
+    SYM_KW_REMOVABLE,
+    SYM_KW_USER,
+    SYM_KW_WHEN,
+    SYM_KW_JUMP,
+    SYM_KW_GROUP,
+    SYM_KW_END,
+    SYM_KW_C_EXPRESSION,
+
+    SYM_string,
+    SYM_vector,
+    SYM_include,
+    SYM_DEPENDENCY,
+    SYM_NOACC,
+    SYM_Monitor_nD,
+
+    SYM_PREDEFINED_CNT,
+};
+
+static_assert(TOK_MCSTAS_END - TOK_MCSTAS_DEFINE == SYM_KW_END - SYM_KW_DEFINE, "keyword syms must follow TokenType order");
+
+struct SymEntry {
+    Str str;
+    u32 hash;
+};
+
+struct SymTable {
+    MArena arena;
+    SymEntry *entries;
+    u32 *slots; // open addressing, holds sym ids, 0 is empty
+    u32 cnt;
+    u32 cap;
+    u32 nslots;
+};
+
+static SymTable g_symtab;
+
+inline
+u32 SymHash(char *str, u32 len) {
+    u32 h = 2166136261u;
+    for (u32 i = 0; i < len; ++i) {
+        h ^= (u8) str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void _SymTableRehash(SymTable *st, u32 nslots) {
+    st->slots = (u32*) ArenaAlloc(&st->arena, sizeof(u32) * nslots);
+    st->nslots = nslots;
+    for (u32 sym = 1; sym < st->cnt; ++sym) {
+        u32 idx = st->entries[sym].hash & (nslots - 1);
+        while (st->slots[idx]) {
+            idx = (idx + 1) & (nslots - 1);
+        }
+        st->slots[idx] = sym;
+    }
+}
+
+Sym StrIntern(char *str, u32 len);
+
+void SymTableInit() {
+    SymTable *st = &g_symtab;
+    if (st->entries) {
+        return;
+    }
+    st->arena = ArenaCreate();
+    st->cap = 4096;
+    st->entries = (SymEntry*) ArenaAlloc(&st->arena, sizeof(SymEntry) * st->cap);
+    st->cnt = 1;
+    _SymTableRehash(st, st->cap * 2);
+
+    const char *predefined[] = {
+        "NULL", "null", "DEFINE", "INSTRUMENT", "COMPONENT", "COPY", "EXTEND", "SETTING", "OUTPUT", "STATE", "POLARISATION",
+        "PARAMETERS", "SHARE", "USERVARS", "DECLARE", "INITIALIZE", "TRACE", "SAVE", "FINALLY", "MCDISPLAY", "AT", "RELATIVE",
+        "ABSOLUTE", "PREVIOUS", "ROTATED", "SPLIT", "REMOVABLE", "USER", "WHEN", "JUMP", "GROUP", "END", "C_EXPRESSION",
+        "string", "vector", "include", "DEPENDENCY", "NOACC", "Monitor_nD"
+    };
+    assert(sizeof(predefined) / sizeof(char*) == SYM_PREDEFINED_CNT - 1);
+    for (u32 i = 0; i < SYM_PREDEFINED_CNT - 1; ++i) {
+        StrIntern((char*) predefined[i], strlen(predefined[i]));
+    }
+}
+
+Sym _SymLookup(SymTable *st, char *str, u32 len, u32 hash, u32 *slot) {
+    u32 idx = hash & (st->nslots - 1);
+    while (u32 sym = st->slots[idx]) {
+        SymEntry *e = st->entries + sym;
+        if (e->hash == hash && e->str.len == len && memcmp(e->str.str, str, len) == 0) {
+            return sym;
+        }
+        idx = (idx + 1) & (st->nslots - 1);
+    }
+    *slot = idx;
+    return SYM_NONE;
+}
+
+Sym StrIntern(char *str, u32 len) {
+    SymTable *st = &g_symtab;
+    if (st->entries == NULL) {
+        SymTableInit();
+    }
+
+    u32 hash = SymHash(str, len);
+    u32 slot;
+    Sym sym = _SymLookup(st, str, len, hash, &slot);
+    if (sym) {
+        return sym;
+    }
+
+    // the interned Str is copied, source texts may be released after their parse
+    char *copy = (char*) ArenaAlloc(&st->arena, len + 1);
+    memcpy(copy, str, len);
+    if (st->cnt == st->cap) {
+        SymEntry *entries = (SymEntry*) ArenaAlloc(&st->arena, sizeof(SymEntry) * st->cap * 2);
+        memcpy(entries, st->entries, sizeof(SymEntry) * st->cnt);
+        st->entries = entries;
+        st->cap *= 2;
+    }
+    sym = st->cnt++;
+    st->entries[sym] = SymEntry { Str { copy, len }, hash };
+    st->slots[slot] = sym;
+    if (st->cnt * 2 > st->nslots) {
+        _SymTableRehash(st, st->nslots * 2);
+    }
+    return sym;
+}
+
+inline
+Sym StrIntern(Str s) {
+    return StrIntern(s.str, s.len);
+}
+
+Sym StrInternFind(Str s) {
+    SymTable *st = &g_symtab;
+    if (st->entries == NULL) {
+        SymTableInit();
+    }
+    u32 slot;
+    return _SymLookup(st, s.str, s.len, SymHash(s.str, s.len), &slot);
+}
+
+inline
+Str SymStr(Sym sym) {
+    assert(sym < g_symtab.cnt);
+    return g_symtab.entries[sym].str;
+}
+
+
 struct Tokenizer {
     char *at;
     s32 line;
@@ -316,6 +500,7 @@ struct Token {
     bool is_rval;
     char* text;
     u32 len;
+    Sym sym;
 
     void PrintValue(bool newline = true) {
         printf("%.*s", len, text);
@@ -818,7 +1003,7 @@ Token GetToken(Tokenizer *tokenizer)
         else if (tokenizer->at[0] && tokenizer->at[0] == 'i') {
             Tokenizer was = *tokenizer;
             Token nxt = GetToken(tokenizer);
-            if (nxt.type == TOK_IDENTIFIER && StrEqual( StrL("include"), nxt.GetValue())) {
+            if (nxt.type == TOK_IDENTIFIER && nxt.sym == SYM_include) {
                 token.type = TOK_MCSTAS_PINCLUDE;
             }
             else {
@@ -894,41 +1079,16 @@ Token GetToken(Tokenizer *tokenizer)
             }
             token.len = tokenizer->at - token.text;
 
-            if (TokenEquals(&token, "NULL")) { token.type = TOK_NULL; }
-            else if (TokenEquals(&token, "null")) { token.type = TOK_NULL; }
-
-            else if (TokenEquals(&token, "DEFINE")) { token.type = TOK_MCSTAS_DEFINE; }
-            else if (TokenEquals(&token, "INSTRUMENT")) { token.type = TOK_MCSTAS_INSTRUMENT; }
-            else if (TokenEquals(&token, "COMPONENT")) { token.type = TOK_MCSTAS_COMPONENT; }
-            else if (TokenEquals(&token, "COPY")) { token.type = TOK_MCSTAS_COPY; }
-            else if (TokenEquals(&token, "EXTEND")) { token.type = TOK_MCSTAS_EXTEND; }
-            else if (TokenEquals(&token, "SETTING")) { token.type = TOK_MCSTAS_SETTING; }
-            else if (TokenEquals(&token, "OUTPUT")) { token.type = TOK_MCSTAS_OUTPUT; }
-            else if (TokenEquals(&token, "STATE")) { token.type = TOK_MCSTAS_STATE; }
-            else if (TokenEquals(&token, "POLARISATION")) { token.type = TOK_MCSTAS_POLARISATION; }
-            else if (TokenEquals(&token, "PARAMETERS")) { token.type = TOK_MCSTAS_PARAMETERS; }
-            else if (TokenEquals(&token, "SHARE")) { token.type = TOK_MCSTAS_SHARE; }
-            else if (TokenEquals(&token, "USERVARS")) { token.type = TOK_MCSTAS_USERVARS; }
-            else if (TokenEquals(&token, "DECLARE")) { token.type = TOK_MCSTAS_DECLARE; }
-            else if (TokenEquals(&token, "INITIALIZE")) { token.type = TOK_MCSTAS_INITIALIZE; }
-            else if (TokenEquals(&token, "TRACE")) { token.type = TOK_MCSTAS_TRACE; }
-            else if (TokenEquals(&token, "SAVE")) { token.type = TOK_MCSTAS_SAVE; }
-            else if (TokenEquals(&token, "FINALLY")) { token.type = TOK_MCSTAS_FINALLY; }
-            else if (TokenEquals(&token, "MCDISPLAY")) { token.type = TOK_MCSTAS_MCDISPLAY; }
-            else if (TokenEquals(&token, "AT")) { token.type = TOK_MCSTAS_AT; }
-            else if (TokenEquals(&token, "RELATIVE")) { token.type = TOK_MCSTAS_RELATIVE; }
-            else if (TokenEquals(&token, "ABSOLUTE")) { token.type = TOK_MCSTAS_ABSOLUTE; }
-            else if (TokenEquals(&token, "PREVIOUS")) { token.type = TOK_MCSTAS_PREVIOUS; }
-            else if (TokenEquals(&token, "ROTATED")) { token.type = TOK_MCSTAS_ROTATED; }
-            else if (TokenEquals(&token, "SPLIT")) { token.type = TOK_MCSTAS_SPLIT; }
-            else if (TokenEquals(&token, "REMOVABLE")) { token.type = TOK_MCSTAS_REMOVABLE; }
-            else if (TokenEquals(&token, "USER")) { token.type = TOK_MCSTAS_USER; }
-            else if (TokenEquals(&token, "WHEN")) { token.type = TOK_MCSTAS_WHEN; }
-            else if (TokenEquals(&token, "JUMP")) { token.type = TOK_MCSTAS_JUMP; }
-            else if (TokenEquals(&token, "GROUP")) { token.type = TOK_MCSTAS_GROUP; }
-            else if (TokenEquals(&token, "END")) { token.type = TOK_MCSTAS_END; }
-
-            else if (TokenEquals(&token, "C_EXPRESSION")) { token.type = TOK_MCSTAS_C_EXPRESSION; }
+            token.sym = StrIntern(token.text, token.len);
+            if (token.sym <= SYM_KW_null) {
+                token.type = TOK_NULL;
+            }
+            else if (token.sym <= SYM_KW_END) {
+                token.type = (TokenType) (TOK_MCSTAS_DEFINE + (token.sym - SYM_KW_DEFINE));
+            }
+            else if (token.sym == SYM_KW_C_EXPRESSION) {
+                token.type = TOK_MCSTAS_C_EXPRESSION;
+            }
         }
 
         else if (IsNumeric(c))
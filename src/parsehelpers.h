@@ -7,6 +7,7 @@ static bool dbg_print_c_expressions;
 
 struct Parameter {
     Str type;
+    Sym type_sym;
     Str name;
     Str default_val;
 };
@@ -308,6 +309,7 @@ Array<StructMember> ParseMembers(MArena *a_dest, Tokenizer *t) {
 
             // de-allocate 'mem' in a hurry (see the TODO above)
             a_dest->used -= sizeof(StructMember);
+            cnt--;
 
             continue;
         }
@@ -428,6 +430,23 @@ static MArena *g_arena_parse_params;
 static Array<Parameter> *g_parse_params;
 
 
+// Add to an arena-backed array, doubling the capacity when full (the old storage is abandoned in the arena)
+template<typename T>
+T *ArrayAddGrow(MArena *a_dest, Array<T> *array, T element) {
+    if (array->len == array->max) {
+        u32 max = array->max ? array->max * 2 : 8;
+        T *arr = (T*) ArenaAlloc(a_dest, sizeof(T) * max);
+        if (array->len) {
+            memcpy(arr, array->arr, sizeof(T) * array->len);
+        }
+        array->arr = arr;
+        array->max = max;
+    }
+    array->Add(element);
+    return array->arr + array->len - 1;
+}
+
+
 Str ParseExpression(Tokenizer *t);
 
 
@@ -629,8 +648,10 @@ Str ParseBracketedParameterList(Tokenizer *t) {
             if (tok.type == TOK_IDENTIFIER) {
                 p.name = tok.GetValue();
                 p.type = {};
+                Sym first_sym = tok.sym;
                 if (Optional(t, &tok, TOK_IDENTIFIER)) {
                     p.type = p.name;
+                    p.type_sym = first_sym;
                     p.name = tok.GetValue();
                 }
 
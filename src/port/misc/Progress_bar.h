@@ -5,6 +5,131 @@
 // share block
 
 
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+/*
+Trace threads count neutrons in a thread local and publish them in batches
+to their own cache line. A monitor thread started in INITIALIZE sums the
+slots, and prints ETA and progress, so the trace loop never reads a clock.
+The rest of a batch is published when the trace thread exits, or by FINALLY
+for the thread that runs it.
+*/
+#define PROGRESS_BAR_SLOTS 64
+#define PROGRESS_BAR_BATCH 256
+
+struct ProgressBarSlot {
+    alignas(64) std::atomic<unsigned long long> count;
+};
+
+struct ProgressBarState {
+    ProgressBarSlot slots[PROGRESS_BAR_SLOTS];
+    std::atomic<int> slot_next;
+    std::atomic<int> running;
+    std::atomic<int> save_request;
+    std::thread monitor;
+    std::chrono::steady_clock::time_point start;
+};
+
+struct ProgressBarPending {
+    unsigned long long count;
+    int slot;
+
+    ProgressBarPending() : count(0), slot(-1) {}
+    ~ProgressBarPending();
+};
+
+static ProgressBarState progress_bar_state;
+static thread_local ProgressBarPending progress_bar_pending;
+
+void ProgressBarFlush(ProgressBarPending *pending) {
+    if (pending->count == 0) {
+        return;
+    }
+    if (pending->slot < 0) {
+        pending->slot = progress_bar_state.slot_next.fetch_add(1) % PROGRESS_BAR_SLOTS;
+    }
+    progress_bar_state.slots[pending->slot].count.fetch_add(pending->count, std::memory_order_relaxed);
+    pending->count = 0;
+}
+
+ProgressBarPending::~ProgressBarPending() {
+    ProgressBarFlush(this);
+}
+
+unsigned long long ProgressBarCount() {
+    unsigned long long n = 0;
+    for (int i = 0; i < PROGRESS_BAR_SLOTS; ++i) {
+        n += progress_bar_state.slots[i].count.load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+void ProgressBarPrintDuration(double secs) {
+    if (secs < 60.0)
+        fprintf(stdout, "%g [s] ", secs);
+    else if (secs > 3600.0)
+        fprintf(stdout, "%g [h] ", secs/3600.0);
+    else
+        fprintf(stdout, "%g [min] ", secs/60.0);
+}
+
+/* stops the monitor thread of the previous INITIALIZE, if any */
+void ProgressBarStop() {
+    ProgressBarState *s = &progress_bar_state;
+    s->running.store(0);
+    if (s->monitor.joinable()) {
+        s->monitor.join();
+    }
+}
+
+void ProgressBarMonitor(double ncount, double percent, double minutes, int flag_save, const char *infostring) {
+    using namespace std::chrono;
+    ProgressBarState *s = &progress_bar_state;
+    steady_clock::time_point last = s->start;
+    double next = 0;
+    int eta_done = 0;
+
+    while (s->running.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(milliseconds(100));
+
+        steady_clock::time_point now = steady_clock::now();
+        double elapsed = duration<double>(now - s->start).count();
+        double n = (double) ProgressBarCount();
+
+        /* wait 10 sec before writing ETA */
+        if (!eta_done) {
+            if (elapsed > 10 && n > 0) {
+                fprintf(stdout, "\nTrace ETA ");
+                fprintf(stdout, "%s", infostring);
+                ProgressBarPrintDuration(elapsed*ncount/n);
+                fprintf(stdout, "\n");
+                fflush(stdout);
+                eta_done = 1;
+                last = now;
+            }
+            continue;
+        }
+
+        /* display percentage when percent or minutes have reached step */
+        if (ncount &&
+            (    (minutes && duration<double>(now - last).count() > minutes*60)
+            || (percent && !minutes && n >= next))   )
+        {
+            fprintf(stdout, "%llu %%\n", (unsigned long long)(n*100.0/ncount)); fflush(stdout);
+            last = now;
+
+            /* next step is the following multiple of the desired percentage */
+            next = (floor(n*100/percent/ncount) + 1)*percent*ncount/100;
+            if (flag_save)
+                s->save_request.store(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+
 struct Progress_bar {
     int index;
     char *name;
@@ -21,10 +146,6 @@ struct Progress_bar {
     double minutes = 0;
 
     // declares
-    double IntermediateCnts;
-    time_t StartTime;
-    time_t EndTime;
-    time_t CurrentTime;
     char infostring[64];
 };
 
@@ -45,18 +166,13 @@ void Init_Progress_bar(Progress_bar *comp, Instrument *instrument) {
     #define flag_save comp->flag_save
     #define minutes comp->minutes
 
-    #define IntermediateCnts comp->IntermediateCnts
-    #define StartTime comp->StartTime
-    #define EndTime comp->EndTime
-    #define CurrentTime comp->CurrentTime
     #define infostring comp->infostring
     ////////////////////////////////////////////////////////////////
 
 
-    IntermediateCnts=0;
-    StartTime=0;
-    EndTime=0;
-    CurrentTime=0;
+    /* INITIALIZE runs again when the instrument is reconfigured */
+    ProgressBarStop();
+    progress_bar_pending.count = 0;
 
     fprintf(stdout, "[%s] Initialize\n", instrument_name);
     if (percent*mcget_ncount()/100 < 1e5) {
@@ -64,6 +180,16 @@ void Init_Progress_bar(Progress_bar *comp, Instrument *instrument) {
     }
     sprintf(infostring, "(single process) ");
 
+    ProgressBarState *s = &progress_bar_state;
+    for (int i = 0; i < PROGRESS_BAR_SLOTS; ++i) {
+        s->slots[i].count.store(0, std::memory_order_relaxed);
+    }
+    s->slot_next.store(0);
+    s->save_request.store(0);
+    s->running.store(1);
+    s->start = std::chrono::steady_clock::now();
+    s->monitor = std::thread(ProgressBarMonitor, (double) mcget_ncount(), (double) percent, (double) minutes, (int) flag_save, (const char*) infostring);
+
 
     ////////////////////////////////////////////////////////////////
     #undef profile
@@ -71,10 +197,6 @@ void Init_Progress_bar(Progress_bar *comp, Instrument *instrument) {
     #undef flag_save
     #undef minutes
 
-    #undef IntermediateCnts
-    #undef StartTime
-    #undef EndTime
-    #undef CurrentTime
     #undef infostring
 
 }
@@ -97,60 +219,20 @@ void Trace_Progress_bar(Progress_bar *comp, Neutron *particle, Instrument *instr
     #define flag_save comp->flag_save
     #define minutes comp->minutes
 
-    #define IntermediateCnts comp->IntermediateCnts
-    #define StartTime comp->StartTime
-    #define EndTime comp->EndTime
-    #define CurrentTime comp->CurrentTime
     #define infostring comp->infostring
     ////////////////////////////////////////////////////////////////
 
 
-    double ncount;
-    ncount = mcget_run_num();
-    if (!StartTime) {
-        time(&StartTime); /* compute starting time */
-        IntermediateCnts = 1e3;
-    }
-    time_t NowTime;
-    time(&NowTime);
-
-    /* compute initial estimate of computation duration */
-    if (!EndTime && ncount >= IntermediateCnts) {
-        CurrentTime = NowTime;
-        if (difftime(NowTime,StartTime) > 10 && ncount) {
-            /* wait 10 sec before writing ETA */
-            EndTime = StartTime + (time_t)(difftime(NowTime,StartTime) *(double)mcget_ncount()/ncount);
-            IntermediateCnts = 0;
-            fprintf(stdout, "\nTrace ETA ");
-            fprintf(stdout, "%s", infostring);
-            
-            if (difftime(EndTime,StartTime) < 60.0)
-                fprintf(stdout, "%g [s] ", difftime(EndTime,StartTime));
-            else if (difftime(EndTime,StartTime) > 3600.0)
-                fprintf(stdout, "%g [h] ", difftime(EndTime,StartTime)/3600.0);
-            else
-                fprintf(stdout, "%g [min] ", difftime(EndTime,StartTime)/60.0);
-            fprintf(stdout, "\n");
-        } else
-            IntermediateCnts += 1e3;
-        fflush(stdout);
-    }
+    if (++progress_bar_pending.count == PROGRESS_BAR_BATCH) {
+        ProgressBarFlush(&progress_bar_pending);
 
-    /* display percentage when percent or minutes have reached step */
-    if (EndTime && mcget_ncount() &&
-        (    (minutes && difftime(NowTime,CurrentTime) > minutes*60)
-        || (percent && !minutes && ncount >= IntermediateCnts))   )
-    {
-        fprintf(stdout, "%llu %%\n", (unsigned long long)(ncount*100.0/mcget_ncount())); fflush(stdout);
-        CurrentTime = NowTime;
-
-        IntermediateCnts = ncount + percent*mcget_ncount()/100;
-        /* check that next intermediate ncount check is a multiple of the desired percentage */
-        IntermediateCnts = floor(IntermediateCnts*100/percent/mcget_ncount())*percent*mcget_ncount()/100;
-        /* raise flag to indicate that we did something */
-        SCATTER;
-        if (flag_save)
+        /* intermediate save requested by the monitor thread */
+        if (progress_bar_state.save_request.load(std::memory_order_relaxed)
+            && progress_bar_state.save_request.exchange(0)) {
+            /* raise flag to indicate that we did something */
+            SCATTER;
             save(NULL);
+        }
     }
 
 
@@ -160,10 +242,6 @@ void Trace_Progress_bar(Progress_bar *comp, Neutron *particle, Instrument *instr
     #undef flag_save
     #undef minutes
 
-    #undef IntermediateCnts
-    #undef StartTime
-    #undef EndTime
-    #undef CurrentTime
     #undef infostring
 
     #undef x
@@ -186,10 +264,6 @@ void Save_Progress_bar(Progress_bar *comp) {
     #define flag_save comp->flag_save
     #define minutes comp->minutes
 
-    #define IntermediateCnts comp->IntermediateCnts
-    #define StartTime comp->StartTime
-    #define EndTime comp->EndTime
-    #define CurrentTime comp->CurrentTime
     #define infostring comp->infostring
     ////////////////////////////////////////////////////////////////
 
@@ -218,10 +292,6 @@ void Save_Progress_bar(Progress_bar *comp) {
     #undef flag_save
     #undef minutes
 
-    #undef IntermediateCnts
-    #undef StartTime
-    #undef EndTime
-    #undef CurrentTime
     #undef infostring
 }
 
@@ -232,23 +302,17 @@ void Finally_Progress_bar(Progress_bar *comp) {
     #define flag_save comp->flag_save
     #define minutes comp->minutes
 
-    #define IntermediateCnts comp->IntermediateCnts
-    #define StartTime comp->StartTime
-    #define EndTime comp->EndTime
-    #define CurrentTime comp->CurrentTime
     #define infostring comp->infostring
     ////////////////////////////////////////////////////////////////
 
 
-    time_t NowTime;
-    time(&NowTime);
+    ProgressBarState *s = &progress_bar_state;
+    ProgressBarFlush(&progress_bar_pending);
+    ProgressBarStop();
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - s->start).count();
     fprintf(stdout, "\nFinally [%s: %s]. Time: ", instrument_name, dirname ? dirname : ".");
-    if (difftime(NowTime,StartTime) < 60.0)
-        fprintf(stdout, "%g [s] ", difftime(NowTime,StartTime));
-    else if (difftime(NowTime,StartTime) > 3600.0)
-        fprintf(stdout, "%g [h] ", difftime(NowTime,StartTime)/3600.0);
-    else
-        fprintf(stdout, "%g [min] ", difftime(NowTime,StartTime)/60.0);
+    ProgressBarPrintDuration(secs);
     fprintf(stdout, "\n");
 
 
@@ -258,10 +322,6 @@ void Finally_Progress_bar(Progress_bar *comp) {
     #undef flag_save
     #undef minutes
 
-    #undef IntermediateCnts
-    #undef StartTime
-    #undef EndTime
-    #undef CurrentTime
     #undef infostring
 }
 
@@ -283,10 +343,6 @@ void Display_Progress_bar(Progress_bar *comp) {
     #define flag_save comp->flag_save
     #define minutes comp->minutes
 
-    #define IntermediateCnts comp->IntermediateCnts
-    #define StartTime comp->StartTime
-    #define EndTime comp->EndTime
-    #define CurrentTime comp->CurrentTime
     #define infostring comp->infostring
     ////////////////////////////////////////////////////////////////
 
@@ -300,10 +356,6 @@ void Display_Progress_bar(Progress_bar *comp) {
     #undef flag_save
     #undef minutes
 
-    #undef IntermediateCnts
-    #undef StartTime
-    #undef EndTime
-    #undef CurrentTime
     #undef infostring
 
     #undef magnify
@@ -1,3 +1,64 @@
 #!/bin/sh
 g++ -g main_parseexpr.cpp -o pexprs_dbg
 
+g++ -O2 main_bench_intern.cpp -o bench_intern
+g++ -O2 main_bench_check.cpp -o bench_check
+g++ -O2 main_stream.cpp -o stream
+g++ -O2 main_fold.cpp -o fold
+g++ -O2 main_reconfigure.cpp -o reconfigure
+g++ -O2 main_lazy.cpp -o lazy
+g++ -O2 main_corpus.cpp -o corpus
+g++ -O2 main_conics.cpp -o conics
+g++ -O2 main_sas_iq_table.cpp -o sas_iq_table
+# share libraries built by the tests, their %include lines made into #includes; they are C, hence -fpermissive
+mkdir -p runtime/share
+for lib in plane polyhedron polyhedron_slab-lib supermirror-lib supermirror_batch-lib monitor_nd-lib mesh_bvh-lib union_arena-lib cdf_guide-lib refl_grid-lib; do
+    for ext in h c; do
+        sed 's/^\([[:space:]]*\)%include "\([^"]*\)"/\1#include "\2.h"\n\1#include "\2.c"/' ../mcstas-comps/share/$lib.$ext > runtime/share/$lib.$ext
+    done
+done
+g++ -O2 -fpermissive -w main_supermirror_batch.cpp -o supermirror_batch
+g++ -O2 -fpermissive -w main_polyhedron_slab.cpp -o polyhedron_slab
+
+# union-lib.c has no header and names a parameter new; the shell points of Union_mesh are cut from its SHARE block
+sed 's/\bnew\b/new_list/g' ../mcstas-comps/share/union-lib.c > runtime/share/union-lib.c
+sed -n '/^int mesh_compare_coords/,/^#ifndef ANY_GEOMETRY_DETECTOR_DECLARE/p' ../mcstas-comps/union/Union_mesh.comp | sed '$d' > runtime/share/union_mesh_shell.c
+g++ -O2 -fpermissive -w main_mesh_bvh.cpp -o mesh_bvh
+g++ -O2 -fpermissive -w main_union_bounds.cpp -o union_bounds
+g++ -O2 -fpermissive -w main_union_arena.cpp -o union_arena
+
+# stub runtime: cogen a small instrument from mcstas-comps and trace it, needs ../mcparse
+mkdir -p runtime/comps
+cp ../mcstas-comps/optics/Arm.comp ../mcstas-comps/optics/Slit.comp ../mcstas-comps/optics/Guide.comp ../mcstas-comps/optics/Beamstop.comp runtime/comps/
+cp ../mcstas-comps/sources/Source_simple.comp ../mcstas-comps/monitors/L_monitor.comp ../mcstas-comps/monitors/PSD_monitor.comp ../mcstas-comps/monitors/E_monitor.comp runtime/comps/
+cp ../mcstas-comps/monitors/Monitor_nD.comp runtime/comps/
+../mcparse --comps runtime/comps --instrs runtime/bench_runtime.instr --cogen
+g++ -O2 -Iruntime/share main_runtime.cpp -o runtime_bench
+
+# placements through the scene graph against the folded ones
+sed 's/placement_runtime/placement_folded/' runtime/placement_runtime.instr > runtime/placement_folded.instr
+../mcparse --comps runtime/comps --instrs runtime/placement_runtime.instr --cogen --nofold
+../mcparse --comps runtime/comps --instrs runtime/placement_folded.instr --cogen
+g++ -O2 -Iruntime/share main_placement.cpp -o placement
+
+# Reconfigure against a fresh InitAndConfig at the new parameter values
+../mcparse --comps runtime/comps --instrs runtime/reconf_runtime.instr --cogen
+g++ -O2 -Iruntime/share main_reconfigure_runtime.cpp -o reconfigure_runtime
+
+# Monitor_nD instances specialised with --spec against the generic trace of monitor_nd-lib
+../mcparse --comps runtime/comps --instrs runtime/monnd_runtime.instr --cogen --spec
+g++ -O2 -Iruntime/share main_monnd_spec.cpp -o monnd_spec
+g++ -O2 main_monnd_stream.cpp -o monnd_stream -lpthread
+g++ -O2 main_progress_bar.cpp -o progress_bar -lpthread
+
+# Isotropic_Sqw cogen'd on its own; it is C, and its data files are not read by the stub read_table-lib
+mkdir -p runtime/samples/comps
+cp ../mcstas-comps/optics/Arm.comp ../mcstas-comps/samples/Isotropic_Sqw.comp runtime/samples/comps/
+../mcparse --comps runtime/samples/comps --instrs runtime/sqw_runtime.instr --cogen
+g++ -O2 -fpermissive -w -Iruntime -Iruntime/share main_sqw_guide.cpp -o sqw_guide
+
+# Single_crystal likewise, its reflection lists are filled by the test
+mkdir -p runtime/crystal/comps
+cp ../mcstas-comps/optics/Arm.comp ../mcstas-comps/samples/Single_crystal.comp runtime/crystal/comps/
+../mcparse --comps runtime/crystal/comps --instrs runtime/sx_runtime.instr --cogen
+g++ -O2 -fpermissive -w -Iruntime -Iruntime/share main_refl_grid.cpp -o refl_grid
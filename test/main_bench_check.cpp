@@ -0,0 +1,155 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <chrono>
+
+#include "../lib/jg_baselayer.h"
+
+#include "../src/parsecore.h"
+#include "../src/parsehelpers.h"
+#include "../src/parse_comp.h"
+#include "../src/parse_instr.h"
+#include "../src/check_instr.h"
+
+
+//
+//  Scaling test: CheckInstrument on synthetic instruments of 1k to 100k components.
+//  Every component is placed RELATIVE to an earlier one, with COPY, PREVIOUS and forward JUMP references mixed in.
+//  Time per component should stay flat as the instrument grows.
+
+
+static f64 BenchNow() {
+    using namespace std::chrono;
+    return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+static Str _Name(const char *fmt, u32 i) {
+    char buff[32];
+    sprintf(buff, fmt, i);
+    Str s = StrAlloc((u32) strlen(buff));
+    StrCopy(StrL(buff), s);
+    return s;
+}
+
+static void _SetRef(Str *dest, Sym *dest_sym, Str name) {
+    *dest = name;
+    *dest_sym = StrIntern(name);
+}
+
+InstrumentParse *BuildInstrument(MArena *a_dest, u32 ncomps) {
+    InstrumentParse *instr = (InstrumentParse*) ArenaAlloc(a_dest, sizeof(InstrumentParse));
+    *instr = {};
+    _SetRef(&instr->name, &instr->name_sym, _Name("scaling_%u", ncomps));
+    instr->comps = InitArray<ComponentCall>(a_dest, ncomps);
+
+    Array<Str> names = InitArray<Str>(a_dest, ncomps);
+    for (u32 i = 0; i < ncomps; ++i) {
+        // COPY(cpy) instances are renamed to cpy_1, cpy_2, ... by the check
+        if (i % 50 == 25) {
+            names.Add(_Name("cpy_%u", i / 50 + 1));
+        }
+        else {
+            names.Add(_Name("c_%u", i));
+        }
+    }
+
+    for (u32 i = 0; i < ncomps; ++i) {
+        ComponentCall c = {};
+        _SetRef(&c.name, &c.name_sym, names.arr[i]);
+        _SetRef(&c.type, &c.type_sym, StrL("Arm"));
+
+        if (i == 0) {
+            c.at_absolute = true;
+        }
+        else if (i % 3 == 0) {
+            _SetRef(&c.at_relative_to, &c.at_relative_sym, StrL("PREVIOUS"));
+        }
+        else {
+            _SetRef(&c.at_relative_to, &c.at_relative_sym, names.arr[i - 1]);
+        }
+        if (i > 0 && i % 2 == 0) {
+            c.rot_defined = true;
+            _SetRef(&c.rot_relative_to, &c.rot_relative_sym, names.arr[i / 2]);
+        }
+        if (i > 5 && i % 10 == 0) {
+            _SetRef(&c.copy_type, &c.copy_type_sym, names.arr[i - 5]);
+        }
+        if (i % 50 == 25) {
+            _SetRef(&c.copy_name, &c.copy_name_sym, StrL("cpy"));
+        }
+        if (i % 100 == 0) {
+            _SetRef(&c.jump, &c.jump_sym, names.arr[ncomps - 1]);
+        }
+        instr->comps.Add(c);
+    }
+
+    return instr;
+}
+
+InstrumentParse *BuildBrokenInstrument(MArena *a_dest) {
+    InstrumentParse *instr = BuildInstrument(a_dest, 20);
+    _SetRef(&instr->name, &instr->name_sym, StrL("broken"));
+
+    // one of each: unknown RELATIVE, forward RELATIVE, unknown COPY source, unknown JUMP, PREVIOUS on the first call
+    ComponentCall *c = instr->comps.arr;
+    c[0].at_absolute = false;
+    _SetRef(&c[0].at_relative_to, &c[0].at_relative_sym, StrL("PREVIOUS"));
+    _SetRef(&c[4].at_relative_to, &c[4].at_relative_sym, StrL("nowhere"));
+    _SetRef(&c[5].at_relative_to, &c[5].at_relative_sym, c[7].name);
+    _SetRef(&c[8].copy_type, &c[8].copy_type_sym, StrL("nothing"));
+    _SetRef(&c[9].jump, &c[9].jump_sym, StrL("nobody"));
+
+    return instr;
+}
+
+void BenchCheck() {
+    MContext *ctx = InitBaselayer();
+
+    HashMap comp_map = InitMap(ctx->a_life, 16);
+    MapPut(&comp_map, (u64) StrIntern(StrL("Arm")), (u64) 1);
+
+    u32 sizes[] = { 1000, 10000, 100000 };
+    f64 per_comp[3] = {};
+    for (u32 k = 0; k < 3; ++k) {
+        MArena a_tmp = ArenaCreate();
+        ParseStats stats = {};
+        InstrumentParse *instr = BuildInstrument(&a_tmp, sizes[k]);
+
+        f64 t0 = BenchNow();
+        bool ok = CheckInstrument(&a_tmp, instr, &comp_map, &stats);
+        f64 dt = BenchNow() - t0;
+
+        if (ok == false) {
+            printf("ERROR: synthetic instrument of %u components failed the check\n", sizes[k]);
+            exit(1);
+        }
+        per_comp[k] = dt / sizes[k] * 1e9;
+        printf("%6u components: %8.2f ms, %6.1f ns/component\n", sizes[k], dt * 1000, per_comp[k]);
+    }
+
+    // linear behaviour: the per-component cost must not grow with the instrument size (generous bound for timer noise)
+    if (per_comp[2] > per_comp[0] * 4) {
+        printf("ERROR: CheckInstrument does not scale linearly\n");
+        exit(1);
+    }
+
+    // all reference errors are reported in one pass
+    MArena a_tmp = ArenaCreate();
+    ParseStats stats = {};
+    InstrumentParse *broken = BuildBrokenInstrument(&a_tmp);
+    bool ok = CheckInstrument(&a_tmp, broken, &comp_map, &stats);
+    if (ok || broken->namerefs_checked || stats.nameref_error_cnt != 1) {
+        printf("ERROR: broken instrument passed the check\n");
+        exit(1);
+    }
+}
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    BenchCheck();
+}
@@ -0,0 +1,143 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <chrono>
+
+#include "../lib/jg_baselayer.h"
+
+#include "../src/parsecore.h"
+
+
+//
+//  Benchmark: identifier interning on a synthetic 100k-component instrument.
+//  Compares tokenization cost and Str- vs Sym-keyed lookups, as done by CheckInstrument and _FindByName.
+
+
+#define BENCH_NCOMPS 100000
+#define BENCH_NTYPES 40
+
+
+static f64 BenchNow() {
+    using namespace std::chrono;
+    return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+Str GenerateInstrument(u32 ncomps) {
+    StrBuff buff = StrBuffInit();
+    StrBuffPrint1K(&buff, "DEFINE INSTRUMENT bench_intern(dummy=1)\nTRACE\n", 0);
+    StrBuffPrint1K(&buff, "COMPONENT comp_0 = Arm() AT (0, 0, 0) ABSOLUTE\n", 0);
+    for (u32 i = 1; i < ncomps; ++i) {
+        StrBuffPrint1K(&buff, "COMPONENT comp_%u = Type_%u(xwidth = 0.1, yheight = 0.1) AT (0, 0, 1) RELATIVE comp_%u\n", 3, i, i % BENCH_NTYPES, i - 1);
+    }
+    StrBuffPrint1K(&buff, "END\n", 0);
+    Str text = { buff.str, buff.len };
+    return text;
+}
+
+void BenchIntern() {
+    MContext *ctx = InitBaselayer();
+
+    Str text = GenerateInstrument(BENCH_NCOMPS);
+    printf("synthetic instrument: %u components, %u bytes\n", BENCH_NCOMPS, text.len);
+
+    // tokenize + intern
+    Array<Str> names = InitArray<Str>(ctx->a_life, BENCH_NCOMPS);
+    Array<Sym> name_syms = InitArray<Sym>(ctx->a_life, BENCH_NCOMPS);
+    Array<Str> types = InitArray<Str>(ctx->a_life, BENCH_NCOMPS);
+    Array<Sym> type_syms = InitArray<Sym>(ctx->a_life, BENCH_NCOMPS);
+
+    f64 t0 = BenchNow();
+    Tokenizer tokenizer = {};
+    Tokenizer *t = &tokenizer;
+    t->Init(text.str);
+    u32 ntoks = 0;
+    Token tok = GetToken(t);
+    while (tok.type != TOK_ENDOFSTREAM) {
+        ++ntoks;
+        if (tok.type == TOK_MCSTAS_COMPONENT) {
+            Token name = GetToken(t);
+            GetToken(t);
+            Token type = GetToken(t);
+            names.Add(name.GetValue());
+            name_syms.Add(name.sym);
+            types.Add(type.GetValue());
+            type_syms.Add(type.sym);
+            ntoks += 3;
+        }
+        tok = GetToken(t);
+    }
+    f64 t_lex = BenchNow() - t0;
+    printf("lex + intern:         %.2f ms (%u tokens, %u symbols)\n", t_lex * 1000, ntoks, g_symtab.cnt);
+
+    // type lookups, as in CheckInstrument
+    HashMap map_str = InitMap(ctx->a_life, BENCH_NTYPES * 3);
+    HashMap map_sym = InitMap(ctx->a_life, BENCH_NTYPES * 3);
+    for (u32 i = 0; i < types.len; ++i) {
+        if (MapGet(&map_sym, (u64) type_syms.arr[i]) == 0) {
+            MapPut(&map_str, types.arr[i], (u64) i + 1);
+            MapPut(&map_sym, (u64) type_syms.arr[i], (u64) i + 1);
+        }
+    }
+
+    u64 acc = 0;
+    t0 = BenchNow();
+    for (u32 i = 0; i < types.len; ++i) {
+        acc += MapGet(&map_str, types.arr[i]);
+    }
+    f64 t_map_str = BenchNow() - t0;
+
+    t0 = BenchNow();
+    for (u32 i = 0; i < type_syms.len; ++i) {
+        acc -= MapGet(&map_sym, (u64) type_syms.arr[i]);
+    }
+    f64 t_map_sym = BenchNow() - t0;
+    printf("type lookup (Str):    %.2f ms\n", t_map_str * 1000);
+    printf("type lookup (Sym):    %.2f ms\n", t_map_sym * 1000);
+
+    // name searches, as in _FindByName (linear scan, a subset of the queries)
+    u32 nqueries = 1000;
+    u32 step = names.len / nqueries;
+    u32 hits_str = 0;
+    u32 hits_sym = 0;
+
+    t0 = BenchNow();
+    for (u32 q = 0; q < nqueries; ++q) {
+        Str query = names.arr[q * step];
+        for (u32 i = 0; i < names.len; ++i) {
+            if (StrEqual(names.arr[i], query)) {
+                ++hits_str;
+                break;
+            }
+        }
+    }
+    f64 t_find_str = BenchNow() - t0;
+
+    t0 = BenchNow();
+    for (u32 q = 0; q < nqueries; ++q) {
+        Sym query = name_syms.arr[q * step];
+        for (u32 i = 0; i < name_syms.len; ++i) {
+            if (name_syms.arr[i] == query) {
+                ++hits_sym;
+                break;
+            }
+        }
+    }
+    f64 t_find_sym = BenchNow() - t0;
+    printf("name search (Str):    %.2f ms (%u queries)\n", t_find_str * 1000, nqueries);
+    printf("name search (Sym):    %.2f ms (%u queries)\n", t_find_sym * 1000, nqueries);
+
+    if (acc != 0 || hits_str != hits_sym) {
+        printf("ERROR: lookup mismatch\n");
+        exit(1);
+    }
+}
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    BenchIntern();
+}
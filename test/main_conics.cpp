@@ -0,0 +1,201 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+#include "test_common.h"
+
+
+//
+//  conic.h scene traversal: the z binned lookup built by initSimulation() against the linear scan over every
+//  surface. Scenes are the Conics_PH condenser and Conics_EH objective of examples/HighNESS/WOFSANS, at their
+//  shell counts and at smaller and larger ones. Every neutron must end in the same state both ways, and the
+//  time per neutron is reported for both.
+//
+//  ./conics [<nrays>]
+
+
+#define V2Q 1.58825361e-3
+
+struct _class_particle {
+    double x, y, z;
+    double vx, vy, vz;
+    double t;
+    double sx, sy, sz;
+    double p;
+    int _mctmp_a;
+    int _absorbed;
+};
+
+// conic.h draws from rand01()
+double rand01() {
+    return Rand01();
+}
+
+double randnorm() {
+    double u = rand01(), v = rand01();
+    return sqrt(-2 * log(u + 1e-300)) * cos(2 * M_PI * v);
+}
+
+#include "runtime/read_table-lib.h"
+#include "runtime/ref-lib.h"
+#include "runtime/ref-lib.c"
+#include "../mcstas-comps/share/conic.h"
+
+
+// mode b of Conics_PH INITIALIZE
+void MakePH(Scene *s, int nshells, double focal_length, double rmin, double rmax, double lp, double lh, double m) {
+    double R0 = 0.99, Qc = 0.021, W = 0.003, alpha = 6.07;
+    double quadratic = (rmax-rmin)/(rmax*rmax - rmin*rmin);
+    double constant = rmax - quadratic*rmax*rmax;
+    double dr = nshells>1?(rmax-rmin)/(nshells-1):0;
+    ConicSurf *pm = NULL;
+    for (int i = 0; i < nshells; i++) {
+        double rr = rmax-dr*i;
+        rr = constant + quadratic*rr*rr;
+        Point pi = makePoint(0,rr,0);
+        double theta_2 = atan(rr/focal_length);
+        double theta_i = 0.25*theta_2;
+        double cH = fabs(0.5*(rr/tan(theta_2 - 2.0*theta_i) - focal_length));
+        pm = addParaboloid(focal_length + 2.0*cH, pi,-lp, 0, m,R0,Qc,W,alpha,s);
+        addHyperboloid(focal_length, focal_length + 2.0*cH, pi,0,lh,m,R0,Qc,W,alpha,s);
+    }
+    addDisk(pm->zs,0.0,rConic(pm->ze,*pm),s);
+}
+
+// mode b of Conics_EH INITIALIZE
+void MakeEH(Scene *s, int nshells, double focal_length_u, double focal_length_d, double rmin, double rmax, double le, double lh, double m) {
+    double R0 = 0.99, Qc = 0.021, W = 0.003, alpha = 6.07;
+    double quadratic = (rmax-rmin)/(rmax*rmax - rmin*rmin);
+    double constant = rmax - quadratic*rmax*rmax;
+    double dr = nshells>1?(rmax-rmin)/(nshells-1):0;
+    ConicSurf *pm = NULL;
+    for (int i = 0; i < nshells; i++) {
+        double rr = rmax-dr*i;
+        rr = constant + quadratic*rr*rr;
+        Point pi = makePoint(0,rr,0);
+        double theta_1 = atan(rr/focal_length_u);
+        double theta_2 = atan(rr/focal_length_d);
+        double theta_i = 0.25*(theta_1 + theta_2);
+        double cH = fabs(0.5*(rr/tan(theta_2 - 2.0*theta_i) - focal_length_d));
+        pm = addEllipsoid(focal_length_d + 2.0*cH, -focal_length_u, pi, -le,  0, m, R0, Qc, W, alpha, s);
+        addHyperboloid( focal_length_d, focal_length_d + 2.0*cH,  pi,   0, lh, m, R0, Qc, W, alpha, s);
+    }
+    addDisk(pm->zs,0.0,rConic(pm->ze,*pm),s);
+}
+
+// 4 AA neutrons entering the optic, from a point at z_source (or a parallel beam with some divergence when
+// z_source is 0) onto the entrance plane z_entry within r_max
+_class_particle MakeRay(double z_source, double z_entry, double r_max) {
+    double v = 3956.036 / 4.0;
+    double r = r_max * sqrt(rand01()), phi = 2 * M_PI * rand01();
+    double ex = r * cos(phi), ey = r * sin(phi);
+    double dx, dy, dz;
+    if (z_source != 0) {
+        double sx = 0.005 * (2 * rand01() - 1), sy = 0.005 * (2 * rand01() - 1);
+        dx = ex - sx; dy = ey - sy; dz = z_entry - z_source;
+    }
+    else {
+        dx = 0.003 * randnorm(); dy = 0.003 * randnorm(); dz = 1;
+    }
+    double n = sqrt(dx*dx + dy*dy + dz*dz);
+    _class_particle pa = {};
+    pa.x = ex; pa.y = ey; pa.z = z_entry;
+    pa.vx = v * dx / n; pa.vy = v * dy / n; pa.vz = v * dz / n;
+    pa.p = 1;
+    return pa;
+}
+
+void Run(const char *name, Scene *linear, Scene *binned, _class_particle *rays, int nrays) {
+    _class_particle *out = (_class_particle*) malloc(nrays * sizeof(_class_particle));
+    int mismatches = 0;
+    long reflected = 0;
+
+    double t0 = BenchNow();
+    for (int i = 0; i < nrays; ++i) {
+        g_rng = 0x9E3779B97F4A7C15ull + i;
+        out[i] = rays[i];
+        traceSingleNeutron(&out[i], linear);
+    }
+    double t_lin = BenchNow() - t0;
+
+    t0 = BenchNow();
+    for (int i = 0; i < nrays; ++i) {
+        g_rng = 0x9E3779B97F4A7C15ull + i;
+        _class_particle pa = rays[i];
+        traceSingleNeutron(&pa, binned);
+        bool same = pa.x == out[i].x && pa.y == out[i].y && pa.z == out[i].z && pa.vx == out[i].vx && pa.vy == out[i].vy
+            && pa.vz == out[i].vz && pa.t == out[i].t && pa.p == out[i].p && pa._absorbed == out[i]._absorbed;
+        if (same == false && mismatches++ < 5) {
+            printf("ERROR: %s ray %d: linear (%g %g %g) absorbed %d, binned (%g %g %g) absorbed %d\n", name, i,
+                out[i].x, out[i].y, out[i].z, out[i]._absorbed, pa.x, pa.y, pa.z, pa._absorbed);
+        }
+        reflected += pa._absorbed == 0 && (pa.vx != rays[i].vx || pa.vy != rays[i].vy);
+    }
+    double t_bin = BenchNow() - t0;
+    g_errors += mismatches;
+
+    printf("%-10s %3d surfaces, %4d bins: %5.1f%% reflected, linear %7.3f us/n, binned %7.3f us/n, %5.1fx\n",
+        name, linear->num_c, binned->num_zb, 100.0 * reflected / nrays, t_lin / nrays * 1e6, t_bin / nrays * 1e6, t_lin / t_bin);
+    free(out);
+}
+
+void RunScene(const char *name, int is_eh, int nshells, int nrays) {
+    Scene *linear = (Scene*) malloc(sizeof(Scene));
+    Scene *binned = (Scene*) malloc(sizeof(Scene));
+    *linear = makeScene();
+    *binned = makeScene();
+
+    _class_particle *rays = (_class_particle*) malloc(nrays * sizeof(_class_particle));
+    g_rng = 4321;
+    if (is_eh) {
+        // WOFSANS objective: focal_length_u=8, focal_length_d=6, rmin=0.01, rmax=0.1, le=0.9, lh=0.82, m=3
+        MakeEH(linear, nshells, 8, 6, 0.01, 0.1, 0.9, 0.82, 3);
+        MakeEH(binned, nshells, 8, 6, 0.01, 0.1, 0.9, 0.82, 3);
+        for (int i = 0; i < nrays; ++i) {
+            rays[i] = MakeRay(-8, -0.9 - 0.01, 0.11);
+        }
+    }
+    else {
+        // WOFSANS condenser: focal_length=5.5, rmin=0.010, rmax=0.075, lp=1.3, lh=1.0, m=3
+        MakePH(linear, nshells, 5.5, 0.01, 0.075, 1.3, 1.0, 3);
+        MakePH(binned, nshells, 5.5, 0.01, 0.075, 1.3, 1.0, 3);
+        for (int i = 0; i < nrays; ++i) {
+            rays[i] = MakeRay(0, -1.3 - 0.01, 0.08);
+        }
+    }
+    initSimulation(binned);
+
+    Run(name, linear, binned, rays, nrays);
+
+    finishSimulation(linear);
+    finishSimulation(binned);
+    free(linear);
+    free(binned);
+    free(rays);
+}
+
+
+int main (int argc, char **argv) {
+    int nrays = argc > 1 ? atoi(argv[1]) : 200000;
+
+    int shells_ph[4] = { 4, 16, 28, 48 };
+    int shells_eh[4] = { 4, 16, 25, 48 };
+    char name[32];
+    for (int i = 0; i < 4; ++i) {
+        snprintf(name, sizeof(name), "PH x%d", shells_ph[i]);
+        RunScene(name, 0, shells_ph[i], nrays);
+    }
+    for (int i = 0; i < 4; ++i) {
+        snprintf(name, sizeof(name), "EH x%d", shells_eh[i]);
+        RunScene(name, 1, shells_eh[i], nrays);
+    }
+
+    if (g_errors) {
+        printf("%d errors\n", g_errors);
+        exit(1);
+    }
+    printf("conics: OK\n");
+}
@@ -0,0 +1,195 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <chrono>
+
+#include "../lib/jg_baselayer.h"
+
+#include "../src/parsecore.h"
+#include "../src/parsehelpers.h"
+#include "../src/parse_comp.h"
+#include "../src/parse_instr.h"
+#include "../src/check_instr.h"
+#include "../src/emitter.h"
+
+
+//
+//  Synthetic corpus: components and instruments far larger than anything in mcstas-comps, generated in five
+//  families with a size knob each. Every family is parsed (and instruments checked) at four sizes, and the time
+//  per input byte is reported. Per-byte cost must stay flat, growth points at a superlinear path.
+//
+//  ./corpus [<outdir>] also writes the largest file of each family to outdir.
+
+
+static f64 BenchNow() {
+    using namespace std::chrono;
+    return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+void GenParams(EmitBuff *b, u32 n) {
+    // thousands of setting parameters
+    Emit(b, "DEFINE COMPONENT Params_", n, "\nSETTING PARAMETERS (");
+    for (u32 i = 0; i < n; ++i) {
+        if (i % 3 == 0) {
+            Emit(b, "string s_", i, " = \"file_", i, ".dat\"");
+        }
+        else if (i % 3 == 1) {
+            Emit(b, "int n_", i, " = ", i);
+        }
+        else {
+            Emit(b, "x_", i, " = ", i, ".5");
+        }
+        if (i + 1 < n) {
+            Emit(b, ",\n    ");
+        }
+    }
+    Emit(b, ")\nTRACE\n%{\n    PROP_Z0;\n%}\nEND\n");
+}
+
+void GenTrace(EmitBuff *b, u32 nlines) {
+    // one huge TRACE block
+    Emit(b, "DEFINE COMPONENT Trace_", nlines, "\nSETTING PARAMETERS (xwidth = 0.1)\n");
+    Emit(b, "DECLARE\n%{\n    double acc;\n%}\n");
+    Emit(b, "TRACE\n%{\n");
+    for (u32 i = 0; i < nlines; ++i) {
+        Emit(b, "    if (x > ", i, " * xwidth) { acc += sin(", i, " * x) / (1 + y * y); } // line ", i, "\n");
+    }
+    Emit(b, "%}\nEND\n");
+}
+
+void GenExpressions(EmitBuff *b, u32 depth) {
+    // deeply nested AT expressions, 64 calls
+    Emit(b, "DEFINE INSTRUMENT Nested_", depth, "(L = 1)\nTRACE\n");
+    Emit(b, "COMPONENT origin = Arm() AT (0, 0, 0) ABSOLUTE\n");
+    for (u32 k = 0; k < 64; ++k) {
+        Emit(b, "COMPONENT c_", k, " = Arm() AT (0, 0, ");
+        for (u32 i = 0; i < depth; ++i) {
+            Emit(b, "(L + ");
+        }
+        Emit(b, "1");
+        for (u32 i = 0; i < depth; ++i) {
+            if (i % 2) {
+                Emit(b, ") * 0.5");
+            }
+            else {
+                Emit(b, ") / 2");
+            }
+        }
+        Emit(b, ") RELATIVE PREVIOUS\n");
+    }
+    Emit(b, "END\n");
+}
+
+void GenCalls(EmitBuff *b, u32 ncalls) {
+    // many component calls with arguments, RELATIVE references back into the instrument
+    Emit(b, "DEFINE INSTRUMENT Calls_", ncalls, "(L = 1, string file = \"in.dat\")\nTRACE\n");
+    Emit(b, "COMPONENT c_0 = Arm() AT (0, 0, 0) ABSOLUTE\n");
+    for (u32 i = 1; i < ncalls; ++i) {
+        Emit(b, "COMPONENT c_", i, " = PSD_monitor(xwidth = 0.1, yheight = L / ", i, ", filename = file) ");
+        Emit(b, "AT (0, 0, 0.01) RELATIVE c_", i / 2, " ROTATED (0, ", i % 360, ", 0) RELATIVE PREVIOUS\n");
+    }
+    Emit(b, "END\n");
+}
+
+void GenCopyChains(EmitBuff *b, u32 ncalls) {
+    // every call copies the previous one, chains of 1000
+    Emit(b, "DEFINE INSTRUMENT Copies_", ncalls, "()\nTRACE\n");
+    Emit(b, "COMPONENT origin = Arm() AT (0, 0, 0) ABSOLUTE\n");
+    for (u32 i = 0; i < ncalls; ++i) {
+        if (i % 1000 == 0) {
+            Emit(b, "COMPONENT c_", i, " = PSD_monitor(xwidth = 0.1, yheight = 0.1, nx = ", i, ")");
+        }
+        else {
+            Emit(b, "COMPONENT c_", i, " = COPY(c_", i - 1, ")");
+        }
+        Emit(b, " AT (0, 0, 0.01) RELATIVE PREVIOUS\n");
+    }
+    Emit(b, "END\n");
+}
+
+typedef void (*GenFunc)(EmitBuff *b, u32 size);
+
+struct CorpusFamily {
+    const char *name;
+    const char *ext;
+    GenFunc gen;
+    u32 sizes[4];
+};
+
+static s32 g_errors = 0;
+
+void RunFamily(CorpusFamily *fam, HashMap *comp_map, const char *outdir, EmitBuff *b) {
+    f64 ns_per_byte[4] = {};
+    for (s32 k = 0; k < 4; ++k) {
+        EmitBuffClear(b);
+        fam->gen(b, fam->sizes[k]);
+        Emit(b, '\0');
+        Str text = { b->str, b->len - 1 };
+
+        MArena a_parse = ArenaCreate();
+        ParseStats stats = {};
+        bool ok;
+        f64 t0 = BenchNow();
+        if (strcmp(fam->ext, "comp") == 0) {
+            ok = ParseComponent(&a_parse, text)->parse_error == false;
+        }
+        else {
+            InstrumentParse *instr = ParseInstrument(&a_parse, text);
+            ok = instr->parse_error == false && CheckInstrument(&a_parse, instr, comp_map, &stats);
+        }
+        f64 dt = BenchNow() - t0;
+
+        ns_per_byte[k] = dt / text.len * 1e9;
+        printf("%-12s %8u: %10u bytes, %9.2f ms, %6.2f ns/byte\n", fam->name, fam->sizes[k], text.len, dt * 1000, ns_per_byte[k]);
+        if (ok == false) {
+            printf("ERROR: %s of size %u does not parse\n", fam->name, fam->sizes[k]);
+            g_errors++;
+        }
+
+        if (outdir && k == 3) {
+            char path[512];
+            snprintf(path, 512, "%s/corpus_%s.%s", outdir, fam->name, fam->ext);
+            SaveFile(path, text.str, text.len);
+        }
+    }
+
+    // generous bound for timer noise at the small sizes
+    if (ns_per_byte[3] > ns_per_byte[0] * 4) {
+        printf("ERROR: %s parses superlinearly, %.2f -> %.2f ns/byte\n", fam->name, ns_per_byte[0], ns_per_byte[3]);
+        g_errors++;
+    }
+}
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    const char *outdir = argc > 1 ? argv[1] : NULL;
+
+    MContext *ctx = InitBaselayer();
+    HashMap comp_map = InitMap(ctx->a_life, 16);
+    MapPut(&comp_map, (u64) StrIntern(StrL("Arm")), (u64) 1);
+    MapPut(&comp_map, (u64) StrIntern(StrL("PSD_monitor")), (u64) 1);
+
+    CorpusFamily families[] = {
+        { "params", "comp", GenParams, { 1000, 4000, 16000, 64000 } },
+        { "trace", "comp", GenTrace, { 10000, 40000, 160000, 640000 } },
+        { "nested", "instr", GenExpressions, { 16, 64, 256, 1024 } },
+        { "calls", "instr", GenCalls, { 1000, 10000, 50000, 100000 } },
+        { "copies", "instr", GenCopyChains, { 1000, 10000, 50000, 100000 } },
+    };
+
+    EmitBuff b = EmitBuffInit();
+    for (u32 i = 0; i < sizeof(families) / sizeof(CorpusFamily); ++i) {
+        RunFamily(families + i, &comp_map, outdir, &b);
+    }
+
+    if (g_errors) {
+        printf("%d errors\n", g_errors);
+        exit(1);
+    }
+    printf("corpus: OK\n");
+}
@@ -0,0 +1,151 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cmath>
+
+#include "../lib/jg_baselayer.h"
+
+#include "../src/parsecore.h"
+#include "../src/parsehelpers.h"
+#include "../src/parse_comp.h"
+#include "../src/parse_instr.h"
+#include "../src/check_instr.h"
+#include "../src/emitter.h"
+#include "../src/cogen_fold.h"
+
+
+//
+//  Cogen-time folding: expression evaluation, and absolute placements of a small instrument computed by
+//  FoldPlacements against hand-computed values.
+
+
+static s32 g_errors = 0;
+
+void ExpectEval(const char *expr, bool ok, f64 expected) {
+    f64 val = 0;
+    bool res = EvalExpression(StrL(expr), NULL, &val);
+    if (res != ok || (ok && fabs(val - expected) > 1e-12)) {
+        printf("ERROR: eval \"%s\": got %d %.17g, expected %d %.17g\n", expr, res, val, ok, expected);
+        g_errors++;
+    }
+}
+
+void ExpectVec(const char *what, f64 *v, f64 x, f64 y, f64 z) {
+    if (fabs(v[0] - x) > 1e-9 || fabs(v[1] - y) > 1e-9 || fabs(v[2] - z) > 1e-9) {
+        printf("ERROR: %s: got (%g, %g, %g), expected (%g, %g, %g)\n", what, v[0], v[1], v[2], x, y, z);
+        g_errors++;
+    }
+}
+
+void TestEval() {
+    ExpectEval("1", true, 1);
+    ExpectEval("-2.5", true, -2.5);
+    ExpectEval("1e-3", true, 1e-3);
+    ExpectEval(".5", true, 0.5);
+    ExpectEval("1 + 2 * 3", true, 7);
+    ExpectEval("(1 + 2) * 3", true, 9);
+    ExpectEval("10 / 4 - 1", true, 1.5);
+    ExpectEval("- -3", true, 3);
+    ExpectEval("90 * DEG2RAD", true, M_PI / 2);
+    ExpectEval("2 * PI", true, 2 * M_PI);
+    ExpectEval("sin(PI / 2) + atan2(1, 1)", true, 1 + M_PI / 4);
+    ExpectEval("sqrt(pow(3, 2) + 16)", true, 5);
+
+    ExpectEval("L", false, 0);
+    ExpectEval("L / 2", false, 0);
+    ExpectEval("a > 0 ? 1 : 2", false, 0);
+    ExpectEval("rand01()", false, 0);
+    ExpectEval("1 / 0", false, 0);
+    ExpectEval("", false, 0);
+}
+
+void TestPlacements() {
+    const char *text =
+        "DEFINE INSTRUMENT fold_test(L = 2, string file = \"x\", tilt = 0)\n"
+        "INITIALIZE\n"
+        "%{\n"
+        "    tilt = tilt * 2;\n"
+        "%}\n"
+        "TRACE\n"
+        "COMPONENT origin = Arm() AT (0, 0, 0) ABSOLUTE\n"
+        "COMPONENT turn = Arm() AT (0, 0, 1) RELATIVE origin ROTATED (0, 90, 0) RELATIVE origin\n"
+        "COMPONENT ahead = Arm() AT (0, 0, L / 2) RELATIVE PREVIOUS\n"
+        "COMPONENT unrot = Arm() AT (0, 0, 1) RELATIVE ahead ROTATED (0, 0, 0) RELATIVE origin\n"
+        "COMPONENT tilted = Arm() AT (0, 0, 1) RELATIVE origin ROTATED (tilt, 0, 0) RELATIVE origin\n"
+        "COMPONENT child = Arm() AT (0, 0, 1) RELATIVE tilted\n"
+        "END\n";
+
+    MContext *ctx = InitBaselayer();
+    HashMap comp_map = InitMap(ctx->a_life, 16);
+    MapPut(&comp_map, (u64) StrIntern(StrL("Arm")), (u64) 1);
+
+    MArena a_tmp = ArenaCreate();
+    ParseStats stats = {};
+    InstrumentParse *instr = ParseInstrument(&a_tmp, StrL(text));
+    if (instr->parse_error || CheckInstrument(&a_tmp, instr, &comp_map, &stats) == false) {
+        printf("ERROR: test instrument does not parse\n");
+        exit(1);
+    }
+
+    // literals only: "ahead" depends on L, and everything after it
+    FoldState fs = FoldPlacements(&a_tmp, instr);
+    if (fs.rows_cnt != 2 || fs.rows[0] != 0 || fs.rows[1] != 1 || fs.rows[2] != -1) {
+        printf("ERROR: literal folding, %d rows\n", fs.rows_cnt);
+        g_errors++;
+    }
+
+    // parameters at their defaults, except tilt which INITIALIZE writes to
+    g_cogen_fold_params = true;
+    fs = FoldPlacements(&a_tmp, instr);
+    g_cogen_fold_params = false;
+    if (fs.rows_cnt != 4 || fs.rows[4] != -1 || fs.rows[5] != -1) {
+        printf("ERROR: parameter folding, %d rows\n", fs.rows_cnt);
+        g_errors++;
+    }
+    if (MapGet(&fs.used, (u64) StrIntern(StrL("L"))) == 0) {
+        printf("ERROR: L not marked as used\n");
+        g_errors++;
+    }
+
+    // turn: rotated 90 degrees about y, which takes z to x; ahead: L/2 = 1 along the rotated z
+    ExpectVec("turn", fs.poses[1].pos, 0, 0, 1);
+    ExpectVec("ahead", fs.poses[2].pos, 1, 0, 1);
+    f64 z_ahead[3] = { fs.poses[2].rot[2], fs.poses[2].rot[5], fs.poses[2].rot[8] };
+    ExpectVec("ahead z-axis", z_ahead, 1, 0, 0);
+
+    // unrot: positioned along the rotated frame of ahead, but with the rotation of origin
+    ExpectVec("unrot", fs.poses[3].pos, 2, 0, 1);
+    f64 z_unrot[3] = { fs.poses[3].rot[2], fs.poses[3].rot[5], fs.poses[3].rot[8] };
+    ExpectVec("unrot z-axis", z_unrot, 0, 0, 1);
+
+    // the emitted angles reproduce the rotation
+    for (s32 i = 0; i < 4; ++i) {
+        f64 phi_x, phi_y, phi_z, rot[9];
+        FoldRotToAngles(fs.poses[i].rot, &phi_x, &phi_y, &phi_z);
+        _RotZYX(rot, phi_x, phi_y, phi_z);
+        for (s32 k = 0; k < 9; ++k) {
+            if (fabs(rot[k] - fs.poses[i].rot[k]) > 1e-12) {
+                printf("ERROR: angles of %d do not reproduce the rotation\n", i);
+                g_errors++;
+                break;
+            }
+        }
+    }
+}
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    TestEval();
+    TestPlacements();
+
+    if (g_errors) {
+        printf("%d errors\n", g_errors);
+        exit(1);
+    }
+    printf("fold: OK\n");
+}
@@ -0,0 +1,138 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+
+#include "../lib/jg_baselayer.h"
+
+#include "../src/parsecore.h"
+#include "../src/parsehelpers.h"
+#include "../src/parse_comp.h"
+
+
+//
+//  Header-only component parse: the parameter lists are complete, and the deferred parse of the code blocks
+//  gives the same result as a full parse.
+
+
+static s32 g_errors = 0;
+
+void ExpectStr(const char *what, Str got, Str expected) {
+    if (StrEqual(got, expected) == false) {
+        printf("ERROR: %s: got \"%.*s\", expected \"%.*s\"\n", what, got.len, got.str, expected.len, expected.str);
+        g_errors++;
+    }
+}
+
+void TestLazy() {
+    const char *text =
+        "/* doc header */\n"
+        "DEFINE COMPONENT Slit_test\n"
+        "SETTING PARAMETERS (xmin = -0.01, xmax = 0.01, string file = 0)\n"
+        "OUTPUT PARAMETERS (hits)\n"
+        "DEPENDENCY \"-lm\"\n"
+        "SHARE\n"
+        "%{\n"
+        "    %include \"read_table-lib\"\n"
+        "%}\n"
+        "DECLARE\n"
+        "%{\n"
+        "    int hits;\n"
+        "%}\n"
+        "TRACE\n"
+        "%{\n"
+        "    PROP_Z0;\n"
+        "    if (x < xmin || x > xmax) ABSORB;\n"
+        "%}\n"
+        "END\n";
+
+    MContext *ctx = InitBaselayer();
+    MArena a_tmp = ArenaCreate();
+
+    ComponentParse *full = ParseComponent(&a_tmp, StrL(text));
+    ComponentParse *lazy = ParseComponent(&a_tmp, StrL(text), true);
+    if (full->parse_error || lazy->parse_error || lazy->header_only == false) {
+        printf("ERROR: test component does not parse\n");
+        exit(1);
+    }
+
+    // the header has everything type checking uses, and no code
+    if (lazy->setting_params.len != 3 || lazy->out_params.len != 1) {
+        printf("ERROR: header-only parse, %d setting and %d output parameters\n", lazy->setting_params.len, lazy->out_params.len);
+        g_errors++;
+    }
+    ExpectStr("dependency", lazy->dependency_str, full->dependency_str);
+    ExpectStr("header-only trace", lazy->trace_block, Str {});
+    ExpectStr("blocks offset", Str { (char*) text + lazy->blocks_offset, 5 }, StrL("\nSHAR"));
+
+    // deferred parse, once
+    if (ParseComponentDeferred(&a_tmp, lazy) == false || lazy->header_only) {
+        printf("ERROR: deferred parse failed\n");
+        g_errors++;
+    }
+    ExpectStr("share", lazy->share_block, full->share_block);
+    ExpectStr("trace", lazy->trace_block, full->trace_block);
+    if (lazy->declare_members.len != full->declare_members.len) {
+        printf("ERROR: deferred parse, %d declare members\n", lazy->declare_members.len);
+        g_errors++;
+    }
+    if (ParseComponentDeferred(&a_tmp, lazy) == false) {
+        printf("ERROR: second deferred parse failed\n");
+        g_errors++;
+    }
+}
+
+void TestStaleIndex() {
+    // an index entry whose file was edited after the index was read: the offsets are stale, so the file is parsed
+    const char *text =
+        "DEFINE COMPONENT Arm_test\n"
+        "SETTING PARAMETERS ()\n"
+        "TRACE\n"
+        "%{\n"
+        "    SCATTER;\n"
+        "%}\n"
+        "END\n";
+    const char *edited_text =
+        "/* a doc header added after the index was written */\n"
+        "DEFINE COMPONENT Arm_test\n"
+        "SETTING PARAMETERS ()\n"
+        "TRACE\n"
+        "%{\n"
+        "    SCATTER;\n"
+        "%}\n"
+        "END\n";
+    const char *path = "lazy_stale_test.comp";
+
+    MArena a_tmp = ArenaCreate();
+    ComponentParse *entry = ParseComponent(&a_tmp, StrL(text), true);
+    entry->file_path = StrL(path);
+    entry->file_size = strlen(text);
+    entry->text = {};
+
+    SaveFile((char*) path, (char*) edited_text, strlen(edited_text));
+    bool ok = ParseComponentDeferred(&a_tmp, entry);
+    remove(path);
+
+    if (ok == false || entry->header_only) {
+        printf("ERROR: deferred parse of an edited file failed\n");
+        g_errors++;
+    }
+    ExpectStr("edited file trace", entry->trace_block, StrL("\n    SCATTER;\n"));
+    ExpectStr("edited file path", entry->file_path, StrL(path));
+}
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    TestLazy();
+    TestStaleIndex();
+
+    if (g_errors) {
+        printf("%d errors\n", g_errors);
+        exit(1);
+    }
+    printf("lazy: OK\n");
+}
@@ -0,0 +1,320 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cmath>
+
+#include "test_mcstas.h"
+
+#include "runtime/share/mesh_bvh-lib.h"
+#include "runtime/share/mesh_bvh-lib.c"
+#include "runtime/share/union_arena-lib.h"
+#include "runtime/share/union_arena-lib.c"
+#include "runtime/share/union-lib.c"
+#include "runtime/share/union_mesh_shell.c"
+
+
+//
+//  sample_mesh_intersect and r_within_mesh of union-lib.c, which traverse the facet hierarchy of mesh_bvh-lib,
+//  against the linear facet loops they replaced. The mesh is the cylinder walls of
+//  examples/Union_sample_environments/cryostat_example, tessellated at increasing resolution up to the 50000 facets
+//  of mesh_storage, and placed off the origin and rotated as Union_mesh does. Hit times and within results must be
+//  identical, and the time per ray is reported for both.
+//
+//  mesh_shell_points of Union_mesh, which sorts the vertices to remove duplicates, is checked against the pairwise
+//  comparison it replaced.
+//
+//  ./mesh_bvh [<nrays>]
+
+
+#define MESH_MAX_FACETS 50000
+
+
+void MeshAdd(mesh_storage *m, double *a, double *b, double *c) {
+    int i = m->n_facets++;
+    m->v1_x[i] = a[0]; m->v1_y[i] = a[1]; m->v1_z[i] = a[2];
+    m->v2_x[i] = b[0]; m->v2_y[i] = b[1]; m->v2_z[i] = b[2];
+    m->v3_x[i] = c[0]; m->v3_y[i] = c[1]; m->v3_z[i] = c[2];
+}
+
+// closed cylinder along y, nseg around and nring along the height
+void MeshCylinder(mesh_storage *m, double r, double h, int nseg, int nring) {
+    for (int i = 0; i < nseg; ++i) {
+        double a0 = 2 * M_PI * i / nseg, a1 = 2 * M_PI * (i + 1) / nseg;
+        double x0 = r * cos(a0), z0 = r * sin(a0), x1 = r * cos(a1), z1 = r * sin(a1);
+        for (int j = 0; j < nring; ++j) {
+            double y0 = -h / 2 + h * j / nring, y1 = -h / 2 + h * (j + 1) / nring;
+            double p00[3] = { x0, y0, z0 }, p10[3] = { x1, y0, z1 }, p01[3] = { x0, y1, z0 }, p11[3] = { x1, y1, z1 };
+            MeshAdd(m, p00, p10, p11);
+            MeshAdd(m, p00, p11, p01);
+        }
+        double cb[3] = { 0, -h / 2, 0 }, ct[3] = { 0, h / 2, 0 };
+        double b0[3] = { x0, -h / 2, z0 }, b1[3] = { x1, -h / 2, z1 }, t0[3] = { x0, h / 2, z0 }, t1[3] = { x1, h / 2, z1 };
+        MeshAdd(m, cb, b1, b0);
+        MeshAdd(m, ct, t0, t1);
+    }
+}
+
+// the facet loop of sample_mesh_intersect and r_within_mesh before the hierarchy, in the local frame of the mesh
+int LinearHits(mesh_storage *m, Coords o, Coords d, int whole_line, double epsilon, double *t_out) {
+    int counter = 0;
+    for (int i = 0; i < m->n_facets; ++i) {
+        Coords edge1 = coords_set(m->v2_x[i] - m->v1_x[i], m->v2_y[i] - m->v1_y[i], m->v2_z[i] - m->v1_z[i]);
+        Coords edge2 = coords_set(m->v3_x[i] - m->v1_x[i], m->v3_y[i] - m->v1_y[i], m->v3_z[i] - m->v1_z[i]);
+        Coords h, q;
+        vec_prod(h.x, h.y, h.z, d.x, d.y, d.z, edge2.x, edge2.y, edge2.z);
+        double a = Dot(edge1, h);
+        if (a > -epsilon && a < epsilon) continue;
+        double f = 1.0 / a;
+        Coords s = coords_sub(o, coords_set(m->v1_x[i], m->v1_y[i], m->v1_z[i]));
+        double u = f * Dot(s, h);
+        if (u < 0.0 || u > 1.0) continue;
+        vec_prod(q.x, q.y, q.z, s.x, s.y, s.z, edge1.x, edge1.y, edge1.z);
+        double V = f * Dot(d, q);
+        if (V < 0.0 || u + V > 1.0) continue;
+        double t = f * Dot(q, edge2);
+        if (whole_line || t > 0) t_out[counter++] = t;
+    }
+    return counter;
+}
+
+// sample_mesh_intersect before the hierarchy: bounding sphere, then every facet
+int LinearIntersect(double *t, int *num_solutions, double *r, double *v, geometry_struct *geometry) {
+    mesh_storage *m = geometry->geometry_parameters.p_mesh_storage;
+    Coords bb = coords_sub(coords_set(r[0], r[1], r[2]), coords_add(m->Bounding_Box_Center, geometry->center));
+    Coords bb_rotated = rot_apply(geometry->transpose_rotation_matrix, bb);
+    Coords o = rot_apply(geometry->transpose_rotation_matrix, coords_sub(coords_set(r[0], r[1], r[2]), geometry->center));
+    Coords d = rot_apply(geometry->transpose_rotation_matrix, coords_set(v[0], v[1], v[2]));
+    double tmp[2];
+    *num_solutions = 0;
+    if (sphere_intersect(&tmp[0], &tmp[1], bb_rotated.x, bb_rotated.y, bb_rotated.z, d.x, d.y, d.z, m->Bounding_Box_Radius) == 0) {
+        return 0;
+    }
+    *num_solutions = LinearHits(m, o, d, 0, 0, t);
+    qsort(t, *num_solutions, sizeof(double), Sample_compare_doubles);
+    return *num_solutions > 0;
+}
+
+// r_within_mesh before the hierarchy: crossings along y, then z and x while the two sides disagree
+int LinearWithin(Coords pos, geometry_struct *geometry, double *scratch) {
+    mesh_storage *m = geometry->geometry_parameters.p_mesh_storage;
+    Coords o = rot_apply(geometry->transpose_rotation_matrix, coords_sub(pos, geometry->center));
+    Coords dirs[3] = { coords_set(0, 1, 0), coords_set(0, 0, 1), coords_set(1, 0, 0) };
+    int counter = 0, neg_counter = 0;
+    for (int k = 0; k < 3; ++k) {
+        counter = 0;
+        int n = LinearHits(m, o, dirs[k], 1, 1e-27, scratch);
+        for (int i = 0; i < n; ++i) {
+            if (scratch[i] > 0) counter++;
+            else neg_counter++;
+        }
+        if (counter % 2 == neg_counter % 2) {
+            return counter % 2;
+        }
+    }
+    return 0;
+}
+
+void Error(int res, const char *what, int i) {
+    printf("ERROR: resolution %d: %s differs for ray %d\n", res, what, i);
+    g_errors++;
+}
+
+void RunSize(int res, int nrays) {
+    // drum, outer and inner cryostat walls and the sample stick of cryostat_example
+    double radii[4] = { 0.2, 0.1, 0.06, 0.04 };
+    double heights[4] = { 0.57, 0.2, 0.16, 0.605 };
+
+    mesh_storage *m = (mesh_storage*) calloc(1, sizeof(mesh_storage));
+    for (int c = 0; c < 4; ++c) {
+        MeshCylinder(m, radii[c], heights[c], res, res);
+    }
+    m->counter = m->n_facets;
+
+    double t0 = BenchNow();
+    mesh_bvh_build(&m->bvh, m->n_facets, m->v1_x, m->v1_y, m->v1_z, m->v2_x, m->v2_y, m->v2_z, m->v3_x, m->v3_y, m->v3_z);
+    double t_build = BenchNow() - t0;
+
+    // placed as by Union_mesh: off the origin, rotated, and the bounding sphere center in the master frame
+    geometry_struct geometry = {};
+    geometry.center = coords_set(0.03, -0.02, 0.05);
+    rot_set_rotation(geometry.rotation_matrix, 0.3, -0.7, 1.1);
+    rot_transpose(geometry.rotation_matrix, geometry.transpose_rotation_matrix);
+    geometry.geometry_parameters.p_mesh_storage = m;
+    m->Bounding_Box_Center = rot_apply(geometry.rotation_matrix, coords_set(0, 0, 0));
+    m->Bounding_Box_Radius = sqrt(0.2 * 0.2 + 0.605 * 0.605 / 4);
+
+    // rays from a sphere around the cryostat towards the sample region, in the master frame, and points around it
+    double *rays = (double*) malloc(nrays * 6 * sizeof(double));
+    Coords *points = (Coords*) malloc(nrays * sizeof(Coords));
+    for (int i = 0; i < nrays; ++i) {
+        double ct = 2 * Rand01() - 1, phi = 2 * M_PI * Rand01(), st = sqrt(1 - ct*ct);
+        double *r = rays + 6 * i;
+        r[0] = geometry.center.x + 0.5 * st * cos(phi);
+        r[1] = geometry.center.y + 0.5 * ct;
+        r[2] = geometry.center.z + 0.5 * st * sin(phi);
+        double tx = 0.05 * (2 * Rand01() - 1), ty = 0.1 * (2 * Rand01() - 1), tz = 0.05 * (2 * Rand01() - 1);
+        r[3] = geometry.center.x + tx - r[0];
+        r[4] = geometry.center.y + ty - r[1];
+        r[5] = geometry.center.z + tz - r[2];
+        if (i % 2) {
+            // and from inside, as after a scattering, in any direction
+            r[0] = geometry.center.x + 0.15 * (2 * Rand01() - 1);
+            r[1] = geometry.center.y + 0.25 * (2 * Rand01() - 1);
+            r[2] = geometry.center.z + 0.15 * (2 * Rand01() - 1);
+            r[3] = st * cos(phi); r[4] = ct; r[5] = st * sin(phi);
+        }
+        points[i] = coords_add(geometry.center, coords_set(0.22 * (2 * Rand01() - 1), 0.32 * (2 * Rand01() - 1), 0.22 * (2 * Rand01() - 1)));
+    }
+
+    double *t_lin = (double*) malloc(m->n_facets * sizeof(double));
+    double *t_bvh = (double*) malloc(m->n_facets * sizeof(double));
+    long hits = 0;
+    int inside = 0;
+    int errors = g_errors;
+    for (int i = 0; i < nrays && g_errors - errors < 5; ++i) {
+        double *r = rays + 6 * i;
+        int n_lin, n_bvh;
+        int ret_lin = LinearIntersect(t_lin, &n_lin, r, r + 3, &geometry);
+        int ret_bvh = sample_mesh_intersect(t_bvh, &n_bvh, r, r + 3, &geometry);
+        if (ret_lin != ret_bvh || n_lin != n_bvh || memcmp(t_lin, t_bvh, n_lin * sizeof(double))) {
+            printf("       %d linear hits, %d through the hierarchy\n", n_lin, n_bvh);
+            Error(res, "sample_mesh_intersect", i);
+        }
+        hits += n_lin;
+
+        int in_lin = LinearWithin(points[i], &geometry, t_lin);
+        int in_bvh = r_within_mesh(points[i], &geometry);
+        if (in_lin != in_bvh) {
+            Error(res, "r_within_mesh", i);
+        }
+        inside += in_bvh;
+    }
+
+    // timing, as Union_master calls them
+    int n;
+    t0 = BenchNow();
+    for (int i = 0; i < nrays; ++i) {
+        double *r = rays + 6 * i;
+        LinearIntersect(t_lin, &n, r, r + 3, &geometry);
+    }
+    double t_lin_total = BenchNow() - t0;
+
+    t0 = BenchNow();
+    for (int i = 0; i < nrays; ++i) {
+        double *r = rays + 6 * i;
+        sample_mesh_intersect(t_bvh, &n, r, r + 3, &geometry);
+    }
+    double t_bvh_total = BenchNow() - t0;
+
+    t0 = BenchNow();
+    for (int i = 0; i < nrays; ++i) {
+        LinearWithin(points[i], &geometry, t_lin);
+    }
+    double t_lin_within = BenchNow() - t0;
+
+    t0 = BenchNow();
+    for (int i = 0; i < nrays; ++i) {
+        r_within_mesh(points[i], &geometry);
+    }
+    double t_bvh_within = BenchNow() - t0;
+
+    printf("%6d facets, %6d nodes, build %6.2f ms, %4.2f hits/ray, %3d%% inside: intersect %8.2f / %6.3f us, within %8.2f / %6.3f us\n",
+        m->n_facets, m->bvh.n_nodes, t_build * 1000, (double) hits / nrays, 100 * inside / nrays,
+        t_lin_total / nrays * 1e6, t_bvh_total / nrays * 1e6, t_lin_within / nrays * 1e6, t_bvh_within / nrays * 1e6);
+
+    mesh_bvh_free(&m->bvh);
+    free(t_lin);
+    free(t_bvh);
+    free(points);
+    free(rays);
+    free(m);
+}
+
+
+//
+//  Shell points
+
+
+int CompareCoords(const void *a, const void *b) {
+    return memcmp(a, b, sizeof(Coords));
+}
+
+// the pairwise duplicate test mesh_shell_points used before sorting
+int PairwiseShell(mesh_storage *m, Coords *out) {
+    int n = 0;
+    for (int i = 0; i < 3 * m->n_facets; ++i) {
+        int f = i / 3;
+        Coords v = i % 3 == 0 ? coords_set(m->v1_x[f], m->v1_y[f], m->v1_z[f])
+                 : i % 3 == 1 ? coords_set(m->v2_x[f], m->v2_y[f], m->v2_z[f])
+                 : coords_set(m->v3_x[f], m->v3_y[f], m->v3_z[f]);
+        int is_duplicate = 0;
+        for (int j = 0; j < n && is_duplicate == 0; ++j) {
+            is_duplicate = v.x == out[j].x && v.y == out[j].y && v.z == out[j].z;
+        }
+        if (is_duplicate == 0) {
+            out[n++] = v;
+        }
+    }
+    return n;
+}
+
+void TestShellPoints(int res) {
+    mesh_storage *m = (mesh_storage*) calloc(1, sizeof(mesh_storage));
+    for (int c = 0; c < 4; ++c) {
+        MeshCylinder(m, 0.2 - 0.04 * c, 0.6 - 0.1 * c, res, res);
+    }
+    geometry_struct geometry = {};
+    geometry.geometry_parameters.p_mesh_storage = m;
+
+    Coords *pairwise = (Coords*) malloc(3 * m->n_facets * sizeof(Coords));
+    double t0 = BenchNow();
+    int n_pairwise = PairwiseShell(m, pairwise);
+    double t_pairwise = BenchNow() - t0;
+
+    // mesh_shell_points reports what it does on stdout
+    fflush(stdout);
+    FILE *saved = stdout;
+    stdout = fopen("/dev/null", "w");
+    t0 = BenchNow();
+    pointer_to_1d_coords_list shell = mesh_shell_points(&geometry, 0);
+    double t_sorted = BenchNow() - t0;
+    fclose(stdout);
+    stdout = saved;
+
+    // the same points, in another order
+    qsort(pairwise, n_pairwise, sizeof(Coords), CompareCoords);
+    qsort(shell.elements, shell.num_elements, sizeof(Coords), CompareCoords);
+    if (shell.num_elements != n_pairwise || memcmp(pairwise, shell.elements, n_pairwise * sizeof(Coords))) {
+        printf("ERROR: resolution %d: %d shell points, %d by pairwise comparison\n", res, shell.num_elements, n_pairwise);
+        g_errors++;
+    }
+    printf("%6d facets: %6d shell points, pairwise %8.2f ms, sorted %6.2f ms\n", m->n_facets, shell.num_elements, t_pairwise * 1000, t_sorted * 1000);
+
+    free(shell.elements);
+    free(pairwise);
+    free(m);
+}
+
+
+int main (int argc, char **argv) {
+    int nrays = argc > 1 ? atoi(argv[1]) : 2000;
+
+    int resolutions[4] = { 8, 24, 72, 78 };
+    for (int i = 0; i < 4; ++i) {
+        if (4 * (2 * resolutions[i] * resolutions[i] + 2 * resolutions[i]) > MESH_MAX_FACETS) {
+            printf("ERROR: resolution %d does not fit mesh_storage\n", resolutions[i]);
+            exit(1);
+        }
+        RunSize(resolutions[i], nrays);
+    }
+    TestShellPoints(8);
+    TestShellPoints(24);
+    TestShellPoints(72);
+
+    if (g_errors) {
+        printf("%d errors\n", g_errors);
+        exit(1);
+    }
+    printf("mesh_bvh: OK\n");
+}
@@ -0,0 +1,161 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cstdarg>
+#include <cmath>
+#include <chrono>
+
+#include "../lib/jg_baselayer.h"
+
+#include "runtime/simcore.h"
+#include "runtime/comps_meta.h"
+
+#include "runtime/monnd_runtime_config.h"
+
+
+//
+//  Monitor_nD instances specialised with --spec against the generic trace: runtime/monnd_runtime.instr is
+//  configured twice, and the same neutrons are traced through the Trace_Monitor_nD_<name> functions of one and
+//  the generic Trace_Monitor_nD (Monitor_nD_Trace of monitor_nd-lib) of the other. Counts, intensities and the
+//  neutron states after every monitor must be identical.
+
+
+static s32 g_errors = 0;
+
+#define SPEC_NEUTRONS 200000
+
+typedef void (*MonNDTraceFunc)(Monitor_nD *comp, Neutron *particle, Instrument *instrument);
+
+// indexed by component, NULL for the components that are not specialised monitors
+static MonNDTraceFunc g_specialised[] = {
+    NULL,
+    NULL,
+    Trace_Monitor_nD_mon_xy,
+    Trace_Monitor_nD_mon_l,
+    Trace_Monitor_nD_mon_disk,
+    Trace_Monitor_nD_mon_multi,
+    Trace_Monitor_nD_mon_k,
+};
+
+
+static f64 BenchNow() {
+    using namespace std::chrono;
+    return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+// traces every neutron through all components, storing its state after each, returns the time spent in the monitors
+static f64 Trace(InstrumentConfig *config, Neutron *states, bool specialised) {
+    f64 secs = 0;
+    srandom_rt(1234);
+    for (u32 k = 0; k < SPEC_NEUTRONS; ++k) {
+        Neutron n = {};
+        n._uid = k;
+        for (u32 i = 0; i < config->comps.len && n._absorb == 0; ++i) {
+            Component *comp = config->comps.arr[i];
+
+            ParticleToLocal(comp, &n);
+            Neutron saved = n;
+            if (comp->type == CT_Monitor_nD) {
+                f64 t0 = BenchNow();
+                if (specialised) {
+                    g_specialised[i]((Monitor_nD*) comp->comp, &n, &config->instr);
+                }
+                else {
+                    Trace_Monitor_nD((Monitor_nD*) comp->comp, &n, &config->instr);
+                }
+                secs += BenchNow() - t0;
+            }
+            else {
+                TraceComponent(comp, &n, &config->instr);
+            }
+            if (n._restore) {
+                n = saved;
+            }
+            else if (n._absorb == 0) {
+                ParticleToAbsolute(comp, &n);
+            }
+            states[k * config->comps.len + i] = n;
+        }
+    }
+    return secs;
+}
+
+static u32 CompareRows(double **a, double **b, u32 rows, long *lens) {
+    u32 diff = 0;
+    for (u32 r = 0; r < rows; ++r) {
+        for (long j = 0; j < lens[r]; ++j) {
+            diff += a[r][j] != b[r][j];
+        }
+    }
+    return diff;
+}
+
+static void CompareMonitor(Component *comp, Monitor_nD *spec, Monitor_nD *gen) {
+    MonitornD_Variables_type *vs = &spec->Vars;
+    MonitornD_Variables_type *vg = &gen->Vars;
+
+    // n1D: one row per coordinate, 2D: Coord_Bin[1] rows of Coord_Bin[2]
+    u32 rows = vg->Flag_Multiple ? vg->Coord_Number : vg->Coord_Bin[1];
+    long *lens = (long*) calloc(rows, sizeof(long));
+    for (u32 r = 0; r < rows; ++r) {
+        lens[r] = vg->Flag_Multiple ? vg->Coord_Bin[r + 1] : vg->Coord_Bin[2];
+    }
+
+    u32 diff = CompareRows(vs->Mon2D_N, vg->Mon2D_N, rows, lens);
+    diff += CompareRows(vs->Mon2D_p, vg->Mon2D_p, rows, lens);
+    diff += CompareRows(vs->Mon2D_p2, vg->Mon2D_p2, rows, lens);
+    free(lens);
+    if (diff || vs->Nsum != vg->Nsum || vs->psum != vg->psum || vs->p2sum != vg->p2sum || vs->Neutron_Counter != vg->Neutron_Counter) {
+        printf("ERROR: %.*s: %u bins differ, Nsum %lld / %lld, psum %g / %g, counter %lld / %lld\n",
+            comp->name.len, comp->name.str, diff, vs->Nsum, vg->Nsum, vs->psum, vg->psum, vs->Neutron_Counter, vg->Neutron_Counter);
+        g_errors++;
+    }
+    else {
+        printf("%-12.*s %-8s %lld events\n", comp->name.len, comp->name.str, vg->Flag_Multiple ? "n1D" : "2D", vg->Nsum);
+    }
+}
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    MContext *ctx = InitBaselayer();
+    cbui.ctx = ctx;
+    InstrumentConfig spec = InitAndConfig_monnd_runtime(ctx->a_life, SPEC_NEUTRONS);
+    InstrumentConfig gen = InitAndConfig_monnd_runtime(ctx->a_life, SPEC_NEUTRONS);
+    u32 ncomps = spec.comps.len;
+    if (ncomps != sizeof(g_specialised) / sizeof(MonNDTraceFunc)) {
+        printf("ERROR: %u components, %lu expected\n", ncomps, sizeof(g_specialised) / sizeof(MonNDTraceFunc));
+        exit(1);
+    }
+
+    Neutron *states_spec = (Neutron*) calloc(SPEC_NEUTRONS * ncomps, sizeof(Neutron));
+    Neutron *states_gen = (Neutron*) calloc(SPEC_NEUTRONS * ncomps, sizeof(Neutron));
+    f64 secs_spec = Trace(&spec, states_spec, true);
+    f64 secs_gen = Trace(&gen, states_gen, false);
+
+    for (u32 i = 0; i < ncomps; ++i) {
+        Component *comp = spec.comps.arr[i];
+        u32 diff = 0;
+        for (u32 k = 0; k < SPEC_NEUTRONS; ++k) {
+            diff += memcmp(states_spec + k * ncomps + i, states_gen + k * ncomps + i, sizeof(Neutron)) != 0;
+        }
+        if (diff) {
+            printf("ERROR: %.*s: %u of %u neutron states differ\n", comp->name.len, comp->name.str, diff, SPEC_NEUTRONS);
+            g_errors++;
+        }
+        if (comp->type == CT_Monitor_nD) {
+            CompareMonitor(comp, (Monitor_nD*) comp->comp, (Monitor_nD*) gen.comps.arr[i]->comp);
+        }
+    }
+    printf("monitors: %.1f ns/n specialised, %.1f ns/n generic\n", secs_spec / SPEC_NEUTRONS * 1e9, secs_gen / SPEC_NEUTRONS * 1e9);
+
+    if (g_errors) {
+        printf("monnd spec: %d errors\n", g_errors);
+        return 1;
+    }
+    printf("monnd spec: OK\n");
+}
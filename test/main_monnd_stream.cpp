@@ -0,0 +1,172 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cstdarg>
+#include <cmath>
+#include <thread>
+
+#include "../lib/jg_baselayer.h"
+
+#include "test_common.h"
+#include "runtime/simcore.h"
+#include "runtime/share/monitor_nd-lib.h"
+#include "runtime/share/monitor_nd-lib.c"
+
+
+//
+//  The Monitor_nD 'stream' option of monitor_nd-lib: several threads push events into one stream, which is
+//  closed and the .evt file read back. The header must carry the layout and, at offset 24, the event count
+//  patched in by Monitor_nD_StreamClose, and every pushed event must be in the blocks exactly once.
+//
+//  Thread t pushes events (p, x, y, t) = (1 + t, t, i, t * STREAM_KEY + i) for i = 0 .. n-1.
+
+
+#define STREAM_NCOL 4
+#define STREAM_KEY 1e7
+
+
+struct EvtHeader {
+    char magic[8];
+    s32 version;
+    s32 ncol;
+    s32 elem_size;
+    s32 block_rows;
+    char component[128];
+};
+
+static void Push(MonitornD_Stream_type *s, s32 thread, s32 nevents) {
+    for (s32 i = 0; i < nevents; ++i) {
+        double coord[STREAM_NCOL] = { 1.0 + thread, (double) thread, (double) i, thread * STREAM_KEY + i };
+        Monitor_nD_StreamPush(s, coord);
+    }
+}
+
+static void Error(const char *name, const char *what) {
+    printf("ERROR: %s: %s\n", name, what);
+    g_errors++;
+}
+
+static void TestStream(const char *name, s32 nthreads, s32 per_thread) {
+    MonitornD_Variables_type *vars = (MonitornD_Variables_type*) calloc(1, sizeof(MonitornD_Variables_type));
+    const char *cols[STREAM_NCOL] = { "p", "x", "y", "t" };
+    vars->Coord_Number = STREAM_NCOL - 1;
+    for (s32 c = 0; c < STREAM_NCOL; ++c) {
+        strcpy(vars->Coord_Var[c], cols[c]);
+    }
+    strcpy(vars->compcurname, name);
+    strcpy(vars->Mon_File, name);
+
+    MonitornD_Stream_type *s = Monitor_nD_StreamOpen(vars);
+    f64 t0 = BenchNow();
+    std::thread *threads = new std::thread[nthreads];
+    for (s32 t = 0; t < nthreads; ++t) {
+        threads[t] = std::thread(Push, s, t, per_thread);
+    }
+    for (s32 t = 0; t < nthreads; ++t) {
+        threads[t].join();
+    }
+    Monitor_nD_StreamClose(s);
+    f64 dt = BenchNow() - t0;
+    delete[] threads;
+
+    char path[256];
+    sprintf(path, "%s.evt", name);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        Error(name, "no .evt file");
+        free(vars);
+        return;
+    }
+
+    // the event count is patched in at offset 24, read it from there rather than through the struct
+    EvtHeader h = {};
+    s64 nevents_24 = -1;
+    fread(h.magic, 1, 8, f);
+    fread(&h.version, sizeof(s32), 1, f);
+    fread(&h.ncol, sizeof(s32), 1, f);
+    fread(&h.elem_size, sizeof(s32), 1, f);
+    fread(&h.block_rows, sizeof(s32), 1, f);
+    fseek(f, 24, SEEK_SET);
+    fread(&nevents_24, sizeof(s64), 1, f);
+    fread(h.component, 1, sizeof(h.component), f);
+    char colname[STREAM_NCOL][30];
+    fread(colname, 1, sizeof(colname), f);
+
+    s64 expected = (s64) nthreads * per_thread;
+    if (memcmp(h.magic, "MONNDEVT", 8) || h.version != 1 || h.ncol != STREAM_NCOL || h.elem_size != sizeof(double)
+        || h.block_rows != MONnD_STREAM_ROWS || strcmp(h.component, name)) {
+        Error(name, "bad header");
+    }
+    for (s32 c = 0; c < STREAM_NCOL; ++c) {
+        if (strcmp(colname[c], cols[c])) {
+            Error(name, "bad column name");
+        }
+    }
+    if (nevents_24 != expected) {
+        printf("       %ld events in the header, %ld pushed\n", nevents_24, expected);
+        Error(name, "event count at offset 24");
+    }
+
+    // every (thread, i) once, with the columns that go with it
+    u8 *seen = (u8*) calloc(expected, 1);
+    double *block = (double*) malloc(sizeof(double) * STREAM_NCOL * MONnD_STREAM_ROWS);
+    s64 rows = 0;
+    s64 total = 0;
+    s64 blocks = 0;
+    s64 bad = 0;
+    while (fread(&rows, sizeof(s64), 1, f) == 1) {
+        if (rows <= 0 || rows > MONnD_STREAM_ROWS || fread(block, sizeof(double), rows * STREAM_NCOL, f) != (u64) (rows * STREAM_NCOL)) {
+            Error(name, "bad block");
+            break;
+        }
+        for (s64 r = 0; r < rows; ++r) {
+            double p = block[r];
+            double x = block[rows + r];
+            double y = block[2 * rows + r];
+            double t = block[3 * rows + r];
+            s64 thread = (s64) x;
+            s64 i = (s64) y;
+            if (thread < 0 || thread >= nthreads || i < 0 || i >= per_thread || p != 1.0 + thread || t != thread * STREAM_KEY + i
+                || seen[thread * per_thread + i]) {
+                bad++;
+                continue;
+            }
+            seen[thread * per_thread + i] = 1;
+        }
+        total += rows;
+        blocks++;
+    }
+    fclose(f);
+    remove(path);
+
+    if (total != expected || bad) {
+        printf("       %ld events in %ld blocks, %ld pushed, %ld bad or repeated\n", total, blocks, expected, bad);
+        Error(name, "events read back");
+    }
+    else {
+        printf("%-20s %3d threads %9ld events in %5ld blocks, %6.1f Mevents/s\n", name, nthreads, total, blocks, total / dt / 1e6);
+    }
+    free(seen);
+    free(block);
+    free(vars);
+}
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    // several full buffers per thread, and a partial one each flushed by close
+    TestStream("monnd_stream_4", 4, 5 * MONnD_STREAM_ROWS + 123);
+
+    // more threads than private slots, the rest share the locked one
+    TestStream("monnd_stream_shared", MONnD_STREAM_NTHREAD + 8, 1000);
+
+    if (g_errors) {
+        printf("monnd stream: %d errors\n", g_errors);
+        return 1;
+    }
+    printf("monnd stream: OK\n");
+}
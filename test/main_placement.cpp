@@ -0,0 +1,67 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cstdarg>
+#include <cmath>
+
+#include "../lib/jg_baselayer.h"
+
+#include "runtime/simcore.h"
+#include "runtime/comps_meta.h"
+
+#include "runtime/placement_runtime_config.h"
+#include "runtime/placement_folded_config.h"
+
+
+//
+//  Placements on the stub runtime: runtime/placement_runtime.instr cogen'd with --nofold, so that AT and ROTATED
+//  relative to different components go through SceneGraphSetRotParent, against the same instrument cogen'd as
+//  placement_folded, where FoldPlacements computes every placement at cogen time. The world transform of each
+//  component must agree to f32 precision.
+
+
+static s32 g_errors = 0;
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    MContext *ctx = InitBaselayer();
+    cbui.ctx = ctx;
+    InstrumentConfig scene = InitAndConfig_placement_runtime(ctx->a_life, 1);
+    InstrumentConfig folded = InitAndConfig_placement_folded(ctx->a_life, 1);
+
+    if (scene.comps.len != folded.comps.len) {
+        printf("ERROR: %u and %u components\n", scene.comps.len, folded.comps.len);
+        exit(1);
+    }
+    for (u32 i = 0; i < scene.comps.len; ++i) {
+        Matrix4f *w_scene = &scene.comps.arr[i]->transform->t_world;
+        Matrix4f *w_folded = &folded.comps.arr[i]->transform->t_world;
+        f32 err = 0;
+        for (s32 r = 0; r < 3; ++r) {
+            for (s32 k = 0; k < 4; ++k) {
+                err = fmax(err, fabs(w_scene->m[r][k] - w_folded->m[r][k]));
+            }
+        }
+        if (err > 1e-5) {
+            Str name = scene.comps.arr[i]->name;
+            printf("ERROR: %.*s: world transforms differ by %g\n", name.len, name.str, err);
+            for (s32 r = 0; r < 3; ++r) {
+                printf("    %9.5f %9.5f %9.5f %9.5f    %9.5f %9.5f %9.5f %9.5f\n",
+                    w_scene->m[r][0], w_scene->m[r][1], w_scene->m[r][2], w_scene->m[r][3],
+                    w_folded->m[r][0], w_folded->m[r][1], w_folded->m[r][2], w_folded->m[r][3]);
+            }
+            g_errors++;
+        }
+    }
+
+    if (g_errors) {
+        printf("%d errors\n", g_errors);
+        exit(1);
+    }
+    printf("placement: OK\n");
+}
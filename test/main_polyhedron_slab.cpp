@@ -0,0 +1,620 @@
+#include "test_mcstas.h"
+
+#include "runtime/share/polyhedron.h"
+#include "runtime/share/polyhedron.c"
+
+
+//
+//  line_polyhedron_intersect() of polyhedron.c, which filters lines and planes with the slab test of
+//  polyhedron_slab-lib, against its per-face implementation before the slab test, which is copied below. Both are
+//  called on the same Polyhedron from form_polyhedron, then rotated and translated so that the slab faces have to
+//  follow. Polyhedra are a supermirror plate as formed by supermirror-lib, a hexagonal sample holder, a cube with
+//  cut edges and corners and a 50 face polyhedron.
+//
+//  Neutrons start outside and inside and aim at the polyhedron or near it, or graze it: through a vertex, through
+//  or along an edge, and in the plane of a face. Some skip planes, and each first intersect is followed by a call
+//  from it with the last intersect set, as supermirror-lib does. The number of intersects and their times, points,
+//  planes and types must be the same both ways. The entry and exit times of the slab test itself are checked on
+//  the clean two-intersect lines, and the time per call is reported for the per-face path, line_polyhedron_intersect
+//  and the slab test alone. Build with -fopenmp-simd to vectorise the slab loop.
+//
+//  ./polyhedron_slab [<nneutrons>]
+
+
+#define MAX_FACES 50 // the face limit of polyhedron.c
+#define MAX_EDGES 256
+#define MAX_D 1e-11 // Maximum_On_Plane_Distance of supermirror-lib
+
+
+// line_polyhedron_intersect() before the slab test: every plane is intersected and checked against the polyhedron,
+// and the intersects are kept in the lpi buffers of the polyhedron and sorted with qsort
+int baseline_line_polyhedron_intersect(double line_t, Coords line_p, Coords line_v, 
+		Polyhedron *polyhedron_in, double maximum_on_plane_distance, 
+		int num_skip_plane, int*skip_plane_number, //use 0 for int*skip_plane_number if num_skip_plane=0
+		double last_intersect_time, Coords last_intersect_point, int last_intersect_plane, 
+		//int*num_intersect below:
+		//INPUT: *num_intersect<=0: allocate output array memory; *num_intersect>0: *num_intersect=size of output array
+		//OUTPUT: number of intersects found with intersect_dtime>0. if input value==0, also output array size
+		int*num_intersect, 
+		//in the following, use 0 for variables that is not used:
+		double*intersect_dtime, Coords*intersect_dpoint, double*intersect_time, Coords*intersect_point, int*intersect_plane, int*intersect_type
+		) 
+{
+
+	if (polyhedron_in == 0) {
+		return 0;
+	}
+
+	Polyhedron*a = polyhedron_in;
+
+	if (a->nf <= 0) {
+		return 0;
+	}
+	
+	int n_intersect_found = 0;
+	
+	int i,j, is_on_inside_outside_polyhedron, is_crossing_plane=0, is_crossing_edge=0, is_crossing_vertex=0, is_flying_on_plane=0, is_flying_on_edge=0, skip; 
+	
+	double max_d = DBL_EPSILON > fabs(maximum_on_plane_distance) ? DBL_EPSILON : fabs(maximum_on_plane_distance);
+	
+	double lp_dt; //intersect dtime
+	Coords lp_dp; //intersect dspace
+	double lp_t; //intersect time absolute
+	Coords lp_p; //intersect position absolute
+
+
+	double *dtime = (double*)malloc(a->nf * sizeof(double));
+	Coords *dpoint = (Coords*)malloc(a->nf * sizeof(Coords));
+	double *time = (double*)malloc(a->nf * sizeof(double));
+	Coords *point = (Coords*)malloc(a->nf * sizeof(Coords));
+	int *plane_number = (int*)malloc(a->nf * sizeof(int));
+	int *type = (int*)malloc(a->nf * sizeof(int));
+
+	if (dtime == NULL || dpoint == NULL || time == NULL || point == NULL || plane_number == NULL || type == NULL) {
+		// Handle memory allocation failure
+		fprintf(stderr, "Memory allocation failed in line_polyhedron_intersect\n");
+		free(dtime);
+		free(dpoint);
+		free(time);
+		free(point);
+		free(plane_number);
+		free(type);
+		return 0;
+	}
+
+	//first find all the potential intersects that happens immediately or in the future.
+	LinePolyhedronIntersect *lpi = &(a->lpi);
+	for (i = 0; i < a->nf; i++) { 
+		
+		//if num_intersect > number of polyhedron faces, something's wrong.
+		if (n_intersect_found >= a->nf) { 
+			break;
+		}
+		
+		//if plane number in the skip list, skip to next plane.
+		if (skip_plane_number && num_skip_plane > 0) {
+			skip = 0;;
+			for (j = 0; j < num_skip_plane; j++) {
+				if (i == skip_plane_number[j]) { 
+					skip = 1; 
+					break;
+				}
+			}
+			if (skip) {
+				continue;
+			}
+		}
+		
+		//if line does not intersect plane, skip to next plane. 
+		if (line_plane_intersect(line_p, line_v, a->fn[i], a->fp[i], max_d, &lp_dt, &lp_dp) == 0) {
+			continue;
+		}
+		
+		//if intersect in the past, skip to next plane.
+		if (lp_dt < 0) {
+			continue;
+		}
+		lp_t = line_t + lp_dt;
+		lp_p = coords_add(line_p, lp_dp); 
+		
+		//if intersect is not on polyhedron, skip to next plane. 
+		check_point_with_respect_to_polyhedron(	&lp_p, &line_v, a, num_skip_plane, skip_plane_number, max_d, 
+												0, 0, 0, &is_on_inside_outside_polyhedron, 
+												&is_crossing_plane, &is_crossing_edge, &is_crossing_vertex, &is_flying_on_plane, &is_flying_on_edge);
+		if (is_on_inside_outside_polyhedron != 1) {
+			continue;
+		}
+		
+		//If same point, time, plane as last intersect, skip to next plane.
+		//For edge or vertex, only check time and point,
+		//for plane intersect that is neither edge or vertex, check time, point, plane
+		if (fabs(last_intersect_time - lp_t) < DBL_EPSILON && 
+			fabs(last_intersect_point.x - lp_p.x) < DBL_EPSILON && 
+			fabs(last_intersect_point.y - lp_p.y) < DBL_EPSILON && 
+			fabs(last_intersect_point.z - lp_p.z) < DBL_EPSILON && 
+			(last_intersect_plane == i || is_crossing_plane == 0)) {
+			continue;
+		}
+		
+		//If intersect already in the list, skip to next plane.
+		if (n_intersect_found > 1) {
+			skip = 0;
+			for (j = 0; j < n_intersect_found; j++) {
+				if (fabs((lpi->a_lp_t)[j] - lp_t) < DBL_EPSILON && 
+					fabs((lpi->a_lp_p)[j].x - lp_p.x) < DBL_EPSILON && 
+					fabs((lpi->a_lp_p)[j].y - lp_p.y) < DBL_EPSILON && 
+					fabs((lpi->a_lp_p)[j].z - lp_p.z) < DBL_EPSILON &&
+					((lpi->a_lp_pn)[j] == i || is_crossing_plane == 0) &&
+					fabs((lpi->a_lp_dt)[j] - lp_dt) < DBL_EPSILON && 
+					fabs((lpi->a_lp_dp)[j].x - lp_dp.x) < DBL_EPSILON && 
+					fabs((lpi->a_lp_dp)[j].y - lp_dp.y) < DBL_EPSILON && 
+					fabs((lpi->a_lp_dp)[j].z - lp_dp.z) < DBL_EPSILON) {
+					skip = 1;
+					break;
+				}
+			}
+			if (skip == 1) {
+				continue;
+			}
+		}
+		
+		//intersect point is on polyhedron, at present or in the future, and not a repeat of last intersect or a duplicated intersect.
+		//store the result of point-plane intersect in the list
+		(lpi->a_lp_dt)[n_intersect_found] = lp_dt;
+		(lpi->a_lp_dp)[n_intersect_found] = lp_dp;
+		(lpi->a_lp_t)[n_intersect_found] = lp_t;
+		(lpi->a_lp_p)[n_intersect_found] = lp_p;
+		(lpi->a_lp_pn)[n_intersect_found] = i;
+		(lpi->a_lp_ty)[n_intersect_found] = 0; //should not be 0
+		if (is_crossing_plane == 1) (lpi->a_lp_ty)[n_intersect_found] = 1;
+		if (is_crossing_edge == 1) (lpi->a_lp_ty)[n_intersect_found] = 2;
+		if (is_crossing_vertex == 1) (lpi->a_lp_ty)[n_intersect_found] = 3;
+		if (is_flying_on_plane == 1) (lpi->a_lp_ty)[n_intersect_found] = 4;
+		if (is_flying_on_edge == 1) (lpi->a_lp_ty)[n_intersect_found] = 5;
+		++(n_intersect_found);
+	}
+	
+	if (n_intersect_found == 0) {
+		//no intersect
+		*num_intersect = 0;
+		// Ensure to free the allocated memory after use
+		free(dtime);
+		free(dpoint);
+		free(time);
+		free(point);
+		free(plane_number);
+		free(type);
+		return 1;
+	}
+	
+	if (*num_intersect <= 0) {
+		//allocate memory to output array
+		intersect_dtime = (double*)calloc(n_intersect_found, sizeof(double));
+		intersect_dpoint = (Coords*)calloc(n_intersect_found, sizeof(Coords));
+		intersect_time = (double*)calloc(n_intersect_found, sizeof(double));
+		intersect_point = (Coords*)calloc(n_intersect_found, sizeof(Coords));
+		intersect_plane = (int*)calloc(n_intersect_found, sizeof(int));
+		intersect_type = (int*)calloc(n_intersect_found, sizeof(int));
+	}
+	
+	int n_output = MIN(n_intersect_found, *num_intersect);
+	
+	if (n_intersect_found == 1) {
+			if (intersect_dtime != 0) intersect_dtime[0] = (lpi->a_lp_dt)[0];
+			if (intersect_dpoint != 0) intersect_dpoint[0] = (lpi->a_lp_dp)[0];
+			if (intersect_time != 0) intersect_time[0] = (lpi->a_lp_t)[0];
+			if (intersect_point != 0) intersect_point[0] = (lpi->a_lp_p)[0];
+			if (intersect_plane != 0) intersect_plane[0] = (lpi->a_lp_pn)[0];
+			if (intersect_type != 0) intersect_type[0] = (lpi->a_lp_ty)[0]; 
+	}
+	else { //n_intersect_found > 1, sort the sequence
+		PolyhedronIndexValuePair *idp = lpi->idp;
+		Coords *a_lp_dp=lpi->a_lp_dp;
+		for (i = 0; i < n_intersect_found; i++) {
+			idp[i].index = i;
+			idp[i].value = coords_len(a_lp_dp[i]);
+		}
+		//sort the intersect list according to the distance between point and intersect |dp|
+		//sort using qsort, the order of list idp is rearranged as a result
+		qsort(idp, n_intersect_found, sizeof(idp[0]), polyhedron_qsort_compare_func);
+		
+		for (i = 0; i < n_output; i++) {
+			if (intersect_dtime != 0) intersect_dtime[i] = (lpi->a_lp_dt)[idp[i].index];
+			if (intersect_dpoint != 0) intersect_dpoint[i] = (lpi->a_lp_dp)[idp[i].index];
+			if (intersect_time != 0) intersect_time[i] = (lpi->a_lp_t)[idp[i].index];
+			if (intersect_point != 0) intersect_point[i] = (lpi->a_lp_p)[idp[i].index];
+			if (intersect_plane != 0) intersect_plane[i] = (lpi->a_lp_pn)[idp[i].index];
+			if (intersect_type != 0) intersect_type[i] = (lpi->a_lp_ty)[idp[i].index];
+		} 
+	}
+	
+	*num_intersect = n_intersect_found;
+
+
+  // Ensure to free the allocated memory after use
+  free(dtime);
+  free(dpoint);
+  free(time);
+  free(point);
+  free(plane_number);
+  free(type);
+  return 1;
+}
+
+
+struct Poly {
+    const char *name;
+    Polyhedron geo;
+    Coords center;
+    double size;
+    int nedges;
+    int edges[MAX_EDGES][2];
+};
+
+struct Hits {
+    int n;
+    double dt[MAX_FACES];
+    Coords dp[MAX_FACES];
+    double t[MAX_FACES];
+    Coords p[MAX_FACES];
+    int plane[MAX_FACES];
+    int type[MAX_FACES];
+};
+
+// vertex pairs that share two faces
+void FindEdges(Poly *p) {
+    Polyhedron *a = &p->geo;
+    p->nedges = 0;
+    for (int f = 0; f < a->nf; f++) {
+        FaceVertexIndices *fv = &a->afvi[f];
+        for (int i = 0; i < fv->nfvi; i++) {
+            for (int j = i + 1; j < fv->nfvi; j++) {
+                int v0 = fv->ifvi[i], v1 = fv->ifvi[j], shared = 0;
+                if (v0 > v1) { int tmp = v0; v0 = v1; v1 = tmp; }
+                for (int g = 0; g < a->nf; g++) {
+                    int has0 = 0, has1 = 0;
+                    for (int k = 0; k < a->afvi[g].nfvi; k++) {
+                        has0 |= a->afvi[g].ifvi[k] == v0;
+                        has1 |= a->afvi[g].ifvi[k] == v1;
+                    }
+                    shared += has0 && has1;
+                }
+                int known = 0;
+                for (int e = 0; e < p->nedges; e++) {
+                    known |= p->edges[e][0] == v0 && p->edges[e][1] == v1;
+                }
+                if (shared >= 2 && !known && p->nedges < MAX_EDGES) {
+                    p->edges[p->nedges][0] = v0;
+                    p->edges[p->nedges][1] = v1;
+                    p->nedges++;
+                }
+            }
+        }
+    }
+}
+
+void FormPoly(Poly *p, const char *name, int nf, Coords *fn, Coords *fp) {
+    p->name = name;
+    memset(&p->geo, 0, sizeof(Polyhedron));
+    if (form_polyhedron(nf, fn, fp, &p->geo) != nf) {
+        printf("polyhedron_slab: %s: form_polyhedron failed\n", name);
+        exit(1);
+    }
+}
+
+// center of the vertices, and the largest distance of a vertex from it
+void Finish(Poly *p) {
+    p->center = coords_set(0, 0, 0);
+    for (int i = 0; i < p->geo.nv; i++) {
+        p->center = coords_add(p->center, coords_scale(p->geo.vp[i], 1.0 / p->geo.nv));
+    }
+    p->size = 0;
+    for (int i = 0; i < p->geo.nv; i++) {
+        p->size = fmax(p->size, coords_len(coords_sub(p->geo.vp[i], p->center)));
+    }
+    FindEdges(p);
+}
+
+void MakePolyhedra(Poly *polys) {
+    Coords fn[MAX_FACES], fp[MAX_FACES];
+
+    // supermirror plate, 0.1 x 0.001 x 0.5 m, tilted and moved as by StdSupermirrorFlat
+    double hx = 0.05, hy = 0.0005, hz = 0.25;
+    fn[0] = coords_set(0, 1, 0);  fp[0] = coords_set(0, hy, 0);
+    fn[1] = coords_set(0, -1, 0); fp[1] = coords_set(0, -hy, 0);
+    fn[2] = coords_set(0, 0, -1); fp[2] = coords_set(0, 0, -hz);
+    fn[3] = coords_set(0, 0, 1);  fp[3] = coords_set(0, 0, hz);
+    fn[4] = coords_set(1, 0, 0);  fp[4] = coords_set(hx, 0, 0);
+    fn[5] = coords_set(-1, 0, 0); fp[5] = coords_set(-hx, 0, 0);
+    FormPoly(&polys[0], "plate", 6, fn, fp);
+    rotate_polyhedron_about_axis(&polys[0].geo, coords_set(0, 1, 0), 1.5, 0);
+    rotate_polyhedron_about_axis(&polys[0].geo, coords_set(0, 0, 1), 0.3, 0);
+    translate_polyhedron(&polys[0].geo, coords_set(0.001, 0.002, 0));
+
+    // hexagonal sample holder
+    for (int i = 0; i < 6; i++) {
+        double phi = i * M_PI / 3;
+        fn[i] = coords_set(cos(phi), 0, sin(phi));
+        fp[i] = coords_set(0.02 * cos(phi), 0, 0.02 * sin(phi));
+    }
+    fn[6] = coords_set(0, 1, 0);  fp[6] = coords_set(0, 0.03, 0);
+    fn[7] = coords_set(0, -1, 0); fp[7] = coords_set(0, -0.03, 0);
+    FormPoly(&polys[1], "hexagonal", 8, fn, fp);
+
+    // cube with cut edges and corners
+    int nf = 0;
+    for (int i = -1; i <= 1; i++) {
+        for (int j = -1; j <= 1; j++) {
+            for (int k = -1; k <= 1; k++) {
+                if (i || j || k) {
+                    Coords n = coords_set(i, j, k);
+                    coords_norm(&n);
+                    fn[nf] = n;
+                    fp[nf] = coords_scale(n, 0.03);
+                    nf++;
+                }
+            }
+        }
+    }
+    FormPoly(&polys[2], "cut cube", nf, fn, fp);
+    rotate_polyhedron_about_axis(&polys[2].geo, coords_set(1, 1, 0), 20, 0);
+
+    // 50 faces tangent to a sphere
+    for (int i = 0; i < 50; i++) {
+        double z = 1 - (2 * i + 1) / 50.0, r = sqrt(1 - z * z), phi = i * M_PI * (3 - sqrt(5.0));
+        fn[i] = coords_set(r * cos(phi), r * sin(phi), z);
+        fp[i] = coords_scale(fn[i], 0.04);
+    }
+    FormPoly(&polys[3], "50 faces", 50, fn, fp);
+
+    for (int i = 0; i < 4; i++) {
+        Finish(&polys[i]);
+    }
+}
+
+Coords RandomDir() {
+    double ct = 2 * Rand01() - 1, phi = 2 * M_PI * Rand01(), st = sqrt(1 - ct * ct);
+    return coords_set(st * cos(phi), st * sin(phi), ct);
+}
+
+// a neutron at 1000 m/s from 0.5 m upstream, or from inside, aiming at the polyhedron or just beside it
+void RandomNeutron(const Poly *p, Coords *pos, Coords *v) {
+    double s = p->size;
+    if (Rand01() < 0.1) {
+        *pos = p->center;
+    } else {
+        *pos = coords_add(p->center, coords_set((Rand01() - 0.5) * 4 * s, (Rand01() - 0.5) * 4 * s, -0.5));
+    }
+    Coords target = coords_add(p->center, coords_set((Rand01() - 0.5) * 2.4 * s, (Rand01() - 0.5) * 2.4 * s, (Rand01() - 0.5) * 2.4 * s));
+    Coords d = coords_sub(target, *pos);
+    coords_norm(&d);
+    *v = coords_scale(d, 1000);
+}
+
+// a neutron at 1000 m/s through a vertex, through or along an edge, or in the plane of a face
+void GrazingNeutron(const Poly *p, int kind, Coords *pos, Coords *v) {
+    const Polyhedron *a = &p->geo;
+    Coords x, d = RandomDir();
+    if (kind == 0) {
+        x = a->vp[(int) (Rand01() * a->nv)];
+    }
+    else if (kind == 1 || kind == 2) {
+        const int *e = p->edges[(int) (Rand01() * p->nedges)];
+        Coords v0 = a->vp[e[0]], v1 = a->vp[e[1]];
+        x = coords_add(v0, coords_scale(coords_sub(v1, v0), Rand01()));
+        if (kind == 2) {
+            d = coords_sub(v1, v0);
+            coords_norm(&d);
+        }
+    }
+    else {
+        int f = (int) (Rand01() * a->nf);
+        const FaceVertexIndices *fv = &a->afvi[f];
+        double w_sum = 0;
+        x = coords_set(0, 0, 0);
+        for (int i = 0; i < fv->nfvi; i++) {
+            double w = Rand01();
+            x = coords_add(x, coords_scale(a->vp[fv->ifvi[i]], w));
+            w_sum += w;
+        }
+        x = coords_scale(x, 1 / w_sum);
+        d = coords_sub(d, coords_scale(a->fn[f], coords_sp(d, a->fn[f])));
+        coords_norm(&d);
+    }
+    *pos = coords_sub(x, coords_scale(d, 0.3));
+    *v = coords_scale(d, 1000);
+}
+
+int Intersect(bool baseline, Poly *p, double t, Coords pos, Coords v, int nskip, int *skip, double last_t, Coords last_p, int last_plane, Hits *h) {
+    h->n = MAX_FACES;
+    if (baseline) {
+        return baseline_line_polyhedron_intersect(t, pos, v, &p->geo, MAX_D, nskip, skip, last_t, last_p, last_plane,
+            &h->n, h->dt, h->dp, h->t, h->p, h->plane, h->type);
+    }
+    return line_polyhedron_intersect(t, pos, v, &p->geo, MAX_D, nskip, skip, last_t, last_p, last_plane,
+        &h->n, h->dt, h->dp, h->t, h->p, h->plane, h->type);
+}
+
+bool SameCoords(Coords a, Coords b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+bool SameHits(const Hits *a, const Hits *b) {
+    if (a->n != b->n) {
+        return false;
+    }
+    for (int i = 0; i < a->n; i++) {
+        if (a->dt[i] != b->dt[i] || a->t[i] != b->t[i] || !SameCoords(a->dp[i], b->dp[i]) || !SameCoords(a->p[i], b->p[i])
+            || a->plane[i] != b->plane[i] || a->type[i] != b->type[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PrintHits(const char *what, const Hits *h) {
+    printf("    %s: %d intersects", what, h->n);
+    for (int i = 0; i < h->n; i++) {
+        printf(", dt %.17g plane %d type %d", h->dt[i], h->plane[i], h->type[i]);
+    }
+    printf("\n");
+}
+
+// both implementations on one line, then on the line from its first intersect; returns the number of intersects
+int CheckLine(Poly *p, Coords pos, Coords v, int nskip, int *skip, long *mismatch, long *types) {
+    Hits base, slab;
+    double t0 = 0.1;
+    Coords no_point = coords_set(9, 9, 9);
+    int ok_base = Intersect(true, p, t0, pos, v, nskip, skip, -1, no_point, -1, &base);
+    int ok_slab = Intersect(false, p, t0, pos, v, nskip, skip, -1, no_point, -1, &slab);
+    if (ok_base != ok_slab || !SameHits(&base, &slab)) {
+        if ((*mismatch)++ < 5) {
+            printf("polyhedron_slab: %s: p (%.17g, %.17g, %.17g) v (%.17g, %.17g, %.17g)\n", p->name, pos.x, pos.y, pos.z, v.x, v.y, v.z);
+            PrintHits("per face", &base);
+            PrintHits("slab", &slab);
+        }
+        return base.n;
+    }
+    for (int i = 0; i < base.n; i++) {
+        types[base.type[i]]++;
+    }
+    if (base.n > 0) {
+        Hits next_base, next_slab;
+        Coords p1 = base.p[0];
+        Intersect(true, p, base.t[0], p1, v, nskip, skip, base.t[0], p1, base.plane[0], &next_base);
+        Intersect(false, p, base.t[0], p1, v, nskip, skip, base.t[0], p1, base.plane[0], &next_slab);
+        if (!SameHits(&next_base, &next_slab)) {
+            if ((*mismatch)++ < 5) {
+                printf("polyhedron_slab: %s: from the intersect at (%.17g, %.17g, %.17g), plane %d\n", p->name, p1.x, p1.y, p1.z, base.plane[0]);
+                PrintHits("per face", &next_base);
+                PrintHits("slab", &next_slab);
+            }
+        }
+    }
+    return base.n;
+}
+
+void CheckPoly(Poly *p, long nneutrons) {
+    long mismatch = 0, hits = 0, slab_hits = 0;
+    long types[6] = {};
+    g_rng = 0x9E3779B97F4A7C15ull;
+    for (long k = 0; k < nneutrons; k++) {
+        Coords pos, v;
+        int skip[2] = { (int) (Rand01() * p->geo.nf), (int) (Rand01() * p->geo.nf) };
+        int nskip = k % 8 == 1 ? 1 + (int) (Rand01() * 2) : 0;
+        bool grazing = k % 4 == 3;
+        if (grazing) {
+            GrazingNeutron(p, (k / 4) % 4, &pos, &v);
+        }
+        else {
+            RandomNeutron(p, &pos, &v);
+        }
+        int n = CheckLine(p, pos, v, nskip, skip, &mismatch, types);
+        hits += n > 0;
+        if (grazing) {
+            continue;
+        }
+
+        // the slab test gives the entry and exit of a clean line, from inside the exit only
+        Hits h;
+        Intersect(true, p, 0, pos, v, 0, 0, -1, coords_set(9, 9, 9), -1, &h);
+        double t_in, t_out, u_in, u_out;
+        int plane_in, plane_out;
+        int hit = line_polyhedron_slab_intersect(pos, v, &p->geo, 0, &t_in, &t_out, &plane_in, &plane_out);
+        int u_hit = line_polyhedron_slab_intersect(pos, v, &p->geo, 0, &u_in, &u_out, 0, 0);
+        if (u_hit != hit || (hit && (fabs(u_in - t_in) > 1e-12 * fabs(t_in) || fabs(u_out - t_out) > 1e-12 * fabs(t_out)))) {
+            if (mismatch++ < 5) printf("polyhedron_slab: %s: simd loop %g %g != %g %g\n", p->name, u_in, u_out, t_in, t_out);
+        }
+        int inside = hit && t_in < 0;
+        bool clean = h.n == 2 - inside && h.type[0] == 1 && (h.n == 1 || (h.type[1] == 1 && (h.dt[1] - h.dt[0]) * 1000 > 1e-6));
+        if (!clean) {
+            continue;
+        }
+        slab_hits++;
+        bool ok = hit;
+        if (inside) {
+            ok = ok && fabs(h.dt[0] - t_out) <= 1e-12 && h.plane[0] == plane_out;
+        }
+        else {
+            ok = ok && fabs(h.dt[0] - t_in) <= 1e-12 && h.plane[0] == plane_in;
+            ok = ok && fabs(h.dt[1] - t_out) <= 1e-12 && h.plane[1] == plane_out;
+        }
+        if (!ok) {
+            if (mismatch++ < 5) printf("polyhedron_slab: %s: %d intersects %g (%d) %g (%d) != slab %g (%d) %g (%d)\n", p->name, h.n,
+                h.dt[0], h.plane[0], h.n > 1 ? h.dt[1] : 0, h.n > 1 ? h.plane[1] : -1, t_in, plane_in, t_out, plane_out);
+        }
+    }
+
+    // a point inside has the largest face distance below 0, one outside above 0
+    Coords in = p->center, out = coords_add(p->center, coords_set(0, 0, 2 * p->size));
+    if (!(polyhedron_slab_distance(&p->geo.slab, in.x, in.y, in.z, 0) < 0) || !(polyhedron_slab_distance(&p->geo.slab, out.x, out.y, out.z, 0) > 0)) {
+        printf("polyhedron_slab: %s: wrong face distance\n", p->name);
+        mismatch++;
+    }
+
+    // the grazing lines must have crossed edges
+    if (mismatch || hits == 0 || slab_hits == 0 || types[2] == 0) {
+        printf("polyhedron_slab: %s: %ld mismatches, %ld hits, %ld clean, types %ld %ld %ld %ld %ld\n", p->name, mismatch, hits, slab_hits,
+            types[1], types[2], types[3], types[4], types[5]);
+        g_errors++;
+    }
+}
+
+void Bench(Poly *p, long nneutrons) {
+    double check[3] = {};
+    double t[3];
+    Coords pos, v;
+    Hits h;
+
+    for (int mode = 0; mode < 3; mode++) {
+        g_rng = 0x2545F4914F6CDD1Dull;
+        double t0 = BenchNow();
+        for (long k = 0; k < nneutrons; k++) {
+            RandomNeutron(p, &pos, &v);
+            if (mode < 2) {
+                Intersect(mode == 0, p, 0, pos, v, 0, 0, -1, coords_set(9, 9, 9), -1, &h);
+                check[mode] += h.n > 0 ? h.dt[0] : 0;
+            }
+            else {
+                double t_in, t_out;
+                if (line_polyhedron_slab_intersect(pos, v, &p->geo, 0, &t_in, &t_out, 0, 0) && t_out >= 0) {
+                    check[mode] += t_in >= 0 ? t_in : t_out;
+                }
+            }
+        }
+        t[mode] = BenchNow() - t0;
+    }
+
+    if (check[0] != check[1] || fabs(check[0] - check[2]) > 1e-3 * check[0]) {
+        printf("polyhedron_slab: %s: timed sums differ %.17g, %.17g, %.17g\n", p->name, check[0], check[1], check[2]);
+        g_errors++;
+    }
+    printf("%-10s %2d faces   per face %7.1f ns   line_polyhedron_intersect %6.1f ns   speedup %5.1fx   slab test %6.1f ns\n",
+        p->name, p->geo.nf, t[0] / nneutrons * 1e9, t[1] / nneutrons * 1e9, t[0] / t[1], t[2] / nneutrons * 1e9);
+}
+
+int main (int argc, char **argv) {
+    long nneutrons = 500000;
+    if (argc > 1) {
+        nneutrons = atol(argv[1]);
+    }
+
+    static Poly polys[4];
+    MakePolyhedra(polys);
+    for (int i = 0; i < 4; i++) {
+        CheckPoly(&polys[i], 200000);
+    }
+    for (int i = 0; i < 4; i++) {
+        Bench(&polys[i], nneutrons);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        empty_polyhedron(&polys[i].geo);
+    }
+    if (g_errors) {
+        printf("polyhedron_slab: %d errors\n", g_errors);
+        exit(1);
+    }
+    printf("polyhedron_slab: OK\n");
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cstdarg>
+#include <cmath>
+#include <thread>
+
+#include "../lib/jg_baselayer.h"
+
+#include "test_common.h"
+#include "runtime/simcore.h"
+
+
+//
+//  Progress_bar of src/port on the stub runtime, traced from 4 threads: the slots must add up to every neutron
+//  once the threads have exited, including the batches they left unfinished. INITIALIZE is run a second time
+//  while the monitor thread of the first is running, as Reconfigure does, and FINALLY publishes the unfinished
+//  batch of the thread that runs it.
+
+
+static char *instrument_name = (char*) "progress_test";
+static char *dirname = NULL;
+static int mcNUMCOMP = 1;
+
+void save(FILE *) {}
+
+#include "../src/port/misc/Progress_bar.h"
+
+
+#define PB_THREADS 4
+#define PB_NEUTRONS 10000003
+
+
+static void TraceMany(Progress_bar *comp, u32 cnt) {
+    Neutron n = {};
+    for (u32 i = 0; i < cnt; ++i) {
+        Trace_Progress_bar(comp, &n, NULL);
+    }
+}
+
+static f64 TraceThreads(Progress_bar *comp) {
+    f64 t0 = BenchNow();
+    std::thread threads[PB_THREADS];
+    for (s32 i = 0; i < PB_THREADS; ++i) {
+        threads[i] = std::thread(TraceMany, comp, PB_NEUTRONS);
+    }
+    for (s32 i = 0; i < PB_THREADS; ++i) {
+        threads[i].join();
+    }
+    return BenchNow() - t0;
+}
+
+static void ExpectCount(const char *when, u64 expected) {
+    u64 n = ProgressBarCount();
+    if (n != expected) {
+        printf("ERROR: %s: %lu neutrons counted, %lu traced\n", when, n, expected);
+        g_errors++;
+    }
+}
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    Progress_bar comp = Create_Progress_bar(0, (char*) "progress");
+    mcset_ncount(PB_THREADS * PB_NEUTRONS);
+    Init_Progress_bar(&comp, NULL);
+
+    f64 dt = TraceThreads(&comp);
+    ExpectCount("after the threads exit", (u64) PB_THREADS * PB_NEUTRONS);
+    printf("%d threads: %.2f ns per neutron and thread\n", PB_THREADS, dt / PB_NEUTRONS * 1e9);
+
+    // re-initialise with the monitor thread running, which starts the count over
+    Init_Progress_bar(&comp, NULL);
+    ExpectCount("after re-initialising", 0);
+
+    TraceThreads(&comp);
+    TraceMany(&comp, 100);
+    Finally_Progress_bar(&comp);
+    ExpectCount("after FINALLY", (u64) PB_THREADS * PB_NEUTRONS + 100);
+    if (progress_bar_state.monitor.joinable()) {
+        printf("ERROR: the monitor thread is still running after FINALLY\n");
+        g_errors++;
+    }
+
+    if (g_errors) {
+        printf("progress bar: %d errors\n", g_errors);
+        return 1;
+    }
+    printf("progress bar: OK\n");
+}
@@ -0,0 +1,118 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cmath>
+
+#include "../lib/jg_baselayer.h"
+
+#include "../src/parsecore.h"
+#include "../src/parsehelpers.h"
+#include "../src/parse_comp.h"
+#include "../src/parse_instr.h"
+#include "../src/check_instr.h"
+#include "../src/emitter.h"
+#include "../src/cogen_monnd.h"
+#include "../src/cogen_fold.h"
+#include "../src/cogen_instr.h"
+
+
+//
+//  Reconfigure_<instr>: the generated dependency map, and which components and placements it re-runs.
+
+
+static s32 g_errors = 0;
+
+void Expect(Str code, const char *snippet, bool present) {
+    bool found = false;
+    for (u32 i = 0; i + strlen(snippet) <= code.len && found == false; ++i) {
+        found = strncmp(code.str + i, snippet, strlen(snippet)) == 0;
+    }
+    if (found != present) {
+        printf("ERROR: expected%s \"%s\"\n", present ? "" : " no", snippet);
+        g_errors++;
+    }
+}
+
+void TestReconfigure() {
+    const char *text =
+        "DEFINE INSTRUMENT scan_test(E = 5, angle = 30, string file = \"sample.dat\")\n"
+        "DECLARE\n"
+        "%{\n"
+        "    double lambda;\n"
+        "%}\n"
+        "INITIALIZE\n"
+        "%{\n"
+        "    lambda = 9.045 / sqrt(E);\n"
+        "%}\n"
+        "TRACE\n"
+        "COMPONENT origin = Arm() AT (0, 0, 0) ABSOLUTE\n"
+        "COMPONENT source = Source_simple(lambda0 = lambda, dlambda = 0.1) AT (0, 0, 0) RELATIVE origin\n"
+        "COMPONENT sample = PowderN(reflections = file) AT (0, 0, 2) RELATIVE origin\n"
+        "COMPONENT arm = Arm() AT (0, 0, 0) RELATIVE sample ROTATED (0, angle, 0) RELATIVE sample\n"
+        "COMPONENT detector = Monitor(xwidth = 0.1) AT (0, 0, 1) RELATIVE arm\n"
+        "END\n";
+
+    MContext *ctx = InitBaselayer();
+    HashMap comp_map = InitMap(ctx->a_life, 16);
+    MapPut(&comp_map, (u64) StrIntern(StrL("Arm")), (u64) 1);
+    MapPut(&comp_map, (u64) StrIntern(StrL("Source_simple")), (u64) 1);
+    MapPut(&comp_map, (u64) StrIntern(StrL("PowderN")), (u64) 1);
+    MapPut(&comp_map, (u64) StrIntern(StrL("Monitor")), (u64) 1);
+
+    MArena a_tmp = ArenaCreate();
+    ParseStats stats = {};
+    InstrumentParse *instr = ParseInstrument(&a_tmp, StrL(text));
+    if (instr->parse_error || CheckInstrument(&a_tmp, instr, &comp_map, &stats) == false) {
+        printf("ERROR: test instrument does not parse\n");
+        exit(1);
+    }
+
+    EmitBuff b = EmitBuffInit();
+    CogenInstrumentConfig(&b, instr);
+    Str code = EmitBuffGetStr(&b);
+
+    // E is read by INITIALIZE, which sets the declare the source uses; file goes to the sample; angle moves the arm
+    Expect(code, "static u64 scan_test_init_deps[1] = { 1ull };", true);
+    Expect(code, "    { 1ull }, // source\n", true);
+    Expect(code, "    { 4ull }, // sample\n", true);
+    Expect(code, "    { 2ull }, // arm\n", true);
+
+    // only the dependent components are re-initialised, the detector follows the arm through the scene graph
+    Expect(code, "scan_test_arg_deps[1])) {", true);
+    Expect(code, "scan_test_arg_deps[2])) {", true);
+    Expect(code, "scan_test_arg_deps[4])) {", false);
+    Expect(code, "scan_test_place_deps[3])) {", true);
+    Expect(code, "scan_test_place_deps[4])) {", false);
+    Expect(code, "        arm->transform->t_loc = ", true);
+
+    // re-initialised instances start over from their defaults, as in InitAndConfig
+    Expect(code, "        *sample_comp = Create_PowderN(sample_comp->index, sample_comp->name);\n", true);
+
+    // with --scan E, angle is folded into the placement table, and Reconfigure must refuse to change it
+    g_cogen_fold_params = true;
+    g_cogen_scan_params = StrL("E");
+    EmitBuffClear(&b);
+    CogenInstrumentConfig(&b, instr);
+    code = EmitBuffGetStr(&b);
+    g_cogen_fold_params = false;
+    g_cogen_scan_params = Str {};
+
+    Expect(code, "    assert((changed[scan_test_P_angle / 64] & (1ull << (scan_test_P_angle % 64))) == 0 && \"angle is folded into the placements\");\n", true);
+    Expect(code, "(1ull << (scan_test_P_E % 64))) == 0", false);
+}
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    TestReconfigure();
+
+    if (g_errors) {
+        printf("%d errors\n", g_errors);
+        exit(1);
+    }
+    printf("reconfigure: OK\n");
+}
@@ -0,0 +1,158 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cstdarg>
+#include <cmath>
+
+#include "../lib/jg_baselayer.h"
+
+#include "runtime/simcore.h"
+#include "runtime/comps_meta.h"
+
+#include "runtime/reconf_runtime_config.h"
+
+
+//
+//  Reconfigure_<instr> on the stub runtime: runtime/reconf_runtime.instr is configured at its defaults and then
+//  reconfigured to new parameter values, which must leave the same state as InitAndConfig at the new values.
+//  The slit width is a parameter, and Slit's Init rewrites its defaulted xmin/xmax from it, so re-running Init on
+//  the old instance would keep the old opening (or stop on the consistency check).
+//
+//  Compared are the world transforms and legacy positions, the slit opening, and the state of the same neutrons
+//  after every component, as well as the wavelength histogram.
+
+
+static s32 g_errors = 0;
+
+#define RECONF_NEUTRONS 100000
+
+
+static void SetChanged(u64 *changed, s32 param) {
+    changed[param / 64] |= 1ull << (param % 64);
+}
+
+static void SetNewValues(reconf_runtime *spec, u64 *changed) {
+    spec->lambda = 4;
+    spec->w = 0.02;
+    spec->L = 8;
+    spec->angle = 2;
+    if (changed) {
+        SetChanged(changed, reconf_runtime_P_lambda);
+        SetChanged(changed, reconf_runtime_P_w);
+        SetChanged(changed, reconf_runtime_P_L);
+        SetChanged(changed, reconf_runtime_P_angle);
+    }
+}
+
+static void Error(Component *comp, const char *what) {
+    printf("ERROR: %.*s: %s differs after Reconfigure\n", comp->name.len, comp->name.str, what);
+    g_errors++;
+}
+
+static void CompareConfigs(InstrumentConfig *fresh, InstrumentConfig *reconf) {
+    for (u32 i = 0; i < fresh->comps.len; ++i) {
+        Component *cf = fresh->comps.arr[i];
+        Component *cr = reconf->comps.arr[i];
+        ComponentHeader *hf = (ComponentHeader*) cf->comp;
+        ComponentHeader *hr = (ComponentHeader*) cr->comp;
+
+        if (memcmp(&cf->transform->t_world, &cr->transform->t_world, sizeof(Matrix4f))) {
+            Error(cf, "world transform");
+        }
+        if (memcmp(&hf->position_absolute, &hr->position_absolute, sizeof(Coords))
+            || memcmp(&hf->rotation_relative, &hr->rotation_relative, sizeof(Rotation))) {
+            Error(cf, "legacy transform");
+        }
+        if (cf->type == CT_Slit) {
+            Slit *sf = (Slit*) cf->comp;
+            Slit *sr = (Slit*) cr->comp;
+            if (sf->xmin != sr->xmin || sf->xmax != sr->xmax || sf->ymin != sr->ymin || sf->ymax != sr->ymax) {
+                printf("       fresh x [%g, %g] y [%g, %g], reconfigured x [%g, %g] y [%g, %g]\n",
+                    sf->xmin, sf->xmax, sf->ymin, sf->ymax, sr->xmin, sr->xmax, sr->ymin, sr->ymax);
+                Error(cf, "slit opening");
+            }
+        }
+    }
+}
+
+static void Trace(InstrumentConfig *config, Neutron *states) {
+    srandom_rt(1234);
+    for (u32 k = 0; k < RECONF_NEUTRONS; ++k) {
+        Neutron n = {};
+        for (u32 i = 0; i < config->comps.len && n._absorb == 0; ++i) {
+            Component *comp = config->comps.arr[i];
+
+            ParticleToLocal(comp, &n);
+            Neutron saved = n;
+            TraceComponent_reconf_runtime(comp, &n, &config->instr);
+            if (n._restore) {
+                n = saved;
+            }
+            else if (n._absorb == 0) {
+                ParticleToAbsolute(comp, &n);
+            }
+            states[k * config->comps.len + i] = n;
+        }
+    }
+}
+
+static void CompareTraces(InstrumentConfig *fresh, InstrumentConfig *reconf) {
+    u32 ncomps = fresh->comps.len;
+    Neutron *states_fresh = (Neutron*) calloc(RECONF_NEUTRONS * ncomps, sizeof(Neutron));
+    Neutron *states_reconf = (Neutron*) calloc(RECONF_NEUTRONS * ncomps, sizeof(Neutron));
+    Trace(fresh, states_fresh);
+    Trace(reconf, states_reconf);
+
+    for (u32 i = 0; i < ncomps; ++i) {
+        u32 diff = 0;
+        for (u32 k = 0; k < RECONF_NEUTRONS; ++k) {
+            diff += memcmp(states_fresh + k * ncomps + i, states_reconf + k * ncomps + i, sizeof(Neutron)) != 0;
+        }
+        if (diff) {
+            printf("       %u of %u neutrons\n", diff, RECONF_NEUTRONS);
+            Error(fresh->comps.arr[i], "neutron state");
+        }
+
+        Component *comp = fresh->comps.arr[i];
+        if (comp->type == CT_L_monitor) {
+            L_monitor *mf = (L_monitor*) comp->comp;
+            L_monitor *mr = (L_monitor*) reconf->comps.arr[i]->comp;
+            if (memcmp(mf->L_N, mr->L_N, sizeof(f64) * mf->nL) || memcmp(mf->L_p, mr->L_p, sizeof(f64) * mf->nL)) {
+                Error(comp, "histogram");
+            }
+        }
+    }
+    free(states_fresh);
+    free(states_reconf);
+}
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    MContext *ctx = InitBaselayer();
+    cbui.ctx = ctx;
+
+    // the instrument parameters are a static of the config, set them before each configuration
+    reconf_runtime_var = reconf_runtime {};
+    SetNewValues(&reconf_runtime_var, NULL);
+    InstrumentConfig fresh = InitAndConfig_reconf_runtime(ctx->a_life, RECONF_NEUTRONS);
+
+    u64 changed[(reconf_runtime_P_CNT + 63) / 64] = {};
+    reconf_runtime_var = reconf_runtime {};
+    InstrumentConfig reconf = InitAndConfig_reconf_runtime(ctx->a_life, RECONF_NEUTRONS);
+    SetNewValues(&reconf_runtime_var, changed);
+    Reconfigure_reconf_runtime(&reconf, changed);
+
+    CompareConfigs(&fresh, &reconf);
+    CompareTraces(&fresh, &reconf);
+
+    if (g_errors) {
+        printf("reconfigure runtime: %d errors\n", g_errors);
+        return 1;
+    }
+    printf("reconfigure runtime: OK\n");
+}
@@ -0,0 +1,357 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cstdarg>
+#include <cstdint>
+#include <cmath>
+
+#include "../lib/jg_baselayer.h"
+
+#include "test_common.h"
+#include "runtime/simcore.h"
+#include "runtime/crystal/comps_shared.h"
+#include "runtime/crystal/comps/Single_crystal.h"
+
+
+//
+//  Single_crystal of runtime/sx_runtime.instr, cogen'd: hkl_search_grid on the refl_grid that INITIALIZE builds
+//  against the sorted list scan of hkl_search. Lists are the Na2Ca3Al2F14.laz calibration sample from
+//  mcstas-comps/data, or any .lau/.laz given on the command line, and P1 protein cells with every hkl down to d_min.
+//  The stub runtime can not read data files, so the lists are filled as read_hkl_data fills them for an isotropic
+//  mosaic, and sorted with SX_list_compare.
+//
+//  Both searches must store the same tau_data through hkl_tau_store, in the same order, with the same sums of
+//  the coherent intensity and cross section. hkl_tau_store must put the centre of the Gauss of a reflection on
+//  the Ewald sphere when ki meets the Bragg condition, and drop its intensity off it. The time per search, with
+//  the tau_data of the found reflections, is reported for the short list of MCSX_REFL_SLIST_SIZE; INITIALIZE only
+//  builds the grid from MCSX_REFL_GRID_MIN reflections, so the short .laz list stays with hkl_search.
+//
+//  ./refl_grid [<nsearch> [<file.lau>]]
+
+
+#define BRAGG_CHECKS 200
+#define BRAGG_SHORT_TAU 500
+
+
+struct List {
+    int n;
+    int max;
+    struct hkl_data *r;
+    struct hkl_info_struct info;
+};
+
+// reciprocal axes and volume of a direct cell given by lengths and angles, as read_hkl_data does
+void ListCell(List *L, double a, double b, double c, double aa, double bb, double cc) {
+    struct hkl_info_struct *info = &L->info;
+    double d2r = M_PI / 180;
+    info->m_ax = 0;
+    info->m_ay = b * sin(cc * d2r);
+    info->m_az = b * cos(cc * d2r);
+    info->m_bx = 0;
+    info->m_by = 0;
+    info->m_bz = a;
+    info->m_cz = c * cos(bb * d2r);
+    info->m_cy = c * (cos(aa * d2r) - cos(cc * d2r) * cos(bb * d2r)) / sin(cc * d2r);
+    info->m_cx = sqrt(c * c - info->m_cz * info->m_cz - info->m_cy * info->m_cy);
+
+    double bxc[3], cxa[3], axb[3];
+    vec_prod(bxc[0], bxc[1], bxc[2], info->m_bx, info->m_by, info->m_bz, info->m_cx, info->m_cy, info->m_cz);
+    vec_prod(cxa[0], cxa[1], cxa[2], info->m_cx, info->m_cy, info->m_cz, info->m_ax, info->m_ay, info->m_az);
+    vec_prod(axb[0], axb[1], axb[2], info->m_ax, info->m_ay, info->m_az, info->m_bx, info->m_by, info->m_bz);
+    info->V0 = fabs(scalar_prod(info->m_ax, info->m_ay, info->m_az, bxc[0], bxc[1], bxc[2]));
+    info->asx = 2 * PI / info->V0 * bxc[0]; info->asy = 2 * PI / info->V0 * bxc[1]; info->asz = 2 * PI / info->V0 * bxc[2];
+    info->bsx = 2 * PI / info->V0 * cxa[0]; info->bsy = 2 * PI / info->V0 * cxa[1]; info->bsz = 2 * PI / info->V0 * cxa[2];
+    info->csx = 2 * PI / info->V0 * axb[0]; info->csy = 2 * PI / info->V0 * axb[1]; info->csz = 2 * PI / info->V0 * axb[2];
+}
+
+// one reflection with the local axes, Gauss and cutoff of read_hkl_data for an isotropic mosaic [arc min]
+void ListAdd(List *L, int h, int k, int l, double F2, double mosaic) {
+    if (L->n == L->max) {
+        L->max = L->max ? 2 * L->max : 1024;
+        L->r = (struct hkl_data*) realloc(L->r, L->max * sizeof(struct hkl_data));
+    }
+    struct hkl_info_struct *info = &L->info;
+    struct hkl_data *r = L->r + L->n++;
+    memset(r, 0, sizeof(struct hkl_data));
+    r->h = h;
+    r->k = k;
+    r->l = l;
+    r->F2 = F2;
+    r->tau_x = h * info->asx + k * info->bsx + l * info->csx;
+    r->tau_y = h * info->asy + k * info->bsy + l * info->csy;
+    r->tau_z = h * info->asz + k * info->bsz + l * info->csz;
+    r->tau = sqrt(r->tau_x * r->tau_x + r->tau_y * r->tau_y + r->tau_z * r->tau_z);
+    r->u1x = r->tau_x / r->tau;
+    r->u1y = r->tau_y / r->tau;
+    r->u1z = r->tau_z / r->tau;
+
+    double b1[3], b2[3];
+    normal_vec(&b1[0], &b1[1], &b1[2], r->u1x, r->u1y, r->u1z);
+    vec_prod(b2[0], b2[1], b2[2], r->u1x, r->u1y, r->u1z, b1[0], b1[1], b1[2]);
+    r->u2x = b1[0]; r->u2y = b1[1]; r->u2z = b1[2];
+    r->u3x = b2[0]; r->u3y = b2[1]; r->u3z = b2[2];
+
+    double sig1 = FWHM2RMS * info->m_delta_d_d * r->tau;
+    double sig2 = FWHM2RMS * r->tau * MIN2RAD * mosaic;
+    double sig3 = sig2;
+    r->sig123 = sig1 * sig2 * sig3;
+    r->m1 = 1 / (2 * sig1 * sig1);
+    r->m2 = 1 / (2 * sig2 * sig2);
+    r->m3 = 1 / (2 * sig3 * sig3);
+    r->cutoff = 5 * (sig1 > sig2 ? sig1 : sig2);
+}
+
+// every hkl of a P1 cell with d >= d_min, with structure factors that vary along the list
+void ListProtein(List *L, double a, double b, double c, double aa, double bb, double cc, double d_min, double mosaic) {
+    ListCell(L, a, b, c, aa, bb, cc);
+    double tau_max = 2 * PI / d_min;
+    int hm = (int) (a / d_min) + 1, km = (int) (b / d_min) + 1, lm = (int) (c / d_min) + 1;
+    for (int h = -hm; h <= hm; ++h) {
+        for (int k = -km; k <= km; ++k) {
+            for (int l = -lm; l <= lm; ++l) {
+                if (h == 0 && k == 0 && l == 0) {
+                    continue;
+                }
+                ListAdd(L, h, k, l, 1 + (abs(h) + 2 * abs(k) + 3 * abs(l)) % 5, mosaic);
+                if (L->r[L->n - 1].tau > tau_max) {
+                    L->n--;
+                }
+            }
+        }
+    }
+}
+
+// h k l and |F| from a .lau/.laz, cell from its '# CELL' or '# lattice_a' and the |F| column from '# column_F'
+bool ListFile(List *L, const char *path, double mosaic) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    double cell[6] = { 0, 0, 0, 90, 90, 90 };
+    bool have_cell = false;
+    int column_F = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') {
+            if (sscanf(line, "# CELL %lf %lf %lf %lf %lf %lf", cell, cell + 1, cell + 2, cell + 3, cell + 4, cell + 5) >= 3) {
+                have_cell = true;
+            }
+            else if (sscanf(line, "# lattice_a %lf", cell) == 1) {
+                cell[1] = cell[2] = cell[0];
+                have_cell = true;
+            }
+            sscanf(line, "# column_F %d", &column_F);
+            continue;
+        }
+        double col[32];
+        int ncol = 0;
+        char *s = line, *end;
+        while (ncol < 32) {
+            col[ncol] = strtod(s, &end);
+            if (end == s) {
+                break;
+            }
+            ncol++;
+            s = end;
+        }
+        if (ncol >= 3) {
+            if (have_cell && L->n == 0) {
+                ListCell(L, cell[0], cell[1], cell[2], cell[3], cell[4], cell[5]);
+            }
+            double F = column_F > 0 && column_F <= ncol ? col[column_F - 1] : 1;
+            ListAdd(L, (int) col[0], (int) col[1], (int) col[2], F * F, mosaic);
+        }
+    }
+    fclose(f);
+    return have_cell && L->n > 0;
+}
+
+// the reflection list as INITIALIZE leaves it: sorted by tau, and the grid over it
+double ListGrid(List *L, refl_grid *grid) {
+    qsort(L->r, L->n, sizeof(struct hkl_data), SX_list_compare);
+    double t0 = BenchNow();
+    grid->n = 0;
+    if (refl_grid_build(grid, L->n, &L->r[0].tau_x, &L->r[0].tau_y, &L->r[0].tau_z,
+            &L->r[0].tau, &L->r[0].cutoff, sizeof(struct hkl_data)) == 0) {
+        printf("ERROR: could not build the reflection grid\n");
+        g_errors++;
+    }
+    return BenchNow() - t0;
+}
+
+// the tau_max of TRACE
+double TauMax(List *L, double *ki) {
+    return 2 * sqrt(ki[0] * ki[0] + ki[1] * ki[1] + ki[2] * ki[2]) / (1 - 5 * L->info.m_delta_d_d);
+}
+
+// ki on the Bragg condition of reflection i: tau/2 plus a random vector normal to tau, so that |ki - tau| = |ki|
+void BraggKi(struct hkl_data *r, double *ki) {
+    double ct = 2 * Rand01() - 1, phi = 2 * M_PI * Rand01(), st = sqrt(1 - ct * ct);
+    double n[3] = { st * cos(phi), st * sin(phi), ct };
+    double along = scalar_prod(n[0], n[1], n[2], r->u1x, r->u1y, r->u1z);
+    n[0] -= along * r->u1x;
+    n[1] -= along * r->u1y;
+    n[2] -= along * r->u1z;
+    NORM(n[0], n[1], n[2]);
+    double p = r->tau * (0.2 + Rand01());
+    ki[0] = r->tau_x / 2 + p * n[0];
+    ki[1] = r->tau_y / 2 + p * n[1];
+    ki[2] = r->tau_z / 2 + p * n[2];
+}
+
+// the tau_data of reflection i in a short list, NULL if it is not there
+struct tau_data *FindTau(struct tau_data *T, int count, int i) {
+    for (int j = 0; j < count; ++j) {
+        if (T[j].index == i) {
+            return T + j;
+        }
+    }
+    return NULL;
+}
+
+// hkl_tau_store on and off the Bragg condition of reflections of the list
+void TestTauStore(const char *name, List *L) {
+    static struct tau_data T[MCSX_REFL_SLIST_SIZE];
+    int checked = 0, errors = 0;
+    for (int c = 0; c < BRAGG_CHECKS && errors < 5; ++c) {
+        // among the short tau, which the short list reaches before it is full
+        int i = (int) (Rand01() * (L->n < BRAGG_SHORT_TAU ? L->n : BRAGG_SHORT_TAU));
+        struct hkl_data *r = L->r + i;
+        double ki[3];
+        BraggKi(r, ki);
+        double coh_refl = 0, coh_xsect = 0;
+        int count = hkl_search(L->r, T, L->n, L->info.V0, ki[0], ki[1], ki[2], TauMax(L, ki), &coh_refl, &coh_xsect);
+        struct tau_data *stored = FindTau(T, count, i);
+        if (stored == NULL) {
+            // a full short list
+            continue;
+        }
+        struct tau_data on = *stored;
+        checked++;
+
+        // the tangent plane touches the Gauss at its centre: no offset, and the peak intensity
+        double k = sqrt(scalar_prod(ki[0], ki[1], ki[2], ki[0], ki[1], ki[2]));
+        double peak = pow(2 * PI, 5.0 / 2.0) / (L->info.V0 * k * k) * on.l11 * on.l22 / r->sig123;
+        double offset = sqrt(on.ox * on.ox + on.oy * on.oy + on.oz * on.oz);
+        bool ok = offset < 1e-9 * r->tau && fabs(on.refl - peak) <= 1e-9 * peak && on.xsect == on.refl * r->F2
+            && fabs(on.rho - k) < 1e-9 * k && fabs(scalar_prod(on.b1x, on.b1y, on.b1z, on.b2x, on.b2y, on.b2z)) < 1e-9;
+
+        // a quarter of the cutoff further out along ki, the intensity drops
+        double s = 1 + 0.25 * r->cutoff / k;
+        double ko[3] = { ki[0] * s, ki[1] * s, ki[2] * s };
+        coh_refl = coh_xsect = 0;
+        count = hkl_search(L->r, T, L->n, L->info.V0, ko[0], ko[1], ko[2], TauMax(L, ko), &coh_refl, &coh_xsect);
+        struct tau_data *off = FindTau(T, count, i);
+        ok = ok && off != NULL && off->refl > 0 && off->refl < peak;
+        if (ok == false) {
+            printf("ERROR: %s: hkl_tau_store of reflection %d (%d %d %d): offset %g, refl %g for a peak of %g, %g off Bragg\n",
+                name, i, r->h, r->k, r->l, offset, on.refl, peak, off ? off->refl : -1.0);
+            errors++;
+        }
+    }
+    if (checked < BRAGG_CHECKS / 2) {
+        printf("ERROR: %s: only %d of %d reflections found on their Bragg condition\n", name, checked, BRAGG_CHECKS);
+        errors++;
+    }
+    g_errors += errors;
+}
+
+void RunList(const char *name, List *L, int nsearch) {
+    refl_grid grid;
+    double t_build = ListGrid(L, &grid);
+    TestTauStore(name, L);
+
+    // ki in random directions, 0.7 to 5 AA
+    double *k = (double*) malloc(nsearch * 3 * sizeof(double));
+    for (int i = 0; i < nsearch; ++i) {
+        double ct = 2 * Rand01() - 1, phi = 2 * M_PI * Rand01(), st = sqrt(1 - ct * ct);
+        double ki = 2 * M_PI / (0.7 + 4.3 * Rand01());
+        k[3 * i] = ki * st * cos(phi); k[3 * i + 1] = ki * st * sin(phi); k[3 * i + 2] = ki * ct;
+    }
+
+    static struct tau_data T_lin[MCSX_REFL_SLIST_SIZE], T_grid[MCSX_REFL_SLIST_SIZE];
+    long found = 0;
+    int mismatches = 0;
+    for (int i = 0; i < nsearch && mismatches < 5; ++i) {
+        double *ki = k + 3 * i;
+        double refl_lin = 0, xsect_lin = 0, refl_grid = 0, xsect_grid = 0;
+        int n_lin = hkl_search(L->r, T_lin, L->n, L->info.V0, ki[0], ki[1], ki[2], TauMax(L, ki), &refl_lin, &xsect_lin);
+        int n_grid = hkl_search_grid(L->r, &grid, T_grid, L->info.V0, ki[0], ki[1], ki[2], TauMax(L, ki), &refl_grid, &xsect_grid);
+        bool same = n_lin == n_grid && memcmp(T_lin, T_grid, n_lin * sizeof(struct tau_data)) == 0
+            && refl_lin == refl_grid && xsect_lin == xsect_grid;
+        if (same == false) {
+            printf("ERROR: %s search %d: %d reflections from the list, %d from the grid, coh_refl %g / %g, coh_xsect %g / %g\n",
+                name, i, n_lin, n_grid, refl_lin, refl_grid, xsect_lin, xsect_grid);
+            mismatches++;
+        }
+        found += n_lin;
+    }
+    g_errors += mismatches;
+
+    double t0 = BenchNow();
+    double sink_lin = 0, sink_grid = 0;
+    for (int i = 0; i < nsearch; ++i) {
+        double *ki = k + 3 * i;
+        double coh_refl = 0, coh_xsect = 0;
+        hkl_search(L->r, T_lin, L->n, L->info.V0, ki[0], ki[1], ki[2], TauMax(L, ki), &coh_refl, &coh_xsect);
+        sink_lin += coh_xsect;
+    }
+    double t_lin = BenchNow() - t0;
+
+    t0 = BenchNow();
+    for (int i = 0; i < nsearch; ++i) {
+        double *ki = k + 3 * i;
+        double coh_refl = 0, coh_xsect = 0;
+        hkl_search_grid(L->r, &grid, T_grid, L->info.V0, ki[0], ki[1], ki[2], TauMax(L, ki), &coh_refl, &coh_xsect);
+        sink_grid += coh_xsect;
+    }
+    double t_grid = BenchNow() - t0;
+    if (sink_lin != sink_grid) {
+        printf("ERROR: %s: cross sections differ in the timing loop\n", name);
+        g_errors++;
+    }
+
+    printf("%-22s %7d reflections, grid %2dx%2dx%2d, build %6.2f ms, %6.2f refl/search: hkl_search %8.2f us, hkl_search_grid %6.2f us, %5.1fx\n",
+        name, L->n, grid.nx, grid.ny, grid.nz, t_build * 1000, (double) found / nsearch,
+        t_lin / nsearch * 1e6, t_grid / nsearch * 1e6, t_lin / t_grid);
+
+    refl_grid_free(&grid);
+    free(k);
+}
+
+
+int main (int argc, char **argv) {
+    int nsearch = argc > 1 ? atoi(argv[1]) : 2000;
+    const char *file = argc > 2 ? argv[2] : "../mcstas-comps/data/Na2Ca3Al2F14.laz";
+
+    // delta_d_d and mosaic of the Single_crystal examples
+    double delta_d_d = 1e-4, mosaic = 5;
+
+    List L = {};
+    L.info.m_delta_d_d = delta_d_d;
+    if (ListFile(&L, file, mosaic)) {
+        RunList(strrchr(file, '/') ? strrchr(file, '/') + 1 : file, &L, nsearch);
+    }
+    else {
+        printf("ERROR: could not read h k l and a cell from %s\n", file);
+        g_errors++;
+    }
+
+    // lysozyme sized cell at 2.5 and 1.8 AA, and a larger one at 1.5 AA
+    double cells[3][7] = { { 79.1, 79.1, 37.9, 90, 90, 90, 2.5 }, { 79.1, 79.1, 37.9, 90, 90, 90, 1.8 }, { 120, 95, 70, 90, 100, 90, 1.5 } };
+    for (int i = 0; i < 3; ++i) {
+        char name[64];
+        L.n = 0;
+        ListProtein(&L, cells[i][0], cells[i][1], cells[i][2], cells[i][3], cells[i][4], cells[i][5], cells[i][6], mosaic);
+        snprintf(name, sizeof(name), "P1 %gx%gx%g %gA", cells[i][0], cells[i][1], cells[i][2], cells[i][6]);
+        RunList(name, &L, nsearch);
+    }
+    free(L.r);
+
+    if (g_errors) {
+        printf("refl_grid: %d errors\n", g_errors);
+        exit(1);
+    }
+    printf("refl_grid: OK\n");
+}
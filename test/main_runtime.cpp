@@ -0,0 +1,113 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cstdarg>
+#include <cmath>
+#include <chrono>
+
+#include "../lib/jg_baselayer.h"
+
+#include "runtime/simcore.h"
+#include "runtime/comps_meta.h"
+
+
+//
+//  Traces neutrons through a cogen'd instrument on the stub runtime, and reports neutrons/s overall and per
+//  component. Neutrons are traced in batches, one component at a time across the batch, so every component is
+//  timed with a single clock pair per batch.
+//
+//  ./runtime_bench [<ncount>]
+//
+//  The instrument is runtime/bench_runtime.instr by default, or any other cogen'd config with
+//      -DBENCH_INSTR=<name> -DBENCH_CONFIG_H='"runtime/<name>_config.h"'
+
+
+#ifndef BENCH_INSTR
+#define BENCH_INSTR bench_runtime
+#define BENCH_CONFIG_H "runtime/bench_runtime_config.h"
+#endif
+
+#include BENCH_CONFIG_H
+
+#define _BENCH_CAT(a, b) a##b
+#define BENCH_CAT(a, b) _BENCH_CAT(a, b)
+#define BENCH_INIT BENCH_CAT(InitAndConfig_, BENCH_INSTR)
+
+
+#define BENCH_BATCH 4096
+
+
+static f64 BenchNow() {
+    using namespace std::chrono;
+    return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct CompBench {
+    f64 secs;
+    u64 entered;
+    u64 absorbed;
+};
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    u64 ncount = argc > 1 ? (u64) atoll(argv[1]) : 1000000;
+
+    MContext *ctx = InitBaselayer();
+    cbui.ctx = ctx;
+    InstrumentConfig config = BENCH_INIT(ctx->a_life, ncount);
+    Instrument *instr = &config.instr;
+    u32 ncomps = config.comps.len;
+
+    CompBench *stats = (CompBench*) ArenaAlloc(ctx->a_life, sizeof(CompBench) * ncomps);
+    Neutron *batch = (Neutron*) ArenaAlloc(ctx->a_life, sizeof(Neutron) * BENCH_BATCH);
+
+    f64 t0 = BenchNow();
+    for (u64 done = 0; done < ncount; done += BENCH_BATCH) {
+        u32 cnt = (u32) (ncount - done < BENCH_BATCH ? ncount - done : BENCH_BATCH);
+        memset(batch, 0, sizeof(Neutron) * cnt);
+
+        for (u32 i = 0; i < ncomps; ++i) {
+            Component *comp = config.comps.arr[i];
+            CompBench *s = stats + i;
+
+            f64 tc = BenchNow();
+            for (u32 k = 0; k < cnt; ++k) {
+                Neutron *n = batch + k;
+                if (n->_absorb) {
+                    continue;
+                }
+                s->entered++;
+
+                ParticleToLocal(comp, n);
+                Neutron saved = *n;
+                TraceComponent(comp, n, instr);
+                if (n->_restore) {
+                    *n = saved;
+                }
+                else if (n->_absorb) {
+                    s->absorbed++;
+                    continue;
+                }
+                ParticleToAbsolute(comp, n);
+            }
+            s->secs += BenchNow() - tc;
+        }
+    }
+    f64 dt = BenchNow() - t0;
+
+    printf("%s: %lu neutrons in %.3f s, %.3f Mn/s\n", instr->name, ncount, dt, ncount / dt / 1e6);
+    printf("\n%-16s %-16s %12s %12s %10s %8s\n", "component", "type", "entered", "absorbed", "ns/n", "share");
+    for (u32 i = 0; i < ncomps; ++i) {
+        Component *comp = config.comps.arr[i];
+        CompBench *s = stats + i;
+        f64 ns = s->entered ? s->secs / s->entered * 1e9 : 0;
+        printf("%-16.*s %-16.*s %12lu %12lu %10.2f %7.1f%%\n",
+            comp->name.len, comp->name.str, comp->type_name.len, comp->type_name.str,
+            s->entered, s->absorbed, ns, s->secs / dt * 100);
+    }
+}
@@ -0,0 +1,194 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+
+#include "test_common.h"
+
+#include "../mcstas-comps/share/sas_iq_table-lib.h"
+#include "../mcstas-comps/share/sas_iq_table-lib.c"
+
+
+//
+//  SasView I(q) table against direct evaluation of an orientation averaged cylinder, the kernel of
+//  SasView_cylinder with its 76 point Gauss-Legendre integral, for a monodisperse and a polydisperse sample.
+//  The interpolated table must stay close to the size averaged I(q) at random q, and the time to build the
+//  table and per neutron, direct with random sizes as in TRACE or interpolated, is reported. Build with
+//  -fopenmp to time the parallel table build.
+//
+//  ./sas_iq_table [<nsamples>]
+
+
+#define GAUSS_N 76
+
+
+static double g_gauss_z[GAUSS_N];
+static double g_gauss_w[GAUSS_N];
+
+double RandNorm() {
+    return sqrt(-2 * log(Rand01Open())) * cos(2 * M_PI * Rand01Open());
+}
+
+// Gauss-Legendre nodes and weights on [-1, 1]
+void GaussLegendre(int n, double *z, double *w) {
+    for (int i = 0; i < n; i++) {
+        double x = cos(M_PI * (i + 0.75) / (n + 0.5));
+        double dp = 1;
+        for (int it = 0; it < 100; it++) {
+            double p0 = 1, p1 = x;
+            for (int k = 2; k <= n; k++) {
+                double p2 = ((2 * k - 1) * x * p1 - (k - 1) * p0) / k;
+                p0 = p1;
+                p1 = p2;
+            }
+            dp = n * (x * p1 - p0) / (x * x - 1);
+            double dx = p1 / dp;
+            x -= dx;
+            if (fabs(dx) < 1e-15) break;
+        }
+        z[i] = x;
+        w[i] = 2 / ((1 - x * x) * dp * dp);
+    }
+}
+
+// <F^2> of a cylinder over orientations, as Fq_cylinder
+double CylinderF2(double q, double sld, double sld_solvent, double radius, double length) {
+    const double zm = M_PI_4;
+    const double zb = M_PI_4;
+    double total = 0;
+    for (int i = 0; i < GAUSS_N; i++) {
+        double theta = g_gauss_z[i] * zm + zb;
+        double s = sin(theta), c = cos(theta);
+        double qab = q * s * radius;
+        double qc = q * c * 0.5 * length;
+        double fab = qab == 0 ? 1 : 2 * j1(qab) / qab;
+        double fc = qc == 0 ? 1 : sin(qc) / qc;
+        double form = fab * fc;
+        total += g_gauss_w[i] * form * form * s;
+    }
+    double v = (sld - sld_solvent) * M_PI * radius * radius * length;
+    return 1e-4 * v * v * total * zm;
+}
+
+// the Iq_table_<model> helper of the comps
+double CylinderTable(double q, double sld, double sld_solvent, double radius, double length,
+    double pd_radius, double pd_length)
+{
+    double s_radius[SAS_IQ_TABLE_PD_N], w_radius[SAS_IQ_TABLE_PD_N];
+    double s_length[SAS_IQ_TABLE_PD_N], w_length[SAS_IQ_TABLE_PD_N];
+    int n_pd = (pd_radius != 0) + (pd_length != 0);
+    int n_radius = sas_iq_table_pd_nodes(pd_radius, n_pd, s_radius, w_radius);
+    int n_length = sas_iq_table_pd_nodes(pd_length, n_pd, s_length, w_length);
+    double sum = 0;
+    for (int i = 0; i < n_radius; i++) {
+        for (int j = 0; j < n_length; j++) {
+            sum += w_radius[i] * w_length[j] * CylinderF2(q, sld, sld_solvent, s_radius[i] * radius, s_length[j] * length);
+        }
+    }
+    return sum;
+}
+
+void RunCase(const char *name, double pd, long nsamples) {
+    double sld = 4, sld_solvent = 1, radius = 20, length = 400;
+    double q_min = 1e-3, q_max = 0.5, tol = 1e-3;
+
+    double t0 = BenchNow();
+    sas_iq_table table;
+    if (!sas_iq_table_init(&table, q_min, q_max, tol)) {
+        printf("sas_iq_table: %s: init failed\n", name);
+        g_errors++;
+        return;
+    }
+    double *table_q, *table_iq;
+    long table_n;
+    long evals = 0;
+    while ((table_n = sas_iq_table_pending(&table, &table_q, &table_iq))) {
+        #pragma omp parallel for schedule(dynamic)
+        for (long i = 0; i < table_n; i++) {
+            table_iq[i] = CylinderTable(table_q[i], sld, sld_solvent, radius, length, pd, pd);
+        }
+        evals += table_n;
+        sas_iq_table_update(&table);
+    }
+    double t_build = BenchNow() - t0;
+
+    // interpolation error at random q, log uniform over the table
+    double iq_max = 0;
+    for (long i = 0; i < table.n; i++) {
+        if (table.iq[i] > iq_max) iq_max = table.iq[i];
+    }
+    double err_max = 0;
+    g_rng = 0x9E3779B97F4A7C15ull;
+    for (long i = 0; i < 2000; i++) {
+        double q = q_min * pow(q_max / q_min, Rand01Open());
+        double iq, ref = CylinderTable(q, sld, sld_solvent, radius, length, pd, pd);
+        if (!sas_iq_table_lookup(&table, q, &iq)) {
+            printf("sas_iq_table: %s: q=%g not in table\n", name, q);
+            g_errors++;
+            break;
+        }
+        double err = fabs(iq - ref) / (fabs(ref) + SAS_IQ_TABLE_FLOOR * iq_max);
+        if (err > err_max) err_max = err;
+    }
+    if (err_max > 10 * tol) {
+        printf("sas_iq_table: %s: interpolation error %g above %g\n", name, err_max, 10 * tol);
+        g_errors++;
+    }
+    double iq;
+    if (sas_iq_table_lookup(&table, 0.5 * q_min, &iq) || sas_iq_table_lookup(&table, 2 * q_max, &iq)) {
+        printf("sas_iq_table: %s: out of range q found in table\n", name);
+        g_errors++;
+    }
+
+    // per neutron: random sizes and the kernel, as TRACE does without table
+    double check = 0;
+    g_rng = 0x2545F4914F6CDD1Dull;
+    t0 = BenchNow();
+    for (long i = 0; i < nsamples; i++) {
+        double q = q_min * pow(q_max / q_min, Rand01Open());
+        double r = radius, l = length;
+        if (pd != 0) {
+            r = (RandNorm() * pd + 1.0) * radius;
+            l = (RandNorm() * pd + 1.0) * length;
+        }
+        check += CylinderF2(q, sld, sld_solvent, r, l);
+    }
+    double t_direct = BenchNow() - t0;
+
+    g_rng = 0x2545F4914F6CDD1Dull;
+    t0 = BenchNow();
+    for (long i = 0; i < nsamples; i++) {
+        double q = q_min * pow(q_max / q_min, Rand01Open());
+        sas_iq_table_lookup(&table, q, &iq);
+        check += iq;
+    }
+    double t_table = BenchNow() - t0;
+
+    if (!(check > 0)) {
+        printf("sas_iq_table: %s: bad intensities\n", name);
+        g_errors++;
+    }
+    printf("%-14s %6li points %6li evals  build %6.3f s  error %8.2e   direct %7.1f ns  table %5.1f ns\n",
+        name, table.n, evals, t_build, err_max, t_direct / nsamples * 1e9, t_table / nsamples * 1e9);
+
+    sas_iq_table_free(&table);
+}
+
+int main (int argc, char **argv) {
+    long nsamples = 1000000;
+    if (argc > 1) {
+        nsamples = atol(argv[1]);
+    }
+    GaussLegendre(GAUSS_N, g_gauss_z, g_gauss_w);
+
+    RunCase("monodisperse", 0, nsamples);
+    RunCase("pd 0.1", 0.1, nsamples);
+
+    if (g_errors) {
+        printf("sas_iq_table: %d errors\n", g_errors);
+        exit(1);
+    }
+    printf("sas_iq_table: OK\n");
+    return 0;
+}
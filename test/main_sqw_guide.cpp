@@ -0,0 +1,399 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cstdarg>
+#include <cstdint>
+#include <cmath>
+
+#include "../lib/jg_baselayer.h"
+
+#include "test_common.h"
+#include "runtime/simcore.h"
+
+
+// the pointers freed by the component
+static void *g_freed[1 << 16];
+static long g_nfreed = 0;
+
+static void CountFree(void *ptr) {
+    if (ptr && g_nfreed < (long) (sizeof(g_freed) / sizeof(g_freed[0]))) {
+        g_freed[g_nfreed++] = ptr;
+    }
+    free(ptr);
+}
+
+#define free CountFree
+#include "runtime/samples/comps/Isotropic_Sqw.h"
+#undef free
+
+
+//
+//  Isotropic_Sqw of runtime/sqw_runtime.instr, cogen'd, on synthetic liquid-like S(q,w) tables: a structure factor
+//  peak in q and a quasi-elastic Lorentzian in w of width D q^2, with detailed balance, tabulated on grids from the
+//  size of the bundled liquid files up to fine ones. The stub runtime can not read data files, so the tables are
+//  built as steps (9) to (11) of Sqw_readfile build them, the guide tables with cdf_guide_build.
+//
+//  Sqw_search_SW and Sqw_search_Q_proba_per_w, which take the data by pointer, must return the first bin reaching
+//  the random number, as a plain linear search and the previous search on a fixed 100 entry lookup do, and the
+//  time per (w, q) sample is reported against the previous search, which took the data struct by value. TRACE
+//  must sample the coherent or the incoherent table it points at, without writing to them, and FINALLY must free
+//  every S(q|w) and guide table row.
+//
+//  ./sqw_guide [<nsamples>]
+
+
+#define OLD_LOOKUP_LENGTH 100
+#define SQW_NEUTRONS 20000
+
+
+// S(q,w) of a simple liquid, q in 1/AA and w in meV, T in K
+double LiquidSqw(double q, double w, double T) {
+    double sq = 1 + 1.5 * exp(-(q - 2.0) * (q - 2.0) / (2 * 0.15 * 0.15)) - exp(-q * q / 0.5);
+    double gamma = 0.05 + 0.8 * q * q;
+    double s = sq * gamma / M_PI / (w * w + gamma * gamma);
+    if (w < 0) s *= exp(w / (0.08617 * T));
+    return s;
+}
+
+// the tables Sqw_readfile leaves in Sqw_Data, sigma(Ei) is flat
+void SqwBuild(Sqw_Data_struct *d, long q_bins, long w_bins, double q_max, double w_max, double sigma) {
+    double T = 300;
+    Sqw_Data_init(d);
+    d->q_bins = q_bins;
+    d->w_bins = w_bins;
+    d->q_max = q_max;
+    d->w_max = w_max;
+    d->q_step = q_max / (q_bins - 1);
+    d->w_step = 2 * w_max / (w_bins - 1);
+    d->lookup_length = OLD_LOOKUP_LENGTH;
+    d->intensity = 1;
+
+    // (8) sigma(Ei)
+    d->iqSq_length = OLD_LOOKUP_LENGTH;
+    d->Ei_max = 2 * w_max > 100 ? 2 * w_max : 100;
+    Table_Init(&d->iqSq, d->iqSq_length, 1);
+    for (long i = 0; i < d->iqSq_length; i++) {
+        Table_SetElement(&d->iqSq, i, 0, sigma);
+    }
+
+    // (9) P(w) and (10) P(q|w), with the Jacobian q
+    d->SW = (Sqw_W_struct*) calloc(w_bins, sizeof(Sqw_W_struct));
+    d->SQW = (Sqw_Q_struct**) calloc(w_bins, sizeof(Sqw_Q_struct*));
+    for (long iw = 0; iw < w_bins; iw++) {
+        double w = -w_max + iw * d->w_step;
+        d->SQW[iw] = (Sqw_Q_struct*) calloc(q_bins, sizeof(Sqw_Q_struct));
+        double sum = 0;
+        for (long iq = 0; iq < q_bins; iq++) {
+            double q = iq * d->q_step;
+            sum += q * LiquidSqw(q, w, T);
+            d->SQW[iw][iq].Q = q;
+            d->SQW[iw][iq].cumul_proba = iq ? sum : 0;
+        }
+        for (long iq = 0; iq < q_bins; iq++) {
+            d->SQW[iw][iq].cumul_proba /= d->SQW[iw][q_bins - 1].cumul_proba;
+        }
+        d->SW[iw].omega = w;
+        d->SW[iw].cumul_proba = iw ? d->SW[iw - 1].cumul_proba + sum : 0;
+    }
+    for (long iw = 0; iw < w_bins; iw++) {
+        d->SW[iw].cumul_proba /= d->SW[w_bins - 1].cumul_proba;
+    }
+
+    // (11) guide tables
+    d->SW_lookup_length = w_bins > OLD_LOOKUP_LENGTH ? w_bins : OLD_LOOKUP_LENGTH;
+    d->QW_lookup_length = q_bins > OLD_LOOKUP_LENGTH ? q_bins : OLD_LOOKUP_LENGTH;
+    d->SW_lookup = (long*) calloc(d->SW_lookup_length, sizeof(long));
+    cdf_guide_build(d->SW_lookup, d->SW_lookup_length, &d->SW[0].cumul_proba, w_bins, sizeof(Sqw_W_struct));
+    d->QW_lookup = (long**) calloc(w_bins, sizeof(long*));
+    for (long iw = 0; iw < w_bins; iw++) {
+        d->QW_lookup[iw] = (long*) calloc(d->QW_lookup_length, sizeof(long));
+        cdf_guide_build(d->QW_lookup[iw], d->QW_lookup_length, &d->SQW[iw][0].cumul_proba, q_bins, sizeof(Sqw_Q_struct));
+    }
+}
+
+long LinearSearch(double *cumul, long n, int stride, double r) {
+    long j = 0;
+    while (j < n && r > *(double*) ((char*) cumul + j * stride)) j++;
+    return j < n ? j : n - 1;
+}
+
+
+// the previous Sqw_search_SW / Sqw_search_Q_proba_per_w: the data by value and a fixed length lookup
+struct OldLookups {
+    long *SW_lookup;
+    long **QW_lookup;
+};
+
+int OldSearchSW(struct Sqw_Data_struct Sqw, long *lookup, double randnum) {
+    int index_w = 0;
+    if (randnum < 0) randnum = 0;
+    if (randnum > 1) randnum = 1;
+    if (Sqw.w_bins == 1) return 0;
+    if (lookup) {
+        long i = (long) floor(randnum * OLD_LOOKUP_LENGTH);
+        index_w = lookup[i < OLD_LOOKUP_LENGTH ? i : OLD_LOOKUP_LENGTH - 1] - 1;
+        if (index_w < 0) index_w = 0;
+    }
+    while (index_w < Sqw.w_bins && randnum > Sqw.SW[index_w].cumul_proba) index_w++;
+    if (index_w >= Sqw.w_bins) index_w = Sqw.w_bins - 1;
+    return index_w;
+}
+
+int OldSearchQ(struct Sqw_Data_struct Sqw, long **lookup, double randnum, int index_w) {
+    int index_q = 0;
+    if (randnum < 0) randnum = 0;
+    if (randnum > 1) randnum = 1;
+    if (lookup && lookup[index_w]) {
+        long i = (long) floor(randnum * OLD_LOOKUP_LENGTH);
+        index_q = lookup[index_w][i < OLD_LOOKUP_LENGTH ? i : OLD_LOOKUP_LENGTH - 1] - 1;
+        if (index_q < 0) index_q = 0;
+    }
+    while (index_q < Sqw.q_bins && randnum > Sqw.SQW[index_w][index_q].cumul_proba) index_q++;
+    if (index_q >= Sqw.q_bins) index_q = Sqw.q_bins - 1;
+    return index_q;
+}
+
+void OldBuild(OldLookups *old, Sqw_Data_struct *d) {
+    int sw = sizeof(Sqw_W_struct);
+    int sq = sizeof(Sqw_Q_struct);
+    old->SW_lookup = (long*) calloc(OLD_LOOKUP_LENGTH, sizeof(long));
+    for (long i = 0; i < OLD_LOOKUP_LENGTH; i++) {
+        old->SW_lookup[i] = LinearSearch(&d->SW[0].cumul_proba, d->w_bins, sw, (double) i / OLD_LOOKUP_LENGTH);
+    }
+    old->QW_lookup = (long**) calloc(d->w_bins, sizeof(long*));
+    for (long iw = 0; iw < d->w_bins; iw++) {
+        old->QW_lookup[iw] = (long*) calloc(OLD_LOOKUP_LENGTH, sizeof(long));
+        for (long i = 0; i < OLD_LOOKUP_LENGTH; i++) {
+            old->QW_lookup[iw][i] = LinearSearch(&d->SQW[iw][0].cumul_proba, d->q_bins, sq, (double) i / OLD_LOOKUP_LENGTH);
+        }
+    }
+}
+
+void OldFree(OldLookups *old, long w_bins) {
+    for (long iw = 0; iw < w_bins; iw++) {
+        free(old->QW_lookup[iw]);
+    }
+    free(old->QW_lookup);
+    free(old->SW_lookup);
+}
+
+// what FINALLY releases, freed here for the tables it never sees
+void SqwFree(Sqw_Data_struct *d) {
+    for (long iw = 0; iw < d->w_bins; iw++) {
+        free(d->SQW[iw]);
+        free(d->QW_lookup[iw]);
+    }
+    free(d->SW);
+    free(d->SQW);
+    free(d->SW_lookup);
+    free(d->QW_lookup);
+    Table_Free(&d->iqSq);
+}
+
+
+void TestSearch(long q_bins, long w_bins, long nsamples) {
+    int sw = sizeof(Sqw_W_struct);
+    int sq = sizeof(Sqw_Q_struct);
+    Sqw_Data_struct d;
+    OldLookups old;
+    SqwBuild(&d, q_bins, w_bins, 10, 50, 1);
+    OldBuild(&old, &d);
+
+    // same bins as a linear search for the random numbers at the tabulated values, the bin edges and the ends
+    long mismatch = 0;
+    for (long i = 0; i <= 4 * d.SW_lookup_length; i++) {
+        double r = (double) i / (4 * d.SW_lookup_length);
+        mismatch += Sqw_search_SW(&d, r) != LinearSearch(&d.SW[0].cumul_proba, w_bins, sw, r);
+    }
+    for (long iw = 0; iw < w_bins; iw += 1 + w_bins / 64) {
+        for (long iq = 0; iq < q_bins; iq++) {
+            double r = d.SQW[iw][iq].cumul_proba;
+            double r_up = nextafter(r, 2.0);
+            mismatch += Sqw_search_Q_proba_per_w(&d, r, iw) != LinearSearch(&d.SQW[iw][0].cumul_proba, q_bins, sq, r);
+            mismatch += Sqw_search_Q_proba_per_w(&d, r_up, iw) != LinearSearch(&d.SQW[iw][0].cumul_proba, q_bins, sq, r_up);
+        }
+    }
+
+    // same bins as the previous lookup for random samples
+    g_rng = 0x9E3779B97F4A7C15ull;
+    for (long i = 0; i < nsamples / 16; i++) {
+        double rw = Rand01();
+        double rq = Rand01();
+        int iw_old = OldSearchSW(d, old.SW_lookup, rw);
+        int iw_new = Sqw_search_SW(&d, rw);
+        int iq_old = OldSearchQ(d, old.QW_lookup, rq, iw_old);
+        int iq_new = Sqw_search_Q_proba_per_w(&d, rq, iw_new);
+        mismatch += iw_old != iw_new || iq_old != iq_new;
+    }
+    if (mismatch) {
+        printf("ERROR: %ld x %ld: %ld searches differ\n", q_bins, w_bins, mismatch);
+        g_errors++;
+    }
+
+    long check_old = 0;
+    long check_new = 0;
+
+    g_rng = 0x2545F4914F6CDD1Dull;
+    double t0 = BenchNow();
+    for (long i = 0; i < nsamples; i++) {
+        double rw = Rand01();
+        double rq = Rand01();
+        int iw = OldSearchSW(d, old.SW_lookup, rw);
+        check_old += iw + OldSearchQ(d, old.QW_lookup, rq, iw);
+    }
+    double t_old = BenchNow() - t0;
+
+    g_rng = 0x2545F4914F6CDD1Dull;
+    t0 = BenchNow();
+    for (long i = 0; i < nsamples; i++) {
+        double rw = Rand01();
+        double rq = Rand01();
+        int iw = Sqw_search_SW(&d, rw);
+        check_new += iw + Sqw_search_Q_proba_per_w(&d, rq, iw);
+    }
+    double t_new = BenchNow() - t0;
+
+    if (check_old != check_new) {
+        printf("ERROR: %ld x %ld: timed samples differ\n", q_bins, w_bins);
+        g_errors++;
+    }
+    printf("q_bins %5ld w_bins %5ld   lookup %8.1f ns   guide %6.1f ns   speedup %5.1fx\n",
+        q_bins, w_bins, t_old / nsamples * 1e9, t_new / nsamples * 1e9, t_old / t_new);
+
+    OldFree(&old, w_bins);
+    SqwFree(&d);
+}
+
+
+// a bulk cylinder as INITIALIZE sets it up, the coherent data wide in w and the incoherent data narrow
+void SampleInit(Isotropic_Sqw *comp, double s_coh, double s_inc) {
+    *comp = Create_Isotropic_Sqw(0, (char*) "sample");
+    comp->radius = 0.005;
+    comp->yheight = 0.02;
+    comp->order = 1;
+    comp->p_interact = 1;
+
+    Sqw_sample_struct *v = &comp->VarSqw;
+    strcpy(v->compname, comp->name);
+    v->shape = 0;
+    v->T2E = 1 / 11.605;
+    v->sqSE2K = (V2K * SE2V) * (V2K * SE2V);
+    v->s_coh = s_coh;
+    v->s_inc = s_inc;
+    v->mat_rho = 0.0313;
+    v->maxloop = 100;
+    v->lookup_length = OLD_LOOKUP_LENGTH;
+    SqwBuild(&v->Data_coh, 100, 200, 10, 10, s_coh);
+    SqwBuild(&v->Data_inc, 100, 200, 10, 0.5, s_inc);
+    v->Data_coh.type = 'c';
+    v->Data_inc.type = 'i';
+}
+
+// single scattering of 20 meV neutrons, returns the largest |dw| and counts those above 1 meV
+double TraceSample(Isotropic_Sqw *comp, long *n_scattered, long *n_wide) {
+    double dw_max = 0;
+    *n_scattered = 0;
+    *n_wide = 0;
+    srandom_rt(0x9E3779B97F4A7C15ull);
+    for (long i = 0; i < SQW_NEUTRONS; i++) {
+        Neutron n = {};
+        n.x = 0.004 * randpm1();
+        n.y = 0.008 * randpm1();
+        n.z = -0.1;
+        n.vz = SE2V * sqrt(20.0);
+        n.p = 1;
+        Trace_Isotropic_Sqw(comp, &n, NULL);
+        if (n._scatter == 1 && n._absorb == 0) {
+            double dw = fabs(comp->VarSqw.dw);
+            (*n_scattered)++;
+            *n_wide += dw > 1;
+            if (dw > dw_max) dw_max = dw;
+        }
+    }
+    return dw_max;
+}
+
+bool Freed(void *ptr) {
+    for (long i = 0; i < g_nfreed; i++) {
+        if (g_freed[i] == ptr) return true;
+    }
+    return false;
+}
+
+// the rows of S(q|w) and of its guide table, and the tables holding them, taken before FINALLY frees them
+long TablePointers(Sqw_Data_struct *d, void **ptrs) {
+    long n = 0;
+    ptrs[n++] = d->SW;
+    ptrs[n++] = d->SQW;
+    ptrs[n++] = d->SW_lookup;
+    ptrs[n++] = d->QW_lookup;
+    for (long iw = 0; iw < d->w_bins; iw++) {
+        ptrs[n++] = d->SQW[iw];
+        ptrs[n++] = d->QW_lookup[iw];
+    }
+    return n;
+}
+
+void TestTraceFinally(const char *name, double s_coh, double s_inc, bool expect_wide) {
+    Isotropic_Sqw comp;
+    SampleInit(&comp, s_coh, s_inc);
+
+    // TRACE reads the tables through a pointer and must leave them as they were
+    Sqw_Data_struct coh = comp.VarSqw.Data_coh;
+    Sqw_Data_struct inc = comp.VarSqw.Data_inc;
+    long n_scattered, n_wide;
+    double dw_max = TraceSample(&comp, &n_scattered, &n_wide);
+    if (memcmp(&coh, &comp.VarSqw.Data_coh, sizeof(coh)) || memcmp(&inc, &comp.VarSqw.Data_inc, sizeof(inc))) {
+        printf("ERROR: %s: TRACE changed the S(q,w) data\n", name);
+        g_errors++;
+    }
+
+    // the energy transfers come from the table of the process
+    double w_max = expect_wide ? coh.w_max : inc.w_max;
+    if (n_scattered < SQW_NEUTRONS / 2 || dw_max > w_max * (1 + 1e-9) || (n_wide > 0) != expect_wide) {
+        printf("       %ld scattered, %ld above 1 meV, |dw| up to %g meV\n", n_scattered, n_wide, dw_max);
+        printf("ERROR: %s: TRACE did not sample the %s data\n", name, expect_wide ? "coherent" : "incoherent");
+        g_errors++;
+    }
+
+    void **ptrs = (void**) malloc(sizeof(void*) * 2 * (4 + coh.w_bins + inc.w_bins));
+    long nptrs = TablePointers(&coh, ptrs);
+    nptrs += TablePointers(&inc, ptrs + nptrs);
+    g_nfreed = 0;
+    Finally_Isotropic_Sqw(&comp);
+    long unfreed = 0;
+    for (long i = 0; i < nptrs; i++) {
+        unfreed += !Freed(ptrs[i]);
+    }
+    free(ptrs);
+    if (unfreed) {
+        printf("ERROR: %s: %ld S(q,w) tables and rows left allocated by FINALLY\n", name, unfreed);
+        g_errors++;
+    }
+    printf("%-12s %6ld scattered, |dw| up to %6.3f meV, %ld freed by FINALLY\n", name, n_scattered, dw_max, g_nfreed);
+}
+
+
+int main (int argc, char **argv) {
+    long nsamples = 2000000;
+    if (argc > 1) {
+        nsamples = atol(argv[1]);
+    }
+
+    TestSearch(100, 200, nsamples);
+    TestSearch(250, 500, nsamples);
+    TestSearch(500, 1000, nsamples);
+    TestSearch(1000, 2000, nsamples);
+    TestSearch(2000, 4000, nsamples);
+
+    TestTraceFinally("coherent", 5, 0, true);
+    TestTraceFinally("incoherent", 0, 5, false);
+
+    if (g_errors) {
+        printf("sqw_guide: %d errors\n", g_errors);
+        exit(1);
+    }
+    printf("sqw_guide: OK\n");
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+
+#include "../lib/jg_baselayer.h"
+
+#include "../src/parsecore.h"
+#include "../src/parsehelpers.h"
+#include "../src/parse_comp.h"
+#include "../src/parse_instr.h"
+#include "../src/check_instr.h"
+
+
+//
+//  Parses a generated 100k-component instrument (a detector bank of tubes) in full and in streaming mode,
+//  and compares the parse arena growth of the two.
+
+
+#define TUBES_CNT 100000
+
+
+Str GenerateDetectorBank(u32 ntubes) {
+    StrBuff buff = StrBuffInit();
+    StrBuffPrint1K(&buff, "DEFINE INSTRUMENT detector_bank(tube_len=1.0)\nTRACE\n", 0);
+    StrBuffPrint1K(&buff, "COMPONENT origin = Arm() AT (0, 0, 0) ABSOLUTE\n", 0);
+    StrBuffPrint1K(&buff, "COMPONENT tube_0 = PSD_monitor(xwidth = 0.025, yheight = tube_len, nx = 1, ny = 256) AT (0, 0, 2) RELATIVE origin\n", 0);
+    for (u32 i = 1; i < ntubes; ++i) {
+        StrBuffPrint1K(&buff, "COMPONENT tube_%u = COPY(tube_0) AT (%u * 0.025, 0, 2) RELATIVE origin ROTATED (0, 0.01, 0) RELATIVE PREVIOUS\n", 2, i, i);
+    }
+    StrBuffPrint1K(&buff, "END\n", 0);
+    Str text = { buff.str, buff.len };
+    return text;
+}
+
+struct StreamTest {
+    MArena *a_check;
+    HashMap *comps;
+    HashMap *copy_sources;
+    ParseStats *stats;
+    s32 comps_cnt;
+    CheckState check;
+    bool begun;
+};
+
+void StreamCheck(InstrumentParse *instr, ComponentCall *c, void *data) {
+    StreamTest *st = (StreamTest*) data;
+    if (st->begun == false) {
+        st->begun = true;
+        st->check = CheckBegin(st->a_check, instr, st->comps, st->stats, st->comps_cnt, st->copy_sources);
+    }
+    CheckComponent(&st->check, c);
+}
+
+void TestStream() {
+    MContext *ctx = InitBaselayer();
+
+    HashMap comp_map = InitMap(ctx->a_life, 16);
+    MapPut(&comp_map, (u64) StrIntern(StrL("Arm")), (u64) 1);
+    MapPut(&comp_map, (u64) StrIntern(StrL("PSD_monitor")), (u64) 1);
+
+    Str text = GenerateDetectorBank(TUBES_CNT);
+    printf("detector bank: %u tubes, %u bytes\n", TUBES_CNT, text.len);
+
+    // full parse, no component cap
+    MArena a_full = ArenaCreate();
+    MArena a_full_check = ArenaCreate();
+    ParseStats stats_full = {};
+    InstrumentParse *full = ParseInstrument(&a_full, text);
+    bool ok_full = CheckInstrument(&a_full_check, full, &comp_map, &stats_full);
+    printf("full parse:    %u calls, %lu parse arena bytes\n", full->comps.len, (u64) a_full.used);
+
+    // streaming
+    MArena a_stream = ArenaCreate();
+    MArena a_stream_check = ArenaCreate();
+    ParseStats stats_stream = {};
+    HashMap copy_sources = InitMap(&a_stream_check, 64);
+    PreScanCopySources(text, &copy_sources);
+
+    StreamTest st = {};
+    st.a_check = &a_stream_check;
+    st.comps = &comp_map;
+    st.copy_sources = &copy_sources;
+    st.stats = &stats_stream;
+    st.comps_cnt = PreScanInstrument(text).comps_cnt;
+    InstrumentParse *streamed = ParseInstrument(&a_stream, text, StreamCheck, &st);
+    bool ok_stream = (streamed->parse_error == false) && CheckEnd(&st.check);
+    printf("streamed:      %u calls, %lu parse arena bytes\n", st.check.idx, (u64) a_stream.used);
+
+    if (full->parse_error || ok_full == false || full->comps.len != TUBES_CNT + 1) {
+        printf("ERROR: full parse failed\n");
+        exit(1);
+    }
+    if (ok_stream == false || st.check.idx != TUBES_CNT + 1) {
+        printf("ERROR: streamed parse failed\n");
+        exit(1);
+    }
+    if (a_stream.used * 100 > a_full.used) {
+        printf("ERROR: streamed parse arena is not bounded\n");
+        exit(1);
+    }
+}
+
+
+int main (int argc, char **argv) {
+    TimeProgram;
+
+    BaselayerAssertVersion(0, 2, 4);
+
+    TestStream();
+}
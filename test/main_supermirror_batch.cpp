@@ -0,0 +1,281 @@
+#include "test_mcstas.h"
+
+#include "runtime/share/supermirror-lib.h"
+#include "runtime/share/supermirror-lib.c"
+
+
+//
+//  Batched supermirror reflectivity and attenuation against the per-neutron functions, both as built from
+//  supermirror-lib.c and supermirror_batch-lib.c. sm_batch_at_plane must give what sm_get_Rm_at_plane,
+//  sm_get_prop_abs_at_plane and sm_get_L_attn_sub give neutron by neutron, and sm_calc_Rm_batch what sm_calc_Rm
+//  gives. Neutrons of 0.5-15 AA hit mirror planes at grazing angles up to 3 deg, plus neutrons parallel to the
+//  plane, at the critical q and at the cut-off. Coatings are m=2, m=3.5 and m=5 supermirrors, a polarising spin-
+//  coating with m=-1 and a bare surface; absorber and substrate attenuation take each of the absorption-only,
+//  incoherent-only, both and none branches, and the planes without reflection or attenuation.
+//
+//  sm_calc_Rm evaluates 0.5*(1 - tanh(arg)) of the McStas formula as 1/(1 + exp(2*arg)). The two must agree within
+//  1e-15 absolute (R0 <= 1) on a fine q grid; relative agreement is not checked, the tanh form cancels in the tail
+//  and is off by up to ~1e-8 relative just below the cut-off.
+//
+//  The time per neutron of the per-neutron functions and of sm_batch_at_plane is reported for batches of 64 and
+//  1024. Build with -fopenmp-simd -ffast-math to vectorise exp.
+//
+//  ./supermirror_batch [<nneutrons>]
+
+
+#define MAX_BATCH 1024
+#define TANH_TOLERANCE 1e-15
+
+
+// the fields of ReflectionParameters and of AbsorberParameters / SubstrateParameters
+struct Mirror {
+    const char *name;
+    double R0, Qc, m, W, alpha, beta;
+};
+
+struct Attn {
+    const char *name;
+    double L_abs, L_inc, thickness_in_micron;
+};
+
+static const Mirror g_mirrors[] = {
+    { "m=2",         0.99,  0.0217, 2.0, 0.003,  3.0,  0.0 },
+    { "m=3.5",       0.99,  0.0217, 3.5, 0.003,  4.0,  0.0 },
+    { "m=5",         0.985, 0.0217, 5.0, 0.0025, 3.5,  20.0 },
+    { "FeSi minus",  0.99,  0.0217, -1,  0.003,  3.0,  0.0 },
+    { "Ni m=1",      0.99,  0.0217, 1.0, 0.0,    0.0,  0.0 },
+};
+static const int g_nmirrors = sizeof(g_mirrors) / sizeof(g_mirrors[0]);
+
+static const Attn g_attns[] = {
+    { "Gd",            6.7e-6, -1,   100 },
+    { "glass",         0.24,   1.2,  0 },
+    { "incoherent",    -1,     0.05, 20 },
+    { "none",          -1,     -1,   10 },
+};
+static const int g_nattns = sizeof(g_attns) / sizeof(g_attns[0]);
+
+void SetMirror(ReflectionParameters *mir, const Mirror *M, bool reflects) {
+    snprintf(mir->name, CHAR_BUF_LENGTH, "%s", M->name);
+    mir->refl_type = reflects ? sm_refl_type_refl : 0;
+    mir->R0 = M->R0;
+    mir->Qc = M->Qc;
+    mir->m = M->m;
+    mir->W = M->W;
+    mir->alpha = M->alpha;
+    mir->beta = M->beta;
+}
+
+void SetAbsorber(AbsorberParameters *abs, const Attn *A, bool attenuates) {
+    snprintf(abs->name, CHAR_BUF_LENGTH, "%s", A->name);
+    abs->abs_type = attenuates ? sm_abs_type_attn : 0;
+    abs->L_abs = A->L_abs;
+    abs->L_inc = A->L_inc;
+    abs->thickness_in_micron = A->thickness_in_micron;
+}
+
+void SetSubstrate(SubstrateParameters *sub, const Attn *A) {
+    snprintf(sub->name, CHAR_BUF_LENGTH, "%s", A->name);
+    sub->sub_type = sm_sub_type_attn;
+    sub->L_abs = A->L_abs;
+    sub->L_inc = A->L_inc;
+}
+
+// materials of case k: plane 0 reflects and attenuates, plane 1 does neither
+void SetMaterials(Supermirror *sm, int k) {
+    for (int spin = 0; spin < SM_Num_Spin_States; spin++) {
+        SetMirror(&sm->mat.mir[0][spin], &g_mirrors[(k + spin) % g_nmirrors], true);
+        SetMirror(&sm->mat.mir[1][spin], &g_mirrors[(k + spin) % g_nmirrors], false);
+    }
+    SetAbsorber(&sm->mat.abs[0], &g_attns[k % g_nattns], true);
+    SetAbsorber(&sm->mat.abs[1], &g_attns[k % g_nattns], false);
+    SetSubstrate(&sm->mat.sub, &g_attns[(k + 1) % g_nattns]);
+}
+
+// neutrons on a plane: speed from the wavelength, normal speed from the grazing angle
+void RandomNeutrons(SupermirrorBatch *b, long n) {
+    for (long i = 0; i < n; i++) {
+        double lambda = 0.5 + 14.5 * Rand01();
+        double theta = 3 * M_PI / 180 * Rand01();
+        b->v_len[i] = AMS / lambda;
+        b->vn_len[i] = b->v_len[i] * sin(theta);
+        b->q[i] = 2 * b->vn_len[i] * V2Q;
+    }
+    b->n = n;
+}
+
+// identical without -ffast-math; with it, within 1e-12 absolute for probabilities and relative above 1
+int Same(double a, double b) {
+    return a == b || fabs(a - b) <= 1e-12 * fmax(1, fmax(fabs(a), fabs(b)));
+}
+
+void CheckKernel(SupermirrorBatch *b) {
+    long mismatch = 0;
+    for (int k = 0; k < g_nmirrors; k++) {
+        const Mirror *M = &g_mirrors[k];
+        sm_calc_Rm_batch(b->n, b->q, M->Qc, M->R0, M->alpha, M->m, M->W, M->beta, b->Rm[0]);
+        for (long i = 0; i < b->n; i++) {
+            double ref = sm_calc_Rm(b->q[i], M->Qc, M->R0, M->alpha, M->m, M->W, M->beta);
+            if (!Same(b->Rm[0][i], ref)) {
+                if (mismatch++ < 5) printf("supermirror_batch: %s q=%g Rm %.17g != %.17g\n", M->name, b->q[i], b->Rm[0][i], ref);
+            }
+        }
+    }
+    if (mismatch) {
+        printf("supermirror_batch: sm_calc_Rm_batch: %ld mismatches\n", mismatch);
+        g_errors++;
+    }
+}
+
+void CheckPlane(Supermirror *sm, SupermirrorBatch *b) {
+    long mismatch = 0;
+    for (int k = 0; k < g_nmirrors * g_nattns; k++) {
+        SetMaterials(sm, k);
+        for (int plane = 0; plane < SM_Num_Mirror_Planes; plane++) {
+            sm_batch_at_plane(sm, plane, b);
+            for (long i = 0; i < b->n; i++) {
+                double R_plus, R_minus, L, t, T, L_sub;
+                sm_get_Rm_at_plane(sm->mat.mir[plane], b->vn_len[i], &R_plus, &R_minus);
+                sm_get_prop_abs_at_plane(&sm->mat.abs[plane], b->v_len[i], b->vn_len[i], &L, &t, &T);
+                L_sub = sm_get_L_attn_sub(&sm->mat.sub, b->v_len[i]);
+                if (!Same(b->Rm[0][i], R_plus) || !Same(b->Rm[1][i], R_minus)) {
+                    if (mismatch++ < 5) printf("supermirror_batch: case %d plane %d vn=%g Rm %.17g,%.17g != %.17g,%.17g\n", k, plane,
+                        b->vn_len[i], b->Rm[0][i], b->Rm[1][i], R_plus, R_minus);
+                }
+                if (!Same(b->L_attn_abs[i], L) || !Same(b->t_prop_abs[i], t) || !Same(b->T_prop_abs[i], T)) {
+                    if (mismatch++ < 5) printf("supermirror_batch: case %d plane %d v=%g vn=%g L,t,T %g,%g,%g != %g,%g,%g\n", k, plane,
+                        b->v_len[i], b->vn_len[i], b->L_attn_abs[i], b->t_prop_abs[i], b->T_prop_abs[i], L, t, T);
+                }
+                if (!Same(b->L_attn_sub[i], L_sub)) {
+                    if (mismatch++ < 5) printf("supermirror_batch: case %d v=%g L_sub %g != %g\n", k, b->v_len[i], b->L_attn_sub[i], L_sub);
+                }
+            }
+        }
+    }
+    if (mismatch) {
+        printf("supermirror_batch: sm_batch_at_plane: %ld mismatches\n", mismatch);
+        g_errors++;
+    }
+}
+
+// R0*0.5*(1-tanh(arg))*(1-alpha*(q-Qc)+beta*(q-Qc)^2), as McStas evaluates it
+double TanhRm(double q, double Qc, double R0, double alpha, double m, double W, double beta) {
+    double Qc_m = m * 0.0217;
+    double arg = W > 0 ? (q - Qc_m)/W : 11;
+    if (arg > 10 || m <= 0 || Qc_m <= 0 || R0 <= 0) {
+        return 0;
+    }
+    if (q <= Qc) {
+        return R0;
+    }
+    q -= Qc;
+    return R0*0.5*(1 - tanh(arg))*(1 - alpha*q + beta*q*q);
+}
+
+void CheckTanh() {
+    long nq = 200000;
+    double err_max = 0;
+    for (int k = 0; k < g_nmirrors; k++) {
+        const Mirror *M = &g_mirrors[k];
+        for (long i = 0; i <= nq; i++) {
+            double q = 0.2 * i / nq;
+            double err = fabs(sm_calc_Rm(q, M->Qc, M->R0, M->alpha, M->m, M->W, M->beta) - TanhRm(q, M->Qc, M->R0, M->alpha, M->m, M->W, M->beta));
+            err_max = fmax(err_max, err);
+        }
+    }
+    if (err_max > TANH_TOLERANCE) {
+        printf("supermirror_batch: sm_calc_Rm is %g off the tanh form\n", err_max);
+        g_errors++;
+    }
+}
+
+void Bench(Supermirror *sm, SupermirrorBatch *b, long batch_size, long nneutrons) {
+    long nbatches = nneutrons / batch_size;
+    double check_scalar = 0, check_batch = 0;
+    int plane = 0;
+
+    SetMaterials(sm, 1);
+    g_rng = 0x2545F4914F6CDD1Dull;
+    RandomNeutrons(b, batch_size);
+
+    double t0 = BenchNow();
+    for (long k = 0; k < nbatches; k++) {
+        for (long i = 0; i < batch_size; i++) {
+            double R_plus, R_minus, L, t, T;
+            sm_get_Rm_at_plane(sm->mat.mir[plane], b->vn_len[i], &R_plus, &R_minus);
+            sm_get_prop_abs_at_plane(&sm->mat.abs[plane], b->v_len[i], b->vn_len[i], &L, &t, &T);
+            check_scalar += R_plus + R_minus + T + sm_get_L_attn_sub(&sm->mat.sub, b->v_len[i]);
+        }
+    }
+    double t_scalar = BenchNow() - t0;
+
+    t0 = BenchNow();
+    for (long k = 0; k < nbatches; k++) {
+        sm_batch_at_plane(sm, plane, b);
+        for (long i = 0; i < batch_size; i++) {
+            check_batch += b->Rm[0][i] + b->Rm[1][i] + b->T_prop_abs[i] + b->L_attn_sub[i];
+        }
+    }
+    double t_batch = BenchNow() - t0;
+
+    if (fabs(check_scalar - check_batch) > 1e-9 * fabs(check_scalar)) {
+        printf("supermirror_batch: batch %ld: timed sums differ %.17g != %.17g\n", batch_size, check_scalar, check_batch);
+        g_errors++;
+    }
+    long ntimed = nbatches * batch_size;
+    printf("batch %5ld   scalar %6.2f ns   batch %6.2f ns   speedup %4.1fx\n",
+        batch_size, t_scalar / ntimed * 1e9, t_batch / ntimed * 1e9, t_scalar / t_batch);
+}
+
+int main (int argc, char **argv) {
+    long nneutrons = 20000000;
+    if (argc > 1) {
+        nneutrons = atol(argv[1]);
+    }
+
+    SupermirrorBatch b;
+    Supermirror *sm = (Supermirror*) calloc(1, sizeof(Supermirror));
+    if (!sm || !sm_batch_alloc(&b, MAX_BATCH)) {
+        printf("supermirror_batch: alloc failed\n");
+        exit(1);
+    }
+
+    // random neutrons
+    for (int rep = 0; rep < 16; rep++) {
+        RandomNeutrons(&b, MAX_BATCH);
+        CheckKernel(&b);
+        CheckPlane(sm, &b);
+    }
+
+    // the edge cases: parallel, at Qc and at the cut-off of each coating, at the exact q and from vn_len
+    long n = 0;
+    b.v_len[n] = 2000; b.vn_len[n] = 0; b.q[n++] = 0;
+    b.v_len[n] = 2000; b.vn_len[n] = FLT_EPSILON; b.q[n++] = 2 * FLT_EPSILON * V2Q;
+    for (int k = 0; k < g_nmirrors; k++) {
+        const Mirror *M = &g_mirrors[k];
+        double q_edge[] = { M->Qc, nextafter(M->Qc, 1), M->m * 0.0217 + 10 * M->W, nextafter(M->m * 0.0217 + 10 * M->W, 1) };
+        for (double q : q_edge) {
+            b.q[n] = q;
+            b.vn_len[n] = q / (2 * V2Q);
+            b.v_len[n] = 50 * b.vn_len[n];
+            n++;
+        }
+    }
+    b.n = n;
+    CheckKernel(&b);
+    CheckPlane(sm, &b);
+
+    CheckTanh();
+
+    Bench(sm, &b, 64, nneutrons);
+    Bench(sm, &b, MAX_BATCH, nneutrons);
+
+    sm_batch_free(&b);
+    free(sm);
+    if (g_errors) {
+        printf("supermirror_batch: %d errors\n", g_errors);
+        exit(1);
+    }
+    printf("supermirror_batch: OK\n");
+    return 0;
+}
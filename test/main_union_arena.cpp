@@ -0,0 +1,274 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+
+#include "test_mcstas.h"
+
+
+// count the mallocs and frees of the libraries
+static long g_mallocs = 0;
+static long g_frees = 0;
+
+static void *CountMalloc(size_t size) {
+    g_mallocs++;
+    return malloc(size);
+}
+
+static void CountFree(void *p) {
+    g_frees += p != NULL;
+    free(p);
+}
+
+#define malloc CountMalloc
+#define free CountFree
+#include "runtime/share/mesh_bvh-lib.h"
+#include "runtime/share/mesh_bvh-lib.c"
+#include "runtime/share/union_arena-lib.h"
+#include "runtime/share/union_arena-lib.c"
+#include "runtime/share/union-lib.c"
+#undef malloc
+#undef free
+
+
+//
+//  The Union tagging tree of union-lib.c with its nodes from the arena of Union_master against nodes from malloc, as
+//  the tree was built before. Rays random walk the volumes of examples/Union_demos/Tagging_demo (vacuum, Al container
+//  and Cu powder, two processes each) through goto_volume_node, goto_process_node and add_statistics_to_node as
+//  Union_master traces them, until the history limit. write_tagging_tree must write the same union_history.dat for
+//  both trees, free every malloc'ed node it visits and none of the nodes from the arena, which is then released in
+//  one pass. The allocations, the time per ray and the time to release the tree are reported.
+//
+//  ./union_arena [<nrays> [<history_limit>]]
+
+
+#define MAX_STEPS 64
+#define TAGGING_VOLUMES 3
+
+
+struct Demo {
+    Volume_struct *Volumes[TAGGING_VOLUMES];
+    list_of_tagging_tree_node_pointers roots;
+    union_arena arena;
+    int leafs;
+    long rays;
+};
+
+// Tagging_demo: next volume lists and processes per volume
+static int g_next[TAGGING_VOLUMES][2] = { { 1, -1 }, { 0, 2 }, { 1, -1 } };
+static int g_n_next[TAGGING_VOLUMES] = { 1, 2, 1 };
+static const char *g_names[TAGGING_VOLUMES] = { "vacuum", "container", "sample" };
+static const char *g_materials[TAGGING_VOLUMES] = { "", "Al", "Cu" };
+
+void DemoInit(Demo *d, bool arena) {
+    *d = Demo {};
+    for (int i = 0; i < TAGGING_VOLUMES; ++i) {
+        Volume_struct *v = (Volume_struct*) calloc(1, sizeof(Volume_struct));
+        strcpy(v->name, g_names[i]);
+        v->geometry.next_volume_list.num_elements = g_n_next[i];
+        v->geometry.next_volume_list.elements = g_next[i];
+        if (i > 0) {
+            v->p_physics = (physics_struct*) calloc(1, sizeof(physics_struct));
+            strcpy(v->p_physics->name, g_materials[i]);
+            v->p_physics->number_of_processes = 2;
+            v->p_physics->p_scattering_array = (scattering_process_struct*) calloc(2, sizeof(scattering_process_struct));
+            sprintf(v->p_physics->p_scattering_array[0].name, "%s_incoherent", g_materials[i]);
+            sprintf(v->p_physics->p_scattering_array[1].name, "%s_powder", g_materials[i]);
+        }
+        d->Volumes[i] = v;
+    }
+
+    // as Union_master initialize, the roots of an arena tree come from the arena
+    union_arena_init(&d->arena, 1048576);
+    d->roots.num_elements = TAGGING_VOLUMES;
+    d->roots.elements = (tagging_tree_node_struct**) calloc(TAGGING_VOLUMES, sizeof(tagging_tree_node_struct*));
+    for (int i = 0; i < TAGGING_VOLUMES; ++i) {
+        d->roots.elements[i] = initialize_tagging_tree_node(d->roots.elements[i], NULL, d->Volumes[i], arena ? &d->arena : NULL);
+    }
+}
+
+void DemoFree(Demo *d) {
+    union_arena_free(&d->arena);
+    free(d->roots.elements);
+    for (int i = 0; i < TAGGING_VOLUMES; ++i) {
+        if (d->Volumes[i]->p_physics) {
+            free(d->Volumes[i]->p_physics->p_scattering_array);
+            free(d->Volumes[i]->p_physics);
+        }
+        free(d->Volumes[i]);
+    }
+}
+
+// one ray: a list of steps, >= 0 the next volume, < 0 the process -1-index in the current volume
+int RandomRay(int *steps) {
+    int n = 0, volume = 1;
+    steps[n++] = 1; // enter the container
+    while (n < MAX_STEPS - 1) {
+        if (Rand01() < 0.3) {
+            steps[n++] = -1 - (Rand01() < 0.8 ? 0 : 1);
+        } else {
+            int k = g_n_next[volume] == 1 ? 0 : (Rand01() < 0.5 ? 0 : 1);
+            volume = g_next[volume][k];
+            steps[n++] = volume;
+            if (volume == 0) break;
+        }
+    }
+    return n;
+}
+
+// as the trace of Union_master with enable_tagging
+void TraceRay(Demo *d, int history_limit, int *steps, int n, double weight) {
+    int stop_creating_nodes = d->leafs > history_limit;
+    int stop_tagging_ray = 0;
+    int volume = 0;
+    tagging_tree_node_struct *node = d->roots.elements[0];
+    for (int i = 0; i < n && stop_tagging_ray == 0; ++i) {
+        if (steps[i] >= 0) {
+            node = goto_volume_node(node, volume, steps[i], d->Volumes, &stop_tagging_ray, stop_creating_nodes);
+            volume = steps[i];
+        }
+        else {
+            node = goto_process_node(node, -1 - steps[i], d->Volumes[volume], &stop_tagging_ray, stop_creating_nodes);
+        }
+    }
+    if (stop_tagging_ray == 0) {
+        Coords r = {}, v = {};
+        add_statistics_to_node(node, &r, &v, &weight, &d->leafs);
+        d->rays++;
+    }
+}
+
+double TraceAll(Demo *d, long nrays, int history_limit) {
+    int steps[MAX_STEPS];
+    g_rng = 0x9E3779B97F4A7C15ull;
+    double t0 = BenchNow();
+    for (long i = 0; i < nrays; ++i) {
+        int n = RandomRay(steps);
+        TraceRay(d, history_limit, steps, n, Rand01());
+    }
+    return BenchNow() - t0;
+}
+
+// write_tagging_tree with its report kept off stdout, union_history.dat renamed to path
+double WriteTree(Demo *d, const char *path) {
+    fflush(stdout);
+    FILE *saved = stdout;
+    stdout = fopen("/dev/null", "w");
+    double t0 = BenchNow();
+    write_tagging_tree(&d->roots, d->Volumes, d->leafs, TAGGING_VOLUMES);
+    double dt = BenchNow() - t0;
+    fclose(stdout);
+    stdout = saved;
+    rename("union_history.dat", path);
+    return dt;
+}
+
+bool SameFile(const char *a, const char *b) {
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    bool same = fa && fb;
+    while (same) {
+        int ca = fgetc(fa);
+        int cb = fgetc(fb);
+        same = ca == cb;
+        if (ca == EOF) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+void Error(const char *what) {
+    printf("ERROR: %s\n", what);
+    g_errors++;
+}
+
+void TestMakeNode() {
+    union_arena arena;
+    union_arena_init(&arena, 4096);
+    tagging_tree_node_struct *from_arena = make_tagging_tree_node(&arena);
+    tagging_tree_node_struct *from_malloc = make_tagging_tree_node(NULL);
+    if (from_arena->arena != &arena || arena.allocations != 1) {
+        Error("make_tagging_tree_node(arena) does not take the node from the arena");
+    }
+    if (from_malloc->arena != NULL) {
+        Error("make_tagging_tree_node(NULL) does not mark the node as malloc'ed");
+    }
+    free(from_malloc);
+    union_arena_free(&arena);
+}
+
+
+int main (int argc, char **argv) {
+    long nrays = 2000000;
+    int history_limit = 300000;
+    if (argc > 1) {
+        nrays = atol(argv[1]);
+    }
+    if (argc > 2) {
+        history_limit = atoi(argv[2]);
+    }
+
+    TestMakeNode();
+
+    // before: malloc per node and branch list
+    Demo old_tree;
+    DemoInit(&old_tree, false);
+    g_mallocs = 0;
+    double t_old = TraceAll(&old_tree, nrays, history_limit);
+    long mallocs_old = g_mallocs;
+
+    // after: nodes from the arena
+    Demo new_tree;
+    DemoInit(&new_tree, true);
+    long arena_before = new_tree.arena.allocations;
+    g_mallocs = 0;
+    double t_new = TraceAll(&new_tree, nrays, history_limit);
+    long mallocs_new = g_mallocs;
+
+    if (old_tree.leafs != new_tree.leafs || old_tree.rays != new_tree.rays) {
+        printf("       leafs %d / %d, rays %ld / %ld\n", old_tree.leafs, new_tree.leafs, old_tree.rays, new_tree.rays);
+        Error("the trees differ");
+    }
+    if (new_tree.arena.allocations - arena_before != mallocs_old) {
+        printf("       %ld arena allocations for %ld mallocs\n", new_tree.arena.allocations - arena_before, mallocs_old);
+        Error("the arena does not serve every allocation of the tree");
+    }
+
+    // every node but the roots is freed by write_tagging_tree, three mallocs each with its branch lists
+    g_frees = 0;
+    double t_write_old = WriteTree(&old_tree, "union_history_malloc.dat");
+    long frees_old = g_frees;
+    g_frees = 0;
+    double t_write_new = WriteTree(&new_tree, "union_history_arena.dat");
+    long frees_new = g_frees;
+    double t0 = BenchNow();
+    union_arena_free(&new_tree.arena);
+    double t_release = BenchNow() - t0;
+
+    if (SameFile("union_history_malloc.dat", "union_history_arena.dat") == false) {
+        Error("union_history.dat differs");
+    }
+    if (frees_old - frees_new != mallocs_old / 3) {
+        printf("       %ld frees of the malloc tree, %ld of the arena tree, %ld nodes\n", frees_old, frees_new, mallocs_old / 3);
+        Error("write_tagging_tree does not free exactly the malloc'ed nodes");
+    }
+    remove("union_history_malloc.dat");
+    remove("union_history_arena.dat");
+
+    printf("rays %ld  history_limit %d  leafs %d  tagged rays %ld\n", nrays, history_limit, new_tree.leafs, new_tree.rays);
+    printf("malloc per node:  %8ld mallocs            %6.1f ns/ray, write_tagging_tree %7.2f ms\n", mallocs_old, t_old / nrays * 1e9, t_write_old * 1e3);
+    printf("arena:            %8ld mallocs (%ld MB)   %6.1f ns/ray, write_tagging_tree %7.2f ms, release %.2f ms\n",
+        mallocs_new, (long) (new_tree.arena.bytes >> 20), t_new / nrays * 1e9, t_write_new * 1e3, t_release * 1e3);
+
+    DemoFree(&old_tree);
+    DemoFree(&new_tree);
+
+    if (g_errors) {
+        printf("union_arena: %d errors\n", g_errors);
+        exit(1);
+    }
+    printf("union_arena: OK\n");
+    return 0;
+}
@@ -0,0 +1,363 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cmath>
+
+#include "test_mcstas.h"
+
+#include "runtime/share/mesh_bvh-lib.h"
+#include "runtime/share/mesh_bvh-lib.c"
+#include "runtime/share/union_arena-lib.h"
+#include "runtime/share/union_arena-lib.c"
+#include "runtime/share/union-lib.c"
+
+
+//
+//  The intersection table of Union_master with the bounding sphere hierarchy of union-lib.c against the table filled
+//  without it. A master of spheres, cylinders, cones, boxes, tapered boxes and meshes, placed and rotated at random,
+//  is traced as Union_master does: the table is filled for every volume on each straight segment of a ray, and reset
+//  when the ray scatters. One table goes through build_volume_bounds, calculate_intersection_table_entry and
+//  reset_intersection_table, the other calls intersect_function for every volume and clears with
+//  clear_intersection_table. The tables must be identical after every segment.
+//
+//  The time per ray is reported for both, and for the resets alone, for masters of increasing volume count.
+//
+//  ./union_bounds [<nrays>]
+
+
+#define SEGMENTS_PER_RAY 4
+#define MESH_SOLUTIONS 100
+
+
+struct Master {
+    int number_of_volumes;
+    Volume_struct **Volumes;
+    intersection_time_table_struct culled;
+    intersection_time_table_struct full;
+    volume_bounds_struct bounds;
+    double size;
+};
+
+
+void TableInit(intersection_time_table_struct *table, Master *m) {
+    // as Union_master initialize: no entry for the surrounding vacuum, 100 solutions for meshes and 2 for the rest
+    table->num_volumes = m->number_of_volumes;
+    table->n_elements = (int*) calloc(m->number_of_volumes, sizeof(int));
+    table->calculated = (int*) calloc(m->number_of_volumes, sizeof(int));
+    table->intersection_times = (double**) calloc(m->number_of_volumes, sizeof(double*));
+    table->calculated_list = (int*) malloc(m->number_of_volumes * sizeof(int));
+    table->num_calculated = 0;
+    for (int i = 1; i < m->number_of_volumes; ++i) {
+        table->n_elements[i] = m->Volumes[i]->geometry.eShape == mesh ? MESH_SOLUTIONS : 2;
+        table->intersection_times[i] = (double*) malloc(table->n_elements[i] * sizeof(double));
+        for (int k = 0; k < table->n_elements[i]; ++k) {
+            table->intersection_times[i][k] = -1;
+        }
+    }
+}
+
+void TableFree(intersection_time_table_struct *table) {
+    for (int i = 1; i < table->num_volumes; ++i) {
+        free(table->intersection_times[i]);
+    }
+    free(table->intersection_times);
+    free(table->n_elements);
+    free(table->calculated);
+    free(table->calculated_list);
+}
+
+// number of volumes whose entries differ
+int TableDiff(intersection_time_table_struct *a, intersection_time_table_struct *b) {
+    int diff = 0;
+    for (int i = 1; i < a->num_volumes; ++i) {
+        diff += a->calculated[i] != b->calculated[i]
+             || memcmp(a->intersection_times[i], b->intersection_times[i], a->n_elements[i] * sizeof(double)) != 0;
+    }
+    return diff;
+}
+
+
+//
+//  Volumes, with their storage filled in as the Union geometry components do
+
+
+// closed cylinder mesh along y, the vertices relative to the center as Union_mesh stores them
+mesh_storage *MakeMesh(double r, double h, int nseg) {
+    mesh_storage *m = (mesh_storage*) calloc(1, sizeof(mesh_storage));
+    for (int i = 0; i < nseg; ++i) {
+        double a0 = 2 * M_PI * i / nseg, a1 = 2 * M_PI * (i + 1) / nseg;
+        double x0 = r * cos(a0), z0 = r * sin(a0), x1 = r * cos(a1), z1 = r * sin(a1);
+        double p[4][9] = {
+            { x0, -h / 2, z0, x1, -h / 2, z1, x1, h / 2, z1 },
+            { x0, -h / 2, z0, x1, h / 2, z1, x0, h / 2, z0 },
+            { 0, -h / 2, 0, x1, -h / 2, z1, x0, -h / 2, z0 },
+            { 0, h / 2, 0, x0, h / 2, z0, x1, h / 2, z1 },
+        };
+        for (int f = 0; f < 4; ++f) {
+            int k = m->n_facets++;
+            m->v1_x[k] = p[f][0]; m->v1_y[k] = p[f][1]; m->v1_z[k] = p[f][2];
+            m->v2_x[k] = p[f][3]; m->v2_y[k] = p[f][4]; m->v2_z[k] = p[f][5];
+            m->v3_x[k] = p[f][6]; m->v3_y[k] = p[f][7]; m->v3_z[k] = p[f][8];
+        }
+    }
+    m->counter = m->n_facets;
+    // the bounding sphere of the mesh is centered on the volume, so it is the same in every placement
+    m->Bounding_Box_Center = coords_set(0, 0, 0);
+    m->Bounding_Box_Radius = sqrt(r * r + h * h / 4);
+    mesh_bvh_build(&m->bvh, m->n_facets, m->v1_x, m->v1_y, m->v1_z, m->v2_x, m->v2_y, m->v2_z, m->v3_x, m->v3_y, m->v3_z);
+    return m;
+}
+
+// box of Union_box, tapered when the second widths differ
+box_storage *MakeBox(double xwidth, double yheight, double zdepth, double xwidth2, double yheight2, Rotation rot) {
+    box_storage *b = (box_storage*) calloc(1, sizeof(box_storage));
+    b->z_depth = zdepth;
+    b->x_width1 = xwidth;
+    b->y_height1 = yheight;
+    b->x_width2 = xwidth2;
+    b->y_height2 = yheight2;
+    b->is_rectangle = xwidth == xwidth2 && yheight == yheight2;
+
+    b->normal_vectors[0] = coords_set(0, 0, 1);
+    b->normal_vectors[1] = coords_set(0, 0, 1);
+    double x_component = 2 * zdepth / sqrt((xwidth - xwidth2) * (xwidth - xwidth2) + 4 * zdepth * zdepth);
+    double z_component = (xwidth - xwidth2) / sqrt(4 * zdepth * zdepth + (xwidth - xwidth2) * (xwidth - xwidth2));
+    b->normal_vectors[2] = coords_set(x_component, 0, z_component);
+    b->normal_vectors[3] = coords_set(-x_component, 0, z_component);
+    double y_component = 2 * zdepth / sqrt((yheight - yheight2) * (yheight - yheight2) + 4 * zdepth * zdepth);
+    z_component = (yheight - yheight2) / sqrt(4 * zdepth * zdepth + (yheight - yheight2) * (yheight - yheight2));
+    b->normal_vectors[4] = coords_set(0, y_component, z_component);
+    b->normal_vectors[5] = coords_set(0, -y_component, z_component);
+
+    // initialize_box_geometry_from_main_component
+    b->x_vector = rot_apply(rot, coords_set(1, 0, 0));
+    b->y_vector = rot_apply(rot, coords_set(0, 1, 0));
+    b->z_vector = rot_apply(rot, coords_set(0, 0, 1));
+    return b;
+}
+
+double RandRange(double lo, double hi) {
+    return lo + (hi - lo) * Rand01();
+}
+
+Master MakeMaster(int n, mesh_storage *shared_mesh) {
+    Master m = {};
+    m.number_of_volumes = n + 1;
+    m.Volumes = (Volume_struct**) calloc(m.number_of_volumes, sizeof(Volume_struct*));
+    // about 4 cm of space per volume, the volumes are 1 to 4 cm
+    m.size = 0.04 * cbrt(n);
+    for (int i = 0; i < m.number_of_volumes; ++i) {
+        m.Volumes[i] = (Volume_struct*) calloc(1, sizeof(Volume_struct));
+    }
+    m.Volumes[0]->geometry.eShape = surroundings;
+
+    for (int i = 1; i < m.number_of_volumes; ++i) {
+        geometry_struct *g = &m.Volumes[i]->geometry;
+        g->center = coords_set(RandRange(-m.size / 2, m.size / 2), RandRange(-m.size / 2, m.size / 2), RandRange(-m.size / 2, m.size / 2));
+        rot_set_rotation(g->rotation_matrix, RandRange(0, 2 * M_PI), RandRange(0, 2 * M_PI), RandRange(0, 2 * M_PI));
+        rot_transpose(g->rotation_matrix, g->transpose_rotation_matrix);
+        switch (i % 6) {
+            case 0:
+                g->eShape = sphere;
+                g->geometry_parameters.p_sphere_storage = (sphere_storage*) calloc(1, sizeof(sphere_storage));
+                g->geometry_parameters.p_sphere_storage->sph_radius = RandRange(0.005, 0.02);
+                break;
+            case 1:
+                g->eShape = cylinder;
+                g->geometry_parameters.p_cylinder_storage = (cylinder_storage*) calloc(1, sizeof(cylinder_storage));
+                g->geometry_parameters.p_cylinder_storage->cyl_radius = RandRange(0.005, 0.02);
+                g->geometry_parameters.p_cylinder_storage->height = RandRange(0.01, 0.04);
+                g->geometry_parameters.p_cylinder_storage->direction_vector = rot_apply(g->rotation_matrix, coords_set(0, 1, 0));
+                break;
+            case 2:
+                g->eShape = cone;
+                g->geometry_parameters.p_cone_storage = (cone_storage*) calloc(1, sizeof(cone_storage));
+                g->geometry_parameters.p_cone_storage->cone_radius_top = RandRange(0.002, 0.02);
+                g->geometry_parameters.p_cone_storage->cone_radius_bottom = RandRange(0.002, 0.02);
+                g->geometry_parameters.p_cone_storage->height = RandRange(0.01, 0.04);
+                g->geometry_parameters.p_cone_storage->direction_vector = rot_apply(g->rotation_matrix, coords_set(0, 1, 0));
+                break;
+            case 3:
+            case 4: {
+                double w = RandRange(0.01, 0.04), h = RandRange(0.01, 0.04);
+                double w2 = i % 6 == 3 ? w : RandRange(0.01, 0.04);
+                double h2 = i % 6 == 3 ? h : RandRange(0.01, 0.04);
+                g->eShape = box;
+                g->geometry_parameters.p_box_storage = MakeBox(w, h, RandRange(0.01, 0.04), w2, h2, g->rotation_matrix);
+            } break;
+            case 5:
+                g->eShape = mesh;
+                g->geometry_parameters.p_mesh_storage = shared_mesh;
+                break;
+        }
+    }
+
+    build_volume_bounds(&m.bounds, m.Volumes, m.number_of_volumes);
+    TableInit(&m.culled, &m);
+    TableInit(&m.full, &m);
+    return m;
+}
+
+void FreeMaster(Master *m) {
+    TableFree(&m->culled);
+    TableFree(&m->full);
+    free_volume_bounds(&m->bounds);
+    for (int i = 1; i < m->number_of_volumes; ++i) {
+        geometry_struct *g = &m->Volumes[i]->geometry;
+        if (g->eShape != mesh) {
+            free(g->geometry_parameters.p_sphere_storage);
+        }
+    }
+    for (int i = 0; i < m->number_of_volumes; ++i) {
+        free(m->Volumes[i]);
+    }
+    free(m->Volumes);
+}
+
+
+//
+//  Tracing
+
+
+// one ray: its starting point and the directions after each scattering, inside the region of the volumes
+void MakeRay(Master *m, double *ray) {
+    for (int k = 0; k < 3; ++k) {
+        ray[k] = RandRange(-m->size / 2, m->size / 2);
+    }
+    for (int s = 0; s < SEGMENTS_PER_RAY; ++s) {
+        double ct = 2 * Rand01() - 1, phi = 2 * M_PI * Rand01(), st = sqrt(1 - ct * ct), speed = RandRange(500, 3000);
+        double *v = ray + 3 + 3 * s;
+        v[0] = speed * st * cos(phi); v[1] = speed * ct; v[2] = speed * st * sin(phi);
+    }
+}
+
+// the segment s of a ray starts where the previous one has gone for 20 us
+void SegmentStart(double *ray, int s, double *r) {
+    memcpy(r, ray, 3 * sizeof(double));
+    for (int k = 0; k < s; ++k) {
+        for (int a = 0; a < 3; ++a) {
+            r[a] += ray[3 + 3 * k + a] * 20e-6;
+        }
+    }
+}
+
+void FillCulled(Master *m, double *r, double *v) {
+    int num_solutions;
+    for (int i = 1; i < m->number_of_volumes; ++i) {
+        if (m->culled.calculated[i] == 0) {
+            calculate_intersection_table_entry(&m->culled, &m->bounds, i, &num_solutions, r, v, &m->Volumes[i]->geometry);
+        }
+    }
+}
+
+void FillFull(Master *m, double *r, double *v) {
+    int num_solutions;
+    for (int i = 1; i < m->number_of_volumes; ++i) {
+        if (m->full.calculated[i] == 0) {
+            intersect_function(m->full.intersection_times[i], &num_solutions, r, v, &m->Volumes[i]->geometry);
+            m->full.calculated[i] = 1;
+        }
+    }
+}
+
+void RunMaster(int n, int nrays, mesh_storage *shared_mesh) {
+    Master m = MakeMaster(n, shared_mesh);
+    double *rays = (double*) malloc(nrays * 3 * (SEGMENTS_PER_RAY + 1) * sizeof(double));
+    for (int i = 0; i < nrays; ++i) {
+        MakeRay(&m, rays + 3 * (SEGMENTS_PER_RAY + 1) * i);
+    }
+
+    // correctness, segment by segment
+    long entries = 0;
+    long hit_entries = 0;
+    int errors = g_errors;
+    for (int i = 0; i < nrays && g_errors - errors < 5; ++i) {
+        double *ray = rays + 3 * (SEGMENTS_PER_RAY + 1) * i;
+        for (int s = 0; s < SEGMENTS_PER_RAY; ++s) {
+            double r[3];
+            SegmentStart(ray, s, r);
+            double *v = ray + 3 + 3 * s;
+            reset_intersection_table(&m.culled, &m.bounds);
+            clear_intersection_table(&m.full);
+            FillCulled(&m, r, v);
+            FillFull(&m, r, v);
+
+            int diff = TableDiff(&m.culled, &m.full);
+            if (diff) {
+                printf("ERROR: %d volumes: %d table entries differ for ray %d, segment %d\n", n, diff, i, s);
+                g_errors++;
+            }
+            for (int k = 1; k < m.number_of_volumes; ++k) {
+                entries++;
+                hit_entries += m.full.intersection_times[k][0] != -1 || m.full.intersection_times[k][1] != -1;
+            }
+        }
+    }
+
+    // timing: each segment resets and fills every volume, as a ray through a flat master does
+    double t0 = BenchNow();
+    for (int i = 0; i < nrays; ++i) {
+        double *ray = rays + 3 * (SEGMENTS_PER_RAY + 1) * i;
+        for (int s = 0; s < SEGMENTS_PER_RAY; ++s) {
+            double r[3];
+            SegmentStart(ray, s, r);
+            reset_intersection_table(&m.culled, &m.bounds);
+            FillCulled(&m, r, ray + 3 + 3 * s);
+        }
+    }
+    double t_culled = BenchNow() - t0;
+
+    t0 = BenchNow();
+    for (int i = 0; i < nrays; ++i) {
+        double *ray = rays + 3 * (SEGMENTS_PER_RAY + 1) * i;
+        for (int s = 0; s < SEGMENTS_PER_RAY; ++s) {
+            double r[3];
+            SegmentStart(ray, s, r);
+            clear_intersection_table(&m.full);
+            FillFull(&m, r, ray + 3 + 3 * s);
+        }
+    }
+    double t_full = BenchNow() - t0;
+
+    // the resets alone, of a table where a few volumes have been calculated
+    int n_calc = n < 4 ? n : 4;
+    t0 = BenchNow();
+    for (int i = 0; i < nrays * SEGMENTS_PER_RAY; ++i) {
+        m.culled.num_calculated = n_calc;
+        reset_intersection_table(&m.culled, &m.bounds);
+    }
+    double t_reset = BenchNow() - t0;
+
+    t0 = BenchNow();
+    for (int i = 0; i < nrays * SEGMENTS_PER_RAY; ++i) {
+        clear_intersection_table(&m.full);
+    }
+    double t_clear = BenchNow() - t0;
+
+    printf("%5d volumes, %4d nodes, %5.2f%% entries hit: per ray %9.2f us culled, %9.2f us unculled, %6.1fx; reset %7.3f us, clear %8.3f us\n",
+        n, m.bounds.num_nodes, 100.0 * hit_entries / entries, t_culled / nrays * 1e6, t_full / nrays * 1e6, t_full / t_culled,
+        t_reset / nrays * 1e6, t_clear / nrays * 1e6);
+
+    free(rays);
+    FreeMaster(&m);
+}
+
+
+int main (int argc, char **argv) {
+    int nrays = argc > 1 ? atoi(argv[1]) : 2000;
+
+    mesh_storage *shared_mesh = MakeMesh(0.015, 0.03, 24);
+    int counts[4] = { 6, 30, 120, 600 };
+    for (int i = 0; i < 4; ++i) {
+        RunMaster(counts[i], nrays, shared_mesh);
+    }
+    mesh_bvh_free(&shared_mesh->bvh);
+    free(shared_mesh);
+
+    if (g_errors) {
+        printf("%d errors\n", g_errors);
+        exit(1);
+    }
+    printf("union_bounds: OK\n");
+}
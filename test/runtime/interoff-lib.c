@@ -0,0 +1,12 @@
+long off_init(char *offfile, double xwidth, double yheight, double zdepth, int notcenter, off_struct *data) {
+    *data = {};
+    return 0;
+}
+
+int off_intersect_all(double *t0, double *t3, Coords *n0, Coords *n3, double x, double y, double z,
+    double vx, double vy, double vz, double ax, double ay, double az, off_struct *data) {
+    return 0;
+}
+
+void off_display(off_struct data) {
+}
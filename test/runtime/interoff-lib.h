@@ -0,0 +1,24 @@
+#ifndef __INTEROFF_LIB_H__
+#define __INTEROFF_LIB_H__
+
+
+//
+//  Stand-in for interoff-lib: the OFF geometry type Monitor_nD declares, OFF files are not supported by the stub
+//  runtime, so off_init fails and the monitor falls back to its plain shape.
+
+
+struct off_struct {
+    long vtxSize;
+    long polySize;
+    long faceSize;
+    int mantidflag;
+    long mantidoffset;
+};
+
+long off_init(char *offfile, double xwidth, double yheight, double zdepth, int notcenter, off_struct *data);
+int off_intersect_all(double *t0, double *t3, Coords *n0, Coords *n3, double x, double y, double z,
+    double vx, double vy, double vz, double ax, double ay, double az, off_struct *data);
+void off_display(off_struct data);
+
+
+#endif
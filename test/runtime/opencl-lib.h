@@ -0,0 +1,9 @@
+#ifndef __OPENCL_LIB_H__
+#define __OPENCL_LIB_H__
+
+
+//
+//  Stand-in for opencl-lib: components only use it under USE_OPENCL, which the stub runtime never defines.
+
+
+#endif
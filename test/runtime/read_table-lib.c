@@ -0,0 +1,83 @@
+FILE *Open_File(char *name, const char *mode, char *path) {
+    printf("Open_File: %s: data files are not supported by the stub runtime\n", name);
+    return NULL;
+}
+
+long Table_Read(t_Table *table, char *filename, long block_number) {
+    printf("Table_Read: %s: data tables are not supported by the stub runtime\n", filename);
+    return -1;
+}
+
+t_Table *Table_Read_Array(char *filename, long *blocks) {
+    printf("Table_Read_Array: %s: data tables are not supported by the stub runtime\n", filename);
+    *blocks = 0;
+    return NULL;
+}
+
+char **Table_ParseHeader(char *header, ...) {
+    return NULL;
+}
+
+// rows x columns of zeros, 0 if they can not be allocated
+long Table_Init(t_Table *table, long rows, long columns) {
+    *table = t_Table {};
+    if (rows * columns > 0) {
+        table->data = (double*) calloc(rows * columns, sizeof(double));
+        if (table->data == NULL) {
+            return 0;
+        }
+    }
+    table->rows = rows;
+    table->columns = columns;
+    return rows * columns > 0 ? rows * columns : 1;
+}
+
+double Table_Index(t_Table table, long i, long j) {
+    if (table.data == NULL || table.rows <= 0 || table.columns <= 0) {
+        return 0;
+    }
+    i = i < 0 ? 0 : (i >= table.rows ? table.rows - 1 : i);
+    j = j < 0 ? 0 : (j >= table.columns ? table.columns - 1 : j);
+    return table.data[i * table.columns + j];
+}
+
+int Table_SetElement(t_Table *table, long i, long j, double value) {
+    if (table->data == NULL || i < 0 || i >= table->rows || j < 0 || j >= table->columns) {
+        return 0;
+    }
+    table->data[i * table->columns + j] = value;
+    return 1;
+}
+
+double Table_Value(t_Table table, double x, long j) {
+    return 0;
+}
+
+// linear interpolation between the rows and columns at the fractional indices x and y
+double Table_Value2d(t_Table table, double x, double y) {
+    long i = (long) floor(x);
+    long j = (long) floor(y);
+    double fx = x - i;
+    double fy = y - j;
+    return (1 - fx) * (1 - fy) * Table_Index(table, i, j) + fx * (1 - fy) * Table_Index(table, i + 1, j)
+        + (1 - fx) * fy * Table_Index(table, i, j + 1) + fx * fy * Table_Index(table, i + 1, j + 1);
+}
+
+void Table_Stat(t_Table *table) {
+}
+
+long Table_Info_Array(t_Table *tables) {
+    return 0;
+}
+
+int Table_Write(t_Table table, char *file, char *xl, char *yl, double x1, double x2, double y1, double y2) {
+    return 0;
+}
+
+void Table_Free(t_Table *table) {
+    free(table->data);
+    table->data = NULL;
+}
+
+void Table_Free_Array(t_Table *tables) {
+}
@@ -0,0 +1,39 @@
+#ifndef __READ_TABLE_LIB_H__
+#define __READ_TABLE_LIB_H__
+
+
+//
+//  Stand-in for read_table-lib: the table type components declare and the tables they fill in memory, reading
+//  and writing files is not supported by the stub runtime.
+
+
+struct t_Table {
+    char *filename;
+    char *header;
+    double *data;
+    long rows;
+    long columns;
+    double min_x;
+    double max_x;
+    double step_x;
+    long block_number;
+    long array_length;
+};
+
+FILE *Open_File(char *name, const char *mode, char *path);
+long Table_Read(t_Table *table, char *filename, long block_number);
+t_Table *Table_Read_Array(char *filename, long *blocks);
+char **Table_ParseHeader(char *header, ...);
+long Table_Init(t_Table *table, long rows, long columns);
+double Table_Index(t_Table table, long i, long j);
+int Table_SetElement(t_Table *table, long i, long j, double value);
+double Table_Value(t_Table table, double x, long j);
+double Table_Value2d(t_Table table, double x, double y);
+void Table_Stat(t_Table *table);
+long Table_Info_Array(t_Table *tables);
+int Table_Write(t_Table table, char *file, char *xl, char *yl, double x1, double x2, double y1, double y2);
+void Table_Free(t_Table *table);
+void Table_Free_Array(t_Table *tables);
+
+
+#endif
@@ -0,0 +1,33 @@
+// par: R0, Qc, alpha, m, W
+void StdReflecFunc(double q, double *par, double *r) {
+    double R0 = par[0];
+    double Qc = par[1];
+    double alpha = par[2];
+    double m = par[3];
+    double W = par[4];
+
+    q = fabs(q);
+    if (m >= 10) {
+        *r = R0;
+        return;
+    }
+    if (q <= Qc) {
+        *r = R0;
+        return;
+    }
+    if (W == 0) {
+        *r = 0;
+        return;
+    }
+    double arg = (q - m*Qc) / W;
+    if (arg < 10) {
+        *r = 0.5 * R0 * (1 - tanh(arg)) * (1 - alpha*(q - Qc));
+    }
+    else {
+        *r = 0;
+    }
+}
+
+void TableReflecFunc(double q, t_Table *table, double *r) {
+    *r = 0;
+}
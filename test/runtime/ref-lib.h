@@ -0,0 +1,13 @@
+#ifndef __REF_LIB_H__
+#define __REF_LIB_H__
+
+
+//
+//  Stand-in for ref-lib: the analytic supermirror reflectivity, tabulated reflectivity always gives zero.
+
+
+void StdReflecFunc(double q, double *par, double *r);
+void TableReflecFunc(double q, t_Table *table, double *r);
+
+
+#endif
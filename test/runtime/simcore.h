@@ -0,0 +1,787 @@
+#ifndef __SIMCORE_H__
+#define __SIMCORE_H__
+
+
+#include <cmath>
+#include <math.h>
+#include <cfloat>
+#include <cctype>
+#include <unistd.h>
+
+
+//
+//  Minimal stand-in for the simulation runtime (simcore.h / simlib.h) that generated component and instrument
+//  code is written against. Enough to compile and trace a cogen'd instrument on a plain box: particle state and
+//  propagation macros, random numbers, monitor arrays, a flat scene graph and the legacy mcstas placement fields.
+//  Display, file output and data tables are no-ops.
+
+
+//
+//  Constants
+
+
+#define PI M_PI
+#define DEG2RAD (M_PI / 180.0)
+#define RAD2DEG (180.0 / M_PI)
+#define V2K 1.58825361e-3
+#define K2V 629.622368
+#define V2Q V2K
+#define Q2V K2V
+#define VS2E 5.22703725e-6
+#define SE2V 437.393377
+#define HBAR 1.05457168e-34
+#define MNEUTRON 1.67492e-27
+#define NA 6.02214179e23
+#define RMS2FWHM 2.35482
+#define FWHM2RMS 0.424660900144
+#define MIN2RAD (M_PI / (180.0 * 60.0))
+
+#define SQR(x) ((x) * (x))
+#define CHAR_BUF_LENGTH 1024
+#define MONND_BUFSIZ 10000
+
+static const f32 deg2rad = (f32) (M_PI / 180.0);
+
+static int mcgravitation = 0;
+
+
+//
+//  Particle
+
+
+struct Neutron {
+    double x, y, z;
+    double vx, vy, vz;
+    double sx, sy, sz;
+    double t;
+    double p;
+    s64 _uid;
+
+    // trace state, set by the macros below
+    s32 _absorb;
+    s32 _restore;
+    s32 _backprop;
+    s32 _scatter;
+};
+
+// the mccode-r names of the particle type and pointer, which the share libraries use
+typedef Neutron _class_particle;
+#define _particle particle
+typedef double MCNUM;
+
+// user variables are not supported
+double particle_getvar(Neutron *particle, char *name, int *fail) {
+    *fail = 1;
+    return 0;
+}
+
+// NOTE: Trace_X functions alias the particle fields as x, y, z, vx ... so the macros use the bare names
+
+#define ABSORB do { particle->_absorb = 1; return; } while (0)
+#define SCATTER do { particle->_scatter++; } while (0)
+#define SCATTERED particle->_scatter
+#define ALLOW_BACKPROP do { particle->_backprop = 1; } while (0)
+#define RESTORE_NEUTRON(...) do { particle->_restore = 1; } while (0)
+
+#define PROP_DT(dt) do { \
+    double _dt = (dt); \
+    if (_dt < 0 && particle->_backprop == 0) { ABSORB; } \
+    x += vx * _dt; \
+    y += vy * _dt; \
+    z += vz * _dt; \
+    t += _dt; \
+    particle->_backprop = 0; \
+} while (0)
+
+#define PROP_Z0 do { \
+    if (vz == 0) { ABSORB; } \
+    double _dt0 = -z / vz; \
+    if (_dt0 < 0 && particle->_backprop == 0) { ABSORB; } \
+    x += vx * _dt0; \
+    y += vy * _dt0; \
+    z = 0; \
+    t += _dt0; \
+    particle->_backprop = 0; \
+} while (0)
+
+
+//
+//  Instrument
+
+
+static u64 g_mcncount;
+
+void mcset_ncount(u64 ncount) {
+    g_mcncount = ncount;
+}
+
+double mcget_ncount() {
+    return (double) g_mcncount;
+}
+
+struct Instrument {
+    char *name;
+};
+
+// a single process, which is the master
+#define MPI_MASTER(statement) statement
+
+// where components look for their data files and tools
+#define MCSTAS "/usr/share/mcstas"
+#define FLAVOR_UPPER "MCSTAS"
+#define MC_PATHSEP_C '/'
+static char instrument_source[] = "";
+
+// the ui context the generated config allocates its scene graph from
+struct RuntimeUI {
+    MContext *ctx;
+};
+static RuntimeUI cbui;
+
+
+//
+//  Legacy placement fields
+
+
+struct Coords {
+    double x, y, z;
+};
+
+struct Rotation {
+    double m[3][3];
+};
+
+Coords coords_set(double x, double y, double z) {
+    return Coords { x, y, z };
+}
+
+Coords coords_sub(Coords a, Coords b) {
+    return Coords { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+Coords coords_add(Coords a, Coords b) {
+    return Coords { a.x + b.x, a.y + b.y, a.z + b.z };
+}
+
+void coords_get(Coords a, double *x, double *y, double *z) {
+    *x = a.x;
+    *y = a.y;
+    *z = a.z;
+}
+
+Coords rot_apply(Rotation r, Coords a) {
+    Coords b;
+    b.x = r.m[0][0] * a.x + r.m[0][1] * a.y + r.m[0][2] * a.z;
+    b.y = r.m[1][0] * a.x + r.m[1][1] * a.y + r.m[1][2] * a.z;
+    b.z = r.m[2][0] * a.x + r.m[2][1] * a.y + r.m[2][2] * a.z;
+    return b;
+}
+
+Coords rot_apply_transposed(Rotation r, Coords a) {
+    Coords b;
+    b.x = r.m[0][0] * a.x + r.m[1][0] * a.y + r.m[2][0] * a.z;
+    b.y = r.m[0][1] * a.x + r.m[1][1] * a.y + r.m[2][1] * a.z;
+    b.z = r.m[0][2] * a.x + r.m[1][2] * a.y + r.m[2][2] * a.z;
+    return b;
+}
+
+// every generated component struct starts with these members
+struct ComponentHeader {
+    int index;
+    char *name;
+    char *type;
+    Coords position_absolute;
+    Coords position_relative;
+    Rotation rotation_absolute;
+    Rotation rotation_relative;
+};
+
+#define NAME_CURRENT_COMP comp->name
+#define INDEX_CURRENT_COMP comp->index
+#define POS_A_CURRENT_COMP comp->position_absolute
+#define POS_R_CURRENT_COMP comp->position_relative
+#define ROT_A_CURRENT_COMP comp->rotation_absolute
+#define ROT_R_CURRENT_COMP comp->rotation_relative
+
+
+//
+//  Parameter helpers
+
+
+#define UNSET NAN
+
+int is_unset(double v) {
+    return std::isnan(v);
+}
+
+int is_set(double v) {
+    return std::isnan(v) == false;
+}
+
+int all_set(int n, ...) {
+    va_list args;
+    va_start(args, n);
+    int res = 1;
+    for (int i = 0; i < n; ++i) {
+        if (std::isnan(va_arg(args, double))) { res = 0; }
+    }
+    va_end(args);
+    return res;
+}
+
+int any_set(int n, ...) {
+    va_list args;
+    va_start(args, n);
+    int res = 0;
+    for (int i = 0; i < n; ++i) {
+        if (std::isnan(va_arg(args, double)) == false) { res = 1; }
+    }
+    va_end(args);
+    return res;
+}
+
+int any_unset(int n, ...) {
+    va_list args;
+    va_start(args, n);
+    int res = 0;
+    for (int i = 0; i < n; ++i) {
+        if (std::isnan(va_arg(args, double))) { res = 1; }
+    }
+    va_end(args);
+    return res;
+}
+
+
+//
+//  Vectors
+
+
+#define NORM(x, y, z) do { \
+    double _len = sqrt((x)*(x) + (y)*(y) + (z)*(z)); \
+    if (_len > 0) { (x) /= _len; (y) /= _len; (z) /= _len; } \
+} while (0)
+
+#define scalar_prod(x1, y1, z1, x2, y2, z2) ((x1) * (x2) + (y1) * (y2) + (z1) * (z2))
+
+#define vec_prod(x, y, z, x1, y1, z1, x2, y2, z2) do { \
+    double _vx = (y1) * (z2) - (z1) * (y2); \
+    double _vy = (z1) * (x2) - (x1) * (z2); \
+    double _vz = (x1) * (y2) - (y1) * (x2); \
+    (x) = _vx; (y) = _vy; (z) = _vz; \
+} while (0)
+
+// (x, y, z) = (vx, vy, vz) rotated by phi [rad] about the axis (ax, ay, az), right hand rule
+void rotate_real(double *x, double *y, double *z, double vx, double vy, double vz, double phi, double ax, double ay, double az) {
+    NORM(ax, ay, az);
+    double c = cos(phi), s = sin(phi);
+    double dot = vx * ax + vy * ay + vz * az;
+    *x = vx * c + (ay * vz - az * vy) * s + ax * dot * (1 - c);
+    *y = vy * c + (az * vx - ax * vz) * s + ay * dot * (1 - c);
+    *z = vz * c + (ax * vy - ay * vx) * s + az * dot * (1 - c);
+}
+
+#define rotate(x, y, z, vx, vy, vz, phi, ax, ay, az) rotate_real(&(x), &(y), &(z), vx, vy, vz, phi, ax, ay, az)
+
+// a unit vector normal to (x, y, z), in the plane of its two largest components, as mccode-r
+void normal_vec(double *nx, double *ny, double *nz, double x, double y, double z) {
+    double ax = fabs(x), ay = fabs(y), az = fabs(z), l;
+    if (x == 0 && y == 0 && z == 0) {
+        *nx = *ny = *nz = 0;
+        return;
+    }
+    if (ax < ay) {
+        if (ax < az) {
+            l = sqrt(z * z + y * y);
+            *nx = 0; *ny = z / l; *nz = -y / l;
+            return;
+        }
+    }
+    else if (ay < az) {
+        l = sqrt(z * z + x * x);
+        *nx = z / l; *ny = 0; *nz = -x / l;
+        return;
+    }
+    l = sqrt(y * y + x * x);
+    *nx = y / l; *ny = -x / l; *nz = 0;
+}
+
+// roots of A t^2 + B t + C, 2 when real, 1 for a linear equation, 0 otherwise
+int solve_2nd_order(double *t1, double *t2, double A, double B, double C) {
+    *t1 = 0;
+    if (t2) { *t2 = 0; }
+    if (fabs(A) < 1e-10) {
+        if (B == 0) {
+            return 0;
+        }
+        *t1 = -C / B;
+        if (t2) { *t2 = *t1; }
+        return 1;
+    }
+    double D = B * B - 4 * A * C;
+    if (D < 0) {
+        return 0;
+    }
+    *t1 = (-B + sqrt(D)) / (2 * A);
+    if (t2) { *t2 = (-B - sqrt(D)) / (2 * A); }
+    return 2;
+}
+
+
+//
+//  Random numbers, xorshift64*
+
+
+static u64 g_rng_state = 0x9E3779B97F4A7C15ull;
+
+void srandom_rt(u64 seed) {
+    g_rng_state = seed ? seed : 0x9E3779B97F4A7C15ull;
+}
+
+double rand01() {
+    g_rng_state ^= g_rng_state >> 12;
+    g_rng_state ^= g_rng_state << 25;
+    g_rng_state ^= g_rng_state >> 27;
+    u64 r = g_rng_state * 0x2545F4914F6CDD1Dull;
+    return (r >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double randpm1() {
+    return rand01() * 2 - 1;
+}
+
+double rand0max(double max) {
+    return rand01() * max;
+}
+
+double randnorm() {
+    double u1 = rand01();
+    double u2 = rand01();
+    if (u1 <= 0) { u1 = 1e-300; }
+    return sqrt(-2 * log(u1)) * cos(2 * PI * u2);
+}
+
+// point on a target rectangle centered at (tx, ty, tz) in the local frame, and the solid angle weight
+// NOTE: the rectangle is taken to face the z axis, the rotation argument is ignored
+void randvec_target_rect_real(double *xo, double *yo, double *zo, double *solid_angle,
+        double tx, double ty, double tz, double width, double height, Rotation A,
+        double x, double y, double z, int order) {
+    *xo = tx + width * randpm1() / 2;
+    *yo = ty + height * randpm1() / 2;
+    *zo = tz;
+    if (solid_angle) {
+        double dx = *xo - x;
+        double dy = *yo - y;
+        double dz = *zo - z;
+        double d2 = dx*dx + dy*dy + dz*dz;
+        *solid_angle = width * height * fabs(dz) / (d2 * sqrt(d2));
+    }
+}
+
+
+// direction of length |(xi, yi, zi)| into the cone of a circle of the given radius around it, any direction for radius 0
+void randvec_target_circle(double *xo, double *yo, double *zo, double *solid_angle, double xi, double yi, double zi, double radius) {
+    double theta, phi, nx = 1, ny = 0, nz = 0;
+    if (radius == 0) {
+        theta = acos(1 - rand0max(2));
+        phi = rand0max(2 * PI);
+        if (solid_angle) { *solid_angle = 4 * PI; }
+        yi = sqrt(xi * xi + yi * yi + zi * zi);
+        xi = zi = 0;
+    }
+    else {
+        double l2 = xi * xi + yi * yi + zi * zi;
+        double costheta0 = sqrt(l2 / (radius * radius + l2));
+        if (radius < 0) { costheta0 *= -1; }
+        if (solid_angle) { *solid_angle = 2 * PI * (1 - costheta0); }
+        theta = acos(1 - rand0max(1 - costheta0));
+        phi = rand0max(2 * PI);
+        if (xi != 0 || zi != 0) { nx = -zi; nz = xi; }
+    }
+    double xu, yu, zu, xt, yt, zt;
+    vec_prod(xu, yu, zu, xi, yi, zi, nx, ny, nz);
+    rotate(xt, yt, zt, xi, yi, zi, theta, xu, yu, zu);
+    rotate(*xo, *yo, *zo, xt, yt, zt, phi, xi, yi, zi);
+}
+
+// NOTE: angular focusing is not supported by the stub runtime
+void randvec_target_rect_angular(double *xo, double *yo, double *zo, double *solid_angle,
+        double xi, double yi, double zi, double width, double height, Rotation A) {
+    printf("randvec_target_rect_angular: focusing is not supported by the stub runtime\n");
+    exit(1);
+}
+
+
+//
+//  Monitor arrays
+
+
+typedef double *DArray1d;
+typedef double **DArray2d;
+
+DArray1d create_darr1d(int n) {
+    return (DArray1d) calloc(n, sizeof(double));
+}
+
+void destroy_darr1d(DArray1d a) {
+    free(a);
+}
+
+DArray2d create_darr2d(int nx, int ny) {
+    DArray2d a = (DArray2d) calloc(nx, sizeof(double*));
+    double *data = (double*) calloc(nx * ny, sizeof(double));
+    for (int i = 0; i < nx; ++i) {
+        a[i] = data + i * ny;
+    }
+    return a;
+}
+
+void destroy_darr2d(DArray2d a) {
+    if (a) { free(a[0]); }
+    free(a);
+}
+
+#define DETECTOR_OUT(...)
+#define DETECTOR_OUT_0D(...)
+#define DETECTOR_OUT_1D(...)
+#define DETECTOR_OUT_2D(...)
+#define DETECTOR_OUT_3D(...)
+
+struct MCDETECTOR {
+    long m;
+    char options[CHAR_BUF_LENGTH];
+};
+
+MCDETECTOR mcdetector_out_0D(...) { return MCDETECTOR {}; }
+MCDETECTOR mcdetector_out_1D(...) { return MCDETECTOR {}; }
+MCDETECTOR mcdetector_out_2D(...) { return MCDETECTOR {}; }
+MCDETECTOR mcdetector_out_list(...) { return MCDETECTOR {}; }
+MCDETECTOR mcdetector_out_2D_list(...) { return MCDETECTOR {}; }
+
+// name.ext in the working directory, or name if it has an extension
+char *mcfull_file(char *name, char *ext) {
+    char *path = (char*) malloc(strlen(name) + (ext ? strlen(ext) : 0) + 2);
+    strcpy(path, name);
+    if (ext && strchr(name, '.') == NULL) {
+        strcat(path, ".");
+        strcat(path, ext);
+    }
+    return path;
+}
+
+
+//
+//  Sphere, cylinder and box intersections of mccode-r: entry and exit times of a line through the shape at the
+//  origin, 0 on a miss
+
+
+int sphere_intersect(double *t0, double *t1, double x, double y, double z, double vx, double vy, double vz, double r) {
+    double A = vx * vx + vy * vy + vz * vz;
+    double B = 2 * (x * vx + y * vy + z * vz);
+    double C = x * x + y * y + z * z - r * r;
+    double D = B * B - 4 * A * C;
+    if (D < 0) {
+        return 0;
+    }
+    D = sqrt(D);
+    *t0 = (-B - D) / (2 * A);
+    *t1 = (-B + D) / (2 * A);
+    return 1;
+}
+
+// cylinder along y of height h, returns 1 + 2 when entering through a cap, + 4 when leaving through one
+int cylinder_intersect(double *t0, double *t1, double x, double y, double z, double vx, double vy, double vz, double r, double h) {
+    double D = (2 * vx * x + 2 * vz * z) * (2 * vx * x + 2 * vz * z) - 4 * (vx * vx + vz * vz) * (x * x + z * z - r * r);
+    if (D < 0) {
+        *t0 = *t1 = 0;
+        return 0;
+    }
+    double t_in, t_out;
+    if (vx * vx + vz * vz) {
+        t_in = (-(2 * vz * z + 2 * vx * x) - sqrt(D)) / (2 * (vz * vz + vx * vx));
+        t_out = (-(2 * vz * z + 2 * vx * x) + sqrt(D)) / (2 * (vz * vz + vx * vx));
+    }
+    else if (vy) {
+        t_in = (-h / 2 - y) / vy;
+        t_out = (h / 2 - y) / vy;
+        if (t_in > t_out) {
+            double tmp = t_in; t_in = t_out; t_out = tmp;
+        }
+    }
+    else {
+        return 0;
+    }
+    double y_in = vy * t_in + y;
+    double y_out = vy * t_out + y;
+    if ((y_in > h / 2 && y_out > h / 2) || (y_in < -h / 2 && y_out < -h / 2)) {
+        return 0;
+    }
+    int ret = 1;
+    if (y_in > h / 2) { t_in = (h / 2 - y) / vy; ret += 2; }
+    else if (y_in < -h / 2) { t_in = (-h / 2 - y) / vy; ret += 2; }
+    if (y_out > h / 2) { t_out = (h / 2 - y) / vy; ret += 4; }
+    else if (y_out < -h / 2) { t_out = (-h / 2 - y) / vy; ret += 4; }
+    *t0 = t_in;
+    *t1 = t_out;
+    return ret;
+}
+
+// box of sides dx, dy, dz, the times of the faces hit, a face hit at exactly t = 0 counts as a miss as in mccode-r
+int box_intersect(double *dt_in, double *dt_out, double x, double y, double z, double vx, double vy, double vz,
+    double dx, double dy, double dz) {
+    double t[6] = {};
+    double p[3] = { x, y, z };
+    double v[3] = { vx, vy, vz };
+    double d[3] = { dx, dy, dz };
+    for (int axis = 0; axis < 3; ++axis) {
+        if (v[axis] == 0) {
+            continue;
+        }
+        int a1 = (axis + 1) % 3;
+        int a2 = (axis + 2) % 3;
+        for (int side = 0; side < 2; ++side) {
+            double tt = ((side ? 1 : -1) * d[axis] / 2 - p[axis]) / v[axis];
+            double c1 = p[a1] + tt * v[a1];
+            double c2 = p[a2] + tt * v[a2];
+            if (c1 > -d[a1] / 2 && c1 < d[a1] / 2 && c2 > -d[a2] / 2 && c2 < d[a2] / 2) {
+                t[2 * axis + side] = tt;
+            }
+        }
+    }
+    double a = 0, b = 0;
+    int count = 0;
+    for (int i = 0; i < 6; ++i) {
+        if (t[i] == 0) continue;
+        if (count == 0) { a = t[i]; count = 1; }
+        else { b = t[i]; count = 2; }
+    }
+    if (a == 0 && b == 0) {
+        return 0;
+    }
+    *dt_in = a < b ? a : b;
+    *dt_out = a < b ? b : a;
+    return 1;
+}
+
+
+//
+//  Display, no-ops
+
+
+void mcdis_magnify(...) {}
+void mcdis_line(...) {}
+void mcdis_dashed_line(...) {}
+void mcdis_multiline(...) {}
+void mcdis_rectangle(...) {}
+void mcdis_box(...) {}
+void mcdis_circle(...) {}
+void mcdis_Circle(...) {}
+void mcdis_cylinder(...) {}
+void mcdis_cone(...) {}
+void mcdis_sphere(...) {}
+void polygon(...) {}
+
+
+//
+//  Scene graph: a flat pool of transforms, parents are allocated before their children
+
+
+struct Vector3f {
+    f32 x, y, z;
+};
+
+struct Matrix4f {
+    f32 m[4][4];
+};
+
+Matrix4f Matrix4f_Identity() {
+    Matrix4f r = {};
+    for (s32 i = 0; i < 4; ++i) { r.m[i][i] = 1; }
+    return r;
+}
+
+Matrix4f operator*(Matrix4f a, Matrix4f b) {
+    Matrix4f r = {};
+    for (s32 i = 0; i < 4; ++i) {
+        for (s32 j = 0; j < 4; ++j) {
+            for (s32 k = 0; k < 4; ++k) { r.m[i][j] += a.m[i][k] * b.m[k][j]; }
+        }
+    }
+    return r;
+}
+
+Matrix4f TransformBuildTranslation(Vector3f v) {
+    Matrix4f r = Matrix4f_Identity();
+    r.m[0][3] = v.x;
+    r.m[1][3] = v.y;
+    r.m[2][3] = v.z;
+    return r;
+}
+
+Matrix4f TransformBuildRotateX(f32 angle) {
+    Matrix4f r = Matrix4f_Identity();
+    r.m[1][1] = cos(angle); r.m[1][2] = -sin(angle);
+    r.m[2][1] = sin(angle); r.m[2][2] = cos(angle);
+    return r;
+}
+
+Matrix4f TransformBuildRotateY(f32 angle) {
+    Matrix4f r = Matrix4f_Identity();
+    r.m[0][0] = cos(angle); r.m[0][2] = sin(angle);
+    r.m[2][0] = -sin(angle); r.m[2][2] = cos(angle);
+    return r;
+}
+
+Matrix4f TransformBuildRotateZ(f32 angle) {
+    Matrix4f r = Matrix4f_Identity();
+    r.m[0][0] = cos(angle); r.m[0][1] = -sin(angle);
+    r.m[1][0] = sin(angle); r.m[1][1] = cos(angle);
+    return r;
+}
+
+struct Transform {
+    Matrix4f t_loc;
+    Matrix4f t_world;
+    Transform *parent;
+    bool rot_separate; // ROTATED is not relative to the AT parent, but to rot_parent, or ABSOLUTE if that is NULL
+    Transform *rot_parent;
+};
+
+struct SceneGraphHandle {
+    Array<Transform> nodes;
+};
+
+SceneGraphHandle SceneGraphInit(MArena *a_dest) {
+    SceneGraphHandle sg = {};
+    sg.nodes = InitArray<Transform>(a_dest, 256);
+    return sg;
+}
+
+Transform *SceneGraphAlloc(SceneGraphHandle *sg, Transform *parent = NULL) {
+    assert(sg->nodes.len < sg->nodes.max && "scene graph full");
+    sg->nodes.Add(Transform {});
+    Transform *node = sg->nodes.arr + sg->nodes.len - 1;
+    node->t_loc = Matrix4f_Identity();
+    node->t_world = Matrix4f_Identity();
+    node->parent = parent;
+    node->rot_separate = false;
+    node->rot_parent = NULL;
+    return node;
+}
+
+// AT stays relative to the parent of SceneGraphAlloc, ROTATED becomes relative to rot_parent, NULL for ABSOLUTE
+void SceneGraphSetRotParent(SceneGraphHandle *sg, Transform *node, Transform *rot_parent) {
+    assert((rot_parent == NULL || (rot_parent < node && rot_parent >= sg->nodes.arr)) && "the ROTATED parent must be allocated before the node");
+    node->rot_separate = true;
+    node->rot_parent = rot_parent;
+}
+
+void SceneGraphUpdate(SceneGraphHandle *sg) {
+    for (u32 i = 0; i < sg->nodes.len; ++i) {
+        Transform *node = sg->nodes.arr + i;
+        if (node->rot_separate) {
+            // position: the local translation in the frame of the AT parent, rotation: the local rotation in the
+            // frame of the ROTATED parent
+            Matrix4f at_world = TransformBuildTranslation( { node->t_loc.m[0][3], node->t_loc.m[1][3], node->t_loc.m[2][3] } );
+            if (node->parent) {
+                at_world = node->parent->t_world * at_world;
+            }
+            Matrix4f rot_loc = node->t_loc;
+            rot_loc.m[0][3] = rot_loc.m[1][3] = rot_loc.m[2][3] = 0;
+            node->t_world = node->rot_parent ? node->rot_parent->t_world * rot_loc : rot_loc;
+            node->t_world.m[0][3] = at_world.m[0][3];
+            node->t_world.m[1][3] = at_world.m[1][3];
+            node->t_world.m[2][3] = at_world.m[2][3];
+        }
+        else if (node->parent) {
+            node->t_world = node->parent->t_world * node->t_loc;
+        }
+        else {
+            node->t_world = node->t_loc;
+        }
+    }
+}
+
+
+//
+//  Components
+
+
+// type and category hold the CompType / CompCategory values of comps_meta.h, which is included later
+struct Component {
+    s32 type;
+    s32 cat;
+    void *comp;
+    Str type_name;
+    Str name;
+    Transform *transform;
+};
+
+struct InstrumentConfig {
+    Instrument instr;
+    SceneGraphHandle scenegraph;
+    Array<Component*> comps;
+};
+
+static Array<Component*> g_legacy_comps;
+
+// the mcstas placement fields: absolute position, and the rotation that takes absolute into local coordinates
+void UpdateLegacyTransforms(Array<Component*> comps) {
+    g_legacy_comps = comps;
+    ComponentHeader *prev = NULL;
+    for (u32 i = 0; i < comps.len; ++i) {
+        Component *c = comps.arr[i];
+        ComponentHeader *h = (ComponentHeader*) c->comp;
+        Matrix4f *w = &c->transform->t_world;
+
+        h->position_absolute = Coords { w->m[0][3], w->m[1][3], w->m[2][3] };
+        for (s32 r = 0; r < 3; ++r) {
+            for (s32 k = 0; k < 3; ++k) { h->rotation_absolute.m[r][k] = w->m[k][r]; }
+        }
+
+        if (prev) {
+            h->position_relative = rot_apply(prev->rotation_absolute, coords_sub(h->position_absolute, prev->position_absolute));
+            for (s32 r = 0; r < 3; ++r) {
+                for (s32 k = 0; k < 3; ++k) {
+                    double sum = 0;
+                    for (s32 j = 0; j < 3; ++j) { sum += h->rotation_absolute.m[r][j] * prev->rotation_absolute.m[k][j]; }
+                    h->rotation_relative.m[r][k] = sum;
+                }
+            }
+        }
+        else {
+            h->position_relative = h->position_absolute;
+            h->rotation_relative = h->rotation_absolute;
+        }
+        prev = h;
+    }
+}
+
+Coords POS_A_COMP_INDEX(s32 index) {
+    assert(index >= 0 && index < (s32) g_legacy_comps.len);
+    return ((ComponentHeader*) g_legacy_comps.arr[index]->comp)->position_absolute;
+}
+
+Rotation ROT_A_COMP_INDEX(s32 index) {
+    assert(index >= 0 && index < (s32) g_legacy_comps.len);
+    return ((ComponentHeader*) g_legacy_comps.arr[index]->comp)->rotation_absolute;
+}
+
+// particle from absolute into component coordinates, and back
+void ParticleToLocal(Component *c, Neutron *n) {
+    ComponentHeader *h = (ComponentHeader*) c->comp;
+    Coords pos = rot_apply(h->rotation_absolute, coords_sub(Coords { n->x, n->y, n->z }, h->position_absolute));
+    Coords vel = rot_apply(h->rotation_absolute, Coords { n->vx, n->vy, n->vz });
+    n->x = pos.x; n->y = pos.y; n->z = pos.z;
+    n->vx = vel.x; n->vy = vel.y; n->vz = vel.z;
+}
+
+void ParticleToAbsolute(Component *c, Neutron *n) {
+    ComponentHeader *h = (ComponentHeader*) c->comp;
+    Coords pos = coords_add(rot_apply_transposed(h->rotation_absolute, Coords { n->x, n->y, n->z }), h->position_absolute);
+    Coords vel = rot_apply_transposed(h->rotation_absolute, Coords { n->vx, n->vy, n->vz });
+    n->x = pos.x; n->y = pos.y; n->z = pos.z;
+    n->vx = vel.x; n->vy = vel.y; n->vz = vel.z;
+}
+
+
+#endif
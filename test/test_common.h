@@ -0,0 +1,39 @@
+#ifndef __TEST_COMMON_H__
+#define __TEST_COMMON_H__
+
+#include <cstdint>
+#include <chrono>
+
+
+//
+//  Shared by the share library tests: the error count, the clock of the timing reports, and a seeded xorshift
+//  generator, so that the random cases are the same on every run and every platform.
+
+
+static int g_errors = 0;
+
+static double BenchNow() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull;
+
+// uniform in [0, 1)
+static double Rand01() {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (g_rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// uniform in (0, 1), for log()
+static double Rand01Open() {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return ((g_rng >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+
+#endif
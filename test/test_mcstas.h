@@ -0,0 +1,255 @@
+#ifndef __TEST_MCSTAS_H__
+#define __TEST_MCSTAS_H__
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <cfloat>
+#include <climits>
+
+#include "test_common.h"
+
+
+//
+//  The parts of the McStas runtime that the share libraries use, so that tests can build the libraries themselves
+//  outside of an instrument: Coords, Rotation, the vector macros and the globals of mccode-r. The libraries are
+//  included from runtime/share/, where build.sh puts copies with their %include lines made into #includes.
+
+
+#define CHAR_BUF_LENGTH 1024
+#define MCSTAS "/usr/share/mcstas"
+#define FLAVOR_UPPER "MCSTAS"
+#define MC_PATHSEP_C '/'
+#define MPI_MASTER(statement) statement
+
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+#define DEG2RAD (M_PI / 180.0)
+#define RAD2DEG (180.0 / M_PI)
+#define V2Q 1.58825361e-3
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+static char *dirname = (char*) ".";
+static char instrument_source[] = "test";
+static char instrument_exe[] = "test";
+static unsigned long long mcrun_num = 0;
+
+double rand01() {
+    return Rand01();
+}
+
+struct Coords {
+    double x, y, z;
+};
+
+typedef double Rotation[3][3];
+
+Coords coords_set(double x, double y, double z) { Coords a = { x, y, z }; return a; }
+Coords coords_add(Coords a, Coords b) { return coords_set(a.x + b.x, a.y + b.y, a.z + b.z); }
+Coords coords_sub(Coords a, Coords b) { return coords_set(a.x - b.x, a.y - b.y, a.z - b.z); }
+Coords coords_neg(Coords a) { return coords_set(-a.x, -a.y, -a.z); }
+Coords coords_scale(Coords a, double s) { return coords_set(a.x * s, a.y * s, a.z * s); }
+double coords_sp(Coords a, Coords b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+double coords_len(Coords a) { return sqrt(coords_sp(a, a)); }
+Coords coords_xp(Coords a, Coords b) { return coords_set(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+void coords_get(Coords a, double *x, double *y, double *z) { *x = a.x; *y = a.y; *z = a.z; }
+
+void coords_norm(Coords *a) {
+    double len = coords_len(*a);
+    if (len > 0) {
+        a->x /= len; a->y /= len; a->z /= len;
+    }
+}
+
+// a mirrored in the plane of normal n
+Coords coords_mirror(Coords a, Coords n) {
+    double n2 = coords_sp(n, n);
+    if (n2 <= 0) return a;
+    return coords_sub(a, coords_scale(n, 2 * coords_sp(a, n) / n2));
+}
+
+#define NORM(x, y, z) do { \
+    double _len = sqrt((x)*(x) + (y)*(y) + (z)*(z)); \
+    if (_len > 0) { (x) /= _len; (y) /= _len; (z) /= _len; } \
+} while (0)
+
+#define scalar_prod(x1, y1, z1, x2, y2, z2) ((x1) * (x2) + (y1) * (y2) + (z1) * (z2))
+
+#define vec_prod(x, y, z, x1, y1, z1, x2, y2, z2) do { \
+    double _vx = (y1) * (z2) - (z1) * (y2); \
+    double _vy = (z1) * (x2) - (x1) * (z2); \
+    double _vz = (x1) * (y2) - (y1) * (x2); \
+    (x) = _vx; (y) = _vy; (z) = _vz; \
+} while (0)
+
+// (x, y, z) = (vx, vy, vz) rotated by phi [rad] about the axis (ax, ay, az), right hand rule
+void TestRotate(double *x, double *y, double *z, double vx, double vy, double vz, double phi, double ax, double ay, double az) {
+    NORM(ax, ay, az);
+    double c = cos(phi), s = sin(phi);
+    double dot = vx * ax + vy * ay + vz * az;
+    *x = vx * c + (ay * vz - az * vy) * s + ax * dot * (1 - c);
+    *y = vy * c + (az * vx - ax * vz) * s + ay * dot * (1 - c);
+    *z = vz * c + (ax * vy - ay * vx) * s + az * dot * (1 - c);
+}
+
+#define rotate(x, y, z, vx, vy, vz, phi, ax, ay, az) TestRotate(&(x), &(y), &(z), vx, vy, vz, phi, ax, ay, az)
+
+void rot_set_rotation(Rotation t, double phx, double phy, double phz) {
+    double cx = cos(phx), sx = sin(phx);
+    double cy = cos(phy), sy = sin(phy);
+    double cz = cos(phz), sz = sin(phz);
+    t[0][0] = cy * cz;
+    t[0][1] = sx * sy * cz + cx * sz;
+    t[0][2] = sx * sz - cx * sy * cz;
+    t[1][0] = -cy * sz;
+    t[1][1] = cx * cz - sx * sy * sz;
+    t[1][2] = sx * cz + cx * sy * sz;
+    t[2][0] = sy;
+    t[2][1] = -sx * cy;
+    t[2][2] = cx * cy;
+}
+
+void rot_copy(Rotation dest, Rotation src) {
+    memcpy(dest, src, sizeof(Rotation));
+}
+
+void rot_transpose(Rotation src, Rotation dst) {
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            dst[j][i] = src[i][j];
+        }
+    }
+}
+
+Coords rot_apply(Rotation t, Coords a) {
+    return coords_set(
+        t[0][0] * a.x + t[0][1] * a.y + t[0][2] * a.z,
+        t[1][0] * a.x + t[1][1] * a.y + t[1][2] * a.z,
+        t[2][0] * a.x + t[2][1] * a.y + t[2][2] * a.z);
+}
+
+
+// the particle is only passed on by pointer in the libraries the tests build
+struct _class_particle {
+    double x, y, z, vx, vy, vz, t, sx, sy, sz, p;
+};
+
+
+//
+//  Geometry of mccode-r: entry and exit times of a line through the shape at the origin, 0 on a miss
+
+
+int sphere_intersect(double *t0, double *t1, double x, double y, double z, double vx, double vy, double vz, double r) {
+    double A = vx * vx + vy * vy + vz * vz;
+    double B = 2 * (x * vx + y * vy + z * vz);
+    double C = x * x + y * y + z * z - r * r;
+    double D = B * B - 4 * A * C;
+    if (D < 0) {
+        return 0;
+    }
+    D = sqrt(D);
+    *t0 = (-B - D) / (2 * A);
+    *t1 = (-B + D) / (2 * A);
+    return 1;
+}
+
+// cylinder along y of height h, returns 1 + 2 when entering through a cap, + 4 when leaving through one
+int cylinder_intersect(double *t0, double *t1, double x, double y, double z, double vx, double vy, double vz, double r, double h) {
+    double D = (2 * vx * x + 2 * vz * z) * (2 * vx * x + 2 * vz * z) - 4 * (vx * vx + vz * vz) * (x * x + z * z - r * r);
+    if (D < 0) {
+        *t0 = *t1 = 0;
+        return 0;
+    }
+    double t_in, t_out;
+    if (vx * vx + vz * vz) {
+        t_in = (-(2 * vz * z + 2 * vx * x) - sqrt(D)) / (2 * (vz * vz + vx * vx));
+        t_out = (-(2 * vz * z + 2 * vx * x) + sqrt(D)) / (2 * (vz * vz + vx * vx));
+    }
+    else if (vy) {
+        t_in = (-h / 2 - y) / vy;
+        t_out = (h / 2 - y) / vy;
+        if (t_in > t_out) {
+            double tmp = t_in; t_in = t_out; t_out = tmp;
+        }
+    }
+    else {
+        return 0;
+    }
+    double y_in = vy * t_in + y;
+    double y_out = vy * t_out + y;
+    if ((y_in > h / 2 && y_out > h / 2) || (y_in < -h / 2 && y_out < -h / 2)) {
+        return 0;
+    }
+    int ret = 1;
+    if (y_in > h / 2) { t_in = (h / 2 - y) / vy; ret += 2; }
+    else if (y_in < -h / 2) { t_in = (-h / 2 - y) / vy; ret += 2; }
+    if (y_out > h / 2) { t_out = (h / 2 - y) / vy; ret += 4; }
+    else if (y_out < -h / 2) { t_out = (-h / 2 - y) / vy; ret += 4; }
+    *t0 = t_in;
+    *t1 = t_out;
+    return ret;
+}
+
+// box of sides dx, dy, dz, the times of the faces hit, a face hit at exactly t = 0 counts as a miss as in mccode-r
+int box_intersect(double *dt_in, double *dt_out, double x, double y, double z, double vx, double vy, double vz, double dx, double dy, double dz) {
+    double t[6] = {};
+    double p[3] = { x, y, z };
+    double v[3] = { vx, vy, vz };
+    double d[3] = { dx, dy, dz };
+    for (int axis = 0; axis < 3; ++axis) {
+        if (v[axis] == 0) {
+            continue;
+        }
+        int a1 = (axis + 1) % 3;
+        int a2 = (axis + 2) % 3;
+        for (int side = 0; side < 2; ++side) {
+            double tt = ((side ? 1 : -1) * d[axis] / 2 - p[axis]) / v[axis];
+            double c1 = p[a1] + tt * v[a1];
+            double c2 = p[a2] + tt * v[a2];
+            if (c1 > -d[a1] / 2 && c1 < d[a1] / 2 && c2 > -d[a2] / 2 && c2 < d[a2] / 2) {
+                t[2 * axis + side] = tt;
+            }
+        }
+    }
+    double a = 0, b = 0;
+    int count = 0;
+    for (int i = 0; i < 6; ++i) {
+        if (t[i] == 0) continue;
+        if (count == 0) { a = t[i]; count = 1; }
+        else { b = t[i]; count = 2; }
+    }
+    if (a == 0 && b == 0) {
+        return 0;
+    }
+    *dt_in = a < b ? a : b;
+    *dt_out = a < b ? b : a;
+    return 1;
+}
+
+// the focusing of the scattering processes is not part of what the tests run
+static void FocusNotMocked(const char *name) {
+    printf("ERROR: %s is not part of test_mcstas.h\n", name);
+    exit(1);
+}
+
+void randvec_target_circle(double *xo, double *yo, double *zo, double *solid_angle, double xi, double yi, double zi, double radius) {
+    FocusNotMocked("randvec_target_circle");
+}
+
+void randvec_target_rect(double *xo, double *yo, double *zo, double *solid_angle, double xi, double yi, double zi, double width, double height, Rotation A) {
+    FocusNotMocked("randvec_target_rect");
+}
+
+void randvec_target_rect_angular(double *xo, double *yo, double *zo, double *solid_angle, double xi, double yi, double zi, double width, double height, Rotation A) {
+    FocusNotMocked("randvec_target_rect_angular");
+}
+
+
+#endif